@@ -29,7 +29,11 @@ using namespace std;
 /*** Map members ***/
 
 /* Main constructor */
-Map::Map(unsigned const w, unsigned const h) : _width(w), _height(h)
+Map::Map(unsigned const w, unsigned const h) :
+	_width(w),
+	_height(h),
+	_version(0),
+	_cache(nullptr)
 {
 	_matrix = new Tile* [_height];
 
@@ -37,7 +41,7 @@ Map::Map(unsigned const w, unsigned const h) : _width(w), _height(h)
 	{
 		_matrix[i] = new Tile [_width];
 
-		for(unsigned j = 0 ; j < _height ; ++j)
+		for(unsigned j = 0 ; j < _width ; ++j)
 		{
 			_matrix[i][j] = WALKABLE;
 		}
@@ -45,7 +49,11 @@ Map::Map(unsigned const w, unsigned const h) : _width(w), _height(h)
 }
 
 /* Copy constructor */
-Map::Map(Map const & m) : _width(m._width), _height(m._height)
+Map::Map(Map const & m) :
+	_width(m._width),
+	_height(m._height),
+	_version(m._version),
+	_cache(nullptr)
 {
 	_matrix = new Tile* [_height];
 
@@ -53,7 +61,7 @@ Map::Map(Map const & m) : _width(m._width), _height(m._height)
 	{
 		_matrix[i] = new Tile [_width];
 
-		for(unsigned j = 0 ; j < _height ; ++j)
+		for(unsigned j = 0 ; j < _width ; ++j)
 		{
 			_matrix[i][j] = m._matrix[i][j];
 		}
@@ -74,10 +82,16 @@ Map::~Map()
 /* Sets given point to given state */
 void Map::set(Point const & p, Tile const & c)
 {
-	if((*this)(p) == NONEXISTENT)
+	Tile const previous((*this)(p));
+
+	if(previous == NONEXISTENT || previous == c)
 		return;
-	else
-		_matrix[p.y][p.x] = c;
+
+	_matrix[p.y][p.x] = c;
+
+	/* Only the paths going through the edited region are dropped */
+	if(_cache)
+		_cache->invalidate(p);
 }
 
 /* Gets given point's state */
@@ -149,6 +163,24 @@ vector<Point> near(Point const & p)
 	return v;
 }
 
+/* 8x8 blocks used as path cache invalidation regions */
+unsigned long region(Point const & p)
+{
+	return (unsigned long)(p.y / 8) * 65536ul + (unsigned long)(p.x / 8);
+}
+
+/* Row-major cell numbering (used by Mach::CompactAStar) */
+uint32_t cellIndex(Map const & m, Point const & p)
+{
+	return uint32_t(p.y) * m.width() + uint32_t(p.x);
+}
+
+/* Inverse of cellIndex() */
+Point cellCoord(Map const & m, uint32_t const i)
+{
+	return Point(i % m.width(), i / m.width());
+}
+
 /* Save the current Map's content on disk */
 void Map::saveTo(string path)
 {
@@ -201,9 +233,9 @@ void Map::loadFrom(string path)
 		if(w != _width || h != _height)
 		{
 			for(unsigned i = 0 ; i < _height ; ++i)
-				delete _matrix[i];
+				delete [] _matrix[i];
 
-			delete _matrix;
+			delete [] _matrix;
 
 			_matrix = nullptr;
 		}
@@ -224,6 +256,11 @@ void Map::loadFrom(string path)
 				file.read((char*)(&_matrix[i][j]), sizeof(Tile));
 
 		file.close();
+
+		/* Brand new layout: previously cached paths are obsolete */
+		++_version;
+		if(_cache)
+			_cache->clear();
 	}
 	else
 		throw SaveFileException("Couldn't open " + path + ": file not found.");
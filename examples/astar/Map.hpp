@@ -27,7 +27,9 @@
 #include <vector>
 #include <string>
 #include <exception>
+#include <stdint.h>
 #include <Mach/Point.hpp>
+#include <Mach/PathCache.hpp>
 
 
 using Mach::Point;
@@ -92,6 +94,12 @@ class Map
 		/* Map content */
 		Tile **_matrix;
 
+		/* Layout version, bumped whenever the whole content changes */
+		unsigned long _version;
+
+		/* Path cache to be kept in sync with the content (optional) */
+		Mach::PathCache<Point> * _cache;
+
 	public:
 		/* Constructors */
 		Map(unsigned const w, unsigned const h);
@@ -103,12 +111,16 @@ class Map
 		/* Getters */
 		unsigned width() const { return _width; }
 		unsigned height() const { return _height; }
+		unsigned long version() const { return _version; }
 
 		Tile operator () (Point const &) const;
 
 		/* Setters */
 		void set(Point const & p, Tile const & c);
 
+		/* Path cache invalidation hook (nullptr to detach) */
+		void attachCache(Mach::PathCache<Point> * cache) { _cache = cache; }
+
 		/* File persistence */
 		void saveTo(std::string path);
 		void loadFrom(std::string path);
@@ -122,5 +134,8 @@ unsigned long distance(Point const & start, Point const & end);
 unsigned long moveCost(Point const & start, Point const & end);
 unsigned long terrainCost(Map const &, Point const &);
 std::vector<Point> near(Point const & p);
+unsigned long region(Point const & p);
+uint32_t cellIndex(Map const &, Point const &);
+Point cellCoord(Map const &, uint32_t const);
 
 #endif // MAP_HPP_INCLUDED
@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Mach/AStar.hpp>
+#include <Mach/CompressedPathDatabase.hpp>
+#include <Mach/ContractionHierarchy.hpp>
+#include <Mach/GridAStar.hpp>
+
+#include "../astar/Map.hpp"
+
+using namespace std;
+using namespace Mach;
+
+
+/*
+ * Brute-force search: costs from the given cell to every cell of the map
+ * (~0ul where unreachable), using nothing but the neighborhood & move costs
+ */
+template <unsigned N, unsigned Connectivity>
+static vector<unsigned long> flood(GridMap<N> const & m,
+		GridPoint<N> const & origin)
+{
+	typedef GridAStar<N, Connectivity> Search;
+	typedef pair<unsigned long, size_t> Entry;
+
+	vector<unsigned long> cost(m.cells(), ~0ul);
+	priority_queue<Entry, vector<Entry>, greater<Entry> > open;
+
+	cost[m.index(origin)] = 0;
+	open.push(Entry(0, m.index(origin)));
+
+	while(!open.empty())
+	{
+		Entry const current(open.top());
+		GridPoint<N> const position(m.coord(current.second));
+
+		open.pop();
+
+		if(current.first > cost[current.second])
+			continue;
+
+		for(GridPoint<N> const & next : Search::near(position))
+		{
+			if(!m.contains(next) || m(next) == 0)
+				continue;
+
+			unsigned long const c(current.first
+					+ Search::moveCost(position, next));
+
+			if(c < cost[m.index(next)])
+			{
+				cost[m.index(next)] = c;
+				open.push(Entry(c, m.index(next)));
+			}
+		}
+	}
+
+	return cost;
+}
+
+/*
+ * Path cost, as priced by the move costs
+ */
+template <unsigned N, unsigned Connectivity>
+static unsigned long price(vector< GridPoint<N> > const & path)
+{
+	unsigned long total(0);
+
+	for(size_t i = 1 ; i < path.size() ; ++i)
+		total += GridAStar<N, Connectivity>::moveCost(path[i - 1],
+				path[i]);
+
+	return total;
+}
+
+/*
+ * Random obstacles (a quarter of the cells, never the given one)
+ */
+template <unsigned N>
+static void scatter(GridMap<N> & m, GridPoint<N> const & spared,
+		mt19937 & random)
+{
+	for(size_t i = 0 ; i < m.cells() ; ++i)
+		if(random() % 4 == 0 && m.coord(i) != spared)
+			m.set(m.coord(i), 0);
+}
+
+/*
+ * Check a neighborhood: on an empty map, the heuristic must be the exact
+ * cost from the center to every cell; with obstacles, it must never exceed
+ * the true cost and searches must find optimal paths.
+ * Returns the number of mismatches.
+ */
+template <unsigned N, unsigned Connectivity>
+static unsigned long check(unsigned const side, unsigned const searches)
+{
+	typedef GridAStar<N, Connectivity> Search;
+
+	array<unsigned, N> size;
+	GridPoint<N> center;
+	unsigned long errors(0), cells(0), obstacles(0);
+	mt19937 random(N * 100 + Connectivity);
+
+	size.fill(side);
+	for(unsigned d = 0 ; d < N ; ++d)
+		center.c[d] = int(side / 2);
+
+	GridMap<N> open(size);
+	vector<unsigned long> const exact(flood<N, Connectivity>(open, center));
+
+	for(size_t i = 0 ; i < open.cells() ; ++i, ++cells)
+	{
+		if(Search::distance(center, open.coord(i)) != exact[i])
+		{
+			if(errors++ < 3)
+				cerr << "  " << N << "D/" << Connectivity
+				<< ": heuristic " << Search::distance(center,
+						open.coord(i))
+				<< ", exact " << exact[i] << endl;
+		}
+	}
+
+	/* Random obstacles (a quarter of the cells) */
+	GridMap<N> blocked(size);
+
+	scatter<N>(blocked, center, random);
+
+	vector<unsigned long> const truth(flood<N, Connectivity>(blocked,
+				center));
+
+	for(size_t i = 0 ; i < blocked.cells() ; ++i)
+	{
+		if(truth[i] != ~0ul && Search::distance(center,
+					blocked.coord(i)) > truth[i])
+			++errors;
+	}
+
+	for(unsigned s = 0 ; s < searches ; ++s)
+	{
+		size_t const i(random() % blocked.cells());
+		Search search(blocked, center, blocked.coord(i));
+		vector< GridPoint<N> > const path(search.run());
+
+		if(truth[i] == ~0ul ? !path.empty()
+				: price<N, Connectivity>(path) != truth[i])
+			++errors;
+
+		++obstacles;
+	}
+
+	cout << left << setw(6) << (to_string(N) + "D")
+	<< setw(14) << Connectivity
+	<< setw(10) << Search::Neighbors::reach
+	<< setw(10) << cells
+	<< setw(10) << obstacles
+	<< setw(10) << errors << endl;
+
+	return errors;
+}
+
+/*
+ * Check ContractionHierarchy against brute-force searches on a random map:
+ * every cost must match, and every path must be a chain of walkable
+ * neighbors from source to destination, priced at that cost.
+ * Returns the number of mismatches.
+ */
+template <unsigned N, unsigned Connectivity>
+static unsigned long hierarchy(unsigned const side, unsigned const searches)
+{
+	typedef GridAStar<N, Connectivity> Search;
+
+	array<unsigned, N> size;
+	GridPoint<N> center;
+	vector< GridPoint<N> > walkable;
+	unsigned long errors(0);
+	mt19937 random(N * 1000 + Connectivity);
+
+	size.fill(side);
+	for(unsigned d = 0 ; d < N ; ++d)
+		center.c[d] = int(side / 2);
+
+	GridMap<N> m(size);
+	scatter<N>(m, center, random);
+
+	for(size_t i = 0 ; i < m.cells() ; ++i)
+		if(m(m.coord(i)))
+			walkable.push_back(m.coord(i));
+
+	/* Every walkable cell is a seed, so that the isolated pockets are
+	 * preprocessed too (and found unreachable from the rest) */
+	ContractionHierarchy< GridMap<N>, GridPoint<N> > ch(m,
+			Search::distance, Search::moveCost, Search::terrainCost,
+			Search::near);
+
+	ch.build(walkable);
+
+	for(unsigned s = 0 ; s < searches ; ++s)
+	{
+		GridPoint<N> const src(walkable[random() % walkable.size()]);
+		GridPoint<N> const dst(m.coord(random() % m.cells()));
+		vector<unsigned long> const truth(flood<N, Connectivity>(m,
+					src));
+		unsigned long const expected(truth[m.index(dst)]);
+		vector< GridPoint<N> > const path(ch.path(src, dst));
+		bool valid(expected == ~0ul ? path.empty()
+				: !path.empty() && path.front() == src
+				&& path.back() == dst
+				&& price<N, Connectivity>(path) == expected);
+
+		for(size_t i = 1 ; valid && i < path.size() ; ++i)
+		{
+			vector< GridPoint<N> > const near(Search::near(path[i - 1]));
+
+			valid = m(path[i]) != 0 && find(near.begin(), near.end(),
+					path[i]) != near.end();
+		}
+
+		if(!valid || ch.cost(src, dst) != expected)
+			++errors;
+	}
+
+	cout << left << setw(6) << (to_string(N) + "D")
+	<< setw(14) << Connectivity
+	<< setw(10) << ch.nodes()
+	<< setw(11) << ch.shortcuts()
+	<< setw(10) << searches
+	<< setw(10) << errors << endl;
+
+	return errors;
+}
+
+/*
+ * Same cell on a GridMap (x first)
+ */
+static GridPoint<2> cell(Point const & p)
+{
+	GridPoint<2> g;
+
+	g.c[0] = p.x;
+	g.c[1] = p.y;
+
+	return g;
+}
+
+/*
+ * Whether a path on the example map walks from src to dst through walkable
+ * neighbors, and what it costs
+ */
+static bool walks(::Map const & m, vector<Point> const & path,
+		Point const & src, Point const & dst, unsigned long & cost)
+{
+	cost = 0;
+
+	if(path.empty() || path.front() != src || path.back() != dst)
+		return false;
+
+	for(size_t i = 1 ; i < path.size() ; ++i)
+	{
+		vector<Point> const near(::near(path[i - 1]));
+
+		if(m(path[i]) != WALKABLE
+			|| find(near.begin(), near.end(), path[i]) == near.end())
+			return false;
+
+		cost += ::moveCost(path[i - 1], path[i]);
+	}
+
+	return true;
+}
+
+/*
+ * Check CompressedPathDatabase on a random map (the A* example's, 8-connected,
+ * mirrored on a GridMap for the brute-force searches): both the built
+ * database and its saved & reloaded copy must give optimal paths. Then a cell
+ * on some optimal path is blocked and another region is marked stale: both
+ * must be found stale, and the queries must still give walkable paths,
+ * through the A* fallback when needed.
+ * Returns the number of mismatches.
+ */
+static unsigned long database(unsigned const width, unsigned const height,
+		unsigned const searches)
+{
+	typedef CompressedPathDatabase< ::Map > Database;
+
+	array<unsigned, 2> size;
+	GridPoint<2> origin;
+	vector<Point> walkable;
+	unsigned long errors(0), cost(0);
+	mt19937 random(width * 1000 + height);
+	string const file("gridcheck.cpd");
+
+	size[0] = width;
+	size[1] = height;
+	origin.c[0] = origin.c[1] = 0;
+
+	GridMap<2> grid(size);
+	::Map m(width, height);
+
+	scatter<2>(grid, origin, random);
+
+	for(unsigned y = 0 ; y < height ; ++y)
+	{
+		for(unsigned x = 0 ; x < width ; ++x)
+		{
+			if(grid(cell(Point(x, y))))
+				walkable.push_back(Point(x, y));
+			else
+				m.set(Point(x, y), UNWALKABLE);
+		}
+	}
+
+	Database built(m, &::distance, &::moveCost, &::terrainCost, &::near);
+	Database loaded(m, &::distance, &::moveCost, &::terrainCost, &::near);
+
+	built.build();
+	built.saveTo(file);
+	loaded.loadFrom(file);
+	remove(file.c_str());
+
+	if(loaded.runs() != built.runs())
+		++errors;
+
+	/* Random pairs, some destinations being unwalkable */
+	vector<Point> blockedPath;
+
+	for(unsigned s = 0 ; s < searches ; ++s)
+	{
+		Point const src(walkable[random() % walkable.size()]);
+		Point const dst(random() % width, random() % height);
+		unsigned long const expected(flood<2, 8>(grid, cell(src))
+				[grid.index(cell(dst))]);
+
+		for(Database * db : { &built, &loaded })
+		{
+			vector<Point> const path(db->path(src, dst));
+
+			if(expected == ~0ul ? !path.empty()
+				: !walks(m, path, src, dst, cost)
+					|| cost != expected)
+				++errors;
+
+			if(blockedPath.size() < path.size())
+				blockedPath = path;
+		}
+	}
+
+	if(loaded.fallbacks() != 0 || blockedPath.size() < 3)
+		++errors;
+
+	/* Block a cell in the middle of the longest path, mark a region far
+	 * from it stale */
+	Point const blocked(blockedPath[blockedPath.size() / 2]);
+	Point const marked(blocked.x < int(width) / 2 ? width - 1 : 0,
+			blocked.y < int(height) / 2 ? height - 1 : 0);
+
+	m.set(blocked, UNWALKABLE);
+	grid.set(cell(blocked), 0);
+
+	if(loaded.refresh() != 1)
+		++errors;
+
+	loaded.markStale(marked);
+
+	if(loaded.refresh() != 2)
+		++errors;
+
+	/* The longest path's ends, then random pairs again */
+	unsigned long const fallbacks(loaded.fallbacks());
+
+	for(unsigned s = 0 ; s <= searches ; ++s)
+	{
+		Point const src(s == 0 ? blockedPath.front()
+				: walkable[random() % walkable.size()]);
+		Point const dst(s == 0 ? blockedPath.back()
+				: Point(random() % width, random() % height));
+		unsigned long const expected(m(src) != WALKABLE ? ~0ul
+				: flood<2, 8>(grid, cell(src))
+				[grid.index(cell(dst))]);
+		vector<Point> const path(loaded.path(src, dst));
+
+		if(expected == ~0ul ? !path.empty()
+				: !walks(m, path, src, dst, cost))
+			++errors;
+	}
+
+	if(loaded.fallbacks() == fallbacks)
+		++errors;
+
+	cout << left << setw(10) << (to_string(width) + "x" + to_string(height))
+	<< setw(10) << walkable.size()
+	<< setw(10) << loaded.runs()
+	<< setw(10) << 2 * searches + 1
+	<< setw(11) << loaded.fallbacks()
+	<< setw(10) << errors << endl;
+
+	return errors;
+}
+
+/*
+ * Check PathCache kept in sync by the example map: editing a cell drops the
+ * paths crossing its region only, and reloading the map bumps its version so
+ * that nothing cached before is served again.
+ * Returns the number of mismatches.
+ */
+static unsigned long cache(unsigned const side)
+{
+	typedef AStar< ::Map, Point> Search;
+
+	unsigned long errors(0), cost(0);
+	string const file("gridcheck.map");
+
+	::Map m(side, side);
+	PathCache<Point> paths(64, &::region);
+
+	m.attachCache(&paths);
+
+	/* A path within the first region, a longer one far from it */
+	Point const nearSrc(1, 1), nearDst(6, 6);
+	Point const farSrc(side / 2, side / 2), farDst(side - 2, side - 2);
+
+	auto const run = [&](Point const & src, Point const & dst)
+	{
+		Search search(m, src, dst, &::distance, &::moveCost,
+				&::terrainCost, &::near);
+		vector<Point> const path(paths.run(search, m.version()));
+
+		if(!walks(m, path, src, dst, cost))
+			++errors;
+	};
+
+	/* Expected hits, misses, invalidations & cached paths */
+	auto const expect = [&](unsigned long hits, unsigned long misses,
+			unsigned long invalidations, size_t size)
+	{
+		if(paths.hits() != hits || paths.misses() != misses
+			|| paths.invalidations() != invalidations
+			|| paths.size() != size)
+			++errors;
+	};
+
+	run(nearSrc, nearDst);
+	run(farSrc, farDst);
+	expect(0, 2, 0, 2);
+
+	run(nearSrc, nearDst);
+	run(farSrc, farDst);
+	expect(2, 2, 0, 2);
+
+	/* Only the path crossing the edited region is dropped; setting a
+	 * cell to its current state or editing an uncrossed region drops
+	 * nothing */
+	m.set(Point(3, 3), UNWALKABLE);
+	expect(2, 2, 1, 1);
+
+	m.set(Point(3, 3), UNWALKABLE);
+	m.set(Point(side - 1, 0), UNWALKABLE);
+	expect(2, 2, 1, 1);
+
+	run(nearSrc, nearDst);
+	run(farSrc, farDst);
+	expect(3, 3, 1, 2);
+
+	/* Reloading bumps the version and empties the cache */
+	unsigned long const version(m.version());
+
+	m.saveTo(file);
+	m.loadFrom(file);
+	remove(file.c_str());
+
+	if(m.version() != version + 1)
+		++errors;
+
+	expect(3, 3, 1, 0);
+
+	run(farSrc, farDst);
+	expect(3, 4, 1, 1);
+
+	m.attachCache(nullptr);
+
+	cout << left << setw(10) << (to_string(side) + "x" + to_string(side))
+	<< setw(10) << paths.hits()
+	<< setw(10) << paths.misses()
+	<< setw(15) << paths.invalidations()
+	<< setw(10) << m.version()
+	<< setw(10) << errors << endl;
+
+	return errors;
+}
+
+/*
+ * ContractionHierarchy scaling: preprocessing & query times over growing
+ * random 8-connected 2D maps
+ */
+static void scaling(unsigned const queries)
+{
+	typedef GridAStar<2, 8> Search;
+	typedef chrono::steady_clock Clock;
+
+	cout << left << setw(8) << "side"
+	<< setw(10) << "nodes"
+	<< setw(11) << "shortcuts"
+	<< setw(11) << "build (s)"
+	<< setw(12) << "query (us)"
+	<< setw(10) << "settled" << endl;
+
+	for(unsigned const side : { 32u, 64u, 96u, 128u, 192u, 256u })
+	{
+		array<unsigned, 2> size;
+		GridPoint<2> center;
+		vector< GridPoint<2> > walkable;
+		mt19937 random(side);
+
+		size.fill(side);
+		center.c[0] = center.c[1] = int(side / 2);
+
+		GridMap<2> m(size);
+		scatter<2>(m, center, random);
+
+		for(size_t i = 0 ; i < m.cells() ; ++i)
+			if(m(m.coord(i)))
+				walkable.push_back(m.coord(i));
+
+		ContractionHierarchy< GridMap<2>, GridPoint<2> > ch(m,
+				Search::distance, Search::moveCost,
+				Search::terrainCost, Search::near);
+
+		Clock::time_point const start(Clock::now());
+		ch.build(vector< GridPoint<2> >(1, center));
+		Clock::time_point const built(Clock::now());
+
+		/* Random pairs, drawn beforehand */
+		vector< pair< GridPoint<2>, GridPoint<2> > > pairs;
+
+		for(unsigned q = 0 ; q < queries ; ++q)
+			pairs.push_back(make_pair(
+				walkable[random() % walkable.size()],
+				walkable[random() % walkable.size()]));
+
+		unsigned long const settled(ch.settled());
+		Clock::time_point const queried(Clock::now());
+
+		for(auto const & p : pairs)
+			ch.cost(p.first, p.second);
+
+		Clock::time_point const done(Clock::now());
+
+		cout << left << setw(8) << side
+		<< setw(10) << ch.nodes()
+		<< setw(11) << ch.shortcuts()
+		<< setw(11) << fixed << setprecision(2)
+		<< chrono::duration<double>(built - start).count()
+		<< setw(12) << setprecision(1) << (queries ? chrono::duration<
+				double, micro>(done - queried).count() / queries : 0.)
+		<< setw(10) << (queries ? (ch.settled() - settled) / queries
+				: 0) << endl;
+	}
+}
+
+
+/*
+ * Usage: gridcheck [searches]
+ *        gridcheck scale [queries]
+ */
+int main(int argc, char ** argv)
+{
+	if(argc > 1 && string(argv[1]) == "scale")
+	{
+		scaling(argc > 2 ? stoul(argv[2]) : 1000);
+		return 0;
+	}
+
+	unsigned const searches(argc > 1 ? stoul(argv[1]) : 200);
+	unsigned long errors(0);
+
+	cout << left << setw(6) << "dim"
+	<< setw(14) << "connectivity"
+	<< setw(10) << "reach"
+	<< setw(10) << "cells"
+	<< setw(10) << "searches"
+	<< setw(10) << "errors" << endl;
+
+	errors += check<2, 4>(41, searches);
+	errors += check<2, 8>(41, searches);
+	errors += check<3, 6>(17, searches);
+	errors += check<3, 18>(17, searches);
+	errors += check<3, 26>(17, searches);
+	errors += check<4, 8>(9, searches);
+	errors += check<4, 32>(9, searches);
+	errors += check<4, 64>(9, searches);
+	errors += check<4, 80>(9, searches);
+
+	cout << endl << left << setw(6) << "dim"
+	<< setw(14) << "connectivity"
+	<< setw(10) << "nodes"
+	<< setw(11) << "shortcuts"
+	<< setw(10) << "searches"
+	<< setw(10) << "errors" << endl;
+
+	errors += hierarchy<2, 4>(41, searches);
+	errors += hierarchy<2, 8>(41, searches);
+	errors += hierarchy<3, 26>(11, searches);
+
+	cout << endl << left << setw(10) << "map"
+	<< setw(10) << "cells"
+	<< setw(10) << "runs"
+	<< setw(10) << "searches"
+	<< setw(11) << "fallbacks"
+	<< setw(10) << "errors" << endl;
+
+	errors += database(41, 41, searches);
+	errors += database(48, 29, searches);
+
+	cout << endl << left << setw(10) << "map"
+	<< setw(10) << "hits"
+	<< setw(10) << "misses"
+	<< setw(15) << "invalidations"
+	<< setw(10) << "version"
+	<< setw(10) << "errors" << endl;
+
+	errors += cache(40);
+
+	return errors == 0 ? 0 : 1;
+}
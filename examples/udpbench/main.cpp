@@ -0,0 +1,1478 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <random>
+#include <cmath>
+#include <Mach/UDPServer.hpp>
+#include <Mach/TimerWheel.hpp>
+#include <Mach/UDPSendBatch.hpp>
+#include <Mach/ReliableServer.hpp>
+#include <Mach/ReliableClient.hpp>
+#include <Mach/MessageServer.hpp>
+#include <Mach/MessageClient.hpp>
+#include <Mach/RequestServer.hpp>
+#include <Mach/RequestClient.hpp>
+#include <Mach/Exception.hpp>
+
+#if defined(__gnu_linux__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+using namespace Mach;
+
+
+/* Loopback port used by the benchmark */
+#define BENCH_PORT 1778
+
+/*
+ * Receive benchmark server: only counts what it receives
+ */
+class BenchUDPServer : public UDPServer
+{
+	private:
+		/* Received datagrams & bytes */
+		atomic<unsigned long> _packets;
+		atomic<unsigned long> _bytes;
+
+	protected:
+		/* Count the datagram */
+		void receiveBytes(uint8_t const *, size_t const length,
+				sockaddr_storage const *, int const)
+		{
+			_packets.fetch_add(1, memory_order_relaxed);
+			_bytes.fetch_add(length, memory_order_relaxed);
+		}
+
+	public:
+		/* Constructor */
+		BenchUDPServer(ReceiveBackend const backend)
+			:
+			UDPServer(BENCH_PORT, "log/udpbench.log", LOG_WARN, 1,
+				backend),
+			_packets(0),
+			_bytes(0)
+		{
+		}
+
+		/* Received datagrams */
+		unsigned long packets() const
+		{
+			return _packets.load(memory_order_relaxed);
+		}
+};
+
+/*
+ * Benchmarked receive mode
+ */
+struct BenchMode
+{
+	/* Displayed name */
+	char const * name;
+
+	/* Server configuration */
+	ReceiveBackend backend;
+	unsigned batchSize;
+	bool gro;
+
+	/* Datagrams sent per UDP_SEGMENT train (0 to send them one by one) */
+	unsigned train;
+};
+
+/*
+ * Measured figures
+ */
+struct BenchResult
+{
+	/* Datagrams received, out of those sent */
+	unsigned long received;
+	unsigned long sent;
+
+	/* Wall-clock duration (seconds) */
+	double elapsed;
+
+	/* Process CPU time (seconds) & voluntary context switches */
+	double cpu;
+	long switches;
+};
+
+/*
+ * Process CPU time and voluntary context switches so far
+ */
+static void usage(double & cpu, long & switches)
+{
+#if defined(__gnu_linux__)
+	rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	cpu = double(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+		+ double(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+	switches = ru.ru_nvcsw;
+#else
+	cpu = 0.;
+	switches = 0;
+#endif
+}
+
+/*
+ * Send count datagrams of the given size to a server running the given mode,
+ * keeping at most window datagrams in flight so that the figures measure the
+ * receive path rather than socket buffer overflows
+ */
+static BenchResult run(BenchMode const & mode, unsigned long const count,
+		size_t const size, unsigned long const window)
+{
+	BenchResult result;
+	BenchUDPServer server(mode.backend);
+	unsigned const train(max(1u, min(mode.train,
+			unsigned(65000 / max(size, size_t(1))))));
+	vector<uint8_t> payload(size * train, 0x42);
+	vector<SendResult> results;
+	sockaddr_in destination;
+	int sock(socket(AF_INET, SOCK_DGRAM, 0));
+	double cpu(0.);
+	long switches(0);
+	unsigned long last(0);
+
+	if(sock == -1)
+		throw Exception("socket");
+
+	memset(&destination, 0, sizeof(sockaddr_in));
+	destination.sin_family = AF_INET;
+	destination.sin_port = htons(BENCH_PORT);
+	destination.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	server.setBatchSize(mode.batchSize);
+	server.setGRO(mode.gro);
+	server.startListening();
+
+	/* Let the receiving threads settle */
+	this_thread::sleep_for(chrono::milliseconds(50));
+
+	usage(result.cpu, result.switches);
+	chrono::steady_clock::time_point const start(
+			chrono::steady_clock::now());
+	chrono::steady_clock::time_point progress(start);
+
+	{
+		UDPSendBatch batch(sock, 64);
+
+		for(result.sent = 0 ; result.sent < count ;
+				result.sent += train)
+		{
+			/* Closed loop: wait for the receiver to catch up */
+			while(result.sent - server.packets() >= window)
+			{
+				batch.flush();
+				batch.results(results);
+				results.clear();
+				this_thread::yield();
+
+				if(chrono::steady_clock::now() - progress
+						> chrono::milliseconds(100))
+					break;
+
+				if(server.packets() != last)
+				{
+					last = server.packets();
+					progress = chrono::steady_clock::now();
+				}
+			}
+
+			if(mode.train > 0)
+				batch.queueSegmented(payload.data(),
+					size * train, uint16_t(size),
+					(sockaddr const *)(&destination));
+			else
+				batch.queue(payload.data(), size,
+					(sockaddr const *)(&destination));
+		}
+	}
+
+	/* Wait for the stragglers (or give up after 200ms without any) */
+	last = server.packets();
+	progress = chrono::steady_clock::now();
+
+	while(last < result.sent && chrono::steady_clock::now() - progress
+			< chrono::milliseconds(200))
+	{
+		this_thread::sleep_for(chrono::microseconds(100));
+
+		if(server.packets() != last)
+		{
+			last = server.packets();
+			progress = chrono::steady_clock::now();
+		}
+	}
+
+	result.elapsed = chrono::duration<double>(progress - start).count();
+	usage(cpu, switches);
+	result.cpu = cpu - result.cpu;
+	result.switches = switches - result.switches;
+	result.received = server.packets();
+
+	server.stopListening();
+	close(sock);
+
+	return result;
+}
+
+/*
+ * Thread placement policy compared by the latency benchmark
+ */
+struct LatencyPolicy
+{
+	/* Displayed name */
+	char const * name;
+
+	/* Server configuration */
+	ReceiveBackend backend;
+	Placement placement;
+};
+
+/*
+ * Send count datagrams one at a time (waiting for each one to be handled, so
+ * that the receiving thread goes idle in between) to a server placed according
+ * to the given policy, returns the histogram of their queueing delays
+ */
+static Histogram latency(LatencyPolicy const & policy,
+		unsigned long const count)
+{
+	BenchUDPServer server(policy.backend);
+	uint8_t payload[64] = { 0 };
+	sockaddr_in destination;
+	int sock(socket(AF_INET, SOCK_DGRAM, 0));
+
+	if(sock == -1)
+		throw Exception("socket");
+
+	memset(&destination, 0, sizeof(sockaddr_in));
+	destination.sin_family = AF_INET;
+	destination.sin_port = htons(BENCH_PORT);
+	destination.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	server.setTimestamps(true);
+	server.setPlacement(policy.placement);
+	server.startListening();
+
+	this_thread::sleep_for(chrono::milliseconds(50));
+
+	for(unsigned long sent = 1 ; sent <= count ; ++sent)
+	{
+		chrono::steady_clock::time_point const start(
+				chrono::steady_clock::now());
+
+		sendto(sock, payload, sizeof(payload), 0,
+				(sockaddr const *)(&destination),
+				sizeof(sockaddr_in));
+
+		/* Give up on a lost datagram after 10ms */
+		while(server.packets() < sent && chrono::steady_clock::now()
+				- start < chrono::milliseconds(10))
+			this_thread::yield();
+
+		this_thread::sleep_for(chrono::microseconds(200));
+	}
+
+	Histogram const queueing(server.latencyStatistics().queueing);
+
+	server.stopListening();
+	close(sock);
+
+	return queueing;
+}
+
+/*
+ * Compare the receive latency of the thread placement policies
+ */
+static void latencies(unsigned long const count)
+{
+	LatencyPolicy policies[] =
+	{
+		{ "default", BACKEND_BLOCKING, Placement() },
+		{ "pinned", BACKEND_BLOCKING, Placement() },
+		{ "busy-poll", BACKEND_BLOCKING, Placement() },
+		{ "spin", BACKEND_BLOCKING, Placement() },
+		{ "epoll", BACKEND_EPOLL, Placement() },
+		{ "epoll+spin", BACKEND_EPOLL, Placement() }
+	};
+	unsigned const cpus(max(1u, thread::hardware_concurrency()));
+
+	/* Pin the receiving thread away from this one when possible */
+	for(LatencyPolicy & policy : policies)
+		if(string(policy.name) != "default")
+		{
+			policy.placement.cpus.push_back(cpus - 1);
+			policy.placement.incomingCpu = true;
+			policy.placement.prefault = 256;
+		}
+
+	policies[2].placement.busyPoll = 50;
+	policies[3].placement.spins = 100000;
+	policies[5].placement.spins = 100000;
+
+	cout
+	<< count << " datagrams, one at a time, queueing delay (us)" << endl
+	<< left << setw(12) << "policy"
+	<< right << setw(10) << "received"
+	<< setw(10) << "mean"
+	<< setw(10) << "p50"
+	<< setw(10) << "p99"
+	<< setw(10) << "max"
+	<< endl;
+
+	for(LatencyPolicy const & policy : policies)
+	{
+		try
+		{
+			Histogram const h(latency(policy, count));
+
+			cout
+			<< left << setw(12) << policy.name
+			<< right << setw(10) << h.count()
+			<< fixed << setprecision(1)
+			<< setw(10) << h.mean() / 1e3
+			<< setw(10) << double(h.percentile(.5)) / 1e3
+			<< setw(10) << double(h.percentile(.99)) / 1e3
+			<< setw(10) << double(h.maximum()) / 1e3
+			<< endl;
+		}
+		catch(Exception const & e)
+		{
+			cerr << policy.name << ": " << e.message() << endl;
+		}
+	}
+}
+
+/*
+ * Cost of the rate limiter's admission stage, over a set of peers either well
+ * within or flooding past their limits
+ */
+static void admissions(unsigned long const count)
+{
+	unsigned const peerCounts[] = { 1, 1000, 60000 };
+	double const rates[] = { 1e9, 1. };
+
+	cout
+	<< count << " admissions, batches of 64" << endl
+	<< left << setw(10) << "peers"
+	<< setw(10) << "limit"
+	<< right << setw(12) << "admitted"
+	<< setw(10) << "ns/pkt"
+	<< endl;
+
+	for(unsigned const peerCount : peerCounts)
+		for(double const rate : rates)
+		{
+			RateLimit limit;
+			vector<SockAddr> peers(peerCount);
+			unsigned long admitted(0);
+			uint64_t date(0);
+
+			limit.packetsPerSecond = rate;
+			limit.packetBurst = rate > 1. ? 1e3 : 10.;
+			limit.bytesPerSecond = 1e3 * rate;
+			limit.byteBurst = 1e3 * limit.packetBurst;
+
+			/* Senders' keys are built beforehand, the server
+			 * reading them out of datagrams it just received */
+			for(unsigned i = 0 ; i < peerCount ; ++i)
+			{
+				sockaddr_storage storage;
+				sockaddr_in & in((sockaddr_in &)(storage));
+
+				memset(&storage, 0, sizeof(storage));
+				in.sin_family = AF_INET;
+				in.sin_addr.s_addr = htonl(0x0A000000 + i);
+				in.sin_port = htons(uint16_t(1024 + i));
+				peers[i] = SockAddr(storage);
+			}
+
+			RateLimiter limiter(limit);
+			auto const start(chrono::steady_clock::now());
+
+			/* Same pattern as UDPServer::admit(...): gather the
+			 * batch's senders, prefetch them, then charge them */
+			for(unsigned long i = 0 ; i < count ; i += 64)
+			{
+				SockAddr const * batch[64];
+				unsigned const size(unsigned(min(count - i,
+						64ul)));
+
+				for(unsigned j = 0 ; j < size ; ++j)
+					batch[j] = &peers[unsigned(((i + j)
+						* 7919) % peerCount)];
+
+				date = RateLimiter::now();
+
+				for(unsigned j = 0 ; j < size ; ++j)
+					limiter.prefetch(*batch[j]);
+
+				for(unsigned j = 0 ; j < size ; ++j)
+					admitted += limiter.admit(*batch[j],
+						100, date) == RATE_ADMITTED;
+			}
+
+			double const elapsed(chrono::duration<double, nano>(
+				chrono::steady_clock::now() - start).count());
+
+			cout
+			<< left << setw(10) << peerCount
+			<< setw(10) << (rate > 1. ? "loose" : "flooded")
+			<< right << setw(12) << admitted
+			<< fixed << setprecision(1)
+			<< setw(10) << elapsed / double(count)
+			<< endl;
+		}
+}
+
+/*
+ * Endpoint 10.x.y.z:port numbered i, for session table benchmarks
+ */
+static SockAddr peerOf(unsigned long const i)
+{
+	sockaddr_storage storage;
+	sockaddr_in & in((sockaddr_in &)(storage));
+
+	memset(&storage, 0, sizeof(storage));
+	in.sin_family = AF_INET;
+	in.sin_addr.s_addr = htonl(0x0A000000 + uint32_t(i >> 16));
+	in.sin_port = htons(uint16_t(i));
+
+	return SockAddr(storage);
+}
+
+/*
+ * Nanoseconds per lookup of count keys, all present or all absent
+ */
+static double lookups(SessionTable<uint64_t> const & table,
+		unsigned long const first, unsigned long const live,
+		unsigned long const count)
+{
+	vector<SockAddr> keys;
+	uint64_t value(0);
+	unsigned long found(0);
+
+	for(unsigned long i = 0 ; i < 4096 ; ++i)
+		keys.push_back(peerOf(first + (i * 7919) % live));
+
+	auto const start(chrono::steady_clock::now());
+
+	for(unsigned long i = 0 ; i < count ; ++i)
+		found += table.find(keys[i % keys.size()], value);
+
+	double const elapsed(chrono::duration<double, nano>(
+		chrono::steady_clock::now() - start).count());
+
+	if(found != 0 && found != count)
+		cerr << "lookups: " << found << "/" << count << " found" << endl;
+
+	return elapsed / double(count);
+}
+
+/*
+ * Session table lookups before & after churn: a live set of peers is replaced
+ * one insertion & one removal at a time, which must not make misses any
+ * longer than on a fresh table
+ */
+static void churns(unsigned long const cycles)
+{
+	unsigned long const live(1000), probes(1000000);
+	SessionTable<uint64_t> table(131072);
+
+	for(unsigned long i = 0 ; i < live ; ++i)
+		table.insert(peerOf(i), i);
+
+	cout
+	<< live << " sessions in " << table.capacity() << " slots, "
+	<< cycles << " insert/erase cycles" << endl
+	<< left << setw(10) << "table"
+	<< right << setw(10) << "hit ns"
+	<< setw(10) << "miss ns"
+	<< setw(10) << "cycle ns"
+	<< setw(10) << "size"
+	<< endl;
+
+	cout
+	<< left << setw(10) << "fresh"
+	<< right << fixed << setprecision(1)
+	<< setw(10) << lookups(table, 0, live, probes)
+	<< setw(10) << lookups(table, 1ul << 40, live, probes)
+	<< setw(10) << "-"
+	<< setw(10) << table.size()
+	<< endl;
+
+	auto const start(chrono::steady_clock::now());
+
+	for(unsigned long i = 0 ; i < cycles ; ++i)
+	{
+		table.insert(peerOf(live + i), i);
+		table.erase(peerOf(i));
+	}
+
+	double const elapsed(chrono::duration<double, nano>(
+		chrono::steady_clock::now() - start).count());
+
+	cout
+	<< left << setw(10) << "churned"
+	<< right << fixed << setprecision(1)
+	<< setw(10) << lookups(table, cycles, live, probes)
+	<< setw(10) << lookups(table, 1ul << 40, live, probes)
+	<< setw(10) << (cycles > 0 ? elapsed / double(cycles) : 0.)
+	<< setw(10) << table.size()
+	<< endl;
+}
+
+/*
+ * Reliable channel receiving end: checks & counts the payloads (each starting
+ * with its index)
+ */
+class BenchReliableServer : public ReliableServer
+{
+	private:
+		/* Delivered payloads & bytes, payloads out of order */
+		atomic<unsigned long> _messages;
+		atomic<unsigned long> _bytes;
+		atomic<unsigned long> _misordered;
+
+	protected:
+		/* Check & count the payload */
+		void receiveMessage(uint8_t const * bytes, size_t const length,
+				SockAddr const &)
+		{
+			uint32_t const index(getWord(bytes));
+
+			if(index != _messages.load(memory_order_relaxed))
+				_misordered.fetch_add(1, memory_order_relaxed);
+
+			_messages.fetch_add(1, memory_order_relaxed);
+			_bytes.fetch_add(length, memory_order_relaxed);
+		}
+
+	public:
+		/* Constructor */
+		explicit BenchReliableServer(size_t const maxStreams
+				= RELIABLE_STREAMS_MAX)
+			:
+			ReliableServer(BENCH_PORT, "log/udpbench.log", LOG_WARN,
+					1024, maxStreams),
+			_messages(0),
+			_bytes(0),
+			_misordered(0)
+		{
+		}
+
+		/* Delivered payloads, bytes & payloads out of order */
+		unsigned long messages() const
+		{
+			return _messages.load(memory_order_relaxed);
+		}
+		unsigned long bytes() const
+		{
+			return _bytes.load(memory_order_relaxed);
+		}
+		unsigned long misordered() const
+		{
+			return _misordered.load(memory_order_relaxed);
+		}
+};
+
+/*
+ * Reliable channel goodput under injected loss (both ways), compared to the
+ * loss-free run
+ */
+static void reliables(unsigned long const count)
+{
+	double const lossRates[] = { 0., 0.001, 0.01, 0.05 };
+	double capacity(0.);
+
+	cout
+	<< count << " payloads of " << RELIABLE_PAYLOAD_MAX << " bytes" << endl
+	<< left << setw(8) << "loss"
+	<< right << setw(10) << "delivered"
+	<< setw(10) << "MB/s"
+	<< setw(10) << "of 0%"
+	<< setw(10) << "retx"
+	<< setw(8) << "fast"
+	<< setw(8) << "probes"
+	<< setw(8) << "rto"
+	<< setw(8) << "cwnd"
+	<< endl;
+
+	for(double const lossRate : lossRates)
+	{
+		try
+		{
+			BenchReliableServer server;
+			ReliableClient client;
+			vector<uint8_t> payload(RELIABLE_PAYLOAD_MAX, 0xA5);
+
+			server.setBatchSize(64);
+			server.setLossRate(lossRate);
+			server.startListening();
+			client.connectTo("127.0.0.1", BENCH_PORT);
+			client.setLossRate(lossRate);
+
+			auto const start(chrono::steady_clock::now());
+
+			for(unsigned long i = 0 ; i < count ; ++i)
+			{
+				putWord(payload.data(), uint32_t(i));
+				client.send(payload.data(), payload.size());
+			}
+
+			bool const flushed(client.flush(
+					chrono::milliseconds(10000)));
+			double const elapsed(chrono::duration<double>(
+				chrono::steady_clock::now() - start).count());
+			ReliableStatistics const stats(client.statistics());
+			double const goodput(double(server.bytes()) / elapsed
+					/ 1e6);
+
+			client.disconnect();
+			server.stopListening();
+
+			if(lossRate == 0.)
+				capacity = goodput;
+
+			cout
+			<< left << setw(8) << lossRate
+			<< right << setw(10) << server.messages()
+			<< fixed << setprecision(1)
+			<< setw(10) << goodput
+			<< setw(9) << (capacity > 0. ? 100. * goodput
+					/ capacity : 0.) << "%"
+			<< setw(10) << stats.retransmits
+			<< setw(8) << stats.fastRetransmits
+			<< setw(8) << stats.probes
+			<< setw(8) << stats.timeouts
+			<< setw(8) << stats.cwnd
+			<< defaultfloat
+			<< (flushed ? "" : "  (flush timed out)")
+			<< (server.misordered() ? "  (misordered)" : "")
+			<< endl;
+		}
+		catch(Exception const & e)
+		{
+			cerr << "reliable: " << e.message() << endl;
+		}
+	}
+
+	/* Senders beyond the stream cap are dropped, not given a stream */
+	try
+	{
+		BenchReliableServer server(64);
+		vector< unique_ptr<UDPClient> > senders;
+		uint8_t segment[RELIABLE_DATA_HEADER + 4] = { 0 };
+		ReliableData data;
+
+		data.connection = 1;
+		data.sequence = 0;
+		data.timestamp = 0;
+		encodeData(segment, data);
+		server.startListening();
+
+		for(unsigned i = 0 ; i < 256 ; ++i)
+		{
+			senders.emplace_back(new UDPClient);
+			senders.back()->connectTo("127.0.0.1", BENCH_PORT);
+			senders.back()->sendBytes(segment, sizeof(segment));
+		}
+
+		this_thread::sleep_for(chrono::milliseconds(200));
+
+		ReliableServerStatistics const stats(
+				server.reliableStatistics());
+
+		server.stopListening();
+
+		cout
+		<< "256 senders, 64 streams at most: " << stats.streams
+		<< " streams, " << stats.refused << " segments refused, "
+		<< server.messages() << " delivered" << endl;
+	}
+	catch(Exception const & e)
+	{
+		cerr << "reliable: " << e.message() << endl;
+	}
+}
+
+/*
+ * A sender idling past RELIABLE_STREAM_IDLE (plus the receiver's expiry
+ * period) must still be delivered to once it sends again, its stream having
+ * been forgotten meanwhile
+ */
+static void revivals(unsigned long const count)
+{
+	unsigned const idle(RELIABLE_STREAM_IDLE + RELIABLE_STREAM_IDLE / 4 + 2);
+
+	try
+	{
+		BenchReliableServer server;
+		ReliableClient client;
+		vector<uint8_t> payload(RELIABLE_PAYLOAD_MAX, 0x5A);
+		unsigned long sent(0);
+
+		server.startListening();
+		client.connectTo("127.0.0.1", BENCH_PORT);
+
+		for(unsigned round = 0 ; round < 2 ; ++round)
+		{
+			if(round != 0)
+			{
+				cout << "idling " << idle << " s" << endl;
+				this_thread::sleep_for(chrono::seconds(idle));
+			}
+
+			unsigned long const delivered(server.messages());
+			size_t const streams(server.reliableStatistics()
+					.streams);
+
+			for(unsigned long i = 0 ; i < count ; ++i, ++sent)
+			{
+				putWord(payload.data(), uint32_t(sent));
+				client.send(payload.data(), payload.size());
+			}
+
+			bool const flushed(client.flush(
+					chrono::milliseconds(10000)));
+
+			cout
+			<< "round " << round << ": " << streams
+			<< " streams before, " << server.messages() - delivered
+			<< " of " << count << " delivered, "
+			<< client.statistics().restarts << " restarts"
+			<< (flushed ? "" : "  (flush timed out)")
+			<< (server.misordered() ? "  (misordered)" : "")
+			<< endl;
+		}
+
+		client.disconnect();
+		server.stopListening();
+	}
+	catch(Exception const & e)
+	{
+		cerr << "revive: " << e.message() << endl;
+	}
+}
+
+/*
+ * Message receiving end: only counts what it receives
+ */
+class BenchMessageServer : public MessageServer
+{
+	private:
+		/* Delivered messages & bytes */
+		atomic<unsigned long> _messages;
+		atomic<unsigned long> _bytes;
+
+	protected:
+		/* Count the message */
+		void receiveMessage(uint8_t const *, size_t const length,
+				SockAddr const &)
+		{
+			_messages.fetch_add(1, memory_order_relaxed);
+			_bytes.fetch_add(length, memory_order_relaxed);
+		}
+
+	public:
+		/* Constructor */
+		BenchMessageServer()
+			:
+			MessageServer(BENCH_PORT, "log/udpbench.log", LOG_WARN),
+			_messages(0),
+			_bytes(0)
+		{
+		}
+
+		/* Delivered messages & bytes */
+		unsigned long messages() const
+		{
+			return _messages.load(memory_order_relaxed);
+		}
+		unsigned long bytes() const
+		{
+			return _bytes.load(memory_order_relaxed);
+		}
+};
+
+/*
+ * Fragmentation & reassembly throughput over a range of message sizes, with
+ * a 4 MiB socket receive buffer (as large messages arrive as bursts) and
+ * about a quarter of it in flight (the kernel's per-datagram overhead
+ * counting against it)
+ */
+static void fragmentations(unsigned long const count)
+{
+	size_t const sizes[] = { 1024, 16384, 65536, 262144, 1048576 };
+
+	cout
+	<< count << " messages per size" << endl
+	<< left << setw(10) << "size"
+	<< right << setw(10) << "delivered"
+	<< setw(10) << "MB/s"
+	<< setw(12) << "kfrag/s"
+	<< setw(12) << "calls/msg"
+	<< setw(10) << "timeouts"
+	<< setw(10) << "pool KiB"
+	<< endl;
+
+	for(size_t const size : sizes)
+	{
+		try
+		{
+			BenchMessageServer server;
+			MessageClient client;
+			vector<uint8_t> payload(size, 0x5A);
+			unsigned long const window(max(size_t(1),
+				server.setReceiveBuffer(4 << 20) / 4 / size));
+			unsigned long sent(0), last(0);
+
+			server.setBatchSize(64);
+			server.startListening();
+			client.connectTo("127.0.0.1", BENCH_PORT);
+
+			/* Let the receiving thread settle */
+			this_thread::sleep_for(chrono::milliseconds(50));
+
+			auto const start(chrono::steady_clock::now());
+			auto progress(start);
+
+			for(sent = 0 ; sent < count ; ++sent)
+			{
+				/* Closed loop: wait for the receiver to catch
+				 * up (a lost fragment loses the message) */
+				while(sent - server.messages() >= window
+						&& chrono::steady_clock::now()
+						- progress
+						< chrono::milliseconds(100))
+				{
+					this_thread::yield();
+
+					if(server.messages() != last)
+					{
+						last = server.messages();
+						progress = chrono::steady_clock
+								::now();
+					}
+				}
+
+				client.sendMessage(payload.data(), size);
+				progress = chrono::steady_clock::now();
+			}
+
+			while(server.messages() < count
+					&& chrono::steady_clock::now()
+					- progress < chrono::milliseconds(100))
+				this_thread::yield();
+
+			double const elapsed(chrono::duration<double>(
+				chrono::steady_clock::now() - start).count());
+			MessageClientStatistics const sender(
+					client.statistics());
+			MessageServerStatistics const receiver(
+					server.messageStatistics());
+
+			client.disconnect();
+			server.stopListening();
+
+			cout
+			<< left << setw(10) << size
+			<< right << setw(10) << server.messages()
+			<< fixed << setprecision(1)
+			<< setw(10) << double(server.bytes()) / elapsed / 1e6
+			<< setw(12) << double(receiver.fragments) / elapsed
+					/ 1e3
+			<< setw(12) << double(sender.calls)
+					/ double(sender.messages)
+			<< setw(10) << receiver.timeouts
+			<< setw(10) << receiver.memory / 1024
+			<< defaultfloat << endl;
+		}
+		catch(Exception const & e)
+		{
+			cerr << "message: " << e.message() << endl;
+		}
+	}
+}
+
+/*
+ * Timer churn with the given number of active timers (delays of 1 ms to 1 min,
+ * 1 ms ticks): the timing wheel against an ordered multimap, the clock being
+ * moved through a minute (and a second) to fire them all
+ */
+static void timers(unsigned long const active)
+{
+	mt19937 random(42);
+	uniform_int_distribution<unsigned> delays(1, 60000);
+	vector<chrono::milliseconds> delay(active);
+	double schedule[2], cancel[2], restart[2], expire[2];
+	unsigned long fired[2] = { 0, 0 };
+
+	for(chrono::milliseconds & d : delay)
+		d = chrono::milliseconds(delays(random));
+
+	/* Time one pass of the given operation over every timer (ns/op) */
+	auto const timed([active](function<void(unsigned long)> const & op)
+	{
+		auto const start(chrono::steady_clock::now());
+
+		for(unsigned long i = 0 ; i < active ; ++i)
+			op(i);
+
+		return chrono::duration<double, nano>(
+			chrono::steady_clock::now() - start).count()
+			/ double(max(active, 1ul));
+	});
+
+	{
+		TimerWheel wheel(chrono::milliseconds(1));
+		vector<TimerWheel::TimerId> ids(active);
+
+		schedule[0] = timed([&](unsigned long const i)
+		{
+			ids[i] = wheel.schedule(delay[i], i);
+		});
+		restart[0] = timed([&](unsigned long const i)
+		{
+			wheel.restart(ids[(i * 7919) % active],
+					delay[active - 1 - i]);
+		});
+		cancel[0] = timed([&](unsigned long const i)
+		{
+			unsigned long const k((i * 7919) % active);
+
+			wheel.cancel(ids[k]);
+			ids[k] = wheel.schedule(delay[k], k);
+		});
+
+		/* Delays count from the clock, which moved on meanwhile */
+		uint64_t const origin(TimerWheel::clock());
+		auto const start(chrono::steady_clock::now());
+
+		for(uint64_t t = 1 ; t <= 61000 ; ++t)
+			fired[0] += wheel.advance(origin + t * 1000000,
+				[](TimerWheel::TimerId const, uint64_t const)
+			{
+			});
+
+		expire[0] = chrono::duration<double, nano>(
+			chrono::steady_clock::now() - start).count()
+			/ double(max(fired[0], 1ul));
+	}
+
+	{
+		typedef multimap<uint64_t, unsigned long> Timers;
+		Timers timers;
+		vector<Timers::iterator> ids(active);
+		uint64_t now(0);
+
+		schedule[1] = timed([&](unsigned long const i)
+		{
+			ids[i] = timers.emplace(now + uint64_t(delay[i].count()),
+					i);
+		});
+		restart[1] = timed([&](unsigned long const i)
+		{
+			unsigned long const k((i * 7919) % active);
+
+			timers.erase(ids[k]);
+			ids[k] = timers.emplace(now + uint64_t(
+				delay[active - 1 - i].count()), k);
+		});
+		cancel[1] = timed([&](unsigned long const i)
+		{
+			unsigned long const k((i * 7919) % active);
+
+			timers.erase(ids[k]);
+			ids[k] = timers.emplace(now + uint64_t(
+				delay[k].count()), k);
+		});
+
+		auto const start(chrono::steady_clock::now());
+
+		for(now = 1 ; now <= 61000 ; ++now)
+			while(!timers.empty() && timers.begin()->first <= now)
+			{
+				timers.erase(timers.begin());
+				++fired[1];
+			}
+
+		expire[1] = chrono::duration<double, nano>(
+			chrono::steady_clock::now() - start).count()
+			/ double(max(fired[1], 1ul));
+	}
+
+	cout
+	<< active << " active timers, ns/op (cancel: cancel + schedule)"
+	<< endl
+	<< left << setw(10) << "timers"
+	<< right << setw(10) << "schedule"
+	<< setw(10) << "restart"
+	<< setw(10) << "cancel"
+	<< setw(10) << "expire"
+	<< setw(10) << "fired"
+	<< endl;
+
+	for(unsigned i = 0 ; i < 2 ; ++i)
+		cout
+		<< left << setw(10) << (i == 0 ? "wheel" : "multimap")
+		<< right << fixed << setprecision(1)
+		<< setw(10) << schedule[i]
+		<< setw(10) << restart[i]
+		<< setw(10) << cancel[i]
+		<< setw(10) << expire[i]
+		<< setw(10) << fired[i]
+		<< endl;
+
+	/* Firing accuracy against the steady clock: timers of 0.1 to 20 ms
+	 * started over a second, the wheel being polled in a loop */
+	TimerWheel wheel(chrono::milliseconds(1));
+	vector<chrono::steady_clock::time_point> deadlines;
+	unsigned long early(0), count(0);
+	double late(0.), latest(0.);
+	auto const end(chrono::steady_clock::now() + chrono::seconds(1));
+	uniform_int_distribution<unsigned> shortDelays(100, 20000);
+
+	while(chrono::steady_clock::now() < end || !wheel.empty())
+	{
+		if(chrono::steady_clock::now() < end && random() % 64 == 0)
+		{
+			chrono::microseconds const d(shortDelays(random));
+
+			deadlines.push_back(chrono::steady_clock::now() + d);
+			wheel.schedule(d, deadlines.size() - 1);
+		}
+
+		wheel.poll([&](TimerWheel::TimerId const, uint64_t const i)
+		{
+			double const lateness(chrono::duration<double, milli>(
+				chrono::steady_clock::now()
+				- deadlines[i]).count());
+
+			early += lateness < 0.;
+			late += lateness;
+			latest = max(latest, lateness);
+			++count;
+		});
+	}
+
+	cout
+	<< count << " timers of 0.1-20 ms: " << early << " fired early, "
+	<< fixed << setprecision(2)
+	<< late / double(max(count, 1ul)) << " ms late on average, "
+	<< latest << " ms at worst" << endl;
+}
+
+/*
+ * Paced stream accuracy over a range of rates (half a second of datagrams at
+ * most per run): sleeping an interval between sends, UDPClient's hybrid wait,
+ * and kernel timing (SO_TXTIME, which only holds datagrams back through an fq
+ * qdisc, the loopback interface having none; departures are not measured
+ * then, only datagrams received are)
+ */
+static void pacings(unsigned long const count)
+{
+	double const rates[] = { 1e3, 1e4, 1e5, 5e5 };
+	char const * const modes[] = { "sleep", "hybrid", "txtime" };
+	vector<uint8_t> const payload(64, 0x42);
+
+	cout
+	<< left << setw(10) << "mode"
+	<< right << setw(10) << "target/s"
+	<< setw(12) << "achieved/s"
+	<< setw(12) << "jitter us"
+	<< setw(10) << "max us"
+	<< setw(10) << "received"
+	<< endl;
+
+	for(double const rate : rates)
+		for(unsigned m = 0 ; m < 3 ; ++m)
+		{
+			BenchUDPServer server(BACKEND_BLOCKING);
+			UDPClient client;
+			unsigned long const n(min(count,
+					(unsigned long)(rate / 2)));
+			PacingStatistics stats;
+
+			server.setBatchSize(64);
+			server.startListening();
+			client.connectTo("127.0.0.1", BENCH_PORT);
+
+			/* Let the receiving thread settle */
+			this_thread::sleep_for(chrono::milliseconds(50));
+
+			if(m == 0)
+			{
+				chrono::nanoseconds const interval(
+					(long long)(1e9 / rate));
+				chrono::steady_clock::time_point first, last;
+				double deviation(0.);
+
+				stats.maxJitter = 0.;
+
+				for(unsigned long i = 0 ; i < n ; ++i)
+				{
+					chrono::steady_clock::time_point const
+						date(chrono::steady_clock
+						::now());
+					double const gap(chrono::duration<
+						double, nano>(date - last)
+						.count());
+
+					if(i == 0)
+						first = date;
+					else
+					{
+						deviation += fabs(gap - double(
+							interval.count()));
+						stats.maxJitter = max(
+							stats.maxJitter,
+							fabs(gap - double(
+							interval.count())));
+					}
+
+					last = date;
+					client.sendBytes(payload.data(),
+							payload.size());
+					this_thread::sleep_for(interval);
+				}
+
+				stats.datagrams = n;
+				stats.achievedRate = double(n - 1) / chrono
+					::duration<double>(last - first)
+					.count();
+				stats.jitter = deviation / double(n - 1);
+			}
+			else if(client.setPacing(rate, m == 2) || m == 1)
+			{
+				for(unsigned long i = 0 ; i < n ; ++i)
+					client.sendPaced(payload.data(),
+							payload.size());
+
+				stats = client.pacingStatistics();
+			}
+			else
+			{
+				cout
+				<< left << setw(10) << modes[m]
+				<< right << setw(10) << rate
+				<< "  (SO_TXTIME unavailable)" << endl;
+				server.stopListening();
+				continue;
+			}
+
+			/* Let the receiver drain its socket */
+			this_thread::sleep_for(chrono::milliseconds(50));
+			server.stopListening();
+
+			cout
+			<< left << setw(10) << modes[m]
+			<< right << fixed << setprecision(0)
+			<< setw(10) << rate;
+
+			if(m == 2)
+				cout
+				<< setw(12) << "-"
+				<< setw(12) << "-"
+				<< setw(10) << "-";
+			else
+				cout
+				<< setw(12) << stats.achievedRate
+				<< setprecision(2)
+				<< setw(12) << stats.jitter / 1000.
+				<< setprecision(1)
+				<< setw(10) << stats.maxJitter / 1000.;
+
+			cout
+			<< setw(10) << server.packets()
+			<< endl;
+		}
+}
+
+/*
+ * Request answering end: echoes the requests back
+ */
+class BenchRequestServer : public RequestServer
+{
+	protected:
+		/* Echo the request */
+		size_t receiveRequest(uint8_t const * request,
+				size_t const length, uint8_t * response,
+				SockAddr const &)
+		{
+			memcpy(response, request, length);
+			return length;
+		}
+
+	public:
+		/* Constructor */
+		BenchRequestServer()
+			:
+			RequestServer(BENCH_PORT, "log/udpbench.log", LOG_WARN)
+		{
+		}
+};
+
+/*
+ * Pipelined request throughput & latency for a range of outstanding request
+ * counts (the client's capacity, which request(...) blocks on), 64-byte echoed
+ * requests with a 5 s deadline, the socket receive buffers on both ends being
+ * sized to hold every outstanding request (2 KiB each, small datagrams
+ * counting their kernel overhead against the buffer)
+ */
+static void requests(unsigned long const count)
+{
+	size_t const windows[] = { 1, 64, 4096, 131072 };
+	vector<uint8_t> const payload(64, 0x42);
+
+	cout
+	<< count << " requests of " << payload.size() << " bytes, "
+	<< "latency (us)" << endl
+	<< left << setw(10) << "window"
+	<< right << setw(10) << "kreq/s"
+	<< setw(10) << "timeouts"
+	<< setw(10) << "stale"
+	<< setw(10) << "p50"
+	<< setw(10) << "p99"
+	<< setw(10) << "max"
+	<< endl;
+
+	for(size_t const window : windows)
+	{
+		BenchRequestServer server;
+		RequestClient client(window);
+		Histogram latencies;
+		atomic<unsigned long> finished(0);
+
+		server.setBatchSize(64);
+		server.setReceiveBuffer(max(window * 2048, size_t(4) << 20));
+		server.startListening();
+		client.connectTo("127.0.0.1", BENCH_PORT);
+		client.setReceiveBuffer(max(window * 2048, size_t(4) << 20));
+
+		/* Let the receiving thread settle */
+		this_thread::sleep_for(chrono::milliseconds(50));
+
+		auto const start(chrono::steady_clock::now());
+
+		for(unsigned long i = 0 ; i < count ; ++i)
+		{
+			chrono::steady_clock::time_point const sentAt(
+					chrono::steady_clock::now());
+
+			client.request(payload.data(), payload.size(),
+				chrono::seconds(5), [&latencies, &finished,
+				sentAt](RequestStatus const status,
+				uint8_t const *, size_t const)
+			{
+				if(status == REQUEST_COMPLETED)
+					latencies.record(uint64_t(chrono
+						::duration_cast<chrono
+						::nanoseconds>(chrono
+						::steady_clock::now()
+						- sentAt).count()));
+
+				finished.fetch_add(1, memory_order_release);
+			});
+		}
+
+		while(finished.load(memory_order_acquire) < count)
+			this_thread::sleep_for(chrono::microseconds(100));
+
+		double const elapsed(chrono::duration<double>(
+			chrono::steady_clock::now() - start).count());
+		RequestStatistics const stats(client.statistics());
+
+		client.disconnect();
+		server.stopListening();
+
+		cout
+		<< left << setw(10) << window
+		<< right << fixed << setprecision(1)
+		<< setw(10) << double(count) / elapsed / 1e3
+		<< setw(10) << stats.timeouts
+		<< setw(10) << stats.stale
+		<< setw(10) << double(latencies.percentile(.5)) / 1e3
+		<< setw(10) << double(latencies.percentile(.99)) / 1e3
+		<< setw(10) << double(latencies.maximum()) / 1e3
+		<< endl;
+	}
+}
+
+/*
+ * Loopback receive benchmark
+ * Usage: udpbench [count [size [window]]]
+ *        udpbench latency [count]
+ *        udpbench admission [count]
+ *        udpbench sessions [cycles]
+ *        udpbench reliable [count]
+ *        udpbench revive [count]
+ *        udpbench message [count]
+ *        udpbench timers [active]
+ *        udpbench pacing [count]
+ *        udpbench request [count]
+ */
+int main(int argc, char ** argv)
+{
+	if(argc > 1 && string(argv[1]) == "latency")
+	{
+		UDPServer::startWSA();
+		latencies(argc > 2 ? stoul(argv[2]) : 10000);
+		UDPServer::stopWSA();
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "admission")
+	{
+		admissions(argc > 2 ? stoul(argv[2]) : 10000000);
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "sessions")
+	{
+		churns(argc > 2 ? stoul(argv[2]) : 6000000);
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "reliable")
+	{
+		UDPServer::startWSA();
+		reliables(argc > 2 ? stoul(argv[2]) : 100000);
+		UDPServer::stopWSA();
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "revive")
+	{
+		UDPServer::startWSA();
+		revivals(argc > 2 ? stoul(argv[2]) : 1000);
+		UDPServer::stopWSA();
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "message")
+	{
+		UDPServer::startWSA();
+		fragmentations(argc > 2 ? stoul(argv[2]) : 2000);
+		UDPServer::stopWSA();
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "timers")
+	{
+		timers(argc > 2 ? stoul(argv[2]) : 1000000);
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "pacing")
+	{
+		UDPServer::startWSA();
+		pacings(argc > 2 ? stoul(argv[2]) : 100000);
+		UDPServer::stopWSA();
+
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "request")
+	{
+		UDPServer::startWSA();
+		requests(argc > 2 ? stoul(argv[2]) : 500000);
+		UDPServer::stopWSA();
+
+		return 0;
+	}
+
+	unsigned long const count(argc > 1 ? stoul(argv[1]) : 1000000);
+	size_t const size(argc > 2 ? stoul(argv[2]) : 64);
+	unsigned long const window(argc > 3 ? stoul(argv[3]) : 128);
+
+	BenchMode const modes[] =
+	{
+		{ "recvfrom", BACKEND_BLOCKING, 0, false, 0 },
+		{ "single", BACKEND_BLOCKING, 1, false, 0 },
+		{ "recvmmsg", BACKEND_BLOCKING, 64, false, 0 },
+		{ "epoll", BACKEND_EPOLL, 64, false, 0 },
+		{ "io_uring", BACKEND_URING, 64, false, 0 },
+		{ "gso", BACKEND_BLOCKING, 64, false, 32 },
+		{ "gso+gro", BACKEND_BLOCKING, 64, true, 32 },
+		{ "uring+gro", BACKEND_URING, 64, true, 32 }
+	};
+
+	UDPServer::startWSA();
+
+	cout
+	<< count << " datagrams of " << size << " bytes, "
+	<< window << " in flight" << endl
+	<< left << setw(10) << "mode"
+	<< right << setw(10) << "received"
+	<< setw(12) << "kdgram/s"
+	<< setw(14) << "cpu ns/dgram"
+	<< setw(14) << "csw/kdgram"
+	<< endl;
+
+	for(BenchMode const & mode : modes)
+	{
+		try
+		{
+			BenchResult const r(run(mode, count, size, window));
+
+			cout
+			<< left << setw(10) << mode.name
+			<< right << setw(10) << r.received
+			<< setw(12) << fixed << setprecision(1)
+			<< double(r.received) / r.elapsed / 1e3
+			<< setw(14) << setprecision(0)
+			<< r.cpu * 1e9 / double(max(r.received, 1ul))
+			<< setw(14) << setprecision(2)
+			<< double(r.switches) * 1e3
+				/ double(max(r.received, 1ul))
+			<< endl;
+		}
+		catch(Exception const & e)
+		{
+			cerr << mode.name << ": " << e.message() << endl;
+		}
+	}
+
+	UDPServer::stopWSA();
+
+	return 0;
+}
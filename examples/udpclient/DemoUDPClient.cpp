@@ -22,8 +22,6 @@
 
 #include "DemoUDPClient.hpp"
 #include <iostream>
-#include <thread>
-#include <chrono>
 
 
 namespace Mach
@@ -88,14 +86,20 @@ void DemoUDPClient::sendPattern(uint8_t const byte, size_t const length) const
  * packet loss, along with the DemoUDPServer's indexed mode.
  */
 void DemoUDPClient::sendIndexes(unsigned const number,
-		unsigned const msDelay) const
+		unsigned const msDelay)
 {
-	/* Send successive indexes and pause between each one */
+	/* Pace successive indexes at one per delay */
+	setPacing(msDelay > 0 ? 1000. / msDelay : 0.);
+
 	for(unsigned i=0 ; i < number ; ++i)
-	{
-		sendBytes((uint8_t*)(&i), sizeof(i));
-		this_thread::sleep_for(chrono::milliseconds(msDelay));
-	}
+		sendPaced((uint8_t*)(&i), sizeof(i));
+
+	PacingStatistics const stats(pacingStatistics());
+
+	cout
+	<< stats.datagrams << " indexes sent at " << stats.achievedRate
+	<< " per second (jitter " << stats.jitter / 1000. << " us, at most "
+	<< stats.maxJitter / 1000. << " us)" << endl;
 }
 
 /*
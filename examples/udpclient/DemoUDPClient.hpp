@@ -49,8 +49,8 @@ class DemoUDPClient : public UDPClient
 		/* Send the given byte N times */
 		void sendPattern(uint8_t const, size_t const) const;
 
-		/* Send N indexed packets */
-		void sendIndexes(unsigned const, unsigned const) const;
+		/* Send N indexed packets, paced at one per delay (ms) */
+		void sendIndexes(unsigned const, unsigned const);
 };
 
 }
@@ -38,37 +38,24 @@ void DemoUDPServer::receiveBytes(uint8_t const * data, size_t const dataLen,
 	/* -Wall warning removal */
 	(void)(socketFd);
 
-	/* Local index for packet arrival order tests */
-	unsigned index(0);
-
-	/* Remote end address (human readable form) */
-	char remoteAddressString[INET6_ADDRSTRLEN];
+	/* Local & previous index for packet arrival order tests */
+	unsigned index(0), previous(0);
 
 	/* Remote end address and port (machine readable) */
-	void *specializedAddress(nullptr);
-	unsigned short port;
-
-	/* Get the sender's network identity */
-	specializedAddress = specializeAddress(
-			(sockaddr *)(sender));
+	SockAddr const remote(*sender);
 
-	port = specializePort((sockaddr *)(sender));
+	/* Remote end address and port (human readable form) */
+	char remoteString[SOCKADDR_STRLEN];
 
-	/* IPv4 or IPv6 (others are discarded) */
-	if(specializedAddress)
+	/* IPv4 or IPv6 (others are discarded), formatted without allocating */
+	if(remote.format(remoteString, sizeof(remoteString)) > 0)
 	{
-		/* Network-to-presentation */
-		inet_ntop(sender->ss_family,
-			specializedAddress,
-			remoteAddressString,
-			sizeof(remoteAddressString));
-
 		switch(_mode)
 		{
 			/* Hexadecimal packet view */
 			case HEX:
 				cout
-				<< remoteAddressString << ":" << port << " ";
+				<< remoteString << " ";
 
 				showHex(data, dataLen);
 				cout << endl;
@@ -77,7 +64,7 @@ void DemoUDPServer::receiveBytes(uint8_t const * data, size_t const dataLen,
 			/* Human-readable packet view */
 			case CHARACTER:
 				cout
-				<< remoteAddressString << ":" << port << " ";
+				<< remoteString << " ";
 
 				showChar(data, dataLen);
 				cout << endl;
@@ -86,7 +73,7 @@ void DemoUDPServer::receiveBytes(uint8_t const * data, size_t const dataLen,
 			/* Only display packet's length */
 			case LENGTH:
 				cout
-				<< remoteAddressString << ":" << port << " ";
+				<< remoteString << " ";
 
 				cout
 				<< "RX: " << dataLen << "B."
@@ -99,25 +86,31 @@ void DemoUDPServer::receiveBytes(uint8_t const * data, size_t const dataLen,
 
 				if(index == 0)
 					cout
-					<< remoteAddressString << ":"
-					<< port << " ";
+					<< remoteString << " ";
 
 				cout << '.';
 				cout.flush();
 
-				if(index != 0 && index != _storedIndex + 1)
+				/* Peers beyond the table's capacity are not
+				 * checked */
+				if(!_storedIndexes.update(remote,
+					[index, &previous](unsigned & last)
+					{
+						previous = last;
+						last = index;
+					}))
+					cout << 'U';
+				else if(index != 0 && index != previous + 1)
 				{
-					++_errors;
+					_errors.fetch_add(1, memory_order_relaxed);
 					cout << 'E';
 				}
-
-				_storedIndex = index;
 			break;
 
 			/* Display hex, char and length */
 			case ALL:
 				cout
-				<< remoteAddressString << ":" << port << " ";
+				<< remoteString << " ";
 
 				showChar(data, dataLen);
 				cout << " ";
@@ -136,7 +129,7 @@ void DemoUDPServer::receiveBytes(uint8_t const * data, size_t const dataLen,
 	}
 
 	/* Update the received packet counter */
-	++_packets;
+	_packets.fetch_add(1, memory_order_relaxed);
 }
 
 /*
@@ -145,15 +138,10 @@ void DemoUDPServer::receiveBytes(uint8_t const * data, size_t const dataLen,
  */
 void DemoUDPServer::showChar(uint8_t const * data, size_t const length) const
 {
-	/* Tmp buffer for local modifications */
-	uint8_t * formattedData = new uint8_t[length+1];
-	memcpy(formattedData, data, length);
-
-	formattedData[length] = '\0';
-
-	cout << "[" << (char *)(formattedData) << "]";
-
-	delete [] formattedData;
+	/* Print up to the first NUL, straight from the packet */
+	cout << "[";
+	cout.write((char const *)(data), strnlen((char const *)(data), length));
+	cout << "]";
 }
 
 /*
@@ -189,10 +177,13 @@ DemoUDPServer::DemoUDPServer(string const file, Priority const priority,
 		unsigned short const portNumber, DemoMode const mode) :
 	UDPServer(portNumber, file, priority),
 	_mode(mode),
-	_storedIndex(0),
+	_storedIndexes(1024),
 	_packets(0),
 	_errors(0)
-{}
+{
+	/* Forget the peers silent for a minute */
+	_storedIndexes.startExpiry(chrono::seconds(60), chrono::seconds(10));
+}
 
 /*
  * Empty destructor
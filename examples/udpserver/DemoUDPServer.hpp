@@ -24,6 +24,7 @@
 #define DEMOUDPSERVER_HPP_INCLUDED
 
 #include <Mach/UDPServer.hpp>
+#include <atomic>
 
 
 namespace Mach
@@ -54,14 +55,15 @@ class DemoUDPServer : public UDPServer
 		/* Current demonstration mode */
 		DemoMode _mode;
 
-		/* Last received packet index */
-		unsigned _storedIndex;
+		/* Last received packet index of each peer (handlers run
+		 * concurrently, hence the session table & atomics) */
+		SessionTable<unsigned> _storedIndexes;
 
 		/* Packets received (total) */
-		unsigned _packets;
+		std::atomic<unsigned> _packets;
 
 		/* Detected inconsistencies */
-		unsigned _errors;
+		std::atomic<unsigned> _errors;
 
 	protected:
 		/* Displays information about the received datagram */
@@ -86,11 +88,11 @@ class DemoUDPServer : public UDPServer
 		/* Various getters */
 		unsigned packets() const
 		{
-			return _packets;
+			return _packets.load(std::memory_order_relaxed);
 		}
 		unsigned errors() const
 		{
-			return _errors;
+			return _errors.load(std::memory_order_relaxed);
 		}
 };
 
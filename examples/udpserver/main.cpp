@@ -94,8 +94,18 @@ int main(void)
 		}
 	} while (choice != 0);
 
+	ServerStatistics const stats(serv->statistics());
+
 	cout
 	<< "RX: " << serv->packets() << " p ; E: " << serv->errors()
+	<< endl
+	<< "Server: " << stats.packets << " p, " << stats.bytes << " B in "
+	<< stats.batches << " batches ; drops: " << stats.kernelDrops
+	<< " kernel, " << stats.poolDrops << " pool, " << stats.queueDrops
+	<< " queue, " << stats.packetRateDrops + stats.byteRateDrops
+	<< " rate ; " << stats.sendFailures << " send failures ; "
+	<< stats.handlerNanoseconds / 1000 << " us in " << stats.handlerCalls
+	<< " handler calls"
 	<< endl;
 
 	delete serv;
@@ -147,6 +147,16 @@ class AStar
 		{
 			return _path;
 		}
+
+		/* Endpoints getters */
+		Coord const & source() const
+		{
+			return _source;
+		}
+		Coord const & destination() const
+		{
+			return _destination;
+		}
 };
 
 /*
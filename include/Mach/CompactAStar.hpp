@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent <julien.laurent@engineer.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef COMPACTASTAR_HPP_INCLUDED
+#define COMPACTASTAR_HPP_INCLUDED
+
+#include "AStar.hpp"
+#include "Exception.hpp"
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+
+namespace Mach
+{
+
+/*
+ * Template parameters: <Map type, Coordinates type>
+ *
+ * Compact variant of Mach::AStar for maps whose cells can be numbered
+ * [0, cells): nodes are stored in a flat array indexed by cell, and hold
+ * 32-bit costs and a 32-bit parent index instead of a full Coord, a parent
+ * pointer and three unsigned longs (16 bytes instead of ~48, the F cost being
+ * recomputed on the fly). Coordinates are only rebuilt from indexes when
+ * needed (heuristic, neighborhood and final path).
+ * The open list is an indexed binary heap, each node remembering its own
+ * position in it.
+ *
+ * Costs exceeding 32 bits are detected while running, and maps with too many
+ * cells at construction: both cases throw a Mach::Exception.
+ */
+template
+<typename Map, typename Coord>
+class CompactAStar
+{
+	public:
+		typedef typename AStar<Map, Coord>::distanceFunction distanceFunction;
+		typedef typename AStar<Map, Coord>::moveCostFunction moveCostFunction;
+		typedef typename AStar<Map, Coord>::terrainCostFunction terrainCostFunction;
+		typedef typename AStar<Map, Coord>::nearFunction nearFunction;
+		typedef uint32_t (*indexFunction) (Map const &, Coord const &);
+		typedef Coord (*coordFunction) (Map const &, uint32_t const);
+
+	protected:
+		/* Node states (any other value is a position in the open heap) */
+		static uint32_t const UNVISITED = 0xFFFFFFFF;
+		static uint32_t const CLOSED = 0xFFFFFFFE;
+
+		/* Parent index of the starting node */
+		static uint32_t const NO_PARENT = 0xFFFFFFFF;
+
+		/* Graph node metadata, used while processing the path */
+		struct Node
+		{
+			/* Movement cost from the starting node */
+			uint32_t _gCost;
+
+			/* Estimated remaining distance to destination */
+			uint32_t _hCost;
+
+			/* Cell index of the node we came from */
+			uint32_t _parent;
+
+			/* Open heap position, UNVISITED or CLOSED */
+			uint32_t _state;
+		};
+
+		static_assert(sizeof(Node) == 16, "CompactAStar::Node must stay 16 bytes wide");
+
+		/* External environment data */
+		Map const & _map;
+		Coord const _source;
+		Coord const _destination;
+		uint32_t const _cells;
+
+		distanceFunction _distance;
+		moveCostFunction _moveCost;
+		terrainCostFunction _terrainCost;
+		nearFunction _near;
+		indexFunction _index;
+		coordFunction _coord;
+
+		/* Internal processing data */
+		std::vector<Node> _nodes;
+		std::vector<uint32_t> _heap;
+
+		std::vector<Coord> _path;
+
+		/* Internal processing methods */
+		virtual void expand(uint32_t current);
+		inline void visit(uint32_t current, uint32_t neighbor,
+				Coord const & position, unsigned long moveCost);
+		inline void completePath(uint32_t destination);
+		static inline uint32_t checkedCost(unsigned long cost);
+
+		/* Open heap management */
+		uint64_t fCost(uint32_t index) const
+		{
+			return uint64_t(_nodes[index]._gCost) + _nodes[index]._hCost;
+		}
+		inline void siftUp(uint32_t position);
+		inline void siftDown(uint32_t position);
+		inline uint32_t popBestOpenNode();
+
+	public:
+		/* Constructor & destructor */
+		CompactAStar
+		(
+			Map const & m,
+			Coord const & src,
+			Coord const & dst,
+			size_t const cells,
+			distanceFunction distance,
+			moveCostFunction moveCost,
+			terrainCostFunction terrainCost,
+			nearFunction near,
+			indexFunction index,
+			coordFunction coord
+		)
+		:
+			_map(m),
+			_source(src),
+			_destination(dst),
+			_cells(uint32_t(cells)),
+			_distance(distance),
+			_moveCost(moveCost),
+			_terrainCost(terrainCost),
+			_near(near),
+			_index(index),
+			_coord(coord)
+		{
+			/* The heap position space must not reach the
+			 * CLOSED & UNVISITED markers */
+			if(cells >= CLOSED)
+				throw Exception("CompactAStar: too many cells for 32-bit indexes.");
+		}
+
+		virtual ~CompactAStar()
+		{}
+
+		/* Main interface */
+		virtual std::vector<Coord> run();
+		std::vector<Coord> path()
+		{
+			return _path;
+		}
+
+		/* Endpoints getters */
+		Coord const & source() const
+		{
+			return _source;
+		}
+		Coord const & destination() const
+		{
+			return _destination;
+		}
+};
+
+/* Static constants definitions */
+template <typename Map, typename Coord>
+uint32_t const CompactAStar<Map, Coord>::UNVISITED;
+
+template <typename Map, typename Coord>
+uint32_t const CompactAStar<Map, Coord>::CLOSED;
+
+template <typename Map, typename Coord>
+uint32_t const CompactAStar<Map, Coord>::NO_PARENT;
+
+/*
+ * Main processing method, same algorithm as AStar::run()
+ */
+template <typename Map, typename Coord>
+std::vector<Coord>
+CompactAStar<Map, Coord>::
+run()
+{
+	Node const unvisited = { 0, 0, NO_PARENT, UNVISITED };
+
+	uint32_t const source((*_index)(_map, _source)),
+		       destination((*_index)(_map, _destination));
+
+	_nodes.assign(_cells, unvisited);
+	_heap.clear();
+	_path.clear();
+
+	/* Open the starting node */
+	_nodes[source]._hCost = checkedCost((*_distance)(_source, _destination));
+	_nodes[source]._state = 0;
+	_heap.push_back(source);
+
+	/* Iterate until a path is found OR the open heap becomes empty */
+	while(!_heap.empty())
+	{
+		uint32_t const current(popBestOpenNode());
+
+		_nodes[current]._state = CLOSED;
+
+		if(current == destination)
+		{
+			completePath(destination);
+			break;
+		}
+
+		expand(current);
+	}
+
+	return _path;
+}
+
+/*
+ * Visit every neighbor of the given node (default implementation, relying
+ * on the near() callback)
+ */
+template <typename Map, typename Coord>
+void
+CompactAStar<Map, Coord>::
+expand(uint32_t current)
+{
+	Coord const position((*_coord)(_map, current));
+	std::vector<Coord> const neighbors((*_near)(position));
+
+	for(Coord const & neighbor : neighbors)
+	{
+		/* If the node isn't walkable, skip it */
+		if((*_terrainCost)(_map, neighbor) == 0)
+			continue;
+
+		visit(current, (*_index)(_map, neighbor), neighbor,
+				(*_moveCost)(position, neighbor));
+	}
+}
+
+/*
+ * Open a walkable neighbor, or apply the shortcut it offers
+ */
+template <typename Map, typename Coord>
+void
+CompactAStar<Map, Coord>::
+visit(uint32_t current, uint32_t neighbor, Coord const & position,
+		unsigned long moveCost)
+{
+	Node & node(_nodes[neighbor]);
+
+	/* If the node is already in the closed list, skip it */
+	if(node._state == CLOSED)
+		return;
+
+	uint32_t const gCost(checkedCost(
+		(unsigned long)(_nodes[current]._gCost) + moveCost));
+
+	if(node._state == UNVISITED)
+	{
+		node._gCost = gCost;
+		node._hCost = checkedCost((*_distance)(position, _destination));
+		node._parent = current;
+		node._state = uint32_t(_heap.size());
+
+		_heap.push_back(neighbor);
+		siftUp(node._state);
+	}
+	else if(gCost < node._gCost)
+	{
+		node._gCost = gCost;
+		node._parent = current;
+
+		siftUp(node._state);
+	}
+}
+
+/*
+ * Walk the parent indexes back from the destination
+ */
+template <typename Map, typename Coord>
+void
+CompactAStar<Map, Coord>::
+completePath(uint32_t destination)
+{
+	for(uint32_t i = destination ; i != NO_PARENT ; i = _nodes[i]._parent)
+		_path.push_back((*_coord)(_map, i));
+
+	/* Reverse the vector (makes more sense) */
+	std::reverse(_path.begin(), _path.end());
+}
+
+/*
+ * Narrow a cost to 32 bits, refusing to silently wrap around
+ */
+template <typename Map, typename Coord>
+uint32_t
+CompactAStar<Map, Coord>::
+checkedCost(unsigned long cost)
+{
+	if(cost > 0xFFFFFFFFul)
+		throw Exception("CompactAStar: path cost overflows 32 bits.");
+
+	return uint32_t(cost);
+}
+
+/*
+ * Move a heap entry up until its parent has a smaller F cost
+ */
+template <typename Map, typename Coord>
+void
+CompactAStar<Map, Coord>::
+siftUp(uint32_t position)
+{
+	uint32_t const index(_heap[position]);
+	uint64_t const f(fCost(index));
+
+	while(position > 0)
+	{
+		uint32_t const parent((position - 1) / 2);
+
+		if(fCost(_heap[parent]) <= f)
+			break;
+
+		_heap[position] = _heap[parent];
+		_nodes[_heap[position]]._state = position;
+		position = parent;
+	}
+
+	_heap[position] = index;
+	_nodes[index]._state = position;
+}
+
+/*
+ * Move a heap entry down until both children have a greater F cost
+ */
+template <typename Map, typename Coord>
+void
+CompactAStar<Map, Coord>::
+siftDown(uint32_t position)
+{
+	uint32_t const index(_heap[position]);
+	uint64_t const f(fCost(index));
+	uint32_t const size(uint32_t(_heap.size()));
+
+	while(2 * position + 1 < size)
+	{
+		uint32_t child(2 * position + 1);
+
+		if(child + 1 < size && fCost(_heap[child + 1]) < fCost(_heap[child]))
+			++child;
+
+		if(f <= fCost(_heap[child]))
+			break;
+
+		_heap[position] = _heap[child];
+		_nodes[_heap[position]]._state = position;
+		position = child;
+	}
+
+	_heap[position] = index;
+	_nodes[index]._state = position;
+}
+
+/*
+ * Get (and remove) the best node available from the open heap
+ */
+template <typename Map, typename Coord>
+uint32_t
+CompactAStar<Map, Coord>::
+popBestOpenNode()
+{
+	uint32_t const best(_heap.front());
+
+	_heap.front() = _heap.back();
+	_heap.pop_back();
+
+	if(!_heap.empty())
+		siftDown(0);
+
+	return best;
+}
+
+}
+
+#endif // COMPACTASTAR_HPP_INCLUDED
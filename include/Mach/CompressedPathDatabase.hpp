@@ -0,0 +1,779 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent <julien.laurent@engineer.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef COMPRESSEDPATHDATABASE_HPP_INCLUDED
+#define COMPRESSEDPATHDATABASE_HPP_INCLUDED
+
+#include "AStar.hpp"
+#include "Exception.hpp"
+#include "Point.hpp"
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+/* Linux-specific bits (file mapping) */
+#if defined(__gnu_linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace Mach
+{
+
+/*
+ * Template parameters: <Map type>
+ *
+ * First-move Compressed Path Database (CPD) for static 2D grids.
+ * An offline build runs one Dijkstra search per source cell and stores, for
+ * every target cell, the index (in the near() output) of the first optimal
+ * move towards it. Each source's table is run-length compressed over the
+ * row-major target order; unwalkable targets and the source itself are never
+ * queried, so they are left out and extend whichever run they fall in.
+ * Queries then simply follow first moves from source to destination: the
+ * cost is proportional to the path length, with no search at all.
+ *
+ * The database remembers a checksum of every region of the map it was built
+ * from; regions found different (see refresh()) or explicitly marked stale
+ * make the queries going through them fall back to Mach::AStar.
+ *
+ * Map shall expose width() and height(), cells being addressed as
+ * Point(x, y) with 0 <= x < width() and 0 <= y < height().
+ */
+template
+<typename Map>
+class CompressedPathDatabase
+{
+	public:
+		typedef typename AStar<Map, Point>::distanceFunction distanceFunction;
+		typedef typename AStar<Map, Point>::moveCostFunction moveCostFunction;
+		typedef typename AStar<Map, Point>::terrainCostFunction terrainCostFunction;
+		typedef typename AStar<Map, Point>::nearFunction nearFunction;
+
+	protected:
+		/* On-disk header (followed by the checksums, offsets & runs) */
+		struct Header
+		{
+			char _magic[4];
+			uint32_t _format;
+			uint32_t _width;
+			uint32_t _height;
+			uint32_t _regionSize;
+			uint32_t _regionCount;
+			uint64_t _runCount;
+		};
+
+		/* "No move" marker (unreachable target) */
+		static uint8_t const NO_MOVE = 0xFF;
+
+		/* Runs are stored as (first target index << 8 | move) */
+		static uint32_t const MAX_CELLS = 0x00FFFFFF;
+
+		/* External environment data */
+		Map const & _map;
+
+		distanceFunction _distance;
+		moveCostFunction _moveCost;
+		terrainCostFunction _terrainCost;
+		nearFunction _near;
+
+		/* Grid geometry */
+		uint32_t _width;
+		uint32_t _height;
+		uint32_t _regionSize;
+		uint32_t _regionsPerRow;
+
+		/* Compressed tables: runs of source s are found in
+		 * _runs[_offsets[s] .. _offsets[s+1]) */
+		uint32_t const * _offsets;
+		uint32_t const * _runs;
+		uint64_t _runCount;
+
+		/* Tables storage, when built in memory (not mapped) */
+		std::vector<uint32_t> _ownedOffsets;
+		std::vector<uint32_t> _ownedRuns;
+
+		/* Mapped database file (if any) */
+		void * _mapping;
+		size_t _mappingLength;
+
+		/* Per-region checksums & staleness flags */
+		std::vector<uint32_t> _checksums;
+		std::vector<bool> _stale;
+
+		/* Statistics */
+		unsigned long _queries;
+		unsigned long _fallbacks;
+
+		/* Internal processing methods */
+		void buildSources(uint32_t first, uint32_t step,
+				std::vector< std::vector<uint32_t> > & tables) const;
+		void compress(uint32_t source,
+				std::vector<uint8_t> const & moves,
+				std::vector<uint32_t> & runs) const;
+		uint32_t checksum(uint32_t region) const;
+		uint8_t firstMove(uint32_t source, uint32_t target) const;
+		std::vector<Point> fallback(Point const & src, Point const & dst);
+		void unmap();
+
+		uint32_t index(Point const & p) const
+		{
+			return uint32_t(p.y) * _width + uint32_t(p.x);
+		}
+		uint32_t regionOf(Point const & p) const
+		{
+			return (uint32_t(p.y) / _regionSize) * _regionsPerRow
+				+ uint32_t(p.x) / _regionSize;
+		}
+		bool contains(Point const & p) const
+		{
+			return p.x >= 0 && p.y >= 0
+				&& uint32_t(p.x) < _width
+				&& uint32_t(p.y) < _height;
+		}
+
+	public:
+		/* Constructor & destructor */
+		CompressedPathDatabase
+		(
+			Map const & m,
+			distanceFunction distance,
+			moveCostFunction moveCost,
+			terrainCostFunction terrainCost,
+			nearFunction near,
+			uint32_t regionSize = 8
+		)
+		:
+			_map(m),
+			_distance(distance),
+			_moveCost(moveCost),
+			_terrainCost(terrainCost),
+			_near(near),
+			_width(0),
+			_height(0),
+			_regionSize(regionSize ? regionSize : 1),
+			_regionsPerRow(0),
+			_offsets(nullptr),
+			_runs(nullptr),
+			_runCount(0),
+			_mapping(nullptr),
+			_mappingLength(0),
+			_queries(0),
+			_fallbacks(0)
+		{}
+
+		virtual ~CompressedPathDatabase()
+		{
+			unmap();
+		}
+
+		/* Copy & assignation are forbidden */
+		CompressedPathDatabase(CompressedPathDatabase const &) = delete;
+		CompressedPathDatabase & operator = (CompressedPathDatabase const &) = delete;
+
+		/* Offline build (0 threads means one per hardware thread) */
+		void build(unsigned threads = 0);
+
+		/* File persistence (loading maps the file in memory) */
+		void saveTo(std::string const & path) const;
+		void loadFrom(std::string const & path);
+
+		/* Compare regions against the map, flag the modified ones as
+		 * stale, and return the number of stale regions */
+		unsigned refresh();
+		void markStale(Point const & p);
+
+		/* Main interface */
+		std::vector<Point> path(Point const & src, Point const & dst);
+
+		/* Various getters */
+		uint64_t runs() const
+		{
+			return _runCount;
+		}
+		unsigned long queries() const
+		{
+			return _queries;
+		}
+		unsigned long fallbacks() const
+		{
+			return _fallbacks;
+		}
+};
+
+/* Static constants definitions */
+template <typename Map>
+uint8_t const CompressedPathDatabase<Map>::NO_MOVE;
+
+template <typename Map>
+uint32_t const CompressedPathDatabase<Map>::MAX_CELLS;
+
+/*
+ * Build the whole database, splitting the sources between worker threads
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+build(unsigned threads)
+{
+	std::vector< std::vector<uint32_t> > tables;
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> errors;
+	uint32_t cells(0);
+
+	unmap();
+
+	_width = _map.width();
+	_height = _map.height();
+	_regionsPerRow = (_width + _regionSize - 1) / _regionSize;
+
+	if(uint64_t(_width) * _height > MAX_CELLS)
+		throw Exception("CompressedPathDatabase: map is too large.");
+
+	cells = _width * _height;
+	tables.resize(cells);
+
+	if(threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	/* Sources are interleaved between threads to even out the load; an
+	 * exception can't leave a thread, so each one's is kept and rethrown
+	 * once all of them are joined */
+	errors.resize(threads);
+
+	for(unsigned t = 0 ; t < threads ; ++t)
+	{
+		auto const work = [this, t, threads, &tables, &errors]()
+		{
+			try
+			{
+				buildSources(t, threads, tables);
+			}
+			catch(...)
+			{
+				errors[t] = std::current_exception();
+			}
+		};
+
+		if(t + 1 < threads)
+			workers.push_back(std::thread(work));
+		else
+			work();
+	}
+
+	for(std::thread & w : workers)
+		w.join();
+
+	for(std::exception_ptr const & error : errors)
+		if(error)
+			std::rethrow_exception(error);
+
+	/* Flatten the per-source tables */
+	_ownedOffsets.assign(1, 0);
+	_ownedRuns.clear();
+
+	for(std::vector<uint32_t> & table : tables)
+	{
+		if(_ownedRuns.size() + table.size() > UINT32_MAX)
+		{
+			unmap();
+			throw Exception("CompressedPathDatabase: too many runs.");
+		}
+
+		_ownedRuns.insert(_ownedRuns.end(), table.begin(), table.end());
+		_ownedOffsets.push_back(uint32_t(_ownedRuns.size()));
+		std::vector<uint32_t>().swap(table);
+	}
+
+	_offsets = _ownedOffsets.data();
+	_runs = _ownedRuns.data();
+	_runCount = _ownedRuns.size();
+
+	/* Remember what the map looked like */
+	_checksums.resize(_regionsPerRow
+			* ((_height + _regionSize - 1) / _regionSize));
+	for(uint32_t r = 0 ; r < _checksums.size() ; ++r)
+		_checksums[r] = checksum(r);
+
+	_stale.assign(_checksums.size(), false);
+}
+
+/*
+ * Run a full Dijkstra search from every source in [first, +step, ...) and
+ * compress its first-move table
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+buildSources(uint32_t first, uint32_t step,
+		std::vector< std::vector<uint32_t> > & tables) const
+{
+	typedef std::pair<unsigned long, uint32_t> Entry;
+
+	uint32_t const cells(_width * _height);
+	unsigned long const infinity(~0ul);
+
+	std::vector<unsigned long> cost(cells);
+	std::vector<uint8_t> moves(cells);
+	std::vector<Point> neighbors;
+
+	for(uint32_t source = first ; source < cells ; source += step)
+	{
+		Point const origin(source % _width, source / _width);
+
+		std::priority_queue<Entry, std::vector<Entry>,
+			std::greater<Entry> > open;
+
+		/* Unwalkable sources are never queried */
+		if((*_terrainCost)(_map, origin) == 0)
+			continue;
+
+		std::fill(cost.begin(), cost.end(), infinity);
+		std::fill(moves.begin(), moves.end(), NO_MOVE);
+
+		cost[source] = 0;
+		open.push(Entry(0, source));
+
+		while(!open.empty())
+		{
+			Entry const current(open.top());
+			Point const position(current.second % _width,
+					current.second / _width);
+
+			open.pop();
+
+			if(current.first > cost[current.second])
+				continue;
+
+			neighbors = (*_near)(position);
+
+			if(neighbors.size() >= NO_MOVE)
+				throw Exception("CompressedPathDatabase: too many neighbors.");
+
+			for(uint8_t k = 0 ; k < neighbors.size() ; ++k)
+			{
+				Point const & neighbor(neighbors[k]);
+
+				if(!contains(neighbor)
+					|| (*_terrainCost)(_map, neighbor) == 0)
+					continue;
+
+				unsigned long const newCost(current.first
+					+ (*_moveCost)(position, neighbor));
+				uint32_t const n(index(neighbor));
+
+				if(newCost < cost[n])
+				{
+					cost[n] = newCost;
+
+					/* The first move is inherited from the
+					 * parent, except around the source */
+					moves[n] = (current.second == source) ?
+						k : moves[current.second];
+
+					open.push(Entry(newCost, n));
+				}
+			}
+		}
+
+		compress(source, moves, tables[source]);
+	}
+}
+
+/*
+ * Run-length compress a first-move table. Unwalkable targets and the source
+ * itself are never queried, so they extend whatever run they fall in.
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+compress(uint32_t source, std::vector<uint8_t> const & moves,
+		std::vector<uint32_t> & runs) const
+{
+	bool open(false);
+	uint8_t current(NO_MOVE);
+
+	runs.clear();
+
+	for(uint32_t target = 0 ; target < moves.size() ; ++target)
+	{
+		Point const position(target % _width, target / _width);
+
+		/* Wildcards */
+		if(target == source || (moves[target] == NO_MOVE
+			&& (*_terrainCost)(_map, position) == 0))
+			continue;
+
+		if(!open || moves[target] != current)
+		{
+			current = moves[target];
+			runs.push_back((target << 8) | current);
+			open = true;
+		}
+	}
+
+	std::vector<uint32_t>(runs).swap(runs);
+}
+
+/*
+ * Look the first move from source to target up in the compressed table
+ */
+template <typename Map>
+uint8_t
+CompressedPathDatabase<Map>::
+firstMove(uint32_t source, uint32_t target) const
+{
+	uint32_t const * begin(_runs + _offsets[source]);
+	uint32_t const * end(_runs + _offsets[source + 1]);
+
+	/* Last run starting at or before the target */
+	uint32_t const * run(std::upper_bound(begin, end, (target << 8) | 0xFF));
+
+	if(run == begin)
+		return NO_MOVE;
+
+	return uint8_t(*(run - 1) & 0xFF);
+}
+
+/*
+ * Follow the first moves from src to dst; if the database can't be trusted
+ * on the way, fall back to a regular A* search
+ */
+template <typename Map>
+std::vector<Point>
+CompressedPathDatabase<Map>::
+path(Point const & src, Point const & dst)
+{
+	std::vector<Point> result, neighbors;
+	Point current(src);
+	uint32_t const target(index(dst));
+
+	++_queries;
+
+	if(_offsets == nullptr || !contains(src) || !contains(dst)
+		|| (*_terrainCost)(_map, src) == 0
+		|| (*_terrainCost)(_map, dst) == 0)
+		return result;
+
+	if(_stale[regionOf(src)] || _stale[regionOf(dst)])
+		return fallback(src, dst);
+
+	result.push_back(current);
+
+	while(current != dst)
+	{
+		uint8_t const move(firstMove(index(current), target));
+
+		if(move == NO_MOVE)
+			return std::vector<Point>();
+
+		neighbors = (*_near)(current);
+
+		/* Any inconsistency means the map changed under our feet */
+		if(move >= neighbors.size()
+			|| !contains(neighbors[move])
+			|| _stale[regionOf(neighbors[move])]
+			|| (*_terrainCost)(_map, neighbors[move]) == 0
+			|| result.size() > size_t(_width) * _height)
+			return fallback(src, dst);
+
+		current = neighbors[move];
+		result.push_back(current);
+	}
+
+	return result;
+}
+
+/*
+ * Plain A* search, used on stale regions
+ */
+template <typename Map>
+std::vector<Point>
+CompressedPathDatabase<Map>::
+fallback(Point const & src, Point const & dst)
+{
+	AStar<Map, Point> search(_map, src, dst, _distance, _moveCost,
+			_terrainCost, _near);
+
+	++_fallbacks;
+
+	return search.run();
+}
+
+/*
+ * Hash the terrain of a region (FNV-1a over the terrain costs)
+ */
+template <typename Map>
+uint32_t
+CompressedPathDatabase<Map>::
+checksum(uint32_t region) const
+{
+	uint32_t hash(2166136261u);
+	uint32_t const left((region % _regionsPerRow) * _regionSize),
+		       top((region / _regionsPerRow) * _regionSize);
+
+	for(uint32_t y = top ; y < std::min(top + _regionSize, _height) ; ++y)
+	{
+		for(uint32_t x = left ; x < std::min(left + _regionSize, _width) ; ++x)
+		{
+			hash ^= uint32_t((*_terrainCost)(_map, Point(x, y)));
+			hash *= 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+/*
+ * Flag every region whose terrain changed since the build as stale
+ */
+template <typename Map>
+unsigned
+CompressedPathDatabase<Map>::
+refresh()
+{
+	unsigned stale(0);
+
+	for(uint32_t r = 0 ; r < _checksums.size() ; ++r)
+	{
+		if(!_stale[r] && checksum(r) != _checksums[r])
+			_stale[r] = true;
+
+		if(_stale[r])
+			++stale;
+	}
+
+	return stale;
+}
+
+/*
+ * Explicitly flag the region hosting the given point as stale
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+markStale(Point const & p)
+{
+	if(!_stale.empty() && contains(p))
+		_stale[regionOf(p)] = true;
+}
+
+/*
+ * Save the database on disk
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+saveTo(std::string const & path) const
+{
+	Header header;
+
+	if(_offsets == nullptr)
+		throw Exception("Couldn't save database to " + path + ": nothing built nor loaded.");
+
+	std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+
+	if(!file.is_open())
+		throw Exception("Couldn't save database to " + path + ".");
+
+	memcpy(header._magic, "MCPD", 4);
+	header._format = 1;
+	header._width = _width;
+	header._height = _height;
+	header._regionSize = _regionSize;
+	header._regionCount = uint32_t(_checksums.size());
+	header._runCount = _runCount;
+
+	file.write((char *)(&header), sizeof(header));
+	file.write((char *)(_checksums.data()),
+			_checksums.size() * sizeof(uint32_t));
+	file.write((char *)(_offsets),
+			(size_t(_width) * _height + 1) * sizeof(uint32_t));
+	file.write((char *)(_runs), _runCount * sizeof(uint32_t));
+
+	file.close();
+}
+
+/*
+ * Load a database from disk: the tables are mapped read-only (Linux) so that
+ * pages are shared between processes, the offsets are checked so that no
+ * query can read out of the runs, then the region checksums are compared
+ * against the current map
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+loadFrom(std::string const & path)
+{
+	Header header;
+	size_t tablesLength(0);
+	uint8_t const * tables(nullptr);
+
+	unmap();
+
+#if defined(__gnu_linux__)
+	struct stat status;
+	int fd(open(path.c_str(), O_RDONLY));
+
+	if(fd == -1)
+		throw Exception("Couldn't open " + path + ".");
+
+	if(fstat(fd, &status) == -1 || size_t(status.st_size) < sizeof(header))
+	{
+		close(fd);
+		throw Exception("Couldn't load " + path + ": truncated file.");
+	}
+
+	_mappingLength = status.st_size;
+	_mapping = mmap(nullptr, _mappingLength, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(_mapping == MAP_FAILED)
+	{
+		_mapping = nullptr;
+		throw Exception("Couldn't map " + path + ".");
+	}
+
+	memcpy(&header, _mapping, sizeof(header));
+	tables = (uint8_t const *)(_mapping) + sizeof(header);
+	tablesLength = _mappingLength - sizeof(header);
+#else
+	std::vector<uint8_t> content;
+	std::ifstream file(path, std::ios_base::binary);
+
+	if(!file.is_open())
+		throw Exception("Couldn't open " + path + ".");
+
+	content.assign(std::istreambuf_iterator<char>(file),
+			std::istreambuf_iterator<char>());
+
+	if(content.size() < sizeof(header))
+		throw Exception("Couldn't load " + path + ": truncated file.");
+
+	memcpy(&header, content.data(), sizeof(header));
+	tables = content.data() + sizeof(header);
+	tablesLength = content.size() - sizeof(header);
+#endif
+
+	uint64_t const cells(uint64_t(header._width) * header._height);
+	uint64_t const regions(header._regionSize == 0 ? 0
+		: ((uint64_t(header._width) + header._regionSize - 1)
+			/ header._regionSize)
+		* ((uint64_t(header._height) + header._regionSize - 1)
+			/ header._regionSize));
+
+	/* Sizes are bounded before being summed so that nothing wraps */
+	if(memcmp(header._magic, "MCPD", 4) != 0 || header._format != 1
+		|| header._width != _map.width()
+		|| header._height != _map.height()
+		|| cells > MAX_CELLS
+		|| header._regionSize == 0
+		|| header._regionCount != regions
+		|| header._runCount > UINT32_MAX
+		|| tablesLength != (header._regionCount + cells + 1
+			+ header._runCount) * sizeof(uint32_t))
+	{
+		unmap();
+		throw Exception("Couldn't load " + path + ": incorrect header or corrupted data.");
+	}
+
+	/* Offsets must go from 0 to the run count without ever decreasing */
+	uint32_t const * offsets((uint32_t const *)(tables
+			+ header._regionCount * sizeof(uint32_t)));
+
+	bool consistent(offsets[0] == 0 && offsets[cells] == header._runCount);
+
+	for(uint64_t c = 0 ; consistent && c < cells ; ++c)
+		consistent = offsets[c] <= offsets[c + 1];
+
+	if(!consistent)
+	{
+		unmap();
+		throw Exception("Couldn't load " + path + ": corrupted offsets.");
+	}
+
+	_width = header._width;
+	_height = header._height;
+	_regionSize = header._regionSize;
+	_regionsPerRow = (_width + _regionSize - 1) / _regionSize;
+	_runCount = header._runCount;
+
+	_checksums.resize(header._regionCount);
+	memcpy(_checksums.data(), tables,
+			header._regionCount * sizeof(uint32_t));
+	tables += header._regionCount * sizeof(uint32_t);
+
+#if defined(__gnu_linux__)
+	_offsets = (uint32_t const *)(tables);
+	_runs = _offsets + cells + 1;
+#else
+	_ownedOffsets.assign((uint32_t const *)(tables),
+			(uint32_t const *)(tables) + cells + 1);
+	_ownedRuns.assign((uint32_t const *)(tables) + cells + 1,
+			(uint32_t const *)(tables) + cells + 1 + _runCount);
+	_offsets = _ownedOffsets.data();
+	_runs = _ownedRuns.data();
+#endif
+
+	_stale.assign(_checksums.size(), false);
+	refresh();
+}
+
+/*
+ * Release the tables
+ */
+template <typename Map>
+void
+CompressedPathDatabase<Map>::
+unmap()
+{
+#if defined(__gnu_linux__)
+	if(_mapping)
+		munmap(_mapping, _mappingLength);
+#endif
+
+	_mapping = nullptr;
+	_mappingLength = 0;
+
+	_offsets = nullptr;
+	_runs = nullptr;
+	_runCount = 0;
+
+	std::vector<uint32_t>().swap(_ownedOffsets);
+	std::vector<uint32_t>().swap(_ownedRuns);
+}
+
+}
+
+#endif // COMPRESSEDPATHDATABASE_HPP_INCLUDED
@@ -0,0 +1,1091 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent <julien.laurent@engineer.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef CONTRACTIONHIERARCHY_HPP_INCLUDED
+#define CONTRACTIONHIERARCHY_HPP_INCLUDED
+
+#include "AStar.hpp"
+#include "Exception.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+
+namespace Mach
+{
+
+/*
+ * Template parameters: <Map type, Coordinates type>
+ *
+ * Contraction Hierarchy (CH) engine for general graphs, using the same
+ * terrain, move cost and neighborhood callbacks as Mach::AStar.
+ *
+ * Preprocessing discovers the graph reachable from the given seeds, then
+ * contracts nodes by increasing importance (edge difference + contracted
+ * neighbors), adding shortcuts wherever a local witness search can't prove
+ * that a shorter path avoids the contracted node. Each round contracts an
+ * independent set of nodes in parallel.
+ * Queries run a bidirectional Dijkstra search restricted to upward edges,
+ * which only settles a tiny fraction of the graph, then unpack the shortcuts
+ * of the resulting path.
+ *
+ * The distance callback isn't used (CH queries need no heuristic) but is kept
+ * in the constructor for symmetry with Mach::AStar.
+ */
+template
+<typename Map, typename Coord>
+class ContractionHierarchy
+{
+	public:
+		typedef typename AStar<Map, Coord>::distanceFunction distanceFunction;
+		typedef typename AStar<Map, Coord>::moveCostFunction moveCostFunction;
+		typedef typename AStar<Map, Coord>::terrainCostFunction terrainCostFunction;
+		typedef typename AStar<Map, Coord>::nearFunction nearFunction;
+
+		/* Coordinates serialization callbacks */
+		typedef void (*coordWriter) (std::ostream &, Coord const &);
+		typedef Coord (*coordReader) (std::istream &);
+
+	protected:
+		/* "No node" marker (also used for original, unpacked, arcs) */
+		static uint32_t const NONE = 0xFFFFFFFF;
+
+		/* Witness searches give up after settling that many nodes
+		 * (fewer when only estimating a node's priority, a missed
+		 * witness then merely making it look less attractive) */
+		static unsigned const WITNESS_LIMIT = 500;
+		static unsigned const ESTIMATE_LIMIT = 5;
+
+		/* Arc of the dynamic graph used while contracting (cost first,
+		 * so that it packs into 16 bytes) */
+		struct Arc
+		{
+			unsigned long _cost;
+			uint32_t _node;
+			uint32_t _middle;
+		};
+
+		/* Arc of the final (upward) search graphs */
+		struct Edge
+		{
+			uint32_t _node;
+			uint32_t _cost;
+			uint32_t _middle;
+		};
+
+		/* Shortcut candidate produced by a contraction */
+		struct Shortcut
+		{
+			uint32_t _from;
+			uint32_t _to;
+			unsigned long _cost;
+		};
+
+		typedef std::pair<unsigned long, uint32_t> QueueEntry;
+		typedef std::pair<long, uint32_t> PriorityKey;
+		typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+			std::greater<QueueEntry> > Queue;
+
+		/* Dijkstra workspace with lazy reset, along with the witness
+		 * searches' heap & target marks (kept across searches so that
+		 * they allocate nothing once warmed up) */
+		struct Workspace
+		{
+			std::vector<unsigned long> _cost;
+			std::vector<uint32_t> _parent;
+			std::vector<uint32_t> _middle;
+			std::vector<uint32_t> _touched;
+			std::vector<QueueEntry> _open;
+			std::vector<char> _target;
+
+			void resize(size_t n)
+			{
+				_cost.assign(n, ~0ul);
+				_parent.assign(n, NONE);
+				_middle.assign(n, NONE);
+				_target.assign(n, 0);
+			}
+
+			void visit(uint32_t node, unsigned long cost)
+			{
+				if(_cost[node] == ~0ul)
+					_touched.push_back(node);
+
+				_cost[node] = cost;
+			}
+
+			void reach(uint32_t node, unsigned long cost,
+					uint32_t parent, uint32_t middle)
+			{
+				if(_cost[node] == ~0ul)
+					_touched.push_back(node);
+
+				_cost[node] = cost;
+				_parent[node] = parent;
+				_middle[node] = middle;
+			}
+
+			void reset()
+			{
+				for(uint32_t node : _touched)
+				{
+					_cost[node] = ~0ul;
+					_parent[node] = NONE;
+					_middle[node] = NONE;
+				}
+
+				_touched.clear();
+			}
+		};
+
+		/* External environment data */
+		Map const & _map;
+
+		distanceFunction _distance;
+		moveCostFunction _moveCost;
+		terrainCostFunction _terrainCost;
+		nearFunction _near;
+
+		/* Nodes, ordered by rank */
+		std::vector<Coord> _coords;
+		std::map<Coord, uint32_t> _ids;
+
+		/* Upward search graphs (CSR): forward arcs go from a node to
+		 * higher ranked ones, backward arcs hold the higher ranked
+		 * sources of the arcs leading to a node */
+		std::vector<uint32_t> _forwardFirst;
+		std::vector<Edge> _forwardEdges;
+		std::vector<uint32_t> _backwardFirst;
+		std::vector<Edge> _backwardEdges;
+
+		/* Contraction-time data */
+		std::vector< std::vector<Arc> > _out;
+		std::vector< std::vector<Arc> > _in;
+		std::vector<char> _contracted;
+		std::vector<char> _selected;
+		std::vector<long> _deleted;
+
+		/* Query workspaces */
+		Workspace _forward;
+		Workspace _backward;
+
+		/* Statistics */
+		unsigned long _shortcuts;
+		unsigned long _settled;
+
+		/* Preprocessing methods */
+		void discover(std::vector<Coord> const & seeds);
+		static void addArc(std::vector<Arc> & arcs, uint32_t node,
+				unsigned long cost, uint32_t middle);
+		unsigned long contract(uint32_t node, Workspace & workspace,
+				std::vector<Shortcut> * shortcuts) const;
+		void contractRange(std::vector<uint32_t> const & nodes,
+				size_t first, size_t step, Workspace & workspace,
+				std::vector< std::vector<Shortcut> > & shortcuts,
+				std::vector<long> * priorities) const;
+		void finalize(std::vector<uint32_t> const & order,
+				std::vector< std::vector<Arc> > const & up,
+				std::vector< std::vector<Arc> > const & down);
+
+		/* Query methods */
+		Edge const * findEdge(uint32_t from, uint32_t to) const;
+		void unpack(uint32_t from, uint32_t to, uint32_t middle,
+				std::vector<Coord> & path) const;
+		uint32_t search(uint32_t source, uint32_t target,
+				unsigned long & cost);
+
+	public:
+		/* Constructor & destructor */
+		ContractionHierarchy
+		(
+			Map const & m,
+			distanceFunction distance,
+			moveCostFunction moveCost,
+			terrainCostFunction terrainCost,
+			nearFunction near
+		)
+		:
+			_map(m),
+			_distance(distance),
+			_moveCost(moveCost),
+			_terrainCost(terrainCost),
+			_near(near),
+			_shortcuts(0),
+			_settled(0)
+		{}
+
+		virtual ~ContractionHierarchy()
+		{}
+
+		/* Copy & assignation are forbidden */
+		ContractionHierarchy(ContractionHierarchy const &) = delete;
+		ContractionHierarchy & operator = (ContractionHierarchy const &) = delete;
+
+		/* Preprocess the graph reachable from the given seeds (0 threads
+		 * means one per hardware thread) */
+		void build(std::vector<Coord> const & seeds, unsigned threads = 0);
+
+		/* File persistence */
+		void saveTo(std::string const & path, coordWriter write) const;
+		void loadFrom(std::string const & path, coordReader read);
+
+		/* Main interface (empty path / ~0ul cost when unreachable) */
+		std::vector<Coord> path(Coord const & src, Coord const & dst);
+		unsigned long cost(Coord const & src, Coord const & dst);
+
+		/* Various getters */
+		size_t nodes() const
+		{
+			return _coords.size();
+		}
+		unsigned long shortcuts() const
+		{
+			return _shortcuts;
+		}
+		unsigned long settled() const
+		{
+			return _settled;
+		}
+};
+
+/* Static constants definitions */
+template <typename Map, typename Coord>
+uint32_t const ContractionHierarchy<Map, Coord>::NONE;
+
+template <typename Map, typename Coord>
+unsigned const ContractionHierarchy<Map, Coord>::WITNESS_LIMIT;
+
+template <typename Map, typename Coord>
+unsigned const ContractionHierarchy<Map, Coord>::ESTIMATE_LIMIT;
+
+/*
+ * Full preprocessing: graph discovery, then contraction rounds until every
+ * node has been ranked
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+build(std::vector<Coord> const & seeds, unsigned threads)
+{
+	std::vector<uint32_t> order, remaining, selection;
+	std::vector<long> priorities;
+	std::vector< std::vector<Shortcut> > shortcuts;
+	std::vector< std::vector<Arc> > up, down;
+	std::vector<char> dirty;
+	std::vector<Workspace> workspaces;
+
+	if(threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	discover(seeds);
+
+	size_t const n(_coords.size());
+
+	/* One witness search workspace per thread for the whole build, reset
+	 * lazily after each search */
+	workspaces.resize(threads);
+	for(Workspace & w : workspaces)
+		w.resize(n);
+
+	_contracted.assign(n, 0);
+	_selected.assign(n, 0);
+	_deleted.assign(n, 0);
+	priorities.assign(n, 0);
+	dirty.assign(n, 1);
+	shortcuts.resize(n);
+	up.resize(n);
+	down.resize(n);
+	_shortcuts = 0;
+
+	for(uint32_t v = 0 ; v < n ; ++v)
+		remaining.push_back(v);
+
+	while(!remaining.empty())
+	{
+		std::vector<std::thread> workers;
+		std::vector<uint32_t> updates;
+
+		/* Refresh the priorities that may have changed */
+		for(uint32_t v : remaining)
+			if(dirty[v])
+				updates.push_back(v);
+
+		for(unsigned t = 1 ; t < threads ; ++t)
+			workers.push_back(std::thread(
+				&ContractionHierarchy<Map, Coord>::contractRange,
+				this, std::cref(updates), t, threads,
+				std::ref(workspaces[t]), std::ref(shortcuts),
+				&priorities));
+
+		contractRange(updates, 0, threads, workspaces[0], shortcuts,
+				&priorities);
+
+		for(std::thread & w : workers)
+			w.join();
+		workers.clear();
+
+		for(uint32_t v : updates)
+			dirty[v] = 0;
+
+		/* Independent set: nodes less important than all of their
+		 * remaining neighbors */
+		selection.clear();
+
+		for(uint32_t v : remaining)
+		{
+			bool minimal(true);
+			PriorityKey const key(priorities[v], v);
+
+			for(Arc const & a : _out[v])
+				if(PriorityKey(priorities[a._node], a._node) < key)
+					minimal = false;
+
+			for(Arc const & a : _in[v])
+				if(PriorityKey(priorities[a._node], a._node) < key)
+					minimal = false;
+
+			if(minimal)
+			{
+				selection.push_back(v);
+				_selected[v] = 1;
+			}
+		}
+
+		/* Simulate the contractions in parallel (read-only) */
+		for(unsigned t = 1 ; t < threads ; ++t)
+			workers.push_back(std::thread(
+				&ContractionHierarchy<Map, Coord>::contractRange,
+				this, std::cref(selection), t, threads,
+				std::ref(workspaces[t]), std::ref(shortcuts),
+				nullptr));
+
+		contractRange(selection, 0, threads, workspaces[0], shortcuts,
+				nullptr);
+
+		for(std::thread & w : workers)
+			w.join();
+
+		/* Then apply them */
+		for(uint32_t v : selection)
+		{
+			order.push_back(v);
+			up[v] = _out[v];
+			down[v] = _in[v];
+
+			for(Arc const & a : _out[v])
+			{
+				std::vector<Arc> & arcs(_in[a._node]);
+
+				for(size_t i = 0 ; i < arcs.size() ; )
+				{
+					if(arcs[i]._node == v)
+					{
+						arcs[i] = arcs.back();
+						arcs.pop_back();
+					}
+					else
+						++i;
+				}
+
+				dirty[a._node] = 1;
+				++_deleted[a._node];
+			}
+
+			for(Arc const & a : _in[v])
+			{
+				std::vector<Arc> & arcs(_out[a._node]);
+
+				for(size_t i = 0 ; i < arcs.size() ; )
+				{
+					if(arcs[i]._node == v)
+					{
+						arcs[i] = arcs.back();
+						arcs.pop_back();
+					}
+					else
+						++i;
+				}
+
+				dirty[a._node] = 1;
+				++_deleted[a._node];
+			}
+
+			for(Shortcut const & s : shortcuts[v])
+			{
+				addArc(_out[s._from], s._to, s._cost, v);
+				addArc(_in[s._to], s._from, s._cost, v);
+			}
+
+			_shortcuts += shortcuts[v].size();
+
+			std::vector<Arc>().swap(_out[v]);
+			std::vector<Arc>().swap(_in[v]);
+			std::vector<Shortcut>().swap(shortcuts[v]);
+
+			_contracted[v] = 1;
+			_selected[v] = 0;
+		}
+
+		/* Keep the remaining nodes only */
+		size_t kept(0);
+		for(uint32_t v : remaining)
+			if(!_contracted[v])
+				remaining[kept++] = v;
+		remaining.resize(kept);
+	}
+
+	finalize(order, up, down);
+
+	std::vector< std::vector<Arc> >().swap(_out);
+	std::vector< std::vector<Arc> >().swap(_in);
+	std::vector<char>().swap(_contracted);
+	std::vector<char>().swap(_selected);
+	std::vector<long>().swap(_deleted);
+}
+
+/*
+ * Flood the graph from the seeds, numbering nodes on the way
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+discover(std::vector<Coord> const & seeds)
+{
+	std::vector<Coord> neighbors;
+
+	_coords.clear();
+	_ids.clear();
+	_out.clear();
+	_in.clear();
+
+	for(Coord const & seed : seeds)
+	{
+		if((*_terrainCost)(_map, seed) == 0
+			|| _ids.find(seed) != _ids.end())
+			continue;
+
+		_ids.insert(std::make_pair(seed, uint32_t(_coords.size())));
+		_coords.push_back(seed);
+	}
+
+	/* _coords doubles as the BFS queue */
+	for(size_t current = 0 ; current < _coords.size() ; ++current)
+	{
+		Coord const position(_coords[current]);
+
+		neighbors = (*_near)(position);
+
+		if(_out.size() < _coords.size())
+		{
+			_out.resize(_coords.size());
+			_in.resize(_coords.size());
+		}
+
+		for(Coord const & neighbor : neighbors)
+		{
+			if((*_terrainCost)(_map, neighbor) == 0)
+				continue;
+
+			auto found = _ids.find(neighbor);
+
+			if(found == _ids.end())
+			{
+				if(_coords.size() == NONE)
+					throw Exception("ContractionHierarchy: graph is too large.");
+
+				found = _ids.insert(std::make_pair(neighbor,
+					uint32_t(_coords.size()))).first;
+				_coords.push_back(neighbor);
+				_out.resize(_coords.size());
+				_in.resize(_coords.size());
+			}
+
+			unsigned long const cost((*_moveCost)(position, neighbor));
+
+			addArc(_out[current], found->second, cost, NONE);
+			addArc(_in[found->second], uint32_t(current), cost, NONE);
+		}
+	}
+
+	_out.resize(_coords.size());
+	_in.resize(_coords.size());
+}
+
+/*
+ * Add an arc, or lower the cost of the existing one
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+addArc(std::vector<Arc> & arcs, uint32_t node, unsigned long cost,
+		uint32_t middle)
+{
+	for(Arc & a : arcs)
+	{
+		if(a._node == node)
+		{
+			if(cost < a._cost)
+			{
+				a._cost = cost;
+				a._middle = middle;
+			}
+
+			return;
+		}
+	}
+
+	Arc const a = { cost, node, middle };
+	arcs.push_back(a);
+}
+
+/*
+ * Simulate the contraction of a node: returns the number of required
+ * shortcuts, and lists them if asked to.
+ * Witness searches avoid the node itself and every node selected for the
+ * current round, since those are contracted simultaneously.
+ */
+template <typename Map, typename Coord>
+unsigned long
+ContractionHierarchy<Map, Coord>::
+contract(uint32_t node, Workspace & workspace,
+		std::vector<Shortcut> * shortcuts) const
+{
+	std::greater<QueueEntry> const later;
+	std::vector<QueueEntry> & open(workspace._open);
+	unsigned const witnessLimit(shortcuts ? WITNESS_LIMIT : ESTIMATE_LIMIT);
+	unsigned long count(0), maxOut(0);
+
+	for(Arc const & a : _out[node])
+		maxOut = std::max(maxOut, a._cost);
+
+	for(Arc const & in : _in[node])
+	{
+		unsigned long const limit(in._cost + maxOut);
+		unsigned settled(0);
+		size_t targets(0);
+
+		/* The search may stop once every out-neighbor is settled */
+		for(Arc const & out : _out[node])
+			if(out._node != in._node && !workspace._target[out._node])
+			{
+				workspace._target[out._node] = 1;
+				++targets;
+			}
+
+		open.clear();
+		workspace.visit(in._node, 0);
+		open.push_back(QueueEntry(0, in._node));
+
+		/* Bounded local search from the in-neighbor */
+		while(!open.empty() && targets > 0 && settled < witnessLimit)
+		{
+			QueueEntry const current(open.front());
+			std::pop_heap(open.begin(), open.end(), later);
+			open.pop_back();
+
+			if(current.first > workspace._cost[current.second])
+				continue;
+			if(current.first > limit)
+				break;
+
+			++settled;
+
+			if(workspace._target[current.second])
+				--targets;
+
+			for(Arc const & a : _out[current.second])
+			{
+				if(a._node == node || _selected[a._node])
+					continue;
+
+				unsigned long const cost(current.first + a._cost);
+
+				if(cost < workspace._cost[a._node])
+				{
+					workspace.visit(a._node, cost);
+					open.push_back(QueueEntry(cost, a._node));
+					std::push_heap(open.begin(), open.end(),
+							later);
+				}
+			}
+		}
+
+		/* A shortcut is needed wherever no witness was found */
+		for(Arc const & out : _out[node])
+		{
+			workspace._target[out._node] = 0;
+
+			if(out._node == in._node)
+				continue;
+
+			if(workspace._cost[out._node] > in._cost + out._cost)
+			{
+				++count;
+
+				if(shortcuts)
+				{
+					Shortcut const s = { in._node, out._node,
+						in._cost + out._cost };
+					shortcuts->push_back(s);
+				}
+			}
+		}
+
+		workspace.reset();
+	}
+
+	return count;
+}
+
+/*
+ * Worker body: contract nodes [first, +step, ...) of the given list, either
+ * to refresh their priorities or to collect their shortcuts, using the
+ * calling thread's workspace
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+contractRange(std::vector<uint32_t> const & nodes, size_t first, size_t step,
+		Workspace & workspace,
+		std::vector< std::vector<Shortcut> > & shortcuts,
+		std::vector<long> * priorities) const
+{
+	for(size_t i = first ; i < nodes.size() ; i += step)
+	{
+		uint32_t const v(nodes[i]);
+
+		if(priorities)
+		{
+			/* Edge difference plus contracted neighbors */
+			long const added(contract(v, workspace, nullptr));
+			long const removed(_in[v].size() + _out[v].size());
+
+			(*priorities)[v] = 2 * (added - removed) + _deleted[v];
+		}
+		else
+			contract(v, workspace, &shortcuts[v]);
+	}
+}
+
+/*
+ * Renumber nodes by rank and build the upward CSR search graphs
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+finalize(std::vector<uint32_t> const & order,
+		std::vector< std::vector<Arc> > const & up,
+		std::vector< std::vector<Arc> > const & down)
+{
+	size_t const n(order.size());
+	std::vector<uint32_t> rank(n);
+	std::vector<Coord> coords;
+
+	for(uint32_t r = 0 ; r < n ; ++r)
+		rank[order[r]] = r;
+
+	_forwardFirst.assign(1, 0);
+	_backwardFirst.assign(1, 0);
+	_forwardEdges.clear();
+	_backwardEdges.clear();
+
+	for(uint32_t r = 0 ; r < n ; ++r)
+	{
+		uint32_t const v(order[r]);
+
+		coords.push_back(_coords[v]);
+
+		for(Arc const & a : up[v])
+		{
+			if(a._cost >= NONE)
+				throw Exception("ContractionHierarchy: cost overflow.");
+
+			Edge const e = { rank[a._node], uint32_t(a._cost),
+				a._middle == NONE ? NONE : rank[a._middle] };
+			_forwardEdges.push_back(e);
+		}
+
+		for(Arc const & a : down[v])
+		{
+			if(a._cost >= NONE)
+				throw Exception("ContractionHierarchy: cost overflow.");
+
+			Edge const e = { rank[a._node], uint32_t(a._cost),
+				a._middle == NONE ? NONE : rank[a._middle] };
+			_backwardEdges.push_back(e);
+		}
+
+		_forwardFirst.push_back(uint32_t(_forwardEdges.size()));
+		_backwardFirst.push_back(uint32_t(_backwardEdges.size()));
+	}
+
+	_coords.swap(coords);
+	_ids.clear();
+
+	for(uint32_t r = 0 ; r < n ; ++r)
+		_ids.insert(std::make_pair(_coords[r], r));
+
+	_forward.resize(n);
+	_backward.resize(n);
+}
+
+/*
+ * Bidirectional upward search, returns the meeting node (or NONE)
+ */
+template <typename Map, typename Coord>
+uint32_t
+ContractionHierarchy<Map, Coord>::
+search(uint32_t source, uint32_t target, unsigned long & cost)
+{
+	Queue forwardOpen, backwardOpen;
+	uint32_t meeting(NONE);
+
+	cost = ~0ul;
+
+	_forward.reach(source, 0, NONE, NONE);
+	_backward.reach(target, 0, NONE, NONE);
+	forwardOpen.push(QueueEntry(0, source));
+	backwardOpen.push(QueueEntry(0, target));
+
+	while(!forwardOpen.empty() || !backwardOpen.empty())
+	{
+		bool const forward(backwardOpen.empty()
+			|| (!forwardOpen.empty()
+			&& forwardOpen.top().first <= backwardOpen.top().first));
+
+		Queue & open(forward ? forwardOpen : backwardOpen);
+		Workspace & mine(forward ? _forward : _backward);
+		Workspace & other(forward ? _backward : _forward);
+		std::vector<uint32_t> const & first(forward ?
+			_forwardFirst : _backwardFirst);
+		std::vector<Edge> const & edges(forward ?
+			_forwardEdges : _backwardEdges);
+
+		QueueEntry const current(open.top());
+		open.pop();
+
+		/* Nothing better can be found on this side */
+		if(current.first >= cost)
+		{
+			Queue().swap(open);
+			continue;
+		}
+
+		if(current.first > mine._cost[current.second])
+			continue;
+
+		++_settled;
+
+		if(other._cost[current.second] != ~0ul
+			&& current.first + other._cost[current.second] < cost)
+		{
+			cost = current.first + other._cost[current.second];
+			meeting = current.second;
+		}
+
+		for(uint32_t i = first[current.second] ;
+			i < first[current.second + 1] ; ++i)
+		{
+			Edge const & e(edges[i]);
+			unsigned long const newCost(current.first + e._cost);
+
+			if(newCost < mine._cost[e._node])
+			{
+				mine.reach(e._node, newCost, current.second,
+						e._middle);
+				open.push(QueueEntry(newCost, e._node));
+			}
+		}
+	}
+
+	return meeting;
+}
+
+/*
+ * Find the arc from -> to in the upward graphs
+ */
+template <typename Map, typename Coord>
+typename ContractionHierarchy<Map, Coord>::Edge const *
+ContractionHierarchy<Map, Coord>::
+findEdge(uint32_t from, uint32_t to) const
+{
+	/* Lower ranked node owns the arc */
+	if(from < to)
+	{
+		for(uint32_t i = _forwardFirst[from] ; i < _forwardFirst[from + 1] ; ++i)
+			if(_forwardEdges[i]._node == to)
+				return &_forwardEdges[i];
+	}
+	else
+	{
+		for(uint32_t i = _backwardFirst[to] ; i < _backwardFirst[to + 1] ; ++i)
+			if(_backwardEdges[i]._node == from)
+				return &_backwardEdges[i];
+	}
+
+	return nullptr;
+}
+
+/*
+ * Recursively expand the arc from -> to, appending every node but "from"
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+unpack(uint32_t from, uint32_t to, uint32_t middle,
+		std::vector<Coord> & path) const
+{
+	if(middle == NONE)
+	{
+		path.push_back(_coords[to]);
+		return;
+	}
+
+	Edge const * first(findEdge(from, middle));
+	Edge const * second(findEdge(middle, to));
+
+	if(first == nullptr || second == nullptr)
+		throw Exception("ContractionHierarchy: corrupted shortcut.");
+
+	unpack(from, middle, first->_middle, path);
+	unpack(middle, to, second->_middle, path);
+}
+
+/*
+ * Shortest path between two nodes of the hierarchy
+ */
+template <typename Map, typename Coord>
+std::vector<Coord>
+ContractionHierarchy<Map, Coord>::
+path(Coord const & src, Coord const & dst)
+{
+	std::vector<Coord> result;
+	std::vector<uint32_t> chain;
+	unsigned long total(0);
+
+	auto const & source = _ids.find(src);
+	auto const & target = _ids.find(dst);
+
+	if(source == _ids.end() || target == _ids.end())
+		return result;
+
+	uint32_t const meeting(search(source->second, target->second, total));
+
+	if(meeting != NONE)
+	{
+		/* Source -> meeting node (walked backwards) */
+		for(uint32_t v = meeting ; v != NONE ; v = _forward._parent[v])
+			chain.push_back(v);
+
+		std::reverse(chain.begin(), chain.end());
+
+		result.push_back(_coords[chain.front()]);
+
+		for(size_t i = 1 ; i < chain.size() ; ++i)
+			unpack(chain[i - 1], chain[i],
+				_forward._middle[chain[i]], result);
+
+		/* Meeting node -> target */
+		for(uint32_t v = meeting ; _backward._parent[v] != NONE ;
+				v = _backward._parent[v])
+			unpack(v, _backward._parent[v],
+				_backward._middle[v], result);
+	}
+
+	_forward.reset();
+	_backward.reset();
+
+	return result;
+}
+
+/*
+ * Shortest path cost between two nodes of the hierarchy
+ */
+template <typename Map, typename Coord>
+unsigned long
+ContractionHierarchy<Map, Coord>::
+cost(Coord const & src, Coord const & dst)
+{
+	unsigned long total(~0ul);
+
+	auto const & source = _ids.find(src);
+	auto const & target = _ids.find(dst);
+
+	if(source != _ids.end() && target != _ids.end())
+		search(source->second, target->second, total);
+
+	_forward.reset();
+	_backward.reset();
+
+	return total;
+}
+
+/*
+ * Save the hierarchy on disk (coordinates are written by the given callback)
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+saveTo(std::string const & path, coordWriter write) const
+{
+	uint32_t header[4] = { 0x3148434D, /* "MCH1" */
+		uint32_t(_coords.size()),
+		uint32_t(_forwardEdges.size()),
+		uint32_t(_backwardEdges.size()) };
+
+	/* Never built nor loaded: there is no graph to write */
+	if(_forwardFirst.empty())
+		throw Exception("Couldn't save hierarchy to " + path + ": nothing built nor loaded.");
+
+	std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+
+	if(!file.is_open())
+		throw Exception("Couldn't save hierarchy to " + path + ".");
+
+	file.write((char *)(header), sizeof(header));
+	file.write((char *)(_forwardFirst.data()),
+			_forwardFirst.size() * sizeof(uint32_t));
+	file.write((char *)(_forwardEdges.data()),
+			_forwardEdges.size() * sizeof(Edge));
+	file.write((char *)(_backwardFirst.data()),
+			_backwardFirst.size() * sizeof(uint32_t));
+	file.write((char *)(_backwardEdges.data()),
+			_backwardEdges.size() * sizeof(Edge));
+
+	for(Coord const & c : _coords)
+		(*write)(file, c);
+
+	file.close();
+}
+
+/*
+ * Load a hierarchy from disk (coordinates are read by the given callback).
+ * The header counts are checked against the file size before anything is
+ * allocated, and the graphs are checked before being used, so that a
+ * corrupted file can't make queries read out of bounds.
+ */
+template <typename Map, typename Coord>
+void
+ContractionHierarchy<Map, Coord>::
+loadFrom(std::string const & path, coordReader read)
+{
+	uint32_t header[4] = { 0, 0, 0, 0 };
+	std::vector<uint32_t> forwardFirst, backwardFirst;
+	std::vector<Edge> forwardEdges, backwardEdges;
+	std::vector<Coord> coords;
+	std::map<Coord, uint32_t> ids;
+	std::ifstream file(path, std::ios_base::binary);
+
+	if(!file.is_open())
+		throw Exception("Couldn't open " + path + ".");
+
+	file.seekg(0, std::ios_base::end);
+	uint64_t const length(file.tellg());
+	file.seekg(0, std::ios_base::beg);
+
+	file.read((char *)(header), sizeof(header));
+
+	uint64_t const n(header[1]);
+
+	/* Fixed-size part (the coordinates follow) */
+	if(!file || header[0] != 0x3148434D || n >= NONE
+		|| length < sizeof(header) + 2 * (n + 1) * sizeof(uint32_t)
+			+ (uint64_t(header[2]) + header[3]) * sizeof(Edge))
+		throw Exception("Couldn't load " + path + ": incorrect header.");
+
+	forwardFirst.resize(n + 1);
+	forwardEdges.resize(header[2]);
+	backwardFirst.resize(n + 1);
+	backwardEdges.resize(header[3]);
+
+	file.read((char *)(forwardFirst.data()),
+			forwardFirst.size() * sizeof(uint32_t));
+	file.read((char *)(forwardEdges.data()),
+			forwardEdges.size() * sizeof(Edge));
+	file.read((char *)(backwardFirst.data()),
+			backwardFirst.size() * sizeof(uint32_t));
+	file.read((char *)(backwardEdges.data()),
+			backwardEdges.size() * sizeof(Edge));
+
+	/* Offsets must cover the edges in order, and every arc must lead
+	 * upwards, through a lower ranked middle node (which bounds the
+	 * unpacking recursion) */
+	bool consistent(file);
+
+	for(int side = 0 ; consistent && side < 2 ; ++side)
+	{
+		std::vector<uint32_t> const & first(side ? backwardFirst
+				: forwardFirst);
+		std::vector<Edge> const & edges(side ? backwardEdges
+				: forwardEdges);
+
+		consistent = first[0] == 0 && first[n] == edges.size();
+
+		for(uint32_t r = 0 ; consistent && r < n ; ++r)
+		{
+			consistent = first[r] <= first[r + 1]
+				&& first[r + 1] <= edges.size();
+
+			for(uint32_t i = first[r] ; consistent
+					&& i < first[r + 1] ; ++i)
+				consistent = edges[i]._node > r
+					&& edges[i]._node < n
+					&& (edges[i]._middle == NONE
+					|| edges[i]._middle < r);
+		}
+	}
+
+	if(!consistent)
+		throw Exception("Couldn't load " + path + ": corrupted graph.");
+
+	for(uint32_t r = 0 ; r < n && file ; ++r)
+	{
+		coords.push_back((*read)(file));
+		ids.insert(std::make_pair(coords.back(), r));
+	}
+
+	if(!file)
+		throw Exception("Couldn't load " + path + ": corrupted data.");
+
+	_forwardFirst.swap(forwardFirst);
+	_forwardEdges.swap(forwardEdges);
+	_backwardFirst.swap(backwardFirst);
+	_backwardEdges.swap(backwardEdges);
+	_coords.swap(coords);
+	_ids.swap(ids);
+
+	_forward.resize(_coords.size());
+	_backward.resize(_coords.size());
+}
+
+}
+
+#endif // CONTRACTIONHIERARCHY_HPP_INCLUDED
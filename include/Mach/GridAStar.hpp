@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent <julien.laurent@engineer.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef GRIDASTAR_HPP_INCLUDED
+#define GRIDASTAR_HPP_INCLUDED
+
+#include "CompactAStar.hpp"
+#include "GridMap.hpp"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <vector>
+
+
+namespace Mach
+{
+
+/*
+ * Compile-time helpers enumerating the {-1, 0, +1}^N offsets of a grid cell.
+ * Candidate m in [0, 3^N) encodes one offset in base 3; its weight is the
+ * number of axes it moves along (1 for straight moves, 2 for diagonals, ...).
+ */
+struct NeighborhoodTables
+{
+	static constexpr unsigned power3(unsigned n)
+	{
+		return n == 0 ? 1 : 3 * power3(n - 1);
+	}
+
+	/* Offset of candidate m along the given axis */
+	static constexpr int component(unsigned m, unsigned axis)
+	{
+		return int((m / power3(axis)) % 3) - 1;
+	}
+
+	/* Number of axes candidate m moves along (among the first n) */
+	static constexpr unsigned weight(unsigned m, unsigned n)
+	{
+		return n == 0 ? 0 :
+			(component(m, n - 1) != 0 ? 1 : 0) + weight(m, n - 1);
+	}
+
+	/* Is candidate m a move of at most "reach" axes ? */
+	static constexpr bool valid(unsigned m, unsigned n, unsigned reach)
+	{
+		return weight(m, n) >= 1 && weight(m, n) <= reach;
+	}
+
+	/* Number of valid candidates below m */
+	static constexpr unsigned count(unsigned m, unsigned n, unsigned reach)
+	{
+		return m == 0 ? 0 :
+			count(m - 1, n, reach) + (valid(m - 1, n, reach) ? 1 : 0);
+	}
+
+	/* k-th valid candidate at or after m */
+	static constexpr unsigned candidate(unsigned k, unsigned m, unsigned n,
+			unsigned reach)
+	{
+		return valid(m, n, reach) ?
+			(k == 0 ? m : candidate(k - 1, m + 1, n, reach)) :
+			candidate(k, m + 1, n, reach);
+	}
+
+	/* Reach matching a connectivity (e.g. 2D: 4 -> 1, 8 -> 2), 0 if none */
+	static constexpr unsigned reach(unsigned n, unsigned connectivity,
+			unsigned r = 1)
+	{
+		return r > n ? 0 :
+			(count(power3(n), n, r) == connectivity ?
+			 r : reach(n, connectivity, r + 1));
+	}
+
+	/* Integer square root */
+	static constexpr unsigned long root(unsigned long v, unsigned long r = 0)
+	{
+		return (r + 1) * (r + 1) > v ? r : root(v, r + 1);
+	}
+
+	/* Cost of a move along w axes: 10 * sqrt(w) (10, 14, 17, ...) */
+	static constexpr unsigned long stepCost(unsigned w)
+	{
+		return root(100ul * w);
+	}
+};
+
+/*
+ * Template parameters: <Dimension, Connectivity>
+ *
+ * Neighborhood of a grid cell as constant expressions: 4 or 8 neighbors in
+ * 2D, 6, 18 or 26 in 3D (and any full shell in higher dimensions).
+ */
+template
+<unsigned N, unsigned Connectivity>
+struct Neighborhood
+{
+	/* Maximal number of axes a single move goes along */
+	static constexpr unsigned reach = NeighborhoodTables::reach(N, Connectivity);
+
+	static_assert(reach != 0, "Unsupported connectivity for this dimension");
+
+	/* Number of neighbors */
+	static constexpr unsigned size = Connectivity;
+
+	/* Offset of the k-th neighbor along the given axis */
+	static constexpr int offset(unsigned k, unsigned axis)
+	{
+		return NeighborhoodTables::component(
+			NeighborhoodTables::candidate(k, 0, N, reach), axis);
+	}
+
+	/* Cost of a move to the k-th neighbor */
+	static constexpr unsigned long cost(unsigned k)
+	{
+		return NeighborhoodTables::stepCost(NeighborhoodTables::weight(
+			NeighborhoodTables::candidate(k, 0, N, reach), N));
+	}
+};
+
+template <unsigned N, unsigned Connectivity>
+constexpr unsigned Neighborhood<N, Connectivity>::reach;
+
+template <unsigned N, unsigned Connectivity>
+constexpr unsigned Neighborhood<N, Connectivity>::size;
+
+/*
+ * Template parameters: <Dimension, Connectivity, Cell type>
+ *
+ * Grid path-finding on a Mach::GridMap, built on Mach::CompactAStar.
+ * The neighbor loop is unrolled at compile time: offsets and move costs are
+ * constant expressions, and neighbor cell indexes are found by adding
+ * precomputed deltas to the current index, with no allocation at all.
+ *
+ * The static distance/moveCost/terrainCost/near functions follow the
+ * Mach::AStar callbacks signatures, so a GridMap can also be fed to the
+ * generic algorithm.
+ */
+template
+<unsigned N, unsigned Connectivity, typename T = uint8_t>
+class GridAStar : public CompactAStar< GridMap<N, T>, GridPoint<N> >
+{
+	public:
+		typedef GridMap<N, T> Map;
+		typedef GridPoint<N> Coord;
+		typedef Neighborhood<N, Connectivity> Neighbors;
+
+	protected:
+		typedef CompactAStar<Map, Coord> Base;
+
+		/* Template recursion used to unroll the neighbor loop */
+		template <unsigned K, typename Dummy = void>
+		struct Unroll
+		{
+			template <typename F>
+			static void apply(F & f)
+			{
+				Unroll<K - 1>::apply(f);
+				f.template step<K - 1>();
+			}
+		};
+
+		template <typename Dummy>
+		struct Unroll<0, Dummy>
+		{
+			template <typename F>
+			static void apply(F &)
+			{}
+		};
+
+		/* Move of the k-th neighbor along the first d axes, offsets
+		 * being forced into compile-time constants */
+		template <unsigned k, unsigned d, typename Dummy = void>
+		struct Axes
+		{
+			static constexpr int offset = Neighbors::offset(k, d - 1);
+
+			/* Returns false if the move leaves the map */
+			static bool shift(Coord & p, Map const & m)
+			{
+				if(!Axes<k, d - 1>::shift(p, m))
+					return false;
+
+				if(offset == 0)
+					return true;
+
+				p.c[d - 1] += offset;
+
+				return p.c[d - 1] >= 0
+					&& unsigned(p.c[d - 1]) < m.size(d - 1);
+			}
+		};
+
+		template <unsigned k, typename Dummy>
+		struct Axes<k, 0, Dummy>
+		{
+			static bool shift(Coord &, Map const &)
+			{
+				return true;
+			}
+		};
+
+		/* Loop body visiting the k-th neighbor of the current node */
+		struct Expander
+		{
+			GridAStar & _search;
+			uint32_t const _current;
+			Coord const _position;
+
+			template <unsigned k>
+			void step()
+			{
+				static constexpr unsigned long cost = Neighbors::cost(k);
+
+				Coord neighbor(_position);
+
+				if(!Axes<k, N>::shift(neighbor, _search._map))
+					return;
+
+				uint32_t const index(uint32_t(
+					long(_current) + _search._deltas[k]));
+
+				/* If the node isn't walkable, skip it */
+				if(_search._map[index] == T(0))
+					return;
+
+				_search.visit(_current, index, neighbor, cost);
+			}
+		};
+
+		/* Cell index offset of every neighbor */
+		std::array<long, Connectivity> _deltas;
+
+		/* Unrolled neighbor loop */
+		virtual void expand(uint32_t current)
+		{
+			Expander e = { *this, current, this->_map.coord(current) };
+
+			Unroll<Connectivity>::apply(e);
+		}
+
+	public:
+		/* Constructor & destructor */
+		GridAStar(Map const & m, Coord const & src, Coord const & dst)
+		:
+			Base(m, src, dst, m.cells(), distance, moveCost,
+				terrainCost, near, index, coord)
+		{
+			for(unsigned k = 0 ; k < Connectivity ; ++k)
+			{
+				_deltas[k] = 0;
+
+				for(unsigned d = 0 ; d < N ; ++d)
+					_deltas[k] += long(Neighbors::offset(k, d))
+						* long(m.stride(d));
+			}
+		}
+
+		virtual ~GridAStar()
+		{}
+
+		/* Mach::AStar compatible callbacks */
+		static unsigned long distance(Coord const & a, Coord const & b);
+		static unsigned long moveCost(Coord const & a, Coord const & b);
+		static unsigned long terrainCost(Map const & m, Coord const & p)
+		{
+			return (unsigned long)(m(p));
+		}
+		static std::vector<Coord> near(Coord const & p);
+
+		/* Mach::CompactAStar index callbacks */
+		static uint32_t index(Map const & m, Coord const & p)
+		{
+			return uint32_t(m.index(p));
+		}
+		static Coord coord(Map const & m, uint32_t const i)
+		{
+			return m.coord(i);
+		}
+};
+
+/*
+ * Cheapest obstacle-free cost.
+ * Axis i has delta[i] unit steps to cover, and a single move covers up to
+ * "reach" axes at once. Since a move's cost is concave in its number of axes,
+ * the cheapest plan is the one whose move sizes are the most uneven: after k
+ * moves, at most min(k * reach, sum of min(delta[i], k)) unit steps can have
+ * been covered, and the best plan reaches that bound at every k.
+ * With deltas sorted in decreasing order, that bound is piecewise linear: while
+ * c axes have more than k steps left, it grows by c per move, and the moves
+ * are "reach" axes wide for as long as the per-axis bound stays ahead (the
+ * slack), then c axes wide.
+ */
+template <unsigned N, unsigned Connectivity, typename T>
+unsigned long
+GridAStar<N, Connectivity, T>::
+distance(Coord const & a, Coord const & b)
+{
+	unsigned long const reach(Neighbors::reach);
+	unsigned long const wide(NeighborhoodTables::stepCost(Neighbors::reach));
+	std::array<unsigned long, N + 1> delta;
+	unsigned long h(0), slack(0);
+	bool limited(true);
+
+	for(unsigned d = 0 ; d < N ; ++d)
+		delta[d] = (unsigned long)(a.c[d] > b.c[d] ?
+				a.c[d] - b.c[d] : b.c[d] - a.c[d]);
+
+	std::sort(delta.begin(), delta.begin() + N,
+			std::greater<unsigned long>());
+	delta[N] = 0;
+
+	/* Moves during which c axes are still moving (c = 0 once every
+	 * axis is done, only the slack being left to cover) */
+	for(unsigned long c = N + 1 ; c-- > 0 ; )
+	{
+		unsigned long moves(c == 0 ? ~0ul : delta[c - 1] - delta[c]);
+
+		if(!limited)
+		{
+			h += moves * NeighborhoodTables::stepCost(unsigned(c));
+			continue;
+		}
+
+		if(c >= reach)
+		{
+			h += moves * wide;
+			slack += moves * (c - reach);
+			continue;
+		}
+
+		/* Full-width moves while the slack lasts */
+		unsigned long const full(std::min(moves,
+					slack / (reach - c)));
+
+		h += full * wide;
+		slack -= full * (reach - c);
+
+		if(full == moves)
+			continue;
+
+		/* Then one narrower move, and c-wide ones */
+		h += NeighborhoodTables::stepCost(unsigned(slack + c));
+		if(c > 0)
+			h += (moves - full - 1)
+				* NeighborhoodTables::stepCost(unsigned(c));
+
+		limited = false;
+	}
+
+	return h;
+}
+
+/*
+ * Cost of a move between two neighbors
+ */
+template <unsigned N, unsigned Connectivity, typename T>
+unsigned long
+GridAStar<N, Connectivity, T>::
+moveCost(Coord const & a, Coord const & b)
+{
+	unsigned w(0);
+
+	for(unsigned d = 0 ; d < N ; ++d)
+		if(a.c[d] != b.c[d])
+			++w;
+
+	return NeighborhoodTables::stepCost(w);
+}
+
+/*
+ * Neighborhood solver (generic, allocating version)
+ */
+template <unsigned N, unsigned Connectivity, typename T>
+std::vector<typename GridAStar<N, Connectivity, T>::Coord>
+GridAStar<N, Connectivity, T>::
+near(Coord const & p)
+{
+	std::vector<Coord> v(Connectivity, p);
+
+	for(unsigned k = 0 ; k < Connectivity ; ++k)
+		for(unsigned d = 0 ; d < N ; ++d)
+			v[k].c[d] += Neighbors::offset(k, d);
+
+	return v;
+}
+
+}
+
+#endif // GRIDASTAR_HPP_INCLUDED
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent <julien.laurent@engineer.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef GRIDMAP_HPP_INCLUDED
+#define GRIDMAP_HPP_INCLUDED
+
+#include <array>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace Mach
+{
+
+/*
+ * Template parameters: <Dimension>
+ *
+ * Point of an N-dimensional integer grid, usable as an ordered container's
+ * key (lexicographic order, last axis first like Mach::Point).
+ */
+template
+<unsigned N>
+class GridPoint
+{
+	public:
+		/* Coordinates */
+		std::array<int, N> c;
+
+		/* Constructors */
+		GridPoint()
+		{
+			c.fill(0);
+		}
+
+		GridPoint(std::array<int, N> const & coordinates) : c(coordinates)
+		{}
+
+		template <typename... Ints>
+		explicit GridPoint(int const first, Ints const... others)
+		:
+			c({{ first, int(others)... }})
+		{
+			static_assert(sizeof...(others) + 1 == N,
+				"GridPoint needs exactly N coordinates");
+		}
+
+		/* Axis accessors */
+		int & operator [] (unsigned const axis)
+		{
+			return c[axis];
+		}
+		int operator [] (unsigned const axis) const
+		{
+			return c[axis];
+		}
+
+		/* Relational operators */
+		bool operator < (GridPoint const & p) const
+		{
+			for(unsigned d = N ; d-- > 0 ; )
+				if(c[d] != p.c[d])
+					return c[d] < p.c[d];
+
+			return false;
+		}
+		bool operator == (GridPoint const & p) const
+		{
+			return c == p.c;
+		}
+		bool operator != (GridPoint const & p) const
+		{
+			return !((*this) == p);
+		}
+
+		/* Arithmetic operators */
+		GridPoint operator + (GridPoint const & p) const
+		{
+			GridPoint r(*this);
+
+			for(unsigned d = 0 ; d < N ; ++d)
+				r.c[d] += p.c[d];
+
+			return r;
+		}
+		GridPoint operator - (GridPoint const & p) const
+		{
+			GridPoint r(*this);
+
+			for(unsigned d = 0 ; d < N ; ++d)
+				r.c[d] -= p.c[d];
+
+			return r;
+		}
+};
+
+/*
+ * Template parameters: <Dimension, Cell type>
+ *
+ * Contiguous N-dimensional map: cells are stored in a single row-major array
+ * (axis 0 varies fastest), so that a cell's neighbors are found at constant
+ * index offsets.
+ * Cell values are terrain costs, 0 meaning "not walkable".
+ */
+template
+<unsigned N, typename T = uint8_t>
+class GridMap
+{
+	protected:
+		/* Size along each axis */
+		std::array<unsigned, N> _size;
+
+		/* Index offset of a +1 step along each axis */
+		std::array<size_t, N> _stride;
+
+		/* Map content */
+		std::vector<T> _cells;
+
+	public:
+		/* Constructor */
+		explicit GridMap(std::array<unsigned, N> const & size,
+				T const fill = T(1))
+		:
+			_size(size)
+		{
+			size_t cells(1);
+
+			for(unsigned d = 0 ; d < N ; ++d)
+			{
+				_stride[d] = cells;
+				cells *= _size[d];
+			}
+
+			_cells.assign(cells, fill);
+		}
+
+		/* Getters */
+		unsigned size(unsigned const axis) const
+		{
+			return _size[axis];
+		}
+		size_t stride(unsigned const axis) const
+		{
+			return _stride[axis];
+		}
+		size_t cells() const
+		{
+			return _cells.size();
+		}
+		T const * data() const
+		{
+			return _cells.data();
+		}
+
+		/* Bounds check */
+		bool contains(GridPoint<N> const & p) const
+		{
+			for(unsigned d = 0 ; d < N ; ++d)
+				if(p.c[d] < 0 || unsigned(p.c[d]) >= _size[d])
+					return false;
+
+			return true;
+		}
+
+		/* Point <-> cell index conversions */
+		size_t index(GridPoint<N> const & p) const
+		{
+			size_t i(0);
+
+			for(unsigned d = 0 ; d < N ; ++d)
+				i += size_t(p.c[d]) * _stride[d];
+
+			return i;
+		}
+		GridPoint<N> coord(size_t i) const
+		{
+			GridPoint<N> p;
+
+			for(unsigned d = 0 ; d < N ; ++d)
+			{
+				p.c[d] = int(i % _size[d]);
+				i /= _size[d];
+			}
+
+			return p;
+		}
+
+		/* Cell access (0 outside the map) */
+		T operator () (GridPoint<N> const & p) const
+		{
+			return contains(p) ? _cells[index(p)] : T(0);
+		}
+		T operator [] (size_t const i) const
+		{
+			return _cells[i];
+		}
+
+		/* Setter */
+		void set(GridPoint<N> const & p, T const value)
+		{
+			if(contains(p))
+				_cells[index(p)] = value;
+		}
+};
+
+}
+
+#endif // GRIDMAP_HPP_INCLUDED
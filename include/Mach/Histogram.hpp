@@ -0,0 +1,79 @@
+#ifndef HISTOGRAM_HPP_INCLUDED
+#define HISTOGRAM_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+/* Linear sub-buckets per power of 2 (log2): values are kept with
+ * HISTOGRAM_SUB_BITS significant bits, i.e. within 1/32 (~3%) */
+#define HISTOGRAM_SUB_BITS 5
+
+/* Number of buckets: one per value below 2^HISTOGRAM_SUB_BITS, then
+ * 2^HISTOGRAM_SUB_BITS per power of 2 up to 2^64 */
+#define HISTOGRAM_BUCKETS ((65 - HISTOGRAM_SUB_BITS) << HISTOGRAM_SUB_BITS)
+
+
+namespace Mach
+{
+
+/*
+ * Log-linear histogram of unsigned values (typically durations in nanoseconds)
+ *
+ * Each power of 2 is split into 2^HISTOGRAM_SUB_BITS equal sub-buckets
+ * (HDR-style), small values getting a bucket each, so that the histogram
+ * spans the whole 64-bit range with a constant relative precision of about
+ * 3% (percentiles are rounded up to the end of their bucket). Counters are
+ * relaxed atomics: record(...) may be called from any thread and the
+ * histogram read or copied meanwhile, without any lock.
+ */
+class Histogram
+{
+	private:
+		/* Bucket counters */
+		std::atomic<unsigned long> _buckets[HISTOGRAM_BUCKETS];
+
+		/* Number of values, sum & maximum */
+		std::atomic<unsigned long> _count;
+		std::atomic<uint64_t> _sum;
+		std::atomic<uint64_t> _maximum;
+
+	public:
+		/* Constructors (copies are snapshots) */
+		Histogram();
+		Histogram(Histogram const &);
+
+		/* Assignation (snapshot) */
+		Histogram & operator = (Histogram const &);
+
+		/* Bucket holding the given value */
+		static unsigned bucketOf(uint64_t const);
+
+		/* Largest value held by the given bucket */
+		static uint64_t upperBound(unsigned const);
+
+		/* Record count occurrences of the given value */
+		void record(uint64_t const value, unsigned long const count = 1);
+
+		/* Add another histogram's counters to this one */
+		void merge(Histogram const &);
+
+		/* Forget every recorded value */
+		void clear();
+
+		/* Number of values, sum, mean & maximum */
+		unsigned long count() const;
+		uint64_t sum() const;
+		double mean() const;
+		uint64_t maximum() const;
+
+		/* Number of values held by the given bucket */
+		unsigned long bucket(unsigned const) const;
+
+		/* Value below which the given fraction (in [0, 1]) of the
+		 * recorded values lie, rounded up to the end of its bucket */
+		uint64_t percentile(double const) const;
+};
+
+}
+
+#endif // HISTOGRAM_HPP_INCLUDED
@@ -0,0 +1,94 @@
+#ifndef MESSAGECLIENT_HPP_INCLUDED
+#define MESSAGECLIENT_HPP_INCLUDED
+
+#include "UDPClient.hpp"
+#include "MessageProtocol.hpp"
+#include <vector>
+
+/* Linux-specific bits */
+#if defined(__gnu_linux__)
+#include <sys/uio.h>
+#endif
+
+/* Maximum number of fragments handed over to a single sendmmsg() call */
+#define MESSAGE_BATCH 64
+
+
+namespace Mach
+{
+
+/*
+ * Message sender statistics (see MessageClient::statistics())
+ */
+struct MessageClientStatistics
+{
+	/* Messages & fragments sent */
+	unsigned long messages;
+	unsigned long fragments;
+
+	/* Send system calls */
+	unsigned long calls;
+};
+
+/*
+ * Message client (sending end, see MessageServer)
+ *
+ * sendMessage(...) cuts payloads of up to 4 GiB into fragments small enough
+ * not to be fragmented by IP (MESSAGE_FRAGMENT_MAX bytes by default), each
+ * carrying a header telling the receiver where it belongs. On Linux, every
+ * fragment is a two-part scatter-gather message (its header, then a slice of
+ * the caller's buffer), up to MESSAGE_BATCH of them being sent by a single
+ * sendmmsg() call: the payload is never copied in user space. Elsewhere,
+ * fragments are assembled in a datagram buffer & sent one by one.
+ * Delivery is not guaranteed: a message missing a fragment is dropped by the
+ * receiver once its reassembly times out.
+ */
+class MessageClient : public UDPClient
+{
+	private:
+		/* Fragment payload size */
+		uint16_t _stride;
+
+		/* Identifier of the next message */
+		uint32_t _nextMessage;
+
+		/* Fragment headers of the current batch */
+		std::vector<uint8_t> _prefixes;
+
+#if defined(__gnu_linux__)
+		/* Messages of the current batch (2 vectors each) */
+		std::vector<mmsghdr> _headers;
+		std::vector<iovec> _vectors;
+#else
+		/* Fragment being sent */
+		std::vector<uint8_t> _datagram;
+#endif
+
+		/* Counters */
+		MessageClientStatistics _stats;
+
+	public:
+		/* Constructor (see setFragmentSize(...)) & destructor */
+		explicit MessageClient(size_t const fragmentSize
+				= MESSAGE_FRAGMENT_MAX);
+		virtual ~MessageClient();
+
+		/* Copy & assignation are forbidden */
+		MessageClient(MessageClient const &) = delete;
+		MessageClient & operator = (MessageClient const &) = delete;
+
+		/* Set the fragment payload size (clamped to [1,
+		 * MESSAGE_FRAGMENT_MAX], lower it for paths with a smaller
+		 * MTU) */
+		void setFragmentSize(size_t const);
+
+		/* Send a message, returns its identifier */
+		uint32_t sendMessage(uint8_t const *, size_t const);
+
+		/* Sender counters */
+		MessageClientStatistics statistics() const;
+};
+
+}
+
+#endif // MESSAGECLIENT_HPP_INCLUDED
@@ -0,0 +1,96 @@
+#ifndef MESSAGEPROTOCOL_HPP_INCLUDED
+#define MESSAGEPROTOCOL_HPP_INCLUDED
+
+/* Big-endian field accessors */
+#include "ReliableProtocol.hpp"
+#include <algorithm>
+
+/* Fragment header size (bytes) */
+#define MESSAGE_HEADER 16
+
+/* Largest fragment payload (1500-byte MTU minus the IPv6, UDP & fragment
+ * headers, so that fragments never get fragmented by IP) */
+#define MESSAGE_FRAGMENT_MAX 1436
+
+
+namespace Mach
+{
+
+/*
+ * Message segment types (numbered after the reliable channel's ones)
+ */
+enum MessageType : uint8_t
+{
+	/* One fragment of a message */
+	MESSAGE_FRAGMENT = 3
+};
+
+/*
+ * Fragment header
+ *
+ * Wire layout (big-endian): type (1), unused (1), stride (2), message (4),
+ * length (4), index (4), then the payload. A message of length bytes is cut
+ * into fragments of stride bytes (the last one may be shorter), fragment
+ * index carrying bytes [index * stride, index * stride + stride) of it.
+ * Messages are numbered by their sender, from a random start so that a
+ * restarted sender does not complete the stale fragments of its predecessor.
+ */
+struct MessageFragment
+{
+	uint16_t stride;
+	uint32_t message;
+	uint32_t length;
+	uint32_t index;
+};
+
+/*
+ * Number of fragments of a message
+ */
+inline uint32_t fragmentCount(uint32_t const length, uint16_t const stride)
+{
+	return length == 0 ? 1 : uint32_t((uint64_t(length) + stride - 1)
+			/ stride);
+}
+
+/*
+ * Write a fragment header
+ */
+inline void encodeFragment(uint8_t * bytes, MessageFragment const & fragment)
+{
+	bytes[0] = MESSAGE_FRAGMENT;
+	bytes[1] = 0;
+	bytes[2] = uint8_t(fragment.stride >> 8);
+	bytes[3] = uint8_t(fragment.stride);
+	putWord(bytes + 4, fragment.message);
+	putWord(bytes + 8, fragment.length);
+	putWord(bytes + 12, fragment.index);
+}
+
+/*
+ * Read a fragment header, returns false if this isn't a well-formed fragment
+ * (its payload must be exactly as long as the header says)
+ */
+inline bool decodeFragment(uint8_t const * bytes, size_t const length,
+		MessageFragment & fragment)
+{
+	if(length < MESSAGE_HEADER || bytes[0] != MESSAGE_FRAGMENT)
+		return false;
+
+	fragment.stride = uint16_t(bytes[2] << 8 | bytes[3]);
+	fragment.message = getWord(bytes + 4);
+	fragment.length = getWord(bytes + 8);
+	fragment.index = getWord(bytes + 12);
+
+	if(fragment.stride == 0 || fragment.index
+			>= fragmentCount(fragment.length, fragment.stride))
+		return false;
+
+	uint64_t const offset(uint64_t(fragment.index) * fragment.stride);
+
+	return length - MESSAGE_HEADER == std::min(uint64_t(fragment.stride),
+			fragment.length - offset);
+}
+
+}
+
+#endif // MESSAGEPROTOCOL_HPP_INCLUDED
@@ -0,0 +1,205 @@
+#ifndef MESSAGESERVER_HPP_INCLUDED
+#define MESSAGESERVER_HPP_INCLUDED
+
+#include "UDPServer.hpp"
+#include "MessageProtocol.hpp"
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+/* Smallest reassembly buffer (bytes, buffers are sized by powers of 2) */
+#define MESSAGE_BUFFER_MIN 4096
+
+
+namespace Mach
+{
+
+/*
+ * Message receiver statistics (see MessageServer::messageStatistics())
+ */
+struct MessageServerStatistics
+{
+	/* Messages handed over to receiveMessage(...), those which took more
+	 * than one fragment, and fragments received */
+	unsigned long delivered;
+	unsigned long reassembled;
+	unsigned long fragments;
+
+	/* Fragments received twice (dropped) & malformed or longer than the
+	 * largest message (dropped) */
+	unsigned long duplicates;
+	unsigned long malformed;
+
+	/* Incomplete messages dropped on timeout & fragments dropped because
+	 * their message didn't fit the memory budget */
+	unsigned long timeouts;
+	unsigned long budgetDrops;
+
+	/* Messages being reassembled & memory held by reassembly buffers
+	 * (spare ones included) */
+	size_t pending;
+	size_t memory;
+};
+
+/*
+ * Message server (receiving end, see MessageClient)
+ *
+ * Single-fragment messages are handed over to receiveMessage(...) straight
+ * from the receive buffer. Larger ones are reassembled into one contiguous
+ * buffer, each fragment being copied once to its final place as it arrives
+ * (in any order), and delivered when the last one is in.
+ * Reassembly buffers come from a pool of power of 2 sizes, buffers of
+ * completed messages being kept for the next ones, and the memory they take
+ * (spare buffers included) never exceeds the budget given to the
+ * constructor: when a new message doesn't fit, spare buffers are released,
+ * then the message is refused. Messages still incomplete after the timeout
+ * are dropped (checked whenever a new message starts, which is when their
+ * memory is needed), and completed ones are remembered until then so that
+ * late duplicates are recognized.
+ * Users of this class implement receiveMessage(...) instead of
+ * receiveBytes(...).
+ */
+class MessageServer : public UDPServer
+{
+	private:
+		/* Pooled reassembly buffer */
+		struct MessageBuffer
+		{
+			std::unique_ptr<uint8_t[]> bytes;
+			size_t capacity;
+		};
+
+		/* Message being reassembled */
+		struct Assembly
+		{
+			/* Serializes the fragments copies */
+			std::mutex _mutex;
+
+			/* Buffer, message length & fragment size */
+			MessageBuffer _buffer;
+			uint32_t _length;
+			uint16_t _stride;
+
+			/* Fragments received & still missing */
+			std::vector<bool> _received;
+			uint32_t _missing;
+
+			/* Completed or expired: later fragments are dropped
+			 * (as duplicates if completed) */
+			bool _closed;
+		};
+
+		/* Assembly lookup key: sender & message identifier */
+		struct AssemblyKey
+		{
+			SockAddr peer;
+			uint32_t message;
+
+			bool operator == (AssemblyKey const & other) const
+			{
+				return message == other.message
+					&& peer == other.peer;
+			}
+		};
+		struct AssemblyHash
+		{
+			size_t operator () (AssemblyKey const & key) const
+			{
+				return key.peer.hash() ^ key.message
+					* 0x9E3779B1u;
+			}
+		};
+
+		/* Assembly in the expiry queue, along with its deadline
+		 * (milliseconds) */
+		struct Expiry
+		{
+			uint64_t deadline;
+			AssemblyKey key;
+			std::shared_ptr<Assembly> assembly;
+		};
+
+		/* Largest message, memory budget & reassembly timeout */
+		size_t const _maxMessage;
+		size_t const _budget;
+		std::chrono::milliseconds const _timeout;
+
+		/* Assemblies (in creation order in the expiry queue, completed
+		 * ones staying until their deadline) & how many are still
+		 * incomplete, spare buffers by log2 size & memory held, under a
+		 * single lock */
+		mutable std::mutex _mutex;
+		std::unordered_map< AssemblyKey, std::shared_ptr<Assembly>,
+			AssemblyHash > _assemblies;
+		std::deque<Expiry> _expiries;
+		size_t _open;
+		std::vector< std::vector<MessageBuffer> > _spares;
+		size_t _memory;
+
+		/* Counters */
+		std::atomic<unsigned long> _delivered;
+		std::atomic<unsigned long> _reassembled;
+		std::atomic<unsigned long> _fragments;
+		std::atomic<unsigned long> _duplicates;
+		std::atomic<unsigned long> _malformed;
+		std::atomic<unsigned long> _timeouts;
+		std::atomic<unsigned long> _budgetDrops;
+
+		/* Current date (steady clock milliseconds) */
+		static uint64_t now();
+
+		/* Assembly a fragment belongs to, created if it starts a
+		 * message (nullptr if the budget is used up) */
+		std::shared_ptr<Assembly> assemblyOf(AssemblyKey const &,
+				MessageFragment const &);
+
+		/* Drop the incomplete messages past their deadline (lock
+		 * held) */
+		void expire(uint64_t const date);
+
+		/* Get a buffer of at least the given size, returns false if it
+		 * doesn't fit the budget (lock held) */
+		bool acquire(size_t const, MessageBuffer &);
+
+		/* Put a buffer back into the pool (lock held) */
+		void release(MessageBuffer &);
+
+	protected:
+		/* Handle one fragment */
+		virtual void receiveBytes(uint8_t const *, size_t const,
+				sockaddr_storage const *, int const);
+
+		/* Handle a complete message (only valid during the call) */
+		virtual void receiveMessage(uint8_t const *, size_t const,
+				SockAddr const & peer) = 0;
+
+	public:
+		/* Constructor (maxMessage is the largest message accepted,
+		 * budget the reassembly memory bound, raised to hold at least
+		 * one such message, see UDPServer for the other parameters) &
+		 * destructor */
+		MessageServer(unsigned short const port,
+				std::string const logPath = "MessageServer.log",
+				Priority const prio = LOG_ERROR,
+				size_t const maxMessage = 16 << 20,
+				size_t const budget = 64 << 20,
+				std::chrono::milliseconds const timeout
+					= std::chrono::milliseconds(1000),
+				unsigned const listeners = 1,
+				ReceiveBackend const backend = BACKEND_BLOCKING);
+		virtual ~MessageServer();
+
+		/* Copy & assignation are forbidden */
+		MessageServer(MessageServer const &) = delete;
+		MessageServer & operator = (MessageServer const &) = delete;
+
+		/* Receiver counters */
+		MessageServerStatistics messageStatistics() const;
+};
+
+}
+
+#endif // MESSAGESERVER_HPP_INCLUDED
@@ -0,0 +1,234 @@
+#ifndef PACKETPOOL_HPP_INCLUDED
+#define PACKETPOOL_HPP_INCLUDED
+
+#include "NetComponent.hpp"
+#include "SPSCQueue.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/* Arbitrary datagram max buffer size */
+#define PACKET_SIZE 65535
+
+/* Room reserved ahead of the payload in every packet buffer (io_uring writes
+ * its recvmsg header, the sender's address & control messages there) */
+#define PACKET_HEADROOM 256
+
+/* Number of buffers allocated at once when a packet pool grows */
+#define PACKET_SLAB_SIZE 64
+
+
+namespace Mach
+{
+
+class PacketPool;
+
+/*
+ * Pooled packet buffer: a received datagram along with its metadata
+ * Only meant to be handled through PacketRef.
+ */
+struct PacketBuffer
+{
+	/* Number of PacketRef pointing to the buffer */
+	std::atomic<unsigned> _references;
+
+	/* Home pool & next buffer in the pool's free lists */
+	PacketPool * _pool;
+	PacketBuffer * _next;
+
+	/* Payload position in _bytes & length */
+	size_t _offset;
+	size_t _length;
+
+	/* Remote end address and port (machine readable form) & receiving
+	 * socket */
+	sockaddr_storage _sender;
+	int _socket;
+
+	/* Kernel arrival date (nanoseconds since the epoch, 0 if unknown) */
+	uint64_t _timestamp;
+
+	/* Storage */
+	uint8_t _bytes[PACKET_HEADROOM + PACKET_SIZE];
+};
+
+/*
+ * Reference to a pooled packet buffer
+ *
+ * Copying a PacketRef shares the buffer (which is never copied), the buffer
+ * going back to its home pool once the last reference is gone, whatever the
+ * thread dropping it. Handlers can thus keep packets and pass them on to
+ * other threads freely.
+ * A reference may also be a slice, only covering part of the buffer's payload
+ * (e.g. one of the datagrams coalesced by UDP GRO).
+ */
+class PacketRef
+{
+	private:
+		/* Referenced buffer (nullptr if none) */
+		PacketBuffer * _buffer;
+
+		/* Slice of the payload (whole payload if not _sliced) */
+		size_t _offset;
+		size_t _length;
+		bool _sliced;
+
+	public:
+		/* Constructors & destructor (the buffer constructor adopts a
+		 * reference already counted) */
+		PacketRef()
+			:
+			_buffer(nullptr),
+			_offset(0),
+			_length(0),
+			_sliced(false)
+		{
+		}
+		explicit PacketRef(PacketBuffer * buffer)
+			:
+			_buffer(buffer),
+			_offset(0),
+			_length(0),
+			_sliced(false)
+		{
+		}
+		PacketRef(PacketRef const & other);
+		PacketRef(PacketRef && other) noexcept
+			:
+			_buffer(other._buffer),
+			_offset(other._offset),
+			_length(other._length),
+			_sliced(other._sliced)
+		{
+			other._buffer = nullptr;
+		}
+		~PacketRef()
+		{
+			reset();
+		}
+
+		/* Assignation */
+		PacketRef & operator = (PacketRef const & other);
+		PacketRef & operator = (PacketRef && other) noexcept;
+
+		/* Drop the reference */
+		void reset();
+
+		/* Another reference to the same buffer, covering length bytes
+		 * of this reference's payload from the given offset */
+		PacketRef slice(size_t const offset, size_t const length) const;
+
+		/* Does it reference a buffer ? */
+		explicit operator bool () const
+		{
+			return _buffer != nullptr;
+		}
+
+		/* Is it the only reference to its buffer ? */
+		bool unique() const
+		{
+			return _buffer != nullptr && _buffer->_references.load(
+					std::memory_order_acquire) == 1;
+		}
+
+		/* Raw buffer access */
+		PacketBuffer * get() const
+		{
+			return _buffer;
+		}
+		PacketBuffer * operator -> () const
+		{
+			return _buffer;
+		}
+
+		/* Payload & metadata */
+		uint8_t * data() const
+		{
+			return _buffer->_bytes + _buffer->_offset + _offset;
+		}
+		size_t length() const
+		{
+			return _sliced ? _length : _buffer->_length;
+		}
+		sockaddr_storage const & sender() const
+		{
+			return _buffer->_sender;
+		}
+		int socket() const
+		{
+			return _buffer->_socket;
+		}
+		uint64_t timestamp() const
+		{
+			return _buffer->_timestamp;
+		}
+};
+
+/*
+ * Packet buffer pool
+ *
+ * Owned by a single thread (typically a receiving thread), which is the only
+ * one allowed to allocate from it: allocation pops a private free list,
+ * without any atomic operation. Buffers released by other threads are pushed
+ * onto a lock-free return stack that the owner takes back as a whole once its
+ * free list is empty. The pool grows by slabs of PACKET_SLAB_SIZE buffers, up
+ * to the given maximum.
+ * As buffers may outlive their owner thread, the pool deletes itself once it
+ * has been retired by its owner and all of its buffers are back.
+ */
+class PacketPool
+{
+	private:
+		/* Owner side: free list & slabs */
+		PacketBuffer * _free;
+		std::vector< std::unique_ptr<PacketBuffer[]> > _slabs;
+		size_t const _maxBuffers;
+		std::atomic<unsigned long> _exhausted;
+
+		/* Released buffers (pushed by any thread, taken by the owner) */
+		char _padding0[CACHE_LINE_SIZE];
+		std::atomic<PacketBuffer *> _returned;
+
+		/* Buffers away from the pool, + 1 until retired */
+		std::atomic<unsigned long> _references;
+		char _padding1[CACHE_LINE_SIZE];
+
+		/* Constructor & destructor (see create() & retire()) */
+		explicit PacketPool(size_t const maxBuffers);
+		~PacketPool();
+
+		/* Allocate one more slab, returns false if at maximum size */
+		bool grow();
+
+	public:
+		/* Copy & assignation are forbidden */
+		PacketPool(PacketPool const &) = delete;
+		PacketPool & operator = (PacketPool const &) = delete;
+
+		/* Create a pool holding up to maxBuffers buffers */
+		static PacketPool * create(size_t const maxBuffers);
+
+		/* Give the pool up (owner only) */
+		void retire();
+
+		/* Get a buffer (owner only), an empty PacketRef if the pool is
+		 * exhausted */
+		PacketRef allocate();
+
+		/* Grow the pool to at least count buffers (up to its maximum)
+		 * and touch their memory, so that it is backed by pages local
+		 * to the calling thread before any datagram arrives (owner
+		 * only), returns the pool size */
+		size_t reserve(size_t const count);
+
+		/* Give a buffer back (any thread, called by PacketRef) */
+		void recycle(PacketBuffer *);
+
+		/* Buffers allocated so far & failed allocations */
+		size_t size() const;
+		unsigned long exhausted() const;
+};
+
+}
+
+#endif // PACKETPOOL_HPP_INCLUDED
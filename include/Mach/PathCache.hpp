@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2016 Julien "Derjik" Laurent <julien.laurent@engineer.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef PATHCACHE_HPP_INCLUDED
+#define PATHCACHE_HPP_INCLUDED
+
+#include <iterator>
+#include <list>
+#include <map>
+#include <set>
+#include <mutex>
+#include <vector>
+
+
+namespace Mach
+{
+
+/*
+ * Template parameters: <Coordinates type>
+ *
+ * LRU cache for path-finding results, keyed by (source, destination, map
+ * version). Each cached path remembers the map regions it crosses, so that
+ * editing a single tile only drops the paths going through the edited region
+ * instead of the whole cache.
+ * Regions are defined by the user through a function mapping a Coord to a
+ * region identifier (e.g. fixed-size square blocks on a 2D grid).
+ * Note: a path which doesn't cross an edited region is kept, even though the
+ * edit may have opened a shorter way elsewhere; bump the map version whenever
+ * strict optimality matters more than hit rate.
+ */
+template
+<typename Coord>
+class PathCache
+{
+	public:
+		typedef unsigned long (*regionFunction) (Coord const &);
+
+	protected:
+		/* Cache key */
+		struct Key
+		{
+			Coord _source;
+			Coord _destination;
+			unsigned long _version;
+
+			Key
+			(
+				Coord const & source,
+				Coord const & destination,
+				unsigned long version
+			)
+			:
+				_source(source),
+				_destination(destination),
+				_version(version)
+			{}
+
+			bool operator < (Key const & k) const
+			{
+				if(_version != k._version)
+					return _version < k._version;
+				if(_source != k._source)
+					return _source < k._source;
+				return _destination < k._destination;
+			}
+		};
+
+		/* Cached path along with the regions it goes through */
+		struct Entry
+		{
+			Key _key;
+			std::vector<Coord> _path;
+			std::set<unsigned long> _regions;
+
+			Entry(Key const & key, std::vector<Coord> const & path)
+			:
+				_key(key),
+				_path(path)
+			{}
+		};
+
+		typedef typename std::list<Entry>::iterator EntryIterator;
+
+		/* Maximum number of cached paths */
+		size_t const _capacity;
+
+		/* Coord to region mapping */
+		regionFunction _region;
+
+		/* Entries, most recently used first */
+		std::list<Entry> _entries;
+
+		/* Key to entry index */
+		std::map<Key, EntryIterator> _index;
+
+		/* Region to crossing entries index */
+		std::map<unsigned long, std::set<Key>> _crossings;
+
+		/* Statistics */
+		unsigned long _hits;
+		unsigned long _misses;
+		unsigned long _invalidations;
+
+		/* Invalidation epoch, bumped by every invalidation or clear:
+		 * a search started before an edit may have gone through the
+		 * edited cell, and its result must not be cached */
+		unsigned long _epoch;
+
+		/* Lookups, insertions and invalidations may come from distinct
+		 * threads (e.g. a search thread and an editing one) */
+		mutable std::mutex _mutex;
+
+		/* Internal helpers, caller must hold _mutex */
+		void erase(EntryIterator entry);
+		void store(Key const & key, std::vector<Coord> const & path);
+
+	public:
+		/* Constructor */
+		PathCache(size_t const capacity, regionFunction region)
+		:
+			_capacity(capacity),
+			_region(region),
+			_hits(0),
+			_misses(0),
+			_invalidations(0),
+			_epoch(0)
+		{}
+
+		/* Copy & assignation are forbidden */
+		PathCache(PathCache const &) = delete;
+		PathCache & operator = (PathCache const &) = delete;
+
+		/* Main interface */
+		bool find(Coord const & src, Coord const & dst,
+				unsigned long version, std::vector<Coord> & path);
+		void insert(Coord const & src, Coord const & dst,
+				unsigned long version,
+				std::vector<Coord> const & path);
+
+		/* Same, unless an invalidation happened since the given
+		 * epoch (read through epoch() before starting the search),
+		 * returns whether the path was cached */
+		bool insert(Coord const & src, Coord const & dst,
+				unsigned long version,
+				std::vector<Coord> const & path,
+				unsigned long epoch);
+
+		/* Run the given algorithm unless its result is already cached */
+		template <typename Algorithm>
+		std::vector<Coord> run(Algorithm & algorithm,
+				unsigned long version);
+
+		/* Drop every path crossing the given position's region */
+		void invalidate(Coord const & position);
+		void invalidateRegion(unsigned long region);
+		void clear();
+
+		/* Statistics getters */
+		unsigned long hits() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _hits;
+		}
+		unsigned long misses() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _misses;
+		}
+		unsigned long invalidations() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _invalidations;
+		}
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _entries.size();
+		}
+		unsigned long epoch() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _epoch;
+		}
+};
+
+/*
+ * Look for a cached path, moving it to the front of the LRU list if found
+ */
+template <typename Coord>
+bool
+PathCache<Coord>::
+find(Coord const & src, Coord const & dst, unsigned long version,
+		std::vector<Coord> & path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto const & found = _index.find(Key(src, dst, version));
+
+	if(found == _index.end())
+	{
+		++_misses;
+		return false;
+	}
+
+	/* Most recently used goes first */
+	_entries.splice(_entries.begin(), _entries, found->second);
+
+	path = found->second->_path;
+	++_hits;
+
+	return true;
+}
+
+/*
+ * Cache the given path, evicting the least recently used one if full.
+ * Empty paths (no solution) aren't cached as they don't cross any region
+ * and thus could never be invalidated.
+ */
+template <typename Coord>
+void
+PathCache<Coord>::
+insert(Coord const & src, Coord const & dst, unsigned long version,
+		std::vector<Coord> const & path)
+{
+	if(path.empty() || _capacity == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	store(Key(src, dst, version), path);
+}
+
+/*
+ * Cache the given path if no invalidation happened since the search started
+ */
+template <typename Coord>
+bool
+PathCache<Coord>::
+insert(Coord const & src, Coord const & dst, unsigned long version,
+		std::vector<Coord> const & path, unsigned long epoch)
+{
+	if(path.empty() || _capacity == 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	/* The map changed while searching: the path may be stale */
+	if(_epoch != epoch)
+		return false;
+
+	store(Key(src, dst, version), path);
+
+	return true;
+}
+
+/*
+ * Cached equivalent of Algorithm::run(), Algorithm being Mach::AStar or any
+ * of its derivatives
+ */
+template <typename Coord>
+template <typename Algorithm>
+std::vector<Coord>
+PathCache<Coord>::
+run(Algorithm & algorithm, unsigned long version)
+{
+	std::vector<Coord> path;
+
+	/* Taken before the lookup so that an invalidation racing with the
+	 * search keeps its result out of the cache */
+	unsigned long const started = epoch();
+
+	if(!find(algorithm.source(), algorithm.destination(), version, path))
+	{
+		path = algorithm.run();
+		insert(algorithm.source(), algorithm.destination(), version,
+				path, started);
+	}
+
+	return path;
+}
+
+/*
+ * Invalidate the region hosting the given position
+ */
+template <typename Coord>
+void
+PathCache<Coord>::
+invalidate(Coord const & position)
+{
+	invalidateRegion((*_region)(position));
+}
+
+/*
+ * Drop every cached path going through the given region
+ */
+template <typename Coord>
+void
+PathCache<Coord>::
+invalidateRegion(unsigned long region)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	/* Even if nothing cached crosses it, a search may be running */
+	++_epoch;
+
+	auto const & crossing = _crossings.find(region);
+
+	if(crossing == _crossings.end())
+		return;
+
+	/* Copy the keys since erase() alters the crossing sets */
+	std::set<Key> const keys(crossing->second);
+
+	for(Key const & key : keys)
+	{
+		auto const & found = _index.find(key);
+
+		if(found != _index.end())
+		{
+			erase(found->second);
+			++_invalidations;
+		}
+	}
+}
+
+/*
+ * Drop all cached paths
+ */
+template <typename Coord>
+void
+PathCache<Coord>::
+clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	++_epoch;
+	_entries.clear();
+	_index.clear();
+	_crossings.clear();
+}
+
+/*
+ * Insert an entry, replacing any previous one & evicting the least recently
+ * used ones if full
+ */
+template <typename Coord>
+void
+PathCache<Coord>::
+store(Key const & key, std::vector<Coord> const & path)
+{
+	/* Replace any previous result */
+	auto const & previous = _index.find(key);
+	if(previous != _index.end())
+		erase(previous->second);
+
+	/* Make room for the new entry */
+	while(_entries.size() >= _capacity)
+		erase(std::prev(_entries.end()));
+
+	_entries.push_front(Entry(key, path));
+	_index.insert(std::make_pair(key, _entries.begin()));
+
+	/* Register the crossed regions */
+	for(Coord const & position : path)
+		_entries.front()._regions.insert((*_region)(position));
+
+	for(unsigned long region : _entries.front()._regions)
+		_crossings[region].insert(key);
+}
+
+/*
+ * Remove an entry from the LRU list and from both indexes
+ */
+template <typename Coord>
+void
+PathCache<Coord>::
+erase(EntryIterator entry)
+{
+	for(unsigned long region : entry->_regions)
+	{
+		auto const & crossing = _crossings.find(region);
+
+		crossing->second.erase(entry->_key);
+
+		if(crossing->second.empty())
+			_crossings.erase(crossing);
+	}
+
+	_index.erase(entry->_key);
+	_entries.erase(entry);
+}
+
+}
+
+#endif // PATHCACHE_HPP_INCLUDED
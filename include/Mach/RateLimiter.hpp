@@ -0,0 +1,131 @@
+#ifndef RATELIMITER_HPP_INCLUDED
+#define RATELIMITER_HPP_INCLUDED
+
+#include "SessionTable.hpp"
+
+/* Bucket date resolution: ticks per nanosecond */
+#define RATE_TICKS_PER_NS 256
+
+
+namespace Mach
+{
+
+/*
+ * Per-peer rate limits (see UDPServer::setRateLimit(...))
+ */
+struct RateLimit
+{
+	/* Sustained rates allowed to each peer (0 for no limit) */
+	double packetsPerSecond;
+	double bytesPerSecond;
+
+	/* Bucket sizes: datagrams & bytes a quiet peer may send at once (the
+	 * byte burst must be at least the largest datagram expected) */
+	double packetBurst;
+	double byteBurst;
+
+	/* Maximum number of tracked peers (peers beyond are let through
+	 * and counted) & seconds of silence before a peer is forgotten */
+	size_t peers;
+	unsigned idleSeconds;
+
+	/* Default limit: none */
+	RateLimit()
+		:
+		packetsPerSecond(0.),
+		bytesPerSecond(0.),
+		packetBurst(0.),
+		byteBurst(0.),
+		peers(65536),
+		idleSeconds(60)
+	{
+	}
+};
+
+/*
+ * Admission decision for a datagram
+ */
+enum RateVerdict
+{
+	/* Within the peer's limits */
+	RATE_ADMITTED,
+
+	/* Over the packet rate */
+	RATE_PACKETS,
+
+	/* Over the byte rate */
+	RATE_BYTES,
+
+	/* Admitted without limit: the peer table is full */
+	RATE_UNTRACKED
+};
+
+/*
+ * Per-peer token bucket rate limiter
+ *
+ * Each peer owns a packet & a byte bucket, kept in a SessionTable (peers
+ * silent for idleSeconds being expired by its timer thread). A bucket is
+ * stored as its theoretical arrival date (GCRA): a datagram costing c tokens
+ * pushes it c times the token interval into the future, and is refused if
+ * that would take it further than burst intervals ahead of now. This is
+ * exactly a token bucket, with a single integer per bucket and no refill
+ * step. Dates are kept in 1/RATE_TICKS_PER_NS nanosecond ticks since the
+ * limiter was created, which wrap around after 2^56 ns (about 2.3 years):
+ * they are only ever compared modulo 2^64 (as sequence numbers are), which
+ * holds as long as no bucket lags more than 2^63 ticks (1.1 years) behind
+ * now, idle peers being expired long before. Known peers' buckets are charged lock-free (see
+ * SessionTable::modify(...)), refused datagrams writing nothing.
+ */
+class RateLimiter
+{
+	private:
+		/* Theoretical arrival dates of a peer's buckets */
+		struct Buckets
+		{
+			uint64_t packets;
+			uint64_t bytes;
+		};
+
+		/* Tracked peers */
+		SessionTable<Buckets> _peers;
+
+		/* Ticks per datagram & per byte (0 if unlimited) and bucket
+		 * depths (ticks) */
+		uint64_t _packetInterval;
+		uint64_t _packetDepth;
+		uint64_t _byteInterval;
+		uint64_t _byteDepth;
+
+		/* Date origin (SessionTable date, nanoseconds) */
+		uint64_t const _epoch;
+
+	public:
+		/* Constructor & destructor */
+		explicit RateLimiter(RateLimit const &);
+		~RateLimiter();
+
+		/* Copy & assignation are forbidden */
+		RateLimiter(RateLimiter const &) = delete;
+		RateLimiter & operator = (RateLimiter const &) = delete;
+
+		/* Current date (SessionTable date, nanoseconds), to be read
+		 * once per batch */
+		static uint64_t now();
+
+		/* Charge a datagram of the given length to a peer at the given
+		 * date (see now()), buckets being left untouched unless it is
+		 * admitted */
+		RateVerdict admit(SockAddr const &, size_t const length,
+				uint64_t const date);
+
+		/* Fetch the peer's buckets into the cache, ahead of admit()
+		 * (callers admitting a batch prefetch it all first) */
+		void prefetch(SockAddr const &) const;
+
+		/* Number of tracked peers */
+		size_t peers() const;
+};
+
+}
+
+#endif // RATELIMITER_HPP_INCLUDED
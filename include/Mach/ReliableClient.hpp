@@ -0,0 +1,260 @@
+#ifndef RELIABLECLIENT_HPP_INCLUDED
+#define RELIABLECLIENT_HPP_INCLUDED
+
+#include "UDPClient.hpp"
+#include "ReliableProtocol.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+/* Retransmission timeout bounds & minimum tail loss probe timeout
+ * (microseconds) */
+#define RELIABLE_RTO_MIN 1000
+#define RELIABLE_RTO_MAX 1000000
+#define RELIABLE_PROBE_MIN 100
+
+/* Longest sleep of the acknowledgement thread (microseconds) */
+#define RELIABLE_TICK 1000
+
+
+namespace Mach
+{
+
+/*
+ * Reliable channel sender statistics (see ReliableClient::statistics())
+ */
+struct ReliableStatistics
+{
+	/* Payloads accepted by send(...) & acknowledged */
+	unsigned long segments;
+	unsigned long acknowledged;
+
+	/* Retransmissions: all of them, those triggered by selective
+	 * acknowledgements (fast retransmit), tail loss probes &
+	 * retransmission timeouts */
+	unsigned long retransmits;
+	unsigned long fastRetransmits;
+	unsigned long probes;
+	unsigned long timeouts;
+
+	/* Timeouts found out to be spurious (undone) */
+	unsigned long spuriousTimeouts;
+
+	/* Segments dropped on purpose (see ReliableClient::setLossRate()) */
+	unsigned long injectedLosses;
+
+	/* New channels started after idling (see RELIABLE_RESTART_IDLE) */
+	unsigned long restarts;
+
+	/* Smoothed RTT & its variation, retransmission timeout
+	 * (microseconds) */
+	unsigned long srtt;
+	unsigned long rttvar;
+	unsigned long rto;
+
+	/* Congestion window & slow start threshold (segments) */
+	double cwnd;
+	double ssthresh;
+};
+
+/*
+ * Reliable, ordered UDP channel (sending end, see ReliableServer)
+ *
+ * Payloads given to send(...) are numbered and kept until the receiver has
+ * acknowledged them. Acknowledgements carry a cumulative sequence number and
+ * selective acknowledgement (SACK) blocks, which are read by a background
+ * thread: a segment is deemed lost as soon as one sent after it has been
+ * acknowledged and a quarter of the smoothed RTT has elapsed (RACK-style
+ * fast retransmit), or after a retransmission timeout (RFC 6298, doubled on
+ * every expiry). When acknowledgements stop coming for two RTTs, the latest
+ * segment is resent as a tail loss probe, whose acknowledgement reveals any
+ * loss before it without waiting for the timeout. RTT samples come from the
+ * timestamp each data segment carries and its acknowledgement echoes.
+ * The amount of data in flight is bounded by the sliding window (the
+ * sender's buffer & the window advertised by the receiver) and by a
+ * congestion window, grown by slow start then additive increase. Every round
+ * trip which lost segments shrinks it in proportion to the fraction lost
+ * (by half of it, as DCTCP does with ECN marks) rather than by half: random
+ * losses only trim it while congestion, which drops whole bursts, cuts it
+ * deeply. The first lossy round halves it and ends slow start, timeouts
+ * reset it to one segment (unless the next acknowledgement echoes a segment
+ * sent before the timeout, which then proves spurious and is undone).
+ * A sender which sent nothing for RELIABLE_RESTART_IDLE seconds, everything
+ * being acknowledged, starts a new channel (identifier & sequence numbers)
+ * with its next segment, the receiver having possibly forgotten the old one.
+ * setLossRate(...) drops outgoing segments at random, emulating a lossy link
+ * for tests and benchmarks.
+ */
+class ReliableClient : public UDPClient
+{
+	private:
+		/* Segment states */
+		enum SegmentState
+		{
+			/* Sent, not acknowledged yet */
+			SEGMENT_FLIGHT,
+
+			/* Deemed lost, waiting to be retransmitted */
+			SEGMENT_LOST,
+
+			/* Selectively acknowledged */
+			SEGMENT_SACKED
+		};
+
+		/* Unacknowledged segment, kept ready to be (re)sent */
+		struct Segment
+		{
+			std::vector<uint8_t> datagram;
+			SegmentState state;
+			uint64_t sentAt;
+			unsigned transmissions;
+		};
+
+		/* Sending buffer (power of 2 size, indexed by sequence) */
+		std::vector<Segment> _segments;
+		uint32_t const _mask;
+
+		/* Channel identifier & sequence numbers: oldest unacknowledged
+		 * and next new segment */
+		uint32_t _connection;
+		uint32_t _acked;
+		uint32_t _next;
+
+		/* Segment counts: in flight & waiting for retransmission */
+		unsigned _inFlight;
+		unsigned _lost;
+
+		/* Window advertised by the receiver (segments) */
+		unsigned _peerWindow;
+
+		/* Congestion control: window, slow start threshold & current
+		 * round (ends once its last segment is acknowledged, counting
+		 * the segments sent & lost meanwhile) */
+		double _cwnd;
+		double _ssthresh;
+		uint32_t _roundEnd;
+		unsigned _roundSent;
+		unsigned _roundLost;
+
+		/* RTT estimation (microseconds) */
+		uint64_t _srtt;
+		uint64_t _rttvar;
+		uint64_t _rto;
+
+		/* Send date of the latest segment known to be delivered,
+		 * retransmission timer deadline & tail loss probe date
+		 * (microseconds, the probe being sent once per tail) */
+		uint64_t _deliveredSentAt;
+		uint64_t _deadline;
+		uint64_t _probeAt;
+		bool _probed;
+
+		/* Date of the last timeout until the next acknowledgement
+		 * (0 if none) & congestion state it replaced, restored if the
+		 * acknowledgement shows the timeout was spurious */
+		uint64_t _timeoutAt;
+		double _priorCwnd;
+		double _priorSsthresh;
+
+		/* Date of the latest transmission (microseconds) */
+		uint64_t _lastSent;
+
+		/* Loss injection: probability & generator state */
+		double _lossRate;
+		uint64_t _random;
+
+		/* Counters */
+		ReliableStatistics _stats;
+
+		/* Acknowledgement thread, woken up by the timers or once per
+		 * millisecond at least */
+		std::thread _acknowledger;
+		std::atomic<bool> _running;
+
+		/* Sender state lock, signaled whenever the window opens */
+		mutable std::mutex _mutex;
+		std::condition_variable _room;
+
+		/* Current date (microseconds) */
+		static uint64_t now();
+
+		/* Read acknowledgements until disconnected */
+		void acknowledgements();
+
+		/* Restart the timers after some progress (lock held) */
+		void arm(uint64_t const date);
+
+		/* Process an acknowledgement (lock held) */
+		void acknowledge(ReliableAck const &, uint64_t const date);
+
+		/* Mark the segments deemed lost (lock held) */
+		void detectLosses();
+
+		/* Apply the losses of the round that just ended to the
+		 * congestion window (lock held) */
+		void endRound();
+
+		/* Run the timers due & retransmit, returns the date of the
+		 * next timer (lock held) */
+		uint64_t timers(uint64_t const date);
+
+		/* Handle the expiry of the retransmission timer (lock held) */
+		void timeout(uint64_t const date);
+
+		/* Resend the latest unacknowledged segment (lock held) */
+		void probe(uint64_t const date);
+
+		/* Resend lost segments as the congestion window allows (lock
+		 * held) */
+		void retransmit(uint64_t const date);
+
+		/* Put a segment on the wire (lock held) */
+		void transmit(uint32_t const sequence, uint64_t const date);
+
+		/* Can a new segment be sent ? (lock held) */
+		bool open() const;
+
+		/* Start a new channel: identifier & sequence numbers (lock
+		 * held, nothing in flight) */
+		void restart();
+
+	public:
+		/* Constructor (window is the sending buffer size in segments,
+		 * rounded up to a power of 2) & destructor */
+		explicit ReliableClient(size_t const window = 1024);
+		virtual ~ReliableClient();
+
+		/* Copy & assignation are forbidden */
+		ReliableClient(ReliableClient const &) = delete;
+		ReliableClient & operator = (ReliableClient const &) = delete;
+
+		/* Connect to the given host:port & start a new channel */
+		void connectTo(std::string const, unsigned short const);
+
+		/* Stop the channel (unacknowledged segments are lost) &
+		 * disconnect */
+		void disconnect();
+
+		/* Queue a payload (up to RELIABLE_PAYLOAD_MAX bytes) for
+		 * reliable, ordered delivery, blocking while the window is
+		 * full */
+		void send(uint8_t const *, size_t const);
+
+		/* Wait until every segment has been acknowledged, returns false
+		 * on timeout */
+		bool flush(std::chrono::milliseconds const);
+
+		/* Drop outgoing segments (retransmissions included) with the
+		 * given probability */
+		void setLossRate(double const);
+
+		/* Sender counters & estimators */
+		ReliableStatistics statistics() const;
+};
+
+}
+
+#endif // RELIABLECLIENT_HPP_INCLUDED
@@ -0,0 +1,182 @@
+#ifndef RELIABLEPROTOCOL_HPP_INCLUDED
+#define RELIABLEPROTOCOL_HPP_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Header sizes (bytes) of data & acknowledgement segments */
+#define RELIABLE_DATA_HEADER 16
+#define RELIABLE_ACK_HEADER 16
+
+/* Largest payload carried by a data segment (1500-byte MTU minus the IPv6,
+ * UDP & data headers) */
+#define RELIABLE_PAYLOAD_MAX 1436
+
+/* Maximum number of selective acknowledgement blocks per acknowledgement */
+#define RELIABLE_SACK_BLOCKS 8
+
+/* Largest acknowledgement segment */
+#define RELIABLE_ACK_MAX (RELIABLE_ACK_HEADER + 8 * RELIABLE_SACK_BLOCKS)
+
+/* Seconds of silence after which a receiver forgets a channel, and after
+ * which a sender with nothing in flight starts a new one (well before the
+ * receiver may have forgotten it) */
+#define RELIABLE_STREAM_IDLE 60
+#define RELIABLE_RESTART_IDLE (RELIABLE_STREAM_IDLE / 2)
+
+
+namespace Mach
+{
+
+/*
+ * Reliable channel segment types
+ */
+enum ReliableType : uint8_t
+{
+	/* Sender to receiver: one payload */
+	RELIABLE_DATA = 1,
+
+	/* Receiver to sender: cumulative & selective acknowledgement */
+	RELIABLE_ACK = 2
+};
+
+/*
+ * Data segment header
+ *
+ * Wire layout (big-endian): type (1), unused (3), connection (4), sequence
+ * (4), timestamp (4), then the payload. The connection is picked at random by
+ * the sender so that the receiver can tell a new channel from a stale one
+ * reusing the same address & port. The timestamp (sender's clock,
+ * microseconds) is echoed back by the acknowledgement it triggers, which
+ * yields RTT samples even for retransmitted segments.
+ */
+struct ReliableData
+{
+	uint32_t connection;
+	uint32_t sequence;
+	uint32_t timestamp;
+};
+
+/*
+ * Acknowledgement segment
+ *
+ * Wire layout (big-endian): type (1), block count (1), window (2),
+ * connection (4), cumulative (4), echo (4), then blocks * (start (4),
+ * end (4)). Every segment before cumulative has been delivered, and the
+ * [start, end) blocks have been received past it. The window is the number
+ * of segments the receiver can hold from cumulative on.
+ */
+struct ReliableAck
+{
+	uint32_t connection;
+	uint32_t cumulative;
+	uint32_t echo;
+	uint16_t window;
+	uint8_t blocks;
+	uint32_t start[RELIABLE_SACK_BLOCKS];
+	uint32_t end[RELIABLE_SACK_BLOCKS];
+};
+
+/*
+ * Sequence number arithmetic (modulo 2^32, RFC 1982)
+ */
+inline bool sequenceBefore(uint32_t const a, uint32_t const b)
+{
+	return int32_t(a - b) < 0;
+}
+
+/*
+ * Big-endian field accessors
+ */
+inline void putWord(uint8_t * bytes, uint32_t const value)
+{
+	bytes[0] = uint8_t(value >> 24);
+	bytes[1] = uint8_t(value >> 16);
+	bytes[2] = uint8_t(value >> 8);
+	bytes[3] = uint8_t(value);
+}
+inline uint32_t getWord(uint8_t const * bytes)
+{
+	return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16
+		| uint32_t(bytes[2]) << 8 | uint32_t(bytes[3]);
+}
+
+/*
+ * Write a data segment header
+ */
+inline void encodeData(uint8_t * bytes, ReliableData const & data)
+{
+	bytes[0] = RELIABLE_DATA;
+	bytes[1] = bytes[2] = bytes[3] = 0;
+	putWord(bytes + 4, data.connection);
+	putWord(bytes + 8, data.sequence);
+	putWord(bytes + 12, data.timestamp);
+}
+
+/*
+ * Read a data segment header, returns false if this isn't one
+ */
+inline bool decodeData(uint8_t const * bytes, size_t const length,
+		ReliableData & data)
+{
+	if(length < RELIABLE_DATA_HEADER || bytes[0] != RELIABLE_DATA)
+		return false;
+
+	data.connection = getWord(bytes + 4);
+	data.sequence = getWord(bytes + 8);
+	data.timestamp = getWord(bytes + 12);
+
+	return true;
+}
+
+/*
+ * Write an acknowledgement, returns its length
+ */
+inline size_t encodeAck(uint8_t * bytes, ReliableAck const & ack)
+{
+	bytes[0] = RELIABLE_ACK;
+	bytes[1] = ack.blocks;
+	bytes[2] = uint8_t(ack.window >> 8);
+	bytes[3] = uint8_t(ack.window);
+	putWord(bytes + 4, ack.connection);
+	putWord(bytes + 8, ack.cumulative);
+	putWord(bytes + 12, ack.echo);
+
+	for(unsigned i = 0 ; i < ack.blocks ; ++i)
+	{
+		putWord(bytes + RELIABLE_ACK_HEADER + 8 * i, ack.start[i]);
+		putWord(bytes + RELIABLE_ACK_HEADER + 8 * i + 4, ack.end[i]);
+	}
+
+	return RELIABLE_ACK_HEADER + 8 * size_t(ack.blocks);
+}
+
+/*
+ * Read an acknowledgement, returns false if this isn't a well-formed one
+ */
+inline bool decodeAck(uint8_t const * bytes, size_t const length,
+		ReliableAck & ack)
+{
+	if(length < RELIABLE_ACK_HEADER || bytes[0] != RELIABLE_ACK
+			|| bytes[1] > RELIABLE_SACK_BLOCKS
+			|| length < RELIABLE_ACK_HEADER + 8 * size_t(bytes[1]))
+		return false;
+
+	ack.blocks = bytes[1];
+	ack.window = uint16_t(bytes[2] << 8 | bytes[3]);
+	ack.connection = getWord(bytes + 4);
+	ack.cumulative = getWord(bytes + 8);
+	ack.echo = getWord(bytes + 12);
+
+	for(unsigned i = 0 ; i < ack.blocks ; ++i)
+	{
+		ack.start[i] = getWord(bytes + RELIABLE_ACK_HEADER + 8 * i);
+		ack.end[i] = getWord(bytes + RELIABLE_ACK_HEADER + 8 * i + 4);
+	}
+
+	return true;
+}
+
+}
+
+#endif // RELIABLEPROTOCOL_HPP_INCLUDED
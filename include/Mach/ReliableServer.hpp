@@ -0,0 +1,186 @@
+#ifndef RELIABLESERVER_HPP_INCLUDED
+#define RELIABLESERVER_HPP_INCLUDED
+
+#include "UDPServer.hpp"
+#include "ReliableProtocol.hpp"
+#include "SessionTable.hpp"
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+/* Default maximum number of channels */
+#define RELIABLE_STREAMS_MAX 4096
+
+
+namespace Mach
+{
+
+/*
+ * Reliable channel receiver statistics (see
+ * ReliableServer::reliableStatistics())
+ */
+struct ReliableServerStatistics
+{
+	/* Payloads handed over to receiveMessage(...) */
+	unsigned long delivered;
+
+	/* Segments received out of order (buffered), already received
+	 * (dropped) & beyond the window (dropped) */
+	unsigned long reordered;
+	unsigned long duplicates;
+	unsigned long overflows;
+
+	/* Acknowledgements sent & dropped on purpose (see
+	 * ReliableServer::setLossRate()) */
+	unsigned long acks;
+	unsigned long injectedLosses;
+
+	/* Channels currently known & segments dropped because as many
+	 * channels as allowed were open already */
+	size_t streams;
+	unsigned long refused;
+};
+
+/*
+ * Reliable, ordered UDP channel (receiving end, see ReliableClient)
+ *
+ * Each sender address & port gets its own stream (reset whenever a new
+ * channel identifier shows up): segments arriving in order are handed over
+ * to receiveMessage(...) straight from the receive buffer, the others being
+ * copied into a reorder window until the gap before them is filled. A
+ * stream's payloads are delivered one at a time, in order, but distinct
+ * streams may be handled concurrently.
+ * Every segment is acknowledged (cumulative sequence number & up to
+ * RELIABLE_SACK_BLOCKS selective acknowledgement blocks, the most recent
+ * first), a single acknowledgement covering all of a stream's segments
+ * pulled by the same receive batch (see UDPServer::setBatchSize(...)).
+ * Streams are preallocated (at most maxStreams of them, segments from further
+ * senders being dropped) and found through a SessionTable without locking,
+ * its timer thread expiring those silent for RELIABLE_STREAM_IDLE seconds.
+ * Reorder buffers are only allocated once a stream gets a segment out of
+ * order.
+ * Users of this class implement receiveMessage(...) instead of
+ * receiveBytes(...).
+ */
+class ReliableServer : public UDPServer
+{
+	private:
+		/* Receiving end of a channel */
+		struct Stream
+		{
+			/* Serializes the stream's segments */
+			std::mutex _mutex;
+
+			/* Sender owning the stream, if open (a stream found
+			 * just as it expired may have changed hands) */
+			SockAddr _peer;
+			bool _open;
+
+			/* Channel identifier, next sequence to deliver & one
+			 * past the highest one received */
+			uint32_t _connection;
+			uint32_t _next;
+			uint32_t _highest;
+
+			/* Reorder window (indexed by sequence) */
+			std::vector< std::vector<uint8_t> > _buffers;
+			std::vector<bool> _received;
+
+			/* Timestamp to echo & pending acknowledgement */
+			uint32_t _echo;
+			bool _ackDue;
+
+			/* Loss injection generator state */
+			uint64_t _random;
+		};
+
+		/* Reorder window size (power of 2) */
+		uint32_t const _window;
+
+		/* Probability of dropping an acknowledgement */
+		std::atomic<double> _lossRate;
+
+		/* Streams & unused ones (indexes) */
+		std::unique_ptr<Stream[]> _pool;
+		std::mutex _freeMutex;
+		std::vector<uint32_t> _free;
+
+		/* Stream indexes plus one by sender (declared after the
+		 * streams, so that its expiry thread stops before they go) */
+		SessionTable<uint32_t> _streams;
+
+		/* Counters */
+		std::atomic<unsigned long> _delivered;
+		std::atomic<unsigned long> _reordered;
+		std::atomic<unsigned long> _duplicates;
+		std::atomic<unsigned long> _overflows;
+		std::atomic<unsigned long> _acks;
+		std::atomic<unsigned long> _injectedLosses;
+		std::atomic<unsigned long> _refused;
+
+		/* Locked stream of a sender, created if needed (nullptr if
+		 * there are too many streams) */
+		Stream * streamOf(SockAddr const &,
+				std::unique_lock<std::mutex> &);
+
+		/* Give a new sender an unused stream, returns its index plus
+		 * one (0 if there is none left) */
+		uint32_t open(SockAddr const &);
+
+		/* Put a stream back into the unused ones */
+		void close(uint32_t const index);
+
+		/* Buffer or deliver a data segment (stream lock held) */
+		void accept(Stream &, ReliableData const &,
+				uint8_t const * payload, size_t const length,
+				SockAddr const & peer);
+
+		/* Send the pending acknowledgement of a stream (stream lock
+		 * held) */
+		void acknowledge(Stream &, SockAddr const &,
+				int const socketFd);
+
+	protected:
+		/* Handle one data segment, acknowledged right away */
+		virtual void receiveBytes(uint8_t const *, size_t const,
+				sockaddr_storage const *, int const);
+
+		/* Handle a batch of data segments, acknowledging each stream
+		 * once */
+		virtual void receiveBatch(Datagram const *, unsigned const,
+				int const);
+
+		/* Handle a payload, in the order it was sent by its peer */
+		virtual void receiveMessage(uint8_t const *, size_t const,
+				SockAddr const & peer) = 0;
+
+	public:
+		/* Constructor (window is each stream's reorder window in
+		 * segments, rounded up to a power of 2, maxStreams the number
+		 * of channels open at once, see UDPServer for the other
+		 * parameters) & destructor */
+		ReliableServer(unsigned short const port,
+				std::string const logPath = "ReliableServer.log",
+				Priority const prio = LOG_ERROR,
+				size_t const window = 1024,
+				size_t const maxStreams = RELIABLE_STREAMS_MAX,
+				unsigned const listeners = 1,
+				ReceiveBackend const backend = BACKEND_BLOCKING);
+		virtual ~ReliableServer();
+
+		/* Copy & assignation are forbidden */
+		ReliableServer(ReliableServer const &) = delete;
+		ReliableServer & operator = (ReliableServer const &) = delete;
+
+		/* Drop outgoing acknowledgements with the given
+		 * probability */
+		void setLossRate(double const);
+
+		/* Receiver counters */
+		ReliableServerStatistics reliableStatistics() const;
+};
+
+}
+
+#endif // RELIABLESERVER_HPP_INCLUDED
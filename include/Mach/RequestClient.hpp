@@ -0,0 +1,186 @@
+#ifndef REQUESTCLIENT_HPP_INCLUDED
+#define REQUESTCLIENT_HPP_INCLUDED
+
+#include "UDPClient.hpp"
+#include "RequestProtocol.hpp"
+#include "TimerWheel.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+/* Responses read per recvmmsg() call */
+#define REQUEST_RECEIVE_BATCH 64
+
+/* Longest sleep of the completion thread (microseconds) */
+#define REQUEST_TICK 1000
+
+
+namespace Mach
+{
+
+/*
+ * How a request ended
+ */
+enum RequestStatus
+{
+	/* Its response arrived */
+	REQUEST_COMPLETED,
+
+	/* Its deadline passed first */
+	REQUEST_TIMEOUT,
+
+	/* The client disconnected first */
+	REQUEST_CANCELLED
+};
+
+/*
+ * Outcome of a request, as delivered through a future
+ */
+struct RequestResult
+{
+	RequestStatus status;
+	std::vector<uint8_t> response;
+};
+
+/*
+ * Request client statistics (see RequestClient::statistics())
+ */
+struct RequestStatistics
+{
+	/* Requests sent, & how they ended */
+	unsigned long sent;
+	unsigned long completed;
+	unsigned long timeouts;
+	unsigned long cancelled;
+
+	/* Responses matching no outstanding request (late, duplicated or
+	 * malformed, dropped) */
+	unsigned long stale;
+
+	/* Requests waiting for their response */
+	size_t outstanding;
+
+	/* Receive calls which returned responses */
+	unsigned long receiveCalls;
+};
+
+/*
+ * Pipelined request/response client (see RequestServer)
+ *
+ * Any number of requests, up to the capacity given to the constructor, may be
+ * waiting for their response at once: request(...) sends the request right
+ * away and returns, its completion (callback or future) being run by a
+ * background thread when the response arrives, when its deadline passes or
+ * when the client disconnects, whichever comes first.
+ * Outstanding requests live in a table indexed by the low bits of their
+ * identifier, the high bits holding the slot's generation (bumped whenever it
+ * is released): a response is matched in O(1), and one arriving after its
+ * request timed out finds a newer generation and is dropped as stale.
+ * Deadlines are timers on a hierarchical timing wheel (O(1) to start &
+ * cancel). The completion thread reads responses by batches of
+ * REQUEST_RECEIVE_BATCH (recvmmsg() on Linux), matches the whole batch and
+ * expires deadlines under a single lock, then runs the completions unlocked.
+ * Requests block while the table is full.
+ * Completions run on the completion thread: a callback must not block (nor
+ * wait for another request's future), and gets the response bytes for the
+ * duration of the call only.
+ */
+class RequestClient : public UDPClient
+{
+	public:
+		/* Completion callback: status & response (nullptr, 0 unless
+		 * completed) */
+		typedef std::function<void(RequestStatus const,
+				uint8_t const *, size_t const)> Completion;
+
+	private:
+		/* Outstanding request slot */
+		struct Slot
+		{
+			Completion completion;
+			TimerWheel::TimerId timer;
+			uint32_t generation;
+			bool busy;
+		};
+
+		/* Completion to run, along with its outcome */
+		struct Done
+		{
+			Completion completion;
+			RequestStatus status;
+			uint8_t const * response;
+			size_t length;
+		};
+
+		/* Request table (power of 2 size) & free slots */
+		std::vector<Slot> _slots;
+		uint32_t const _mask;
+		unsigned const _slotBits;
+		std::vector<uint32_t> _free;
+
+		/* Deadlines (data: slot index) */
+		TimerWheel _deadlines;
+
+		/* Counters */
+		RequestStatistics _stats;
+
+		/* Completion thread */
+		std::thread _completer;
+		std::atomic<bool> _running;
+
+		/* Table lock, signaled whenever a slot is released */
+		mutable std::mutex _mutex;
+		std::condition_variable _room;
+
+		/* Read responses & run completions until disconnected */
+		void completions();
+
+		/* Release a slot, moving its completion out (lock held) */
+		Completion release(uint32_t const index);
+
+		/* Put a request on the wire */
+		void transmit(uint32_t const id, uint8_t const *,
+				size_t const);
+
+	public:
+		/* Constructor (capacity is the number of outstanding requests,
+		 * rounded up to a power of 2) & destructor */
+		explicit RequestClient(size_t const capacity = 1 << 17);
+		virtual ~RequestClient();
+
+		/* Copy & assignation are forbidden */
+		RequestClient(RequestClient const &) = delete;
+		RequestClient & operator = (RequestClient const &) = delete;
+
+		/* Connect to the given host:port & start the completion
+		 * thread */
+		void connectTo(std::string const, unsigned short const);
+
+		/* Stop the completion thread, cancel the outstanding requests
+		 * & disconnect */
+		void disconnect();
+
+		/* Send a request (up to REQUEST_PAYLOAD_MAX bytes), the
+		 * completion being called once with its outcome, blocking
+		 * while the table is full, returns its identifier */
+		uint32_t request(uint8_t const *, size_t const,
+				std::chrono::microseconds const deadline,
+				Completion);
+
+		/* Same, the outcome being delivered through a future */
+		std::future<RequestResult> request(uint8_t const *,
+				size_t const,
+				std::chrono::microseconds const deadline);
+
+		/* Client counters */
+		RequestStatistics statistics() const;
+};
+
+}
+
+#endif // REQUESTCLIENT_HPP_INCLUDED
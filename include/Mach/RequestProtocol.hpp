@@ -0,0 +1,73 @@
+#ifndef REQUESTPROTOCOL_HPP_INCLUDED
+#define REQUESTPROTOCOL_HPP_INCLUDED
+
+/* Big-endian field accessors */
+#include "ReliableProtocol.hpp"
+
+/* Request & response header size (bytes) */
+#define REQUEST_HEADER 8
+
+/* Largest request or response payload (1500-byte MTU minus the IPv6, UDP &
+ * request headers) */
+#define REQUEST_PAYLOAD_MAX 1444
+
+
+namespace Mach
+{
+
+/*
+ * Request segment types (numbered after the message ones)
+ */
+enum RequestType : uint8_t
+{
+	/* Client to server: one request */
+	REQUEST_CALL = 4,
+
+	/* Server to client: the response to a request */
+	REQUEST_REPLY = 5
+};
+
+/*
+ * Request & response header
+ *
+ * Wire layout (big-endian): type (1), unused (3), identifier (4), then the
+ * payload. A response carries the identifier of the request it answers, which
+ * the client picks so that it can find the request back in O(1) (see
+ * RequestClient) and tell a late response from the one it is waiting for.
+ */
+struct RequestHeader
+{
+	RequestType type;
+	uint32_t id;
+};
+
+/*
+ * Write a request or response header
+ */
+inline void encodeRequest(uint8_t * bytes, RequestHeader const & header)
+{
+	bytes[0] = header.type;
+	bytes[1] = bytes[2] = bytes[3] = 0;
+	putWord(bytes + 4, header.id);
+}
+
+/*
+ * Read a request or response header, returns false if this isn't one
+ */
+inline bool decodeRequest(uint8_t const * bytes, size_t const length,
+		RequestHeader & header)
+{
+	if(length < REQUEST_HEADER || (bytes[0] != REQUEST_CALL
+			&& bytes[0] != REQUEST_REPLY)
+			|| length - REQUEST_HEADER > REQUEST_PAYLOAD_MAX)
+		return false;
+
+	header.type = RequestType(bytes[0]);
+	header.id = getWord(bytes + 4);
+
+	return true;
+}
+
+}
+
+#endif // REQUESTPROTOCOL_HPP_INCLUDED
@@ -0,0 +1,85 @@
+#ifndef REQUESTSERVER_HPP_INCLUDED
+#define REQUESTSERVER_HPP_INCLUDED
+
+#include "UDPServer.hpp"
+#include "RequestProtocol.hpp"
+#include <atomic>
+
+/* Responses sent per sendmmsg() call */
+#define REQUEST_BATCH 64
+
+
+namespace Mach
+{
+
+/*
+ * Request server statistics (see RequestServer::requestStatistics())
+ */
+struct RequestServerStatistics
+{
+	/* Requests answered & malformed datagrams (dropped) */
+	unsigned long answered;
+	unsigned long malformed;
+
+	/* Response sending calls */
+	unsigned long calls;
+};
+
+/*
+ * Request/response server (answering end, see RequestClient)
+ *
+ * Each request is handed over to receiveRequest(...), which writes its
+ * response straight into the datagram sent back (after the header carrying the
+ * request's identifier). The responses to a receive batch (see
+ * UDPServer::setBatchSize(...)) are sent together, REQUEST_BATCH per
+ * sendmmsg() call on Linux.
+ * Users of this class implement receiveRequest(...) instead of
+ * receiveBytes(...).
+ */
+class RequestServer : public UDPServer
+{
+	private:
+		/* Counters */
+		std::atomic<unsigned long> _answered;
+		std::atomic<unsigned long> _malformed;
+		std::atomic<unsigned long> _calls;
+
+		/* Answer up to REQUEST_BATCH datagrams with a single call */
+		void answer(Datagram const *, unsigned const count,
+				int const socketFd);
+
+	protected:
+		/* Answer one request */
+		virtual void receiveBytes(uint8_t const *, size_t const,
+				sockaddr_storage const *, int const);
+
+		/* Answer a batch of requests */
+		virtual void receiveBatch(Datagram const *, unsigned const,
+				int const);
+
+		/* Handle a request, writing the response (up to
+		 * REQUEST_PAYLOAD_MAX bytes) to the given buffer, returns its
+		 * length */
+		virtual size_t receiveRequest(uint8_t const *, size_t const,
+				uint8_t * response, SockAddr const & peer) = 0;
+
+	public:
+		/* Constructor (see UDPServer) & destructor */
+		RequestServer(unsigned short const port,
+				std::string const logPath = "RequestServer.log",
+				Priority const prio = LOG_ERROR,
+				unsigned const listeners = 1,
+				ReceiveBackend const backend = BACKEND_BLOCKING);
+		virtual ~RequestServer();
+
+		/* Copy & assignation are forbidden */
+		RequestServer(RequestServer const &) = delete;
+		RequestServer & operator = (RequestServer const &) = delete;
+
+		/* Server counters */
+		RequestServerStatistics requestStatistics() const;
+};
+
+}
+
+#endif // REQUESTSERVER_HPP_INCLUDED
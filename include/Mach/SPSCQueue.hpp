@@ -0,0 +1,152 @@
+#ifndef SPSCQUEUE_HPP_INCLUDED
+#define SPSCQUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/* Assumed cache line size, used to keep concurrently written data apart */
+#define CACHE_LINE_SIZE 64
+
+
+namespace Mach
+{
+
+/*
+ * Bounded lock-free single-producer single-consumer ring
+ *
+ * Slots are allocated once and reused: tryPush(...) and tryPop(...) hand the
+ * slot itself to the given callable, so that types owning memory (buffers,
+ * vectors...) keep their capacity from one use to the next and nothing is
+ * copied twice. The producer & consumer indexes live on separate cache lines,
+ * each side caching the other's index to avoid touching it on every call.
+ * Exactly one thread may push and exactly one thread may pop at any time.
+ */
+template <typename T>
+class SPSCQueue
+{
+	private:
+		/* Slots (power of 2 count) & index mask */
+		std::unique_ptr<T[]> _slots;
+		size_t const _mask;
+
+		/* Producer side: next slot to fill & cached consumer index */
+		char _padding0[CACHE_LINE_SIZE];
+		std::atomic<size_t> _tail;
+		size_t _headCache;
+
+		/* Consumer side: next slot to read & cached producer index */
+		char _padding1[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)
+			- sizeof(size_t)];
+		std::atomic<size_t> _head;
+		size_t _tailCache;
+		char _padding2[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)
+			- sizeof(size_t)];
+
+		/* Smallest power of 2 >= n (and >= 2) */
+		static size_t roundUp(size_t const n)
+		{
+			size_t size(2);
+
+			while(size < n)
+				size <<= 1;
+
+			return size;
+		}
+
+	public:
+		/* Constructor (capacity is rounded up to a power of 2) */
+		explicit SPSCQueue(size_t const capacity)
+			:
+			_slots(new T[roundUp(capacity)]),
+			_mask(roundUp(capacity) - 1),
+			_tail(0),
+			_headCache(0),
+			_head(0),
+			_tailCache(0)
+		{
+		}
+
+		/* Copy & assignation are forbidden */
+		SPSCQueue(SPSCQueue const &) = delete;
+		SPSCQueue & operator = (SPSCQueue const &) = delete;
+
+		/* Fill the next free slot using fill(T &) then publish it,
+		 * returns false if the queue is full (producer only) */
+		template <typename Fill>
+		bool tryPush(Fill && fill)
+		{
+			size_t const tail(_tail.load(std::memory_order_relaxed));
+
+			if(tail - _headCache > _mask)
+			{
+				_headCache = _head.load(std::memory_order_acquire);
+
+				if(tail - _headCache > _mask)
+					return false;
+			}
+
+			fill(_slots[tail & _mask]);
+			_tail.store(tail + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		/* Hand the oldest slot to consume(T &) then release it,
+		 * returns false if the queue is empty (consumer only) */
+		template <typename Consume>
+		bool tryPop(Consume && consume)
+		{
+			size_t const head(_head.load(std::memory_order_relaxed));
+
+			if(head == _tailCache)
+			{
+				_tailCache = _tail.load(std::memory_order_acquire);
+
+				if(head == _tailCache)
+					return false;
+			}
+
+			consume(_slots[head & _mask]);
+			_head.store(head + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		/* Copying variants */
+		bool push(T const & value)
+		{
+			return tryPush([&value](T & slot) { slot = value; });
+		}
+
+		bool pop(T & value)
+		{
+			return tryPop([&value](T & slot) { value = slot; });
+		}
+
+		/* Number of queued elements (approximate when called from
+		 * a third thread) */
+		size_t size() const
+		{
+			size_t const head(_head.load(std::memory_order_acquire));
+			size_t const tail(_tail.load(std::memory_order_acquire));
+
+			return tail >= head ? tail - head : 0;
+		}
+
+		/* Is the queue empty ? */
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+		/* Maximum number of queued elements */
+		size_t capacity() const
+		{
+			return _mask + 1;
+		}
+};
+
+}
+
+#endif // SPSCQUEUE_HPP_INCLUDED
@@ -0,0 +1,785 @@
+#ifndef SESSIONTABLE_HPP_INCLUDED
+#define SESSIONTABLE_HPP_INCLUDED
+
+#include "SockAddr.hpp"
+#include "SPSCQueue.hpp"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <type_traits>
+
+/* Number of 32-bit words of a PeerKey: IPv6 address & port */
+#define PEER_KEY_WORDS 5
+
+/* Minimum delay between two refreshes of an entry's last use date by
+ * lookups, which thus seldom write to the table (nanoseconds) */
+#define SESSION_TOUCH_PERIOD 1000000
+
+
+namespace Mach
+{
+
+/*
+ * Compact fixed-size form of an endpoint, as stored by SessionTable
+ *
+ * The address is kept in IPv6 form (IPv4 addresses being IPv4-mapped), both
+ * it and the port being stored as the host-order values of their big-endian
+ * 32-bit words, so that keys compare and hash without caring about the family
+ * of the socket the peer was seen on. Tables are keyed on SockAddr, this form
+ * only saving slot space.
+ */
+struct PeerKey
+{
+	/* Address words & port */
+	uint32_t words[PEER_KEY_WORDS];
+
+	/* Constructors (the default key is ::, port 0) */
+	PeerKey();
+	explicit PeerKey(SockAddr const &);
+
+	/* Endpoint of the peer (AF_INET for IPv4-mapped keys) */
+	SockAddr address() const;
+
+	/* Is it an IPv4 (mapped) endpoint ? */
+	bool ipv4() const;
+
+	/* Hash of the endpoint (same as SockAddr::hash()) */
+	uint32_t hash() const;
+
+	/* Comparison */
+	bool operator == (PeerKey const &) const;
+	bool operator != (PeerKey const &) const;
+};
+
+/*
+ * Concurrent per-peer session table
+ *
+ * Fixed capacity open addressing (linear probing) hash table, sharded by peer
+ * hash. Lookups never lock: every slot is guarded by a sequence lock, readers
+ * copying the key & value out of its atomic words and retrying if a writer
+ * got in meanwhile. Writers claim a slot by turning its sequence odd with a
+ * compare & swap, so that existing sessions may be modified without locking
+ * (modify()), the claim failing if the slot changed since it was read.
+ * Structural writers (insertions, removals) serialize on their shard's mutex
+ * only, so that threads owning distinct peers (see
+ * UDPServer::setFlowSteering(...)) seldom contend.
+ * Removals leave no tombstone: the following entries of the probe chain are
+ * shifted back into the hole, so that a miss only ever walks the live chain
+ * however many sessions came & went. A shard's move sequence is odd while
+ * entries are being shifted, lookups missing meanwhile being retried.
+ * Values are stored as raw words and must be trivially copyable. Entries idle
+ * for too long may be expired by hand or by a timer thread (startExpiry()).
+ */
+template <typename T>
+class SessionTable
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+			"Session values must be trivially copyable");
+
+	private:
+		/* Number of 64-bit words holding a value */
+		static size_t const VALUE_WORDS = (sizeof(T) + 7) / 8;
+
+		/* Slot states */
+		enum SlotState : unsigned
+		{
+			SLOT_EMPTY,
+			SLOT_USED
+		};
+
+		/* Entry, its sequence being odd while written */
+		struct Slot
+		{
+			std::atomic<unsigned> _sequence;
+			std::atomic<unsigned> _state;
+			std::atomic<uint32_t> _key[PEER_KEY_WORDS];
+			std::atomic<uint64_t> _lastUse;
+			std::atomic<uint64_t> _value[VALUE_WORDS];
+		};
+
+		/* Slots of a range of hashes along with the writers' lock
+		 * (padded, so that shards never share a cache line) */
+		struct Shard
+		{
+			char _padding0[CACHE_LINE_SIZE];
+			std::mutex _mutex;
+			std::unique_ptr<Slot[]> _slots;
+			std::atomic<size_t> _size;
+			std::atomic<unsigned> _moves;
+			char _padding1[CACHE_LINE_SIZE];
+		};
+
+		/* Shards (power of 2 count) & slots per shard (power of 2) */
+		std::unique_ptr<Shard[]> _shards;
+		unsigned const _shardMask;
+		unsigned const _shardBits;
+		size_t const _slotMask;
+
+		/* Expiry timer thread */
+		std::thread _expiry;
+		std::mutex _expiryMutex;
+		std::condition_variable _expiryWakeup;
+		bool _expiring;
+
+		/* Smallest power of 2 >= n (and >= 1) */
+		static size_t roundUp(size_t const n)
+		{
+			size_t size(1);
+
+			while(size < n)
+				size <<= 1;
+
+			return size;
+		}
+
+		/* Base 2 logarithm of a power of 2 */
+		static unsigned log2(size_t n)
+		{
+			unsigned bits(0);
+
+			while(n > 1)
+			{
+				n >>= 1;
+				++bits;
+			}
+
+			return bits;
+		}
+
+		/* Shard & first slot of a key, taken from the upper half of a
+		 * 64-bit multiplication of its hash (the peer hash alone
+		 * clusters consecutive addresses & ports in its low bits) */
+		static uint64_t spread(uint32_t const hash)
+		{
+			return (uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> 32;
+		}
+		Shard & shardOf(uint32_t const hash) const
+		{
+			return _shards[spread(hash) & _shardMask];
+		}
+		size_t firstSlot(uint32_t const hash) const
+		{
+			return size_t(spread(hash) >> _shardBits) & _slotMask;
+		}
+
+		/* Consistent copy of a slot's state & key, and of its value too
+		 * if the key matches the given one (lock-free), returns whether
+		 * the slot holds that key (the even sequence the copy was made
+		 * at being stored in sequence) */
+		static bool read(Slot const & slot, PeerKey const & key,
+				unsigned & state, T * value, unsigned & sequence)
+		{
+			uint64_t words[VALUE_WORDS];
+			bool match(false);
+
+			do
+			{
+				sequence = slot._sequence.load(
+						std::memory_order_acquire);
+				state = slot._state.load(
+						std::memory_order_relaxed);
+				match = state == SLOT_USED;
+
+				for(unsigned i = 0 ; match
+						&& i < PEER_KEY_WORDS ; ++i)
+					match = slot._key[i].load(
+						std::memory_order_relaxed)
+						== key.words[i];
+
+				if(match && value != nullptr)
+					for(size_t i = 0 ; i < VALUE_WORDS ; ++i)
+						words[i] = slot._value[i].load(
+						std::memory_order_relaxed);
+
+				std::atomic_thread_fence(
+						std::memory_order_acquire);
+			} while((sequence & 1) || sequence != slot._sequence.load(
+					std::memory_order_relaxed));
+
+			if(match && value != nullptr)
+				memcpy(value, words, sizeof(T));
+
+			return match;
+		}
+		static bool read(Slot const & slot, PeerKey const & key,
+				unsigned & state, T * value)
+		{
+			unsigned sequence(0);
+
+			return read(slot, key, state, value, sequence);
+		}
+
+		/* Make a slot's sequence odd, waiting for any other writer to
+		 * be done with it, returns the even sequence it was at */
+		static unsigned claim(Slot & slot)
+		{
+			unsigned sequence(slot._sequence.load(
+					std::memory_order_relaxed));
+
+			while((sequence & 1) || !slot._sequence
+					.compare_exchange_weak(sequence,
+					sequence + 1,
+					std::memory_order_acquire,
+					std::memory_order_relaxed))
+			{
+				if(sequence & 1)
+				{
+					std::this_thread::yield();
+					sequence = slot._sequence.load(
+						std::memory_order_relaxed);
+				}
+			}
+
+			std::atomic_thread_fence(std::memory_order_release);
+
+			return sequence;
+		}
+
+		/* Claim a slot only if its sequence is still the given even
+		 * one, i.e. if it was not written since it was read */
+		static bool claim(Slot & slot, unsigned sequence)
+		{
+			if(!slot._sequence.compare_exchange_strong(sequence,
+					sequence + 1,
+					std::memory_order_acquire,
+					std::memory_order_relaxed))
+				return false;
+
+			std::atomic_thread_fence(std::memory_order_release);
+
+			return true;
+		}
+
+		/* Release a slot claimed at the given sequence */
+		static void publish(Slot & slot, unsigned const sequence)
+		{
+			slot._sequence.store(sequence + 2,
+					std::memory_order_release);
+		}
+
+		/* Store a value into a claimed slot */
+		static void store(Slot & slot, T const & value,
+				uint64_t const lastUse)
+		{
+			uint64_t words[VALUE_WORDS] = { 0 };
+
+			memcpy(words, &value, sizeof(T));
+
+			for(size_t i = 0 ; i < VALUE_WORDS ; ++i)
+				slot._value[i].store(words[i],
+						std::memory_order_relaxed);
+
+			slot._lastUse.store(lastUse, std::memory_order_relaxed);
+		}
+
+		/* Rewrite a slot (shard lock held) */
+		static void write(Slot & slot, unsigned const state,
+				PeerKey const & key, T const & value,
+				uint64_t const lastUse)
+		{
+			unsigned const sequence(claim(slot));
+
+			slot._state.store(state, std::memory_order_relaxed);
+
+			for(unsigned i = 0 ; i < PEER_KEY_WORDS ; ++i)
+				slot._key[i].store(key.words[i],
+						std::memory_order_relaxed);
+
+			store(slot, value, lastUse);
+			publish(slot, sequence);
+		}
+
+		/* Keep a session alive on lookup, writing its last use date
+		 * seldom (a slot rewritten meanwhile may be kept a bit longer,
+		 * which is harmless; dates are compared without subtracting,
+		 * other writers' being possibly newer than the given one) */
+		static void touch(Slot & slot, uint64_t const date)
+		{
+			if(slot._lastUse.load(std::memory_order_relaxed)
+					+ SESSION_TOUCH_PERIOD < date)
+				slot._lastUse.store(date,
+						std::memory_order_relaxed);
+		}
+
+		/* Copy a slot into a claimed one, the source being claimed
+		 * too so that it cannot be modified meanwhile (shard lock
+		 * held) */
+		static void copy(Slot & to, Slot const & from)
+		{
+			to._state.store(SLOT_USED, std::memory_order_relaxed);
+
+			for(unsigned i = 0 ; i < PEER_KEY_WORDS ; ++i)
+				to._key[i].store(from._key[i].load(
+						std::memory_order_relaxed),
+						std::memory_order_relaxed);
+
+			for(size_t i = 0 ; i < VALUE_WORDS ; ++i)
+				to._value[i].store(from._value[i].load(
+						std::memory_order_relaxed),
+						std::memory_order_relaxed);
+
+			to._lastUse.store(from._lastUse.load(
+					std::memory_order_relaxed),
+					std::memory_order_relaxed);
+		}
+
+		/* First slot of the probe chain of a used slot's key (shard
+		 * lock held) */
+		size_t home(Slot const & slot) const
+		{
+			PeerKey key;
+
+			for(unsigned i = 0 ; i < PEER_KEY_WORDS ; ++i)
+				key.words[i] = slot._key[i].load(
+						std::memory_order_relaxed);
+
+			return firstSlot(key.hash());
+		}
+
+		/* Empty the i-th slot of a shard, shifting back the entries
+		 * which follow it in their probe chain (backward shift
+		 * deletion, shard lock held). Each entry moved stays claimed
+		 * until its old slot is refilled or emptied, so that no
+		 * lock-free modification of either copy gets lost. */
+		void remove(Shard & shard, size_t i)
+		{
+			unsigned const moves(shard._moves.load(
+					std::memory_order_relaxed));
+			unsigned sequence(claim(shard._slots[i]));
+			bool moving(false);
+
+			for(size_t j = (i + 1) & _slotMask ; j != i ;
+					j = (j + 1) & _slotMask)
+			{
+				Slot & next(shard._slots[j]);
+
+				if(next._state.load(std::memory_order_relaxed)
+						== SLOT_EMPTY)
+					break;
+
+				/* Entries whose chain starts after the hole
+				 * (cyclically, in (i, j]) stay where they are */
+				size_t const first(home(next));
+
+				if(((first - i - 1) & _slotMask)
+						< ((j - i) & _slotMask))
+					continue;
+
+				if(!moving)
+				{
+					shard._moves.store(moves + 1,
+						std::memory_order_relaxed);
+					std::atomic_thread_fence(
+						std::memory_order_release);
+					moving = true;
+				}
+
+				unsigned const held(claim(next));
+
+				copy(shard._slots[i], next);
+				publish(shard._slots[i], sequence);
+				sequence = held;
+				i = j;
+			}
+
+			shard._slots[i]._state.store(SLOT_EMPTY,
+					std::memory_order_relaxed);
+			shard._slots[i]._lastUse.store(0,
+					std::memory_order_relaxed);
+			publish(shard._slots[i], sequence);
+			shard._size.fetch_sub(1, std::memory_order_relaxed);
+
+			if(moving)
+				shard._moves.store(moves + 2,
+						std::memory_order_release);
+		}
+
+		/* Lock-free search: index of the slot holding the key & the
+		 * sequence its value was copied at, returns false if the key
+		 * is absent (misses being retried while entries are shifted
+		 * back) */
+		bool search(Shard & shard, PeerKey const & key,
+				uint32_t const hash, T & value, size_t & index,
+				unsigned & sequence) const
+		{
+			unsigned state(SLOT_EMPTY);
+			unsigned moves(0);
+
+			do
+			{
+				moves = shard._moves.load(
+						std::memory_order_acquire);
+
+				for(size_t probe = 0, i = firstSlot(hash) ;
+						probe <= _slotMask ;
+						++probe, i = (i + 1) & _slotMask)
+				{
+					if(read(shard._slots[i], key, state,
+							&value, sequence))
+					{
+						index = i;
+						return true;
+					}
+
+					if(state == SLOT_EMPTY)
+						break;
+				}
+
+				/* A miss only counts if no entry was shifted
+				 * back meanwhile */
+				std::atomic_thread_fence(
+						std::memory_order_acquire);
+			} while((moves & 1) || moves != shard._moves.load(
+					std::memory_order_relaxed));
+
+			return false;
+		}
+
+		/* Index of the slot holding the key, or of the empty one ending
+		 * its probe chain if absent (past the last slot if the shard is
+		 * full), shard lock held */
+		size_t locate(Shard & shard, PeerKey const & key,
+				uint32_t const hash, bool & found) const
+		{
+			unsigned state(SLOT_EMPTY);
+
+			found = false;
+
+			for(size_t probe = 0, i = firstSlot(hash) ;
+					probe <= _slotMask ;
+					++probe, i = (i + 1) & _slotMask)
+			{
+				if(read(shard._slots[i], key, state, nullptr))
+				{
+					found = true;
+					return i;
+				}
+
+				if(state == SLOT_EMPTY)
+					return i;
+			}
+
+			return _slotMask + 1;
+		}
+
+	public:
+		/* Monotonic date (nanoseconds) entries' last use is measured
+		 * with */
+		static uint64_t now()
+		{
+			return uint64_t(std::chrono::duration_cast<
+				std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now()
+				.time_since_epoch()).count());
+		}
+
+		/* Constructor (capacity is spread between the shards, both
+		 * being rounded up to powers of 2) & destructor */
+		explicit SessionTable(size_t const capacity,
+				unsigned const shards = 16)
+			:
+			_shards(new Shard[roundUp(shards)]),
+			_shardMask(unsigned(roundUp(shards) - 1)),
+			_shardBits(log2(roundUp(shards))),
+			_slotMask(roundUp(std::max(size_t(1),
+					capacity / roundUp(shards))) - 1),
+			_expiring(false)
+		{
+			for(unsigned s = 0 ; s <= _shardMask ; ++s)
+			{
+				Shard & shard(_shards[s]);
+
+				shard._slots.reset(new Slot[_slotMask + 1]);
+				shard._size.store(0, std::memory_order_relaxed);
+				shard._moves.store(0, std::memory_order_relaxed);
+
+				for(size_t i = 0 ; i <= _slotMask ; ++i)
+				{
+					shard._slots[i]._sequence.store(0,
+						std::memory_order_relaxed);
+					shard._slots[i]._state.store(SLOT_EMPTY,
+						std::memory_order_relaxed);
+				}
+			}
+		}
+		~SessionTable()
+		{
+			stopExpiry();
+		}
+
+		/* Copy & assignation are forbidden */
+		SessionTable(SessionTable const &) = delete;
+		SessionTable & operator = (SessionTable const &) = delete;
+
+		/* Copy the value of the given peer's session (lock-free),
+		 * returns false if there is none */
+		bool find(SockAddr const & peer, T & value) const
+		{
+			PeerKey const key(peer);
+			uint32_t const hash(key.hash());
+			Shard & shard(shardOf(hash));
+			size_t i(0);
+			unsigned sequence(0);
+
+			if(!search(shard, key, hash, value, i, sequence))
+				return false;
+
+			touch(shard._slots[i], now());
+
+			return true;
+		}
+
+		/* Fetch the first slot of the given peer's probe chain into the
+		 * cache ahead of a lookup or update of its session */
+		void prefetch(SockAddr const & peer) const
+		{
+#if defined(__GNUC__)
+			uint32_t const hash(peer.hash());
+			Slot const * slot(&shardOf(hash)._slots[firstSlot(hash)]);
+
+			__builtin_prefetch(slot, 1);
+			__builtin_prefetch((char const *)(slot + 1) - 1, 1);
+#else
+			(void)(peer);
+#endif
+		}
+
+		/* Create or replace the given peer's session, returns false if
+		 * its shard is full */
+		bool insert(SockAddr const & peer, T const & value)
+		{
+			return update(peer, [&value](T & current)
+			{
+				current = value;
+			});
+		}
+
+		/* Apply update(T &) to the given peer's session, created
+		 * value-initialized first if there is none, and mark it used
+		 * at the given date (which callers updating many sessions at
+		 * once may read only once), returns false if its shard is
+		 * full. Should modify() get in meanwhile, update is called
+		 * again on the fresher value. */
+		template <typename Update>
+		bool update(SockAddr const & peer, Update && update,
+				uint64_t const date = now())
+		{
+			PeerKey const key(peer);
+			uint32_t const hash(key.hash());
+			Shard & shard(shardOf(hash));
+			std::lock_guard<std::mutex> lock(shard._mutex);
+			bool found(false);
+			T value = T();
+			size_t const i(locate(shard, key, hash, found));
+
+			if(i > _slotMask)
+				return false;
+
+			Slot & slot(shard._slots[i]);
+
+			if(!found)
+			{
+				update(value);
+				shard._size.fetch_add(1,
+						std::memory_order_relaxed);
+				write(slot, SLOT_USED, key, value, date);
+
+				return true;
+			}
+
+			unsigned state(SLOT_USED);
+			unsigned sequence(0);
+
+			do
+			{
+				read(slot, key, state, &value, sequence);
+				update(value);
+			} while(!claim(slot, sequence));
+
+			store(slot, value, date);
+			publish(slot, sequence);
+
+			return true;
+		}
+
+		/* Apply update(T &) to the given peer's existing session and
+		 * mark it used at the given date, without locking (update may
+		 * thus be called again on a fresher copy if another writer got
+		 * in meanwhile; the session is not rewritten if update left it
+		 * unchanged), returns false if there is none */
+		template <typename Update>
+		bool modify(SockAddr const & peer, Update && update,
+				uint64_t const date = now())
+		{
+			PeerKey const key(peer);
+			uint32_t const hash(key.hash());
+			Shard & shard(shardOf(hash));
+			T value = T();
+			size_t i(0);
+			unsigned sequence(0);
+
+			while(search(shard, key, hash, value, i, sequence))
+			{
+				Slot & slot(shard._slots[i]);
+				T changed(value);
+
+				update(changed);
+
+				if(memcmp(&changed, &value, sizeof(T)) == 0)
+				{
+					touch(slot, date);
+					return true;
+				}
+
+				if(claim(slot, sequence))
+				{
+					store(slot, changed, date);
+					publish(slot, sequence);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		/* Remove the given peer's session, returns false if there was
+		 * none */
+		bool erase(SockAddr const & peer)
+		{
+			PeerKey const key(peer);
+			uint32_t const hash(key.hash());
+			Shard & shard(shardOf(hash));
+			std::lock_guard<std::mutex> lock(shard._mutex);
+			bool found(false);
+			size_t const i(locate(shard, key, hash, found));
+
+			if(!found)
+				return false;
+
+			remove(shard, i);
+
+			return true;
+		}
+
+		/* Remove the sessions unused for longer than idle, calling
+		 * expired(SockAddr const &, T const &) for each of them (shard
+		 * lock held), returns their number */
+		template <typename Expired>
+		size_t expire(std::chrono::nanoseconds const idle,
+				Expired && expired)
+		{
+			uint64_t const date(now());
+			uint64_t const limit(uint64_t(idle.count()));
+			size_t removed(0);
+
+			for(unsigned s = 0 ; s <= _shardMask ; ++s)
+			{
+				Shard & shard(_shards[s]);
+				std::lock_guard<std::mutex> lock(shard._mutex);
+
+				/* A removal may shift another entry into the
+				 * current slot, which is then checked again */
+				for(size_t i = 0 ; i <= _slotMask ; )
+				{
+					Slot & slot(shard._slots[i]);
+					PeerKey key;
+					T value = T();
+					unsigned state(SLOT_USED);
+
+					/* Sessions used after the scan began
+					 * are newer than date: kept */
+					if(slot._state.load(std::memory_order_relaxed)
+						!= SLOT_USED || slot._lastUse.load(
+						std::memory_order_relaxed) + limit
+						>= date)
+					{
+						++i;
+						continue;
+					}
+
+					for(unsigned w = 0 ; w < PEER_KEY_WORDS ;
+							++w)
+						key.words[w] = slot._key[w].load(
+						std::memory_order_relaxed);
+
+					read(slot, key, state, &value);
+					expired(key.address(), value);
+
+					remove(shard, i);
+					++removed;
+				}
+			}
+
+			return removed;
+		}
+		size_t expire(std::chrono::nanoseconds const idle)
+		{
+			return expire(idle, [](SockAddr const &, T const &) {});
+		}
+
+		/* Start a thread expiring idle sessions every period, calling
+		 * expired for each of them if set (restarts it if running) */
+		void startExpiry(std::chrono::nanoseconds const idle,
+				std::chrono::nanoseconds const period,
+				std::function<void (SockAddr const &,
+					T const &)> expired = nullptr)
+		{
+			stopExpiry();
+
+			_expiring = true;
+			_expiry = std::thread([this, idle, period, expired]()
+			{
+				std::unique_lock<std::mutex> lock(_expiryMutex);
+
+				while(!_expiryWakeup.wait_for(lock, period,
+						[this]() { return !_expiring; }))
+				{
+					if(expired)
+						expire(idle, expired);
+					else
+						expire(idle);
+				}
+			});
+		}
+
+		/* Stop the expiry thread, if any */
+		void stopExpiry()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_expiryMutex);
+				_expiring = false;
+			}
+
+			_expiryWakeup.notify_all();
+
+			if(_expiry.joinable())
+				_expiry.join();
+		}
+
+		/* Number of sessions (approximate while being written) */
+		size_t size() const
+		{
+			size_t total(0);
+
+			for(unsigned s = 0 ; s <= _shardMask ; ++s)
+				total += _shards[s]._size.load(
+						std::memory_order_relaxed);
+
+			return total;
+		}
+
+		/* Maximum number of sessions */
+		size_t capacity() const
+		{
+			return size_t(_shardMask + 1) * (_slotMask + 1);
+		}
+};
+
+}
+
+#endif // SESSIONTABLE_HPP_INCLUDED
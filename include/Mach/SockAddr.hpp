@@ -0,0 +1,125 @@
+#ifndef SOCKADDR_HPP_INCLUDED
+#define SOCKADDR_HPP_INCLUDED
+
+#include "NetComponent.hpp"
+#include <functional>
+#include <type_traits>
+
+/* Buffer size fitting any formatted SockAddr, NUL included
+ * ("[" IPv6 "]:" port) */
+#define SOCKADDR_STRLEN (INET6_ADDRSTRLEN + 8)
+
+/* Endpoint hash seed & multiplier (shared with PeerKey & UDPServer's flow
+ * steering) */
+#define PEER_HASH_SEED 0x811C9DC5u
+#define PEER_HASH_PRIME 0x9E3779B1u
+
+
+namespace Mach
+{
+
+/*
+ * IPv4 or IPv6 endpoint (address & port) value
+ *
+ * Holds a sockaddr_in or sockaddr_in6 (28 bytes, trivially copyable) which
+ * can be handed over to the socket API as is. Comparing, hashing, formatting
+ * into a caller buffer & parsing never allocate, unlike the addrinfo helpers
+ * of NetComponent, so that endpoints can be used as keys on the receive path.
+ */
+class SockAddr
+{
+	private:
+		/* IPv6 storage, also holding sockaddr_in (same family field)
+		 * or nothing (AF_UNSPEC) */
+		sockaddr_in6 _address;
+
+	public:
+		/* Constructors (the default endpoint is unspecified, any other
+		 * family than AF_INET & AF_INET6 yields it too) */
+		constexpr SockAddr()
+			:
+			_address()
+		{
+		}
+		explicit SockAddr(sockaddr const *);
+		explicit SockAddr(sockaddr_storage const &);
+
+		/* Parse "a.b.c.d[:port]", "[IPv6]:port" or a bare IPv6
+		 * address into endpoint, returns false (leaving it untouched)
+		 * if the text is not one of those */
+		static bool parse(char const *, SockAddr & endpoint);
+
+		/* Address family & checks */
+		constexpr int family() const
+		{
+			return _address.sin6_family;
+		}
+		constexpr bool ipv4() const
+		{
+			return family() == AF_INET;
+		}
+		constexpr bool ipv6() const
+		{
+			return family() == AF_INET6;
+		}
+		constexpr bool valid() const
+		{
+			return ipv4() || ipv6();
+		}
+
+		/* Port (host order) */
+		unsigned short port() const;
+		void setPort(unsigned short const);
+
+		/* Socket API view */
+		sockaddr const * get() const
+		{
+			return (sockaddr const *)(&_address);
+		}
+		socklen_t length() const
+		{
+			return socklen_t(ipv4() ? sizeof(sockaddr_in)
+					: sizeof(sockaddr_in6));
+		}
+		sockaddr_storage storage() const;
+
+		/* Hash of the address & port (same as PeerKey::hash() and
+		 * UDPServer's flow steering, IPv4-mapped addresses hashing as
+		 * IPv4) */
+		uint32_t hash() const;
+
+		/* Write "a.b.c.d:port" or "[IPv6]:port" (the address only if
+		 * withPort is false) and a final NUL into the buffer, returns
+		 * the formatted length (0 if the buffer is too small) */
+		size_t format(char * buffer, size_t const size,
+				bool const withPort = true) const;
+
+		/* Comparison (family, then address, then port) */
+		bool operator == (SockAddr const &) const;
+		bool operator != (SockAddr const &) const;
+		bool operator < (SockAddr const &) const;
+};
+
+static_assert(sizeof(SockAddr) == sizeof(sockaddr_in6),
+		"SockAddr must be as large as sockaddr_in6");
+static_assert(std::is_trivially_copyable<SockAddr>::value,
+		"SockAddr must be trivially copyable");
+
+}
+
+/* Hashing support for the standard unordered containers */
+namespace std
+{
+
+template <>
+struct hash<Mach::SockAddr>
+{
+	size_t operator () (Mach::SockAddr const & endpoint) const
+	{
+		return endpoint.hash();
+	}
+};
+
+}
+
+#endif // SOCKADDR_HPP_INCLUDED
@@ -0,0 +1,193 @@
+#ifndef TIMERWHEEL_HPP_INCLUDED
+#define TIMERWHEEL_HPP_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <vector>
+
+/* Wheel geometry: levels & slots per level (each level covering 256 times
+ * the span of the previous one, i.e. 2^32 ticks in all) */
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 8
+#define TIMER_SLOTS (1u << TIMER_SLOT_BITS)
+
+
+namespace Mach
+{
+
+/*
+ * Hierarchical timing wheel
+ *
+ * Holds any number of timers, each carrying a 64-bit user value handed back
+ * when it expires. Time is cut into ticks (1 ms by default): level 0 has a
+ * slot per tick for the next 256 ticks, level 1 a slot per 256 ticks for the
+ * next 65536, and so on up to 2^32 ticks (longer delays are clamped). Timers
+ * are kept in intrusive doubly linked lists, one per slot, so that
+ * scheduling, cancelling & restarting a timer are O(1). When level 0 wraps,
+ * the next level's current slot is cascaded down (its timers being spread
+ * over the lower level), which amortizes to O(1) per timer as well; advancing
+ * the wheel skips empty level 0 slots through per-level occupancy bitmaps.
+ * Timers fire no earlier than their deadline, and at most one tick (plus the
+ * clock's own granularity) late.
+ * The wheel is driven by a coarse monotonic clock (CLOCK_MONOTONIC_COARSE on
+ * Linux, which costs a few nanoseconds to read but only moves once per
+ * kernel tick), see clock(). Expiries are computed from a precise reading of
+ * the same clock (rounded up to the next tick), the coarse one lagging behind
+ * by up to a kernel tick but never running ahead.
+ * A wheel is NOT thread-safe: it belongs to a single thread, typically a
+ * receiving thread of an UDPServer (see UDPServer::setTimerWheel(...)).
+ */
+class TimerWheel
+{
+	public:
+		/* Timer handle (never 0, stale once the timer has fired or
+		 * been cancelled) */
+		typedef uint64_t TimerId;
+
+	private:
+		/* Timer storage (pooled, linked by index) */
+		struct Timer
+		{
+			uint64_t expiry;
+			uint64_t data;
+			uint32_t prev;
+			uint32_t next;
+			uint32_t generation;
+			uint32_t slot;
+		};
+
+		/* Timers, free ones being chained through next */
+		std::vector<Timer> _timers;
+		uint32_t _free;
+
+		/* List heads of every slot (level * TIMER_SLOTS + index) &
+		 * occupancy bitmaps */
+		uint32_t _heads[TIMER_LEVELS * TIMER_SLOTS];
+		uint64_t _occupied[TIMER_LEVELS][TIMER_SLOTS / 64];
+
+		/* Tick length (nanoseconds), last tick processed & number of
+		 * pending timers */
+		uint64_t const _tick;
+		uint64_t _now;
+		size_t _size;
+
+		/* Put a timer into the slot its expiry falls in */
+		void link(uint32_t const);
+
+		/* Take a timer out of its slot */
+		void unlink(uint32_t const);
+
+		/* Spread the timers of a slot over the lower levels */
+		void cascade(unsigned const level, unsigned const index);
+
+		/* Next tick needing work (an occupied level 0 slot or the
+		 * next cascade) up to limit */
+		uint64_t nextStep(uint64_t const limit) const;
+
+		/* Detach the first timer of a level 0 slot & release it,
+		 * returns its id & data (false if the slot is empty) */
+		bool pop(unsigned const index, TimerId &, uint64_t & data);
+
+		/* Index of a live timer (UINT32_MAX if the id is stale) */
+		uint32_t find(TimerId const) const;
+
+		/* Expiry tick of a timer started now */
+		uint64_t expiryOf(std::chrono::nanoseconds const) const;
+
+		/* Precise monotonic date (nanoseconds, same origin as
+		 * clock()) */
+		static uint64_t preciseClock();
+
+	public:
+		/* Constructor (the wheel starts at the current clock date) */
+		explicit TimerWheel(std::chrono::nanoseconds const tick
+				= std::chrono::milliseconds(1));
+
+		/* Copy & assignation are forbidden */
+		TimerWheel(TimerWheel const &) = delete;
+		TimerWheel & operator = (TimerWheel const &) = delete;
+
+		/* Coarse monotonic date (nanoseconds) */
+		static uint64_t clock();
+
+		/* Start a timer expiring after the given delay (at least one
+		 * tick), returns its handle */
+		TimerId schedule(std::chrono::nanoseconds const delay,
+				uint64_t const data);
+
+		/* Stop a timer, returns false if it is no longer pending */
+		bool cancel(TimerId const);
+
+		/* Push a pending timer's expiry to the given delay from now
+		 * (keeping its handle), returns false if it is no longer
+		 * pending */
+		bool restart(TimerId const, std::chrono::nanoseconds const);
+
+		/* Move the wheel to the given clock date, calling
+		 * expired(TimerId, uint64_t data) for each timer due (in
+		 * expiry order, give or take a tick), returns how many fired.
+		 * Callbacks may schedule, cancel & restart timers. */
+		template<class Expired>
+		size_t advance(uint64_t const date, Expired && expired)
+		{
+			uint64_t const target(date / _tick);
+			size_t fired(0);
+
+			while(_now < target)
+			{
+				if(_size == 0)
+				{
+					_now = target;
+					break;
+				}
+
+				_now = nextStep(target);
+
+				unsigned const index(unsigned(_now)
+						& (TIMER_SLOTS - 1));
+				TimerId id(0);
+				uint64_t data(0);
+
+				/* Level 0 wrapped: cascade the levels above
+				 * (each one only when the lower one wraps) */
+				for(unsigned level = 1 ; level < TIMER_LEVELS
+						&& (_now & ((uint64_t(1)
+						<< (TIMER_SLOT_BITS * level))
+						- 1)) == 0 ; ++level)
+					cascade(level, unsigned(_now
+						>> (TIMER_SLOT_BITS * level))
+						& (TIMER_SLOTS - 1));
+
+				while(pop(index, id, data))
+				{
+					expired(id, data);
+					++fired;
+				}
+			}
+
+			return fired;
+		}
+
+		/* Same, up to the current clock date */
+		template<class Expired>
+		size_t poll(Expired && expired)
+		{
+			return advance(clock(), expired);
+		}
+
+		/* Clock date by which advance(...) has work to do (the next
+		 * expiry or cascade, UINT64_MAX if no timer is pending) */
+		uint64_t nextDeadline() const;
+
+		/* Pending timers */
+		size_t size() const;
+		bool empty() const;
+
+		/* Tick length */
+		std::chrono::nanoseconds tick() const;
+};
+
+}
+
+#endif // TIMERWHEEL_HPP_INCLUDED
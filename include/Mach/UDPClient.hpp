@@ -3,11 +3,42 @@
 
 #include "NetComponent.hpp"
 #include <string>
+#include <chrono>
+
+/* Paced sends: how long before a departure the hybrid wait stops sleeping &
+ * spins (nanoseconds, about a scheduler wake-up delay), and how far ahead of
+ * their departure kernel-timed datagrams are handed over (nanoseconds) */
+#define PACING_SPIN 60000
+#define PACING_LEAD 1000000
 
 
 namespace Mach
 {
 
+/*
+ * Paced transmission statistics (see UDPClient::setPacing(...))
+ */
+struct PacingStatistics
+{
+	/* Datagrams sent through sendPaced(...) & target rate (datagrams per
+	 * second) */
+	unsigned long datagrams;
+	double targetRate;
+
+	/* Rate achieved from the first departure to the last one */
+	double achievedRate;
+
+	/* Inter-departure jitter: mean & largest deviation of the gaps
+	 * between departures from the target interval (nanoseconds) */
+	double jitter;
+	double maxJitter;
+
+	/* Were departure dates handed over to the kernel (SO_TXTIME) ? The
+	 * actual departures are then unknown to the client: the rate & jitter
+	 * are not measured (0) */
+	bool txtime;
+};
+
 /*
  * UDP client
  *
@@ -16,14 +47,55 @@ namespace Mach
  * The API is very straightforward as we're working with UDP, therefore MTU and
  * packet loss issues should be addressed on a higher level.
  * You can basicaly achieve this by inheriting this class and adding some
- * clever custom mechanisms around the send & receive methods.
+ * clever custom mechanisms around the send & receive methods (ReliableClient
+ * does so for reliable, ordered delivery).
+ * setPacing(...) spreads the datagrams sent through sendPaced(...) evenly at a
+ * target rate instead of letting them leave in bursts which overflow the
+ * receiver: each one gets a departure date, and is either handed to the kernel
+ * with it (SO_TXTIME) or sent once it is due, after sleeping until shortly
+ * before then spinning on the monotonic clock (sleeping alone being late by
+ * tens of microseconds at best).
+ * SO_TXTIME dates are only enforced by the fq qdisc (e.g. "tc qdisc replace
+ * dev eth0 root fq"; etf wants CLOCK_TAI dates): on interfaces without it,
+ * the loopback included, datagrams leave as soon as they are handed over,
+ * i.e. PACING_LEAD ahead of their date.
+ * A sender falling behind resumes at the target rate without catching up with
+ * a burst.
  */
 class UDPClient : public NetComponent
 {
+	private:
+		/* Interval between paced departures (nanoseconds, 0 if not
+		 * pacing), next departure date & kernel timing */
+		uint64_t _interval;
+		uint64_t _nextDeparture;
+		bool _txtime;
+
+		/* Paced departures: count, first & last date, sum & largest
+		 * deviation from the interval */
+		unsigned long _departures;
+		uint64_t _firstDeparture;
+		uint64_t _lastDeparture;
+		double _deviation;
+		double _maxDeviation;
+
+		/* Monotonic date (nanoseconds, SO_TXTIME's clock) */
+		static uint64_t now();
+
+		/* Sleep, then spin until the given date, returns the date */
+		static uint64_t waitUntil(uint64_t const);
+
+		/* Send a datagram the kernel holds until the given date */
+		void sendAt(uint8_t const *, size_t const, uint64_t const date);
+
 	protected:
 		/* Remote server connection socket */
 		int _socket;
 
+		/* Wait for a datagram for at most the given time (forever if
+		 * negative), returns whether one is pending */
+		bool pending(std::chrono::microseconds const) const;
+
 	public:
 		/* Constructors & destructor */
 		UDPClient();
@@ -42,8 +114,32 @@ class UDPClient : public NetComponent
 		/* Send some bytes to the remote server */
 		void sendBytes(uint8_t const *, size_t const) const;
 
-		/* Receive some bytes from the remote server */
-		void receiveBytes(uint8_t *, size_t const) const;
+		/* Receive a datagram from the remote server, waiting for at
+		 * most the given time (forever if negative), returns its
+		 * length (-1 on timeout) */
+		long receiveBytes(uint8_t *, size_t const,
+				std::chrono::milliseconds const timeout
+					= std::chrono::milliseconds(-1)) const;
+
+		/* Set the socket receive buffer size (SO_RCVBUFFORCE if
+		 * allowed, SO_RCVBUF otherwise, must be connected), returns
+		 * the size the kernel actually uses */
+		size_t setReceiveBuffer(size_t const);
+
+		/* Pace sendPaced(...) at the given rate (datagrams per second,
+		 * 0 to stop pacing), handing departure dates over to the
+		 * kernel if txtime is set and SO_TXTIME is available (Linux,
+		 * must be connected, the outgoing interface needing the fq
+		 * qdisc to enforce them), returns whether it does. Resets the
+		 * pacing statistics. */
+		bool setPacing(double const rate, bool const txtime = false);
+
+		/* Send some bytes to the remote server at the next paced
+		 * departure date (right away if not pacing) */
+		void sendPaced(uint8_t const *, size_t const);
+
+		/* Paced transmission counters */
+		PacingStatistics pacingStatistics() const;
 };
 
 }
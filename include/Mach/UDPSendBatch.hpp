@@ -0,0 +1,137 @@
+#ifndef UDPSENDBATCH_HPP_INCLUDED
+#define UDPSENDBATCH_HPP_INCLUDED
+
+#include "NetComponent.hpp"
+#include <chrono>
+#include <vector>
+
+/* Linux-specific bits */
+#if defined(__gnu_linux__)
+#include <sys/uio.h>
+#endif
+
+/* Default number of results kept until collected */
+#define SEND_RESULTS_MAX 65536
+
+
+namespace Mach
+{
+
+/*
+ * Outcome of a datagram sent through an UDPSendBatch
+ */
+struct SendResult
+{
+	/* Identifier returned by UDPSendBatch::queue(...) */
+	unsigned long id;
+
+	/* 0 on success, errno (or WSAGetLastError()) value otherwise */
+	int error;
+
+	/* Number of bytes actually sent */
+	size_t bytes;
+};
+
+/*
+ * Batched datagram sender
+ *
+ * Queues (buffer, destination) pairs for a given socket and sends them using
+ * as few sendmmsg() system calls as possible (one sendto() per datagram on
+ * other platforms). This is meant for fan-out: the same buffer can be queued
+ * for thousands of peers, as buffers are NOT copied and must stay valid until
+ * they have been flushed.
+ * The queue is flushed automatically whenever it holds "capacity" datagrams
+ * or when its oldest datagram has been waiting for more than "maxDelay"
+ * (checked by queue(...) and poll()).
+ * Failures never throw: each datagram gets its own SendResult, collected
+ * through results(...). At most "maxResults" of them are kept: callers must
+ * collect them regularly, the ones arriving while full being dropped (and
+ * counted, see droppedResults()).
+ * Trains of equal-sized datagrams going to the same destination can be queued
+ * as a single contiguous buffer through queueSegmented(...): on Linux the
+ * kernel splits it (UDP_SEGMENT, i.e. GSO), saving one trip through the stack
+ * per datagram.
+ */
+class UDPSendBatch : public NetComponent
+{
+	private:
+		/* Destination socket */
+		int const _socket;
+
+		/* Flush thresholds */
+		size_t const _capacity;
+		std::chrono::microseconds const _maxDelay;
+
+		/* Queued datagrams (& segment size of the trains, 0 for plain
+		 * datagrams) */
+#if defined(__gnu_linux__)
+		std::vector<mmsghdr> _headers;
+		std::vector<iovec> _vectors;
+		std::vector<uint64_t> _controls;
+#else
+		std::vector< std::pair<uint8_t const *, size_t> > _vectors;
+#endif
+		std::vector<sockaddr_storage> _destinations;
+		std::vector<bool> _addressed;
+		std::vector<uint16_t> _segments;
+
+		/* Queuing date of the oldest queued datagram */
+		std::chrono::steady_clock::time_point _oldest;
+
+		/* Identifier of the next queued datagram */
+		unsigned long _nextId;
+
+		/* Results not yet collected, bounded */
+		std::vector<SendResult> _results;
+		size_t const _maxResults;
+		unsigned long _droppedResults;
+
+		/* Record the outcome of the i-th queued datagram */
+		void record(size_t const, int const, size_t const);
+
+	public:
+		/* Constructor & destructor (pending datagrams are flushed) */
+		UDPSendBatch(int const socket, size_t const capacity = 64,
+				std::chrono::microseconds const maxDelay
+					= std::chrono::microseconds(1000),
+				size_t const maxResults = SEND_RESULTS_MAX);
+		virtual ~UDPSendBatch();
+
+		/* Copy & assignation are forbidden */
+		UDPSendBatch(UDPSendBatch const &) = delete;
+		UDPSendBatch & operator = (UDPSendBatch const &) = delete;
+
+		/* Queue a datagram (destination may be nullptr on a connected
+		 * socket), returns its identifier */
+		unsigned long queue(uint8_t const *, size_t const,
+				sockaddr const * = nullptr);
+
+		/* Queue a train of datagrams of segment bytes each (the last
+		 * one may be shorter) stored contiguously, sent with a single
+		 * UDP_SEGMENT message on Linux, returns its identifier (its
+		 * SendResult covers the whole train) */
+		unsigned long queueSegmented(uint8_t const *, size_t const,
+				uint16_t const segment,
+				sockaddr const * = nullptr);
+
+		/* Flush if the time threshold has been reached */
+		void poll();
+
+		/* Send all queued datagrams now, returns the number of
+		 * datagrams successfully sent */
+		size_t flush();
+
+		/* Number of queued datagrams */
+		size_t pending() const;
+
+		/* Move the results collected so far into the given vector */
+		void results(std::vector<SendResult> &);
+
+		/* Number of results dropped since the batch was created, for
+		 * not having been collected in time */
+		unsigned long droppedResults() const;
+};
+
+}
+
+#endif // UDPSENDBATCH_HPP_INCLUDED
@@ -3,18 +3,234 @@
 
 #include "NetComponent.hpp"
 #include "Logger.hpp"
+#include "URing.hpp"
+#include "SPSCQueue.hpp"
+#include "PacketPool.hpp"
+#include "Histogram.hpp"
+#include "SockAddr.hpp"
+#include "SessionTable.hpp"
+#include "RateLimiter.hpp"
+#include "TimerWheel.hpp"
 #include <string>
 #include <vector>
 #include <utility>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
-/* Arbitrary datagram max buffer size */
-#define PACKET_SIZE 65535
+/* Maximum number of datagrams received by a single batch */
+#define BATCH_SIZE_MAX 1024
 
 
 namespace Mach
 {
 
+/*
+ * Receive backends, chosen when constructing a UDPServer
+ */
+enum ReceiveBackend
+{
+	/* One blocking listening thread per socket */
+	BACKEND_BLOCKING,
+
+	/* Fixed pool of epoll event loops serving non-blocking sockets
+	 * (Linux only, see UDPServer::setEventLoops(...)) */
+	BACKEND_EPOLL,
+
+	/* Same event loops driving io_uring instances instead: multishot
+	 * recvmsg into provided buffers on registered sockets (Linux only,
+	 * falls back to BACKEND_EPOLL when the kernel lacks support) */
+	BACKEND_URING
+};
+
+/*
+ * What to do with a datagram when the worker it is handed to has a full queue
+ * (see UDPServer::setWorkers(...))
+ */
+enum OverflowPolicy
+{
+	/* Drop it & count it */
+	OVERFLOW_DROP,
+
+	/* Wait for room, which stops reading the socket: the kernel then drops
+	 * datagrams once the socket receive buffer is full */
+	OVERFLOW_BLOCK
+};
+
+/*
+ * Placement of the receiving threads (see UDPServer::setPlacement(...))
+ */
+struct Placement
+{
+	/* CPUs the receiving threads (listeners or event loops) are pinned
+	 * to, round-robin (empty to let them float) */
+	std::vector<unsigned> cpus;
+
+	/* Have the kernel steer each socket's flows (within SO_REUSEPORT
+	 * groups) to the socket whose thread is pinned on the CPU receiving
+	 * them (SO_INCOMING_CPU) */
+	bool incomingCpu;
+
+	/* Microseconds spent busy-polling the device queue when a receive
+	 * call finds the socket empty (SO_BUSY_POLL, 0 to disable, raising
+	 * it above net.core.busy_read requires CAP_NET_ADMIN) */
+	unsigned busyPoll;
+
+	/* Non-blocking receive attempts (or epoll_wait() polls) before
+	 * blocking, when latency matters more than CPU time (blocking &
+	 * epoll backends, 0 to block right away) */
+	unsigned spins;
+
+	/* Packet buffers each receiving thread allocates & touches when it
+	 * starts, after being pinned, so that they live on its NUMA node
+	 * (0 to allocate them on demand) */
+	size_t prefault;
+
+	/* Default placement: floating threads, blocking right away */
+	Placement()
+		:
+		incomingCpu(false),
+		busyPoll(0),
+		spins(0),
+		prefault(0)
+	{
+	}
+};
+
+/*
+ * Received datagram, as handed to UDPServer::receiveBatch(...)
+ * Pointers are only valid during the handler call: copy the PacketRef to keep
+ * the datagram (without copying its content).
+ */
+struct Datagram
+{
+	/* Payload */
+	uint8_t const * data;
+	size_t length;
+
+	/* Remote end address and port (machine readable form) */
+	sockaddr_storage const * sender;
+
+	/* Pooled buffer holding the datagram */
+	PacketRef const * packet;
+};
+
+/*
+ * Batched receive statistics (see UDPServer::setBatchSize(...))
+ */
+struct BatchStatistics
+{
+	/* Number of receive calls which returned something */
+	unsigned long batches;
+
+	/* Number of datagrams received through those calls (those split out
+	 * of GRO super-packets included) */
+	unsigned long datagrams;
+
+	/* fill[n] = number of batches holding exactly n messages (a GRO
+	 * super-packet counting as one), up to the largest batch seen */
+	std::vector<unsigned long> fill;
+
+	/* Datagrams split out of GRO super-packets */
+	unsigned long segments;
+
+	/* Datagrams dropped because the packet pool was exhausted (the
+	 * io_uring backend leaves them in the socket for the kernel to drop) */
+	unsigned long exhausted;
+};
+
+/*
+ * Server counters, summed over all sockets, receiving threads & workers (see
+ * UDPServer::statistics())
+ */
+struct ServerStatistics
+{
+	/* Datagrams & bytes received (rate limit & worker queue drops
+	 * included) */
+	unsigned long packets;
+	unsigned long bytes;
+
+	/* Receive calls which returned something */
+	unsigned long batches;
+
+	/* Datagrams dropped by the kernel because a socket receive buffer
+	 * was full (SO_RXQ_OVFL, Linux only and not with setBatchSize(0), as
+	 * of the last datagram each socket received), because the packet pool was exhausted & because
+	 * a worker queue was full */
+	unsigned long kernelDrops;
+	unsigned long poolDrops;
+	unsigned long queueDrops;
+
+	/* Datagrams refused because their sender was over its packet rate
+	 * or its byte rate, and datagrams let through unlimited because the
+	 * peer table was full (see UDPServer::setRateLimit(...)) */
+	unsigned long packetRateDrops;
+	unsigned long byteRateDrops;
+	unsigned long untrackedPeers;
+
+	/* Timers fired by the receiving threads' wheels (see
+	 * UDPServer::setTimerWheel(...)) */
+	unsigned long timersFired;
+
+	/* Failed sendBytes(...) calls & datagrams handlers failed to send
+	 * otherwise (see UDPServer::sendFailed(...)) */
+	unsigned long sendFailures;
+
+	/* Handler calls (a batch counting as one) & time spent in them */
+	unsigned long handlerCalls;
+	uint64_t handlerNanoseconds;
+};
+
+/*
+ * Per-datagram latency histograms, in nanoseconds (see
+ * UDPServer::setTimestamps(...))
+ */
+struct LatencyStatistics
+{
+	/* From kernel arrival to handler start (time spent in the socket
+	 * buffer, the receiving thread & worker queues) */
+	Histogram queueing;
+
+	/* Handler duration (per datagram, batches being averaged) */
+	Histogram handling;
+};
+
+/*
+ * Share of the received traffic handled by a listening socket (see
+ * UDPServer::listenerLoad())
+ */
+struct ListenerLoad
+{
+	/* Socket file descriptor & bound address family */
+	int socket;
+	int family;
+
+	/* Datagrams received so far (those split out of GRO super-packets
+	 * included) */
+	unsigned long datagrams;
+
+	/* Fraction of the datagrams received by all sockets of the family */
+	double share;
+};
+
+/*
+ * Worker pool statistics (see UDPServer::workerStatistics())
+ */
+struct WorkerStatistics
+{
+	/* Datagrams handed to the worker, dropped on overflow & handled */
+	unsigned long queued;
+	unsigned long dropped;
+	unsigned long handled;
+
+	/* Current number of queued datagrams & highest depth reached by any
+	 * of the worker's queues */
+	size_t depth;
+	size_t maxDepth;
+};
+
 /*
  * UDP server
  *
@@ -23,45 +239,377 @@ namespace Mach
  * Users of this class shall inherit from it and implement the
  * receiveBytes(...) method in order to instantiate a concrete server.
  * It uses a threaded model, so any implementation of UDPServer::receiveBytes
- * should be thought in a thread-safe way: using std::mutex for queuing
- * incoming messages into a common data structure might be a good idea,
- * for example.
+ * should be thought in a thread-safe way.
+ * By default handlers run inline on the receiving threads, so a slow handler
+ * holds its socket back. setWorkers(...) decouples them: receiving threads
+ * then copy datagrams into bounded lock-free queues (one per receiving thread
+ * and worker) and a pool of worker threads runs the handlers.
+ * On Linux, datagrams can be received by batches (see setBatchSize(...)),
+ * pulling up to N datagrams per recvmmsg() system call.
+ * Several listening sockets (and threads) can also be bound to each address
+ * using SO_REUSEPORT, the kernel spreading incoming flows between them so
+ * that receive throughput scales with the number of cores.
+ * Instead of one blocking thread per socket, the BACKEND_EPOLL backend serves
+ * every socket from a fixed number of event loops, which is better suited to
+ * servers holding many sockets. Its loops are woken up through an eventfd
+ * when stopping, before the sockets are closed.
+ * BACKEND_URING goes further, each event loop keeping one multishot recvmsg
+ * armed per socket so that receiving costs next to no system call at all.
+ * With setGRO(true), the kernel hands trains of equal-sized datagrams over as
+ * single super-packets, which are split back into datagrams (slices of the
+ * same pooled buffer) before reaching the handlers.
+ * Latency-critical servers may pin their receiving threads, steer flows to
+ * them and have them busy-poll or spin before blocking (see setPlacement()).
+ * With setFlowSteering(true), a classic BPF program hashes each datagram's
+ * source address & port to pick the socket of its SO_REUSEPORT group, and
+ * the same hash (flowHash(...)) picks its worker: all datagrams from a peer
+ * are then handled by the same thread, which can keep per-peer state in
+ * thread-local storage without any locking.
+ * setRateLimit(...) adds an admission stage in front of the handlers, each
+ * peer's datagrams being charged to its own packet & byte token buckets.
+ * Counters (see statistics()) live in cache line padded per-socket and
+ * per-thread slots, each written by a single thread and only summed on read.
+ * setTimestamps(true) stamps each datagram with its kernel arrival date and
+ * records how long datagrams wait before their handler runs, and how long the
+ * handlers take, into lock-free log-linear histograms (32 sub-buckets per
+ * power of 2, see Histogram).
+ * setTimerWheel(...) gives each receiving thread a hierarchical timing wheel,
+ * driven by its loop: handlers running inline schedule session expiries,
+ * retransmissions or keepalives on their own thread's wheel (no locking, and
+ * with flow steering a peer's timers stay on the thread handling its
+ * datagrams) and timerExpired(...) is called back from there. Event loops
+ * sleep until the next deadline, blocking listeners & io_uring loops wake up
+ * once per tick while their wheel holds timers.
  */
 class UDPServer : public NetComponent
 {
 	private:
+		/* Listening socket along with its per-thread state (padded so
+		 * that the counters of different threads never share a cache
+		 * line) */
+		struct Listener
+		{
+			char _padding0[CACHE_LINE_SIZE];
+
+			/* Socket file descriptor */
+			int _socket;
+
+			/* Bound address family */
+			int _family;
+
+			/* Rank among the sockets bound to the same address */
+			unsigned _rank;
+
+			/* Position in _sockets */
+			unsigned _index;
+
+			/* Receive counters (only written by the thread serving
+			 * the socket, hence relaxed atomics): datagrams & bytes
+			 * received, datagrams dropped because the
+			 * packet pool was exhausted, datagrams split out of GRO
+			 * super-packets & kernel drop count (SO_RXQ_OVFL) */
+			std::atomic<unsigned long> _packets;
+			std::atomic<unsigned long> _bytes;
+			std::atomic<unsigned long> _exhausted;
+			std::atomic<unsigned long> _segments;
+			std::atomic<unsigned long> _kernelDrops;
+
+			/* Failed sends through the socket (any thread, rare
+			 * enough not to need a slot of its own) */
+			std::atomic<unsigned long> _sendFailures;
+
+			/* Batch fill histogram (same writer as the counters) */
+			std::unique_ptr< std::atomic<unsigned long>[] > _fill;
+
+			char _padding1[CACHE_LINE_SIZE];
+
+			/* Count a batch of the given number of messages, holding
+			 * datagrams datagrams & bytes bytes */
+			void received(unsigned const messages,
+					unsigned const datagrams,
+					size_t const bytes)
+			{
+				_fill[messages].fetch_add(1,
+						std::memory_order_relaxed);
+				_packets.fetch_add(datagrams,
+						std::memory_order_relaxed);
+				_bytes.fetch_add(bytes,
+						std::memory_order_relaxed);
+			}
+		};
+
+		/* Per-thread receive buffers (batched & event loop modes) */
+		struct ReceiveBuffers;
+
+		/* Queue between a receiving thread and a worker, along with its
+		 * producer-side counters */
+		struct WorkQueue
+		{
+			SPSCQueue<PacketRef> _ring;
+			std::atomic<unsigned long> _queued;
+			std::atomic<unsigned long> _dropped;
+			std::atomic<unsigned long> _maxDepth;
+
+			explicit WorkQueue(size_t const capacity)
+				:
+				_ring(capacity),
+				_queued(0),
+				_dropped(0),
+				_maxDepth(0)
+			{
+			}
+		};
+
+		/* Counters & latency histograms of a thread running handlers
+		 * (padded, see Listener) */
+		struct HandlerSlot
+		{
+			char _padding0[CACHE_LINE_SIZE];
+
+			/* Handler calls & time spent in them */
+			std::atomic<unsigned long> _calls;
+			std::atomic<uint64_t> _nanoseconds;
+
+			/* Filled when timestamps are enabled */
+			Histogram _queueing;
+			Histogram _handling;
+
+			/* Admission verdicts other than RATE_ADMITTED
+			 * (receiving threads' slots only) */
+			std::atomic<unsigned long> _packetRateDrops;
+			std::atomic<unsigned long> _byteRateDrops;
+			std::atomic<unsigned long> _untracked;
+
+			/* Timers fired (receiving threads' slots only) */
+			std::atomic<unsigned long> _timersFired;
+
+			char _padding1[CACHE_LINE_SIZE];
+
+			HandlerSlot()
+				:
+				_calls(0),
+				_nanoseconds(0),
+				_packetRateDrops(0),
+				_byteRateDrops(0),
+				_untracked(0),
+				_timersFired(0)
+			{
+			}
+		};
+
+		/* Handler thread & its queues (one per receiving thread) */
+		struct Worker
+		{
+			std::vector< std::unique_ptr<WorkQueue> > _queues;
+			std::atomic<unsigned long> _handled;
+			HandlerSlot _slot;
+
+			/* Idle workers sleep on _wakeup */
+			std::atomic<bool> _sleeping;
+			std::mutex _mutex;
+			std::condition_variable _wakeup;
+		};
+
 		/* Is the server currently listening ? */
 		bool _listening;
 
-		/* Socket vector <file descriptor , address information> */
-		std::vector< std::pair< int, addrinfo > > _sockets;
+		/* Maximum number of datagrams per receive call */
+		unsigned _batchSize;
+
+		/* Do blocking listeners make plain recvfrom() calls (see
+		 * setBatchSize(...)) ? */
+		bool _plainReceive;
+
+		/* Number of listening sockets bound to each address */
+		unsigned const _listenersPerAddress;
+
+		/* Receive backend in use */
+		ReceiveBackend _backend;
+
+		/* Bound sockets */
+		std::vector< std::unique_ptr<Listener> > _sockets;
 
-		/* Currently running listener threads */
+		/* Currently running listener threads (or event loops) */
 		std::vector< std::thread > _threads;
 
+		/* Number of event loops (BACKEND_EPOLL) */
+		unsigned _eventLoops;
+
+		/* Event loops' epoll instances & shared wakeup eventfd */
+		std::vector<int> _epolls;
+		int _wakeup;
+
+		/* Worker pool (empty if handlers run inline) & its settings */
+		std::vector< std::unique_ptr<Worker> > _workers;
+		std::vector< std::thread > _workerThreads;
+		unsigned _workerCount;
+		size_t _queueCapacity;
+		OverflowPolicy _overflow;
+		std::atomic<bool> _working;
+
+		/* Maximum number of packet buffers per receiving thread */
+		size_t _poolSize;
+
+		/* Is UDP GRO requested ? */
+		bool _gro;
+
+		/* Are kernel timestamps requested ? */
+		bool _timestamps;
+
+		/* Placement of the receiving threads */
+		Placement _placement;
+
+		/* Is flow steering requested ? */
+		bool _steering;
+
+		/* Tick of the receiving threads' timer wheels (0 if none) */
+		std::chrono::nanoseconds _timerTick;
+
+		/* Per-peer rate limiter (nullptr if unlimited) */
+		std::unique_ptr<RateLimiter> _limiter;
+
+		/* Handler counters of the receiving threads (handlers running
+		 * inline) */
+		std::vector< std::unique_ptr<HandlerSlot> > _handlerSlots;
+
+#if defined(__gnu_linux__)
+		/* Event loops' io_uring instances (BACKEND_URING) */
+		std::vector< std::unique_ptr<URing> > _rings;
+#endif
+
 		/* Error & misc information logger */
 		Logger _log;
 
 	protected:
-		/* Try binding to the given addrinfo (or any if nullptr is given) */
-		void bindTo(addrinfo const *);
+		/* Create the worker queues & start the workers */
+		void startWorkers();
+
+		/* Let the workers drain their queues, then join them */
+		void stopWorkers();
+
+		/* Run the handlers of the datagrams queued for the given
+		 * worker */
+		void worker(unsigned const index);
+
+		/* Fire the due timers of a receiving thread's wheel, counting
+		 * them into the given slot */
+		void runTimers(TimerWheel &, HandlerSlot &);
+
+		/* Run the batch handler, timing it into the given slot */
+		void handle(HandlerSlot &, Datagram const *, unsigned const count,
+				int const socketFd);
+
+		/* Drop the datagrams refused by the rate limiter, compacting
+		 * the others, returns how many are left */
+		unsigned admit(HandlerSlot &, Datagram *, unsigned const count);
+
+		/* Hand received datagrams over to the handlers (once admitted):
+		 * inline, or to the workers, round-robin (cursor is the calling
+		 * receiving thread's position) or by flow hash if steering */
+		void dispatch(unsigned const producer, unsigned & cursor,
+				Datagram *, unsigned count,
+				int const socketFd);
+
+		/* Try binding to the given addrinfo (or any if nullptr is given),
+		 * as the given member of a SO_REUSEPORT group if rank > 0 or
+		 * _listenersPerAddress > 1 */
+		void bindTo(addrinfo const *, unsigned const rank = 0);
+
+		/* CPU the given receiving thread is pinned to (-1 if none) */
+		int cpuOf(unsigned const thread) const;
+
+		/* Pin the calling receiving thread */
+		void place(unsigned const thread);
+
+		/* Apply the per-socket placement settings */
+		void placeSockets();
+
+		/* Attach the flow steering program to every SO_REUSEPORT
+		 * group */
+		void steerSockets();
 
 		/* Listen on the given socket as long as it is valid */
-		void listener(std::pair< int, addrinfo >);
+		void listener(Listener * const);
+
+		/* Receive & drop a datagram (packet pool exhausted) */
+		int dropFrom(Listener &, ReceiveBuffers &, int const flags);
+
+#if defined(__gnu_linux__)
+		/* Same, pulling datagrams by batches using recvmmsg() */
+		void batchListener(Listener &);
+
+		/* Pull datagrams from the given socket with a single recvmmsg()
+		 * call and hand them over to receiveBatch(...), returning the
+		 * number of datagrams received (or -1) */
+		int receiveFrom(Listener &, ReceiveBuffers &, int const flags);
+
+		/* Enable a boolean socket option on every socket, returns false
+		 * (the option being disabled again) if any of them refused */
+		bool enableOption(int const level, int const name,
+				std::string const & label);
+
+		/* Create the epoll instances & start the event loops */
+		void startEventLoops();
+
+		/* Create the io_uring instances & start the event loops */
+		void startRingLoops();
+
+		/* Wake the event loops up, join them & release their
+		 * epoll or io_uring instances */
+		void stopEventLoops();
+
+		/* Serve the sockets registered to the given epoll instance until
+		 * the wakeup eventfd is signaled */
+		void eventLoop(unsigned const index);
+
+		/* Same, reaping the completions of the given io_uring
+		 * instance */
+		void ringLoop(unsigned const index);
+#endif
 
 		/* Send some data to destination using the given socket */
 		void sendBytes(uint8_t const *, size_t, sockaddr const *,
 				int const);
+		void sendBytes(uint8_t const *, size_t, SockAddr const &,
+				int const);
+
+		/* Count a failed send against the given socket's listener
+		 * (for handlers sending by other means than sendBytes) */
+		void sendFailed(int const);
 
 		/* Handle an incoming datagram */
 		virtual void receiveBytes(uint8_t const *, size_t const,
 				sockaddr_storage const *, int const) = 0;
 
+		/* Handle a batch of incoming datagrams (the default
+		 * implementation forwards each of them to receivePacket) */
+		virtual void receiveBatch(Datagram const *, unsigned const,
+				int const);
+
+		/* Handle an incoming packet, which may be kept by copying the
+		 * PacketRef (the default implementation forwards its content to
+		 * receiveBytes) */
+		virtual void receivePacket(PacketRef const &);
+
+		/* Timer wheel of the calling receiving thread, for handlers
+		 * running inline to schedule timers on (nullptr on other
+		 * threads or if disabled, see setTimerWheel(...)) */
+		static TimerWheel * timerWheel();
+
+		/* Handle the expiry of a timer scheduled on a receiving
+		 * thread's wheel (run by that thread, the default
+		 * implementation does nothing) */
+		virtual void timerExpired(TimerWheel::TimerId const,
+				uint64_t const data);
+
 	public:
-		/* Constructor & destructor */
+		/* Constructor & destructor (listeners is the number of sockets
+		 * per address, Linux only) */
 		UDPServer(unsigned short const port,
 				std::string const logPath = "UDPServer.log",
-				Priority const prio = LOG_ERROR);
+				Priority const prio = LOG_ERROR,
+				unsigned const listeners = 1,
+				ReceiveBackend const backend = BACKEND_BLOCKING);
 		virtual ~UDPServer();
 
 		/* Copy & assignation are forbidden */
@@ -73,6 +621,94 @@ class UDPServer : public NetComponent
 		
 		/* Close bound sockets & stop listening */
 		void stopListening();
+
+		/* Set the maximum number of datagrams pulled by a single receive
+		 * call (1 to disable batching, 0 for plain recvfrom() calls by
+		 * blocking listeners, which bring no control messages: no
+		 * kernel drop count, GRO or timestamps; must be called before
+		 * listening) */
+		void setBatchSize(unsigned const);
+
+		/* Set the number of event loops used by BACKEND_EPOLL and
+		 * BACKEND_URING (capped to the number of sockets, must be called
+		 * before listening) */
+		void setEventLoops(unsigned const);
+
+		/* Set the placement of the receiving threads: CPU pinning,
+		 * SO_INCOMING_CPU, busy-polling, spinning & NUMA-local buffers
+		 * (Linux only, must be called before listening) */
+		void setPlacement(Placement const &);
+
+		/* Send each peer's datagrams to the same socket of its
+		 * SO_REUSEPORT group (SO_ATTACH_REUSEPORT_CBPF, Linux only) and
+		 * to the same worker (must be called before listening) */
+		void setFlowSteering(bool const);
+
+		/* Hash of a peer's address & port, as computed by the flow
+		 * steering program (same as SockAddr::hash()) */
+		static uint32_t flowHash(sockaddr_storage const &);
+
+		/* Limit the packet & byte rates of every peer, datagrams over
+		 * their sender's limits being dropped before reaching any
+		 * handler or worker queue (no limit by default, must be called
+		 * before listening) */
+		void setRateLimit(RateLimit const &);
+
+		/* Set the maximum number of pooled packet buffers per receiving
+		 * thread (packets kept by handlers or queued for workers count
+		 * against it, must be called before listening) */
+		void setPacketPool(size_t const);
+
+		/* Let the kernel coalesce bulk datagram streams into
+		 * super-packets (UDP_GRO, Linux only), split back into
+		 * zero-copy slices for the handlers (must be called before
+		 * listening) */
+		void setGRO(bool const);
+
+		/* Resize the kernel receive buffer of every socket, so that
+		 * longer bursts fit (SO_RCVBUFFORCE when the process may,
+		 * SO_RCVBUF capped by net.core.rmem_max otherwise), returns the
+		 * size obtained (as reported by the kernel, which counts its
+		 * own overhead in) */
+		size_t setReceiveBuffer(size_t const);
+
+		/* Have the kernel timestamp every datagram (SO_TIMESTAMPNS,
+		 * Linux only, see PacketRef::timestamp()) and measure queueing
+		 * delays & handler durations (must be called before
+		 * listening) */
+		void setTimestamps(bool const);
+
+		/* Give every receiving thread a timer wheel of the given tick
+		 * (0 to disable, Linux only, must be called before
+		 * listening), which handlers reach through timerWheel() */
+		void setTimerWheel(std::chrono::nanoseconds const);
+
+		/* Run handlers on a pool of worker threads fed through queues
+		 * of the given capacity (0 workers to run them inline on the
+		 * receiving threads, must be called before listening) */
+		void setWorkers(unsigned const workers,
+				size_t const capacity = 1024,
+				OverflowPolicy const policy = OVERFLOW_DROP);
+
+		/* Worker pool statistics, one entry per worker */
+		std::vector<WorkerStatistics> workerStatistics() const;
+
+		/* Receive backend in use (may have fallen back to another one
+		 * when listening started) */
+		ReceiveBackend backend() const;
+
+		/* Server counters, aggregated over every per-thread slot */
+		ServerStatistics statistics() const;
+
+		/* Batch fill statistics, summed over all sockets */
+		BatchStatistics batchStatistics() const;
+
+		/* Latency histograms, merged over all receiving threads &
+		 * workers (empty unless timestamps are enabled) */
+		LatencyStatistics latencyStatistics() const;
+
+		/* Received traffic spread between the listening sockets */
+		std::vector<ListenerLoad> listenerLoad() const;
 };
 
 }
@@ -0,0 +1,120 @@
+#ifndef URING_HPP_INCLUDED
+#define URING_HPP_INCLUDED
+
+#include "NetComponent.hpp"
+#include <memory>
+
+/* Linux-only component */
+#if defined(__gnu_linux__)
+#include <linux/io_uring.h>
+
+
+namespace Mach
+{
+
+/*
+ * Minimal io_uring instance
+ *
+ * Thin wrapper around the io_uring_setup(), io_uring_enter() and
+ * io_uring_register() system calls (liburing is not required): it maps the
+ * submission & completion rings, registers socket file descriptors and
+ * manages a ring of provided buffers the kernel picks receive buffers from.
+ * An instance is meant to be driven by a single thread.
+ */
+class URing : public NetComponent
+{
+	private:
+		/* Ring file descriptor */
+		int _fd;
+
+		/* Submission queue ring (shared mapping) */
+		void * _sqRing;
+		size_t _sqRingSize;
+		unsigned * _sqHead;
+		unsigned * _sqTail;
+		unsigned * _sqMask;
+		unsigned * _sqEntries;
+		unsigned * _sqArray;
+		unsigned _sqLocalTail;
+
+		/* Submission queue entries */
+		io_uring_sqe * _sqes;
+		size_t _sqesSize;
+
+		/* Completion queue ring (may share the submission mapping) */
+		void * _cqRing;
+		size_t _cqRingSize;
+		unsigned * _cqHead;
+		unsigned * _cqTail;
+		unsigned * _cqMask;
+		io_uring_cqe * _cqes;
+
+		/* Provided buffer ring */
+		io_uring_buf * _bufferRing;
+		size_t _bufferRingSize;
+		unsigned short _bufferMask;
+		unsigned short _bufferTail;
+
+		/* Unmap the rings & close the ring file descriptor */
+		void release();
+
+	public:
+		/* Constructor & destructor (entries is the submission queue
+		 * size, rounded up to a power of 2 by the kernel) */
+		explicit URing(unsigned const entries);
+		~URing();
+
+		/* Copy & assignation are forbidden */
+		URing(URing const &) = delete;
+		URing & operator = (URing const &) = delete;
+
+		/* Check whether the running kernel supports the features used
+		 * by UDPServer (multishot recvmsg into provided buffers) */
+		static bool supported();
+
+		/* Register file descriptors (referenced by their index through
+		 * IOSQE_FIXED_FILE afterwards) */
+		void registerFiles(int const *, unsigned const);
+
+		/* Register a ring of count (power of 2) provided buffers as
+		 * buffer group 0 */
+		void setupBuffers(unsigned const count);
+
+		/* Hand a buffer (owned by the caller) to the kernel under the
+		 * given id, which completions will report */
+		void provideBuffer(unsigned short const id, uint8_t *,
+				unsigned const length);
+
+		/* Get a zeroed submission queue entry (submitting the pending
+		 * ones first if the queue is full) */
+		io_uring_sqe * prepare();
+
+		/* Queue a multishot recvmsg on the given registered file,
+		 * receiving into provided buffers (the header only sets the
+		 * name & control lengths and must outlive the request) */
+		void receiveMultishot(unsigned const file, msghdr const *,
+				uint64_t const userData);
+
+		/* Queue a one-shot readability poll on the given descriptor */
+		void pollIn(int const fd, uint64_t const userData);
+
+		/* Queue a timeout completing after the given delay, which must
+		 * outlive the request */
+		void timeout(__kernel_timespec const *, uint64_t const userData);
+
+		/* Submit pending entries & wait for at least wait completions,
+		 * returning -1 on error (errno is set) */
+		int submit(unsigned const wait);
+
+		/* Oldest unread completion (nullptr if none) */
+		io_uring_cqe * peek();
+
+		/* Mark the oldest completion as read */
+		void advance();
+};
+
+}
+
+#endif
+
+#endif // URING_HPP_INCLUDED
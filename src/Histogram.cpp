@@ -0,0 +1,211 @@
+#include "../include/Mach/Histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Construct an empty histogram
+ */
+Histogram::Histogram()
+{
+	clear();
+}
+
+/*
+ * Snapshot another histogram
+ */
+Histogram::Histogram(Histogram const & other)
+{
+	clear();
+	merge(other);
+}
+
+/*
+ * Replace the counters by a snapshot of another histogram's ones
+ */
+Histogram & Histogram::operator = (Histogram const & other)
+{
+	if(this != &other)
+	{
+		clear();
+		merge(other);
+	}
+
+	return *this;
+}
+
+/*
+ * Values below 2^HISTOGRAM_SUB_BITS are their own bucket; above, the bucket is
+ * made of the position of the highest set bit (group) & of the
+ * HISTOGRAM_SUB_BITS bits following it (sub-bucket)
+ */
+unsigned Histogram::bucketOf(uint64_t const value)
+{
+	unsigned const sub(1u << HISTOGRAM_SUB_BITS);
+	unsigned high(0);
+
+	if(value < sub)
+		return unsigned(value);
+
+#if defined(__GNUC__)
+	high = 63 - unsigned(__builtin_clzll(value));
+#else
+	for(uint64_t v = value >> 1 ; v != 0 ; v >>= 1)
+		++high;
+#endif
+
+	unsigned const shift(high - HISTOGRAM_SUB_BITS);
+
+	return ((shift + 1) << HISTOGRAM_SUB_BITS)
+		+ unsigned((value >> shift) & (sub - 1));
+}
+
+/*
+ * Largest value of the given bucket: its sub-bucket's lower bound plus its
+ * width, minus one
+ */
+uint64_t Histogram::upperBound(unsigned const b)
+{
+	unsigned const sub(1u << HISTOGRAM_SUB_BITS);
+
+	if(b < sub)
+		return b;
+
+	if(b >= HISTOGRAM_BUCKETS)
+		return ~uint64_t(0);
+
+	unsigned const shift((b >> HISTOGRAM_SUB_BITS) - 1);
+	uint64_t const lower(uint64_t(sub + (b & (sub - 1))) << shift);
+
+	return lower + ((uint64_t(1) << shift) - 1);
+}
+
+/*
+ * Count the value in its bucket & update the summary figures
+ */
+void Histogram::record(uint64_t const value, unsigned long const count)
+{
+	uint64_t current(_maximum.load(memory_order_relaxed));
+
+	if(count == 0)
+		return;
+
+	_buckets[bucketOf(value)].fetch_add(count, memory_order_relaxed);
+	_count.fetch_add(count, memory_order_relaxed);
+	_sum.fetch_add(value * count, memory_order_relaxed);
+
+	while(value > current && !_maximum.compare_exchange_weak(current,
+			value, memory_order_relaxed));
+}
+
+/*
+ * Sum the counters (the other histogram may be written meanwhile)
+ */
+void Histogram::merge(Histogram const & other)
+{
+	uint64_t const otherMaximum(other.maximum());
+	uint64_t current(_maximum.load(memory_order_relaxed));
+
+	for(unsigned b = 0 ; b < HISTOGRAM_BUCKETS ; ++b)
+		_buckets[b].fetch_add(other.bucket(b), memory_order_relaxed);
+
+	_count.fetch_add(other.count(), memory_order_relaxed);
+	_sum.fetch_add(other.sum(), memory_order_relaxed);
+
+	while(otherMaximum > current && !_maximum.compare_exchange_weak(
+			current, otherMaximum, memory_order_relaxed));
+}
+
+/*
+ * Reset every counter
+ */
+void Histogram::clear()
+{
+	for(unsigned b = 0 ; b < HISTOGRAM_BUCKETS ; ++b)
+		_buckets[b].store(0, memory_order_relaxed);
+
+	_count.store(0, memory_order_relaxed);
+	_sum.store(0, memory_order_relaxed);
+	_maximum.store(0, memory_order_relaxed);
+}
+
+/*
+ * Number of recorded values
+ */
+unsigned long Histogram::count() const
+{
+	return _count.load(memory_order_relaxed);
+}
+
+/*
+ * Sum of the recorded values
+ */
+uint64_t Histogram::sum() const
+{
+	return _sum.load(memory_order_relaxed);
+}
+
+/*
+ * Mean of the recorded values (0 if none)
+ */
+double Histogram::mean() const
+{
+	unsigned long const n(count());
+
+	return n > 0 ? double(sum()) / double(n) : 0.;
+}
+
+/*
+ * Largest recorded value
+ */
+uint64_t Histogram::maximum() const
+{
+	return _maximum.load(memory_order_relaxed);
+}
+
+/*
+ * Number of values held by the given bucket (0 if out of range)
+ */
+unsigned long Histogram::bucket(unsigned const b) const
+{
+	if(b >= HISTOGRAM_BUCKETS)
+		return 0;
+
+	return _buckets[b].load(memory_order_relaxed);
+}
+
+/*
+ * Walk the buckets until the wanted rank is reached (the result never exceeds
+ * the maximum)
+ */
+uint64_t Histogram::percentile(double const fraction) const
+{
+	unsigned long total(0), seen(0), rank(0);
+
+	for(unsigned b = 0 ; b < HISTOGRAM_BUCKETS ; ++b)
+		total += bucket(b);
+
+	if(total == 0)
+		return 0;
+
+	rank = max(1ul, (unsigned long)(ceil(
+		min(max(fraction, 0.), 1.) * double(total))));
+
+	for(unsigned b = 0 ; b < HISTOGRAM_BUCKETS ; ++b)
+	{
+		seen += bucket(b);
+
+		if(seen >= rank)
+			return min(upperBound(b), maximum());
+	}
+
+	return maximum();
+}
+
+}
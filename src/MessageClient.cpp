@@ -0,0 +1,146 @@
+#include "../include/Mach/MessageClient.hpp"
+#include "../include/Mach/Exception.hpp"
+#include <algorithm>
+#include <random>
+
+#if defined(__gnu_linux__)
+#include <errno.h>
+#endif
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Set up the batch buffers & pick a random first message identifier
+ */
+MessageClient::MessageClient(size_t const fragmentSize)
+	:
+	UDPClient(),
+	_stride(MESSAGE_FRAGMENT_MAX),
+	_nextMessage(random_device()()),
+	_prefixes(MESSAGE_BATCH * MESSAGE_HEADER),
+#if defined(__gnu_linux__)
+	_headers(MESSAGE_BATCH),
+	_vectors(2 * MESSAGE_BATCH),
+#else
+	_datagram(MESSAGE_HEADER + MESSAGE_FRAGMENT_MAX),
+#endif
+	_stats()
+{
+	setFragmentSize(fragmentSize);
+}
+
+/*
+ * Nothing to release but the socket (see UDPClient)
+ */
+MessageClient::~MessageClient()
+{
+}
+
+/*
+ * Set the fragment payload size
+ */
+void MessageClient::setFragmentSize(size_t const size)
+{
+	_stride = uint16_t(max(size_t(1), min(size,
+			size_t(MESSAGE_FRAGMENT_MAX))));
+}
+
+/*
+ * Cut the message into fragments & send them by batches (see the class
+ * description)
+ */
+uint32_t MessageClient::sendMessage(uint8_t const * bytes,
+		size_t const length)
+{
+	if(_socket == -1)
+		throw Exception("MessageClient is not connected!");
+
+	if(length > UINT32_MAX)
+		throw Exception("Message too large for "
+				"MessageClient::sendMessage()!");
+
+	MessageFragment fragment;
+	uint32_t const count(fragmentCount(uint32_t(length), _stride));
+
+	fragment.stride = _stride;
+	fragment.message = _nextMessage++;
+	fragment.length = uint32_t(length);
+
+	for(uint32_t first = 0 ; first < count ; first += MESSAGE_BATCH)
+	{
+		uint32_t const batch(min(count - first,
+				uint32_t(MESSAGE_BATCH)));
+
+		for(uint32_t i = 0 ; i < batch ; ++i)
+		{
+			size_t const offset(size_t(first + i) * _stride);
+			size_t const size(min(size_t(_stride),
+					length - offset));
+			uint8_t * prefix(&_prefixes[i * MESSAGE_HEADER]);
+
+			fragment.index = first + i;
+			encodeFragment(prefix, fragment);
+
+#if defined(__gnu_linux__)
+			_vectors[2 * i].iov_base = prefix;
+			_vectors[2 * i].iov_len = MESSAGE_HEADER;
+			_vectors[2 * i + 1].iov_base = (void *)(bytes + offset);
+			_vectors[2 * i + 1].iov_len = size;
+
+			memset(&_headers[i], 0, sizeof(mmsghdr));
+			_headers[i].msg_hdr.msg_iov = &_vectors[2 * i];
+			_headers[i].msg_hdr.msg_iovlen = 2;
+#else
+			memcpy(_datagram.data(), prefix, MESSAGE_HEADER);
+			memcpy(_datagram.data() + MESSAGE_HEADER, bytes + offset,
+					size);
+
+			if(send(_socket, (char *)(_datagram.data()),
+					MESSAGE_HEADER + size, 0) == -1)
+				throw Exception(lastError("send"));
+
+			++_stats.calls;
+#endif
+		}
+
+#if defined(__gnu_linux__)
+		/* A blocking socket may still send part of the batch */
+		for(uint32_t sent = 0 ; sent < batch ; )
+		{
+			int const result(sendmmsg(_socket, &_headers[sent],
+					batch - sent, 0));
+
+			if(result == -1)
+			{
+				if(errno == EINTR)
+					continue;
+
+				throw Exception(lastError("sendmmsg"));
+			}
+
+			sent += unsigned(result);
+			++_stats.calls;
+		}
+#endif
+	}
+
+	++_stats.messages;
+	_stats.fragments += count;
+
+	return fragment.message;
+}
+
+/*
+ * Snapshot of the counters
+ */
+MessageClientStatistics MessageClient::statistics() const
+{
+	return _stats;
+}
+
+}
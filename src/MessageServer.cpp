@@ -0,0 +1,287 @@
+#include "../include/Mach/MessageServer.hpp"
+#include "../include/Mach/Exception.hpp"
+#include <algorithm>
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Size class of a reassembly buffer: log2 of its capacity
+ */
+static unsigned sizeClass(size_t const size)
+{
+	unsigned k(0);
+
+	while((size_t(1) << k) < max(size, size_t(MESSAGE_BUFFER_MIN)))
+		++k;
+
+	return k;
+}
+
+/*
+ * Build the underlying UDPServer (the budget being raised to the buffer size
+ * of the largest message if needed)
+ */
+MessageServer::MessageServer(unsigned short const port,
+		string const logPath, Priority const prio,
+		size_t const maxMessage, size_t const budget,
+		chrono::milliseconds const timeout, unsigned const listeners,
+		ReceiveBackend const backend)
+	:
+	UDPServer(port, logPath, prio, listeners, backend),
+	_maxMessage(min(maxMessage, size_t(UINT32_MAX))),
+	_budget(max(budget, size_t(1) << sizeClass(_maxMessage))),
+	_timeout(timeout),
+	_open(0),
+	_spares(sizeClass(_maxMessage) + 1),
+	_memory(0),
+	_delivered(0),
+	_reassembled(0),
+	_fragments(0),
+	_duplicates(0),
+	_malformed(0),
+	_timeouts(0),
+	_budgetDrops(0)
+{
+}
+
+/*
+ * Buffers go away with the pool
+ */
+MessageServer::~MessageServer()
+{
+}
+
+/*
+ * Steady clock date (milliseconds)
+ */
+uint64_t MessageServer::now()
+{
+	return uint64_t(chrono::duration_cast<chrono::milliseconds>(
+			chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+
+/*
+ * Look the message up, starting its reassembly (after dropping the expired
+ * ones) if it is new
+ */
+shared_ptr<MessageServer::Assembly> MessageServer::assemblyOf(
+		AssemblyKey const & key, MessageFragment const & fragment)
+{
+	lock_guard<mutex> lock(_mutex);
+	auto const found(_assemblies.find(key));
+
+	if(found != _assemblies.end())
+		return found->second;
+
+	uint64_t const date(now());
+	shared_ptr<Assembly> assembly(new Assembly);
+	Expiry expiry;
+
+	expire(date);
+
+	if(!acquire(fragment.length, assembly->_buffer))
+	{
+		_budgetDrops.fetch_add(1, memory_order_relaxed);
+		return nullptr;
+	}
+
+	assembly->_length = fragment.length;
+	assembly->_stride = fragment.stride;
+	assembly->_missing = fragmentCount(fragment.length, fragment.stride);
+	assembly->_received.assign(assembly->_missing, false);
+	assembly->_closed = false;
+
+	expiry.deadline = date + uint64_t(_timeout.count());
+	expiry.key = key;
+	expiry.assembly = assembly;
+
+	_expiries.push_back(expiry);
+	_assemblies[key] = assembly;
+	++_open;
+
+	return assembly;
+}
+
+/*
+ * Messages are queued in creation order, hence in deadline order: pop the
+ * expired ones, dropping those which are still incomplete (completed ones
+ * have given their buffer back already, they only stayed in the table so
+ * that late duplicates of their fragments were recognized)
+ */
+void MessageServer::expire(uint64_t const date)
+{
+	while(!_expiries.empty() && _expiries.front().deadline <= date)
+	{
+		Expiry const expiry(_expiries.front());
+		lock_guard<mutex> lock(expiry.assembly->_mutex);
+
+		_expiries.pop_front();
+		_assemblies.erase(expiry.key);
+
+		if(expiry.assembly->_closed)
+			continue;
+
+		expiry.assembly->_closed = true;
+		release(expiry.assembly->_buffer);
+		--_open;
+		_timeouts.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+/*
+ * Take a spare buffer of the right size class, or allocate one, releasing
+ * spare buffers (largest first) until it fits the budget
+ */
+bool MessageServer::acquire(size_t const size, MessageBuffer & buffer)
+{
+	unsigned const k(sizeClass(size));
+	size_t const capacity(size_t(1) << k);
+
+	if(!_spares[k].empty())
+	{
+		buffer = move(_spares[k].back());
+		_spares[k].pop_back();
+		return true;
+	}
+
+	for(size_t c = _spares.size() ; c > 0 && _memory + capacity > _budget
+			; )
+	{
+		if(_spares[c - 1].empty())
+		{
+			--c;
+			continue;
+		}
+
+		_memory -= _spares[c - 1].back().capacity;
+		_spares[c - 1].pop_back();
+	}
+
+	if(_memory + capacity > _budget)
+		return false;
+
+	buffer.bytes.reset(new uint8_t[capacity]);
+	buffer.capacity = capacity;
+	_memory += capacity;
+
+	return true;
+}
+
+/*
+ * Keep the buffer for a later message of the same size class (its memory
+ * still counts against the budget)
+ */
+void MessageServer::release(MessageBuffer & buffer)
+{
+	_spares[sizeClass(buffer.capacity)].push_back(move(buffer));
+}
+
+/*
+ * Deliver single-fragment messages right away, copy the others' fragments
+ * into their reassembly buffer, delivering them once complete
+ */
+void MessageServer::receiveBytes(uint8_t const * bytes, size_t const length,
+		sockaddr_storage const * sender, int const)
+{
+	MessageFragment fragment;
+
+	if(!decodeFragment(bytes, length, fragment)
+			|| fragment.length > _maxMessage)
+	{
+		_malformed.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	SockAddr const peer(*sender);
+	uint8_t const * payload(bytes + MESSAGE_HEADER);
+	size_t const size(length - MESSAGE_HEADER);
+
+	_fragments.fetch_add(1, memory_order_relaxed);
+
+	if(fragmentCount(fragment.length, fragment.stride) == 1)
+	{
+		receiveMessage(payload, size, peer);
+		_delivered.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	AssemblyKey key;
+
+	key.peer = peer;
+	key.message = fragment.message;
+
+	shared_ptr<Assembly> const assembly(assemblyOf(key, fragment));
+
+	if(!assembly)
+		return;
+
+	{
+		lock_guard<mutex> lock(assembly->_mutex);
+
+		/* Too late to complete it */
+		if(assembly->_closed && assembly->_missing > 0)
+			return;
+
+		if(fragment.length != assembly->_length
+				|| fragment.stride != assembly->_stride)
+		{
+			_malformed.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+
+		if(assembly->_received[fragment.index])
+		{
+			_duplicates.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+
+		memcpy(assembly->_buffer.bytes.get() + size_t(fragment.index)
+				* fragment.stride, payload, size);
+		assembly->_received[fragment.index] = true;
+
+		if(--assembly->_missing > 0)
+			return;
+
+		assembly->_closed = true;
+	}
+
+	/* Complete: nobody else touches the buffer anymore */
+	receiveMessage(assembly->_buffer.bytes.get(), assembly->_length, peer);
+	_delivered.fetch_add(1, memory_order_relaxed);
+	_reassembled.fetch_add(1, memory_order_relaxed);
+
+	lock_guard<mutex> lock(_mutex);
+
+	release(assembly->_buffer);
+	--_open;
+}
+
+/*
+ * Snapshot of the counters
+ */
+MessageServerStatistics MessageServer::messageStatistics() const
+{
+	MessageServerStatistics stats;
+
+	stats.delivered = _delivered.load(memory_order_relaxed);
+	stats.reassembled = _reassembled.load(memory_order_relaxed);
+	stats.fragments = _fragments.load(memory_order_relaxed);
+	stats.duplicates = _duplicates.load(memory_order_relaxed);
+	stats.malformed = _malformed.load(memory_order_relaxed);
+	stats.timeouts = _timeouts.load(memory_order_relaxed);
+	stats.budgetDrops = _budgetDrops.load(memory_order_relaxed);
+
+	lock_guard<mutex> lock(_mutex);
+	stats.pending = _open;
+	stats.memory = _memory;
+
+	return stats;
+}
+
+}
@@ -0,0 +1,239 @@
+#include "../include/Mach/PacketPool.hpp"
+
+/* Smallest page size, used as the stride when touching buffers */
+#define PAGE_STRIDE 4096
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Share the other reference's buffer
+ */
+PacketRef::PacketRef(PacketRef const & other)
+	:
+	_buffer(other._buffer),
+	_offset(other._offset),
+	_length(other._length),
+	_sliced(other._sliced)
+{
+	if(_buffer != nullptr)
+		_buffer->_references.fetch_add(1, memory_order_relaxed);
+}
+
+/*
+ * Drop the current buffer & share the other reference's one
+ */
+PacketRef & PacketRef::operator = (PacketRef const & other)
+{
+	if(other._buffer != nullptr)
+		other._buffer->_references.fetch_add(1, memory_order_relaxed);
+
+	reset();
+	_buffer = other._buffer;
+	_offset = other._offset;
+	_length = other._length;
+	_sliced = other._sliced;
+
+	return *this;
+}
+
+/*
+ * Drop the current buffer & take the other reference's one
+ */
+PacketRef & PacketRef::operator = (PacketRef && other) noexcept
+{
+	if(this != &other)
+	{
+		reset();
+		_buffer = other._buffer;
+		_offset = other._offset;
+		_length = other._length;
+		_sliced = other._sliced;
+		other._buffer = nullptr;
+	}
+
+	return *this;
+}
+
+/*
+ * Drop the reference, sending the buffer home if it was the last one
+ */
+void PacketRef::reset()
+{
+	if(_buffer != nullptr && _buffer->_references.fetch_sub(1,
+			memory_order_acq_rel) == 1)
+		_buffer->_pool->recycle(_buffer);
+
+	_buffer = nullptr;
+	_offset = 0;
+	_length = 0;
+	_sliced = false;
+}
+
+/*
+ * Share the buffer, restricted to part of the current payload
+ */
+PacketRef PacketRef::slice(size_t const offset, size_t const length) const
+{
+	PacketRef part(*this);
+
+	part._offset = _offset + offset;
+	part._length = length;
+	part._sliced = true;
+
+	return part;
+}
+
+/*
+ * Construct an empty pool
+ */
+PacketPool::PacketPool(size_t const maxBuffers)
+	:
+	_free(nullptr),
+	_maxBuffers(maxBuffers),
+	_exhausted(0),
+	_returned(nullptr),
+	_references(1)
+{
+}
+
+/*
+ * Slabs are released along with the pool
+ */
+PacketPool::~PacketPool()
+{
+}
+
+/*
+ * Create a pool (allocated on the heap, see retire())
+ */
+PacketPool * PacketPool::create(size_t const maxBuffers)
+{
+	return new PacketPool(maxBuffers);
+}
+
+/*
+ * Drop the owner's reference: the pool is deleted right away if no buffer is
+ * away, by the thread releasing the last one otherwise
+ */
+void PacketPool::retire()
+{
+	if(_references.fetch_sub(1, memory_order_acq_rel) == 1)
+		delete this;
+}
+
+/*
+ * Chain a new slab into the free list
+ */
+bool PacketPool::grow()
+{
+	size_t const current(_slabs.size() * PACKET_SLAB_SIZE);
+
+	if(current + PACKET_SLAB_SIZE > max(_maxBuffers, size_t(
+			PACKET_SLAB_SIZE)))
+		return false;
+
+	unique_ptr<PacketBuffer[]> slab(new PacketBuffer[PACKET_SLAB_SIZE]);
+
+	for(size_t i = 0 ; i < PACKET_SLAB_SIZE ; ++i)
+	{
+		slab[i]._references.store(0, memory_order_relaxed);
+		slab[i]._pool = this;
+		slab[i]._next = _free;
+		_free = &slab[i];
+	}
+
+	_slabs.push_back(move(slab));
+
+	return true;
+}
+
+/*
+ * Pop the free list, refilled from the return stack (then a new slab) when
+ * empty
+ */
+PacketRef PacketPool::allocate()
+{
+	PacketBuffer * buffer(nullptr);
+
+	if(_free == nullptr)
+		_free = _returned.exchange(nullptr, memory_order_acquire);
+
+	if(_free == nullptr && !grow())
+	{
+		_exhausted.fetch_add(1, memory_order_relaxed);
+		return PacketRef();
+	}
+
+	buffer = _free;
+	_free = buffer->_next;
+
+	buffer->_references.store(1, memory_order_relaxed);
+	buffer->_offset = 0;
+	buffer->_length = 0;
+	buffer->_socket = -1;
+	buffer->_timestamp = 0;
+
+	_references.fetch_add(1, memory_order_relaxed);
+
+	return PacketRef(buffer);
+}
+
+/*
+ * Add slabs, then write to every page of the new buffers (first-touch policy:
+ * the kernel backs a page with memory from the node of the CPU touching it)
+ */
+size_t PacketPool::reserve(size_t const count)
+{
+	size_t const first(_slabs.size());
+
+	while(size() < count && grow());
+
+	for(size_t s = first ; s < _slabs.size() ; ++s)
+		for(size_t i = 0 ; i < PACKET_SLAB_SIZE ; ++i)
+			for(size_t o = 0 ; o < sizeof(PacketBuffer::_bytes) ;
+					o += PAGE_STRIDE)
+				_slabs[s][i]._bytes[o] = 0;
+
+	return size();
+}
+
+/*
+ * Push the buffer onto the return stack (the owner only ever takes the whole
+ * stack, which keeps this safe from ABA issues)
+ */
+void PacketPool::recycle(PacketBuffer * buffer)
+{
+	PacketBuffer * head(_returned.load(memory_order_relaxed));
+
+	do
+	{
+		buffer->_next = head;
+	} while(!_returned.compare_exchange_weak(head, buffer,
+			memory_order_release, memory_order_relaxed));
+
+	if(_references.fetch_sub(1, memory_order_acq_rel) == 1)
+		delete this;
+}
+
+/*
+ * Buffers allocated so far
+ */
+size_t PacketPool::size() const
+{
+	return _slabs.size() * PACKET_SLAB_SIZE;
+}
+
+/*
+ * Allocations which failed because the pool was at its maximum size
+ */
+unsigned long PacketPool::exhausted() const
+{
+	return _exhausted.load(memory_order_relaxed);
+}
+
+}
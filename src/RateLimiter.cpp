@@ -0,0 +1,129 @@
+#include "../include/Mach/RateLimiter.hpp"
+#include <algorithm>
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Convert the rates into bucket intervals & depths and start expiring idle
+ * peers (the table being sized twice the peers, so that probe chains stay
+ * short when it fills up)
+ */
+RateLimiter::RateLimiter(RateLimit const & limit)
+	:
+	_peers(2 * max(limit.peers, size_t(1))),
+	_packetInterval(0),
+	_packetDepth(0),
+	_byteInterval(0),
+	_byteDepth(0),
+	_epoch(now())
+{
+	double const second(1e9 * RATE_TICKS_PER_NS);
+
+	if(limit.packetsPerSecond > 0.)
+	{
+		_packetInterval = max(uint64_t(1), uint64_t(second
+				/ limit.packetsPerSecond));
+		_packetDepth = uint64_t(double(_packetInterval)
+				* max(limit.packetBurst, 1.));
+	}
+
+	if(limit.bytesPerSecond > 0.)
+	{
+		_byteInterval = max(uint64_t(1), uint64_t(second
+				/ limit.bytesPerSecond));
+		_byteDepth = uint64_t(double(_byteInterval)
+				* max(limit.byteBurst, 1.));
+	}
+
+	_peers.startExpiry(chrono::seconds(max(limit.idleSeconds, 1u)),
+			chrono::seconds(max(limit.idleSeconds / 4, 1u)));
+}
+
+/*
+ * The table stops its expiry thread itself
+ */
+RateLimiter::~RateLimiter()
+{
+}
+
+/*
+ * Same clock as the peer table's expiry
+ */
+uint64_t RateLimiter::now()
+{
+	return SessionTable<Buckets>::now();
+}
+
+/*
+ * Later of two tick dates, modulo 2^64 (see RateLimiter)
+ */
+static inline uint64_t later(uint64_t const a, uint64_t const b)
+{
+	return int64_t(a - b) > 0 ? a : b;
+}
+
+/*
+ * Push both buckets forward, unless either would overflow. Known peers are
+ * charged without locking, the shard lock being taken only to insert new ones
+ * (the charge may be computed again if another writer got in meanwhile).
+ */
+RateVerdict RateLimiter::admit(SockAddr const & peer, size_t const length,
+		uint64_t const date)
+{
+	RateVerdict verdict(RATE_ADMITTED);
+	uint64_t const now((date - _epoch) * RATE_TICKS_PER_NS);
+	uint64_t const packetDepth(_packetDepth);
+	uint64_t const packetInterval(_packetInterval);
+	uint64_t const byteDepth(_byteDepth);
+	uint64_t const byteCost(_byteInterval * length);
+
+	auto const charge([&](Buckets & buckets)
+	{
+		/* A new peer's buckets (value-initialized, which modular
+		 * dates can't tell from a recent date) start empty */
+		bool const fresh(buckets.packets == 0 && buckets.bytes == 0);
+		uint64_t const packets((fresh ? now : later(buckets.packets,
+				now)) + packetInterval);
+		uint64_t const bytes((fresh ? now : later(buckets.bytes, now))
+				+ byteCost);
+
+		if(packetInterval != 0 && packets - now > packetDepth)
+			verdict = RATE_PACKETS;
+		else if(byteCost != 0 && bytes - now > byteDepth)
+			verdict = RATE_BYTES;
+		else
+		{
+			verdict = RATE_ADMITTED;
+			buckets.packets = packets;
+			buckets.bytes = bytes;
+		}
+	});
+
+	if(_peers.modify(peer, charge, date))
+		return verdict;
+
+	return _peers.update(peer, charge, date) ? verdict : RATE_UNTRACKED;
+}
+
+/*
+ * Warm the peer's slot up ahead of admit()
+ */
+void RateLimiter::prefetch(SockAddr const & peer) const
+{
+	_peers.prefetch(peer);
+}
+
+/*
+ * Peers currently tracked
+ */
+size_t RateLimiter::peers() const
+{
+	return _peers.size();
+}
+
+}
@@ -0,0 +1,651 @@
+#include "../include/Mach/ReliableClient.hpp"
+#include "../include/Mach/Exception.hpp"
+#include <algorithm>
+#include <random>
+
+/* Initial retransmission timeout (microseconds) & congestion window
+ * (segments) */
+#define RELIABLE_RTO_INITIAL 200000
+#define RELIABLE_INITIAL_WINDOW 10.
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Sending buffer size: window rounded up to a power of 2 (at most 32768, half
+ * the largest window a receiver can advertise)
+ */
+static size_t bufferSize(size_t const window)
+{
+	size_t size(1);
+
+	while(size < window && size < 32768)
+		size <<= 1;
+
+	return size;
+}
+
+/*
+ * Allocate the sending buffer, the channel itself being set up by connectTo()
+ */
+ReliableClient::ReliableClient(size_t const window)
+	:
+	_segments(bufferSize(window)),
+	_mask(uint32_t(bufferSize(window) - 1)),
+	_connection(0),
+	_acked(0),
+	_next(0),
+	_inFlight(0),
+	_lost(0),
+	_peerWindow(0),
+	_cwnd(RELIABLE_INITIAL_WINDOW),
+	_ssthresh(0.),
+	_roundEnd(0),
+	_roundSent(0),
+	_roundLost(0),
+	_srtt(0),
+	_rttvar(0),
+	_rto(RELIABLE_RTO_INITIAL),
+	_deliveredSentAt(0),
+	_deadline(0),
+	_probeAt(0),
+	_probed(false),
+	_timeoutAt(0),
+	_priorCwnd(0.),
+	_priorSsthresh(0.),
+	_lastSent(0),
+	_lossRate(0.),
+	_random(0x9E3779B97F4A7C15ull),
+	_stats(),
+	_running(false)
+{
+}
+
+/*
+ * Stop the acknowledgement thread before the socket goes away
+ */
+ReliableClient::~ReliableClient()
+{
+	disconnect();
+}
+
+/*
+ * Monotonic microseconds
+ */
+uint64_t ReliableClient::now()
+{
+	return uint64_t(chrono::duration_cast<chrono::microseconds>(
+			chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+
+/*
+ * Connect, pick a new channel identifier, reset the sender state and start
+ * reading acknowledgements (a client still reading them, even through a
+ * socket closed by UDPClient::disconnect(), must disconnect first)
+ */
+void ReliableClient::connectTo(string const host, unsigned short const port)
+{
+	random_device device;
+
+	if(_acknowledger.joinable())
+		throw Exception("ReliableClient is already connected!");
+
+	UDPClient::connectTo(host, port);
+
+	_connection = uint32_t(device());
+	_random = uint64_t(device()) << 32 | device() | 1;
+	_acked = _next = 0;
+	_inFlight = _lost = 0;
+	_peerWindow = unsigned(_segments.size());
+	_cwnd = RELIABLE_INITIAL_WINDOW;
+	_ssthresh = double(_segments.size());
+	_roundEnd = 0;
+	_roundSent = _roundLost = 0;
+	_srtt = _rttvar = 0;
+	_rto = RELIABLE_RTO_INITIAL;
+	_deliveredSentAt = _deadline = _probeAt = 0;
+	_probed = false;
+	_timeoutAt = 0;
+	_lastSent = now();
+	_stats = ReliableStatistics();
+
+	_running = true;
+	_acknowledger = thread(&ReliableClient::acknowledgements, this);
+}
+
+/*
+ * Stop the acknowledgement thread, release blocked senders & close the socket
+ */
+void ReliableClient::disconnect()
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		_running = false;
+		_room.notify_all();
+	}
+
+	if(_acknowledger.joinable())
+		_acknowledger.join();
+
+	UDPClient::disconnect();
+}
+
+/*
+ * Wait for acknowledgements until the next timer, read them all (one at a time
+ * outside Linux), then run the timers
+ */
+void ReliableClient::acknowledgements()
+{
+	uint8_t bytes[RELIABLE_ACK_MAX];
+	ReliableAck ack;
+	uint64_t wait(RELIABLE_TICK);
+
+	while(_running)
+	{
+		bool readable(pending(chrono::microseconds(wait)));
+		unique_lock<mutex> lock(_mutex);
+		uint64_t const date(now());
+
+		while(readable)
+		{
+#if defined(__gnu_linux__)
+			long const length(long(recv(_socket, (char *)(bytes),
+					sizeof(bytes), MSG_DONTWAIT)));
+#else
+			long const length(long(recv(_socket, (char *)(bytes),
+					sizeof(bytes), 0)));
+
+			readable = false;
+#endif
+
+			if(length < 0)
+				break;
+
+			if(decodeAck(bytes, size_t(length), ack)
+					&& ack.connection == _connection)
+				acknowledge(ack, date);
+		}
+
+		wait = timers(date) - date;
+		lock.unlock();
+		_room.notify_all();
+	}
+}
+
+/*
+ * Fire the tail loss probe, or the retransmission timeout once the probe has
+ * been tried, and retransmit what the congestion window allows. Any thread
+ * holding the lock runs this, so that a sender waiting for room notices a
+ * timer the acknowledgement thread (sleeping on a stale date) would only see
+ * at its next tick.
+ */
+uint64_t ReliableClient::timers(uint64_t const date)
+{
+	uint64_t next(date + RELIABLE_TICK);
+
+	if(_acked != _next)
+	{
+		if(!_probed && date >= _probeAt)
+			probe(date);
+		else if(date >= _deadline)
+			timeout(date);
+
+		next = min(next, _probed ? _deadline : _probeAt);
+	}
+
+	retransmit(date);
+
+	return max(next, date + 1);
+}
+
+/*
+ * The retransmission timeout restarts from now, and so does the tail loss
+ * probe (two RTTs)
+ */
+void ReliableClient::arm(uint64_t const date)
+{
+	_deadline = date + _rto;
+	_probeAt = date + max(2 * _srtt, uint64_t(RELIABLE_PROBE_MIN));
+	_probed = false;
+}
+
+/*
+ * Take an RTT sample, release the cumulatively & selectively acknowledged
+ * segments and grow the congestion window by as many
+ */
+void ReliableClient::acknowledge(ReliableAck const & ack, uint64_t const date)
+{
+	uint64_t const sample(uint32_t(uint32_t(date) - ack.echo));
+	unsigned delivered(0);
+	bool advanced(false);
+
+	/* RFC 6298 estimators */
+	if(sample < RELIABLE_RTO_MAX)
+	{
+		if(_srtt == 0)
+		{
+			_srtt = max(sample, uint64_t(1));
+			_rttvar = _srtt / 2;
+		}
+		else
+		{
+			uint64_t const error(sample > _srtt ? sample - _srtt
+					: _srtt - sample);
+
+			_rttvar = (3 * _rttvar + error) / 4;
+			_srtt = (7 * _srtt + sample) / 8;
+		}
+
+		_rto = min(max(_srtt + 4 * _rttvar,
+				uint64_t(RELIABLE_RTO_MIN)),
+				uint64_t(RELIABLE_RTO_MAX));
+	}
+
+	_peerWindow = ack.window;
+
+	/* Eifel detection: the first acknowledgement after a timeout
+	 * echoing an original transmission means the timeout was spurious.
+	 * Segments it marked lost are back in flight (the real losses being
+	 * detected again below) */
+	if(_timeoutAt != 0)
+	{
+		if(sequenceBefore(ack.echo, uint32_t(_timeoutAt)))
+		{
+			for(uint32_t s = _acked ; s != _next ; ++s)
+			{
+				Segment & segment(_segments[s & _mask]);
+
+				if(segment.state == SEGMENT_LOST)
+				{
+					segment.state = SEGMENT_FLIGHT;
+					--_lost;
+					++_inFlight;
+				}
+			}
+
+			_cwnd = _priorCwnd;
+			_ssthresh = _priorSsthresh;
+			++_stats.spuriousTimeouts;
+		}
+
+		_timeoutAt = 0;
+	}
+
+	/* Cumulative part (ignored if stale or beyond what was sent) */
+	if(!sequenceBefore(ack.cumulative, _acked)
+			&& !sequenceBefore(_next, ack.cumulative))
+		for( ; _acked != ack.cumulative ; ++_acked)
+		{
+			Segment & segment(_segments[_acked & _mask]);
+
+			if(segment.state != SEGMENT_SACKED)
+			{
+				if(segment.state == SEGMENT_FLIGHT)
+					--_inFlight;
+				else
+					--_lost;
+
+				_deliveredSentAt = max(_deliveredSentAt,
+						segment.sentAt);
+				++_stats.acknowledged;
+				++delivered;
+			}
+
+			advanced = true;
+		}
+
+	/* Selective part */
+	for(unsigned b = 0 ; b < ack.blocks ; ++b)
+	{
+		uint32_t start(ack.start[b]);
+		uint32_t end(ack.end[b]);
+
+		if(sequenceBefore(start, _acked))
+			start = _acked;
+
+		if(sequenceBefore(_next, end))
+			end = _next;
+
+		for(uint32_t s = start ; sequenceBefore(s, end) ; ++s)
+		{
+			Segment & segment(_segments[s & _mask]);
+
+			if(segment.state == SEGMENT_SACKED)
+				continue;
+
+			if(segment.state == SEGMENT_FLIGHT)
+				--_inFlight;
+			else
+				--_lost;
+
+			segment.state = SEGMENT_SACKED;
+			_deliveredSentAt = max(_deliveredSentAt,
+					segment.sentAt);
+			++_stats.acknowledged;
+			++delivered;
+		}
+	}
+
+	if(advanced || delivered > 0)
+		arm(date);
+
+	if(!sequenceBefore(_acked, _roundEnd))
+		endRound();
+
+	/* Slow start, then additive increase */
+	if(delivered > 0)
+	{
+		if(_cwnd < _ssthresh)
+			_cwnd += double(delivered);
+		else
+			_cwnd += double(delivered) / _cwnd;
+
+		_cwnd = min(_cwnd, double(_segments.size()));
+	}
+
+	detectLosses();
+}
+
+/*
+ * A segment in flight is lost when one sent a quarter RTT after it has been
+ * delivered. Segments sent once are scanned in sending order, so the scan
+ * stops at the first of them which isn't lost.
+ */
+void ReliableClient::detectLosses()
+{
+	uint64_t const reorder(max(_srtt / 4, uint64_t(1)));
+
+	for(uint32_t s = _acked ; s != _next ; ++s)
+	{
+		Segment & segment(_segments[s & _mask]);
+
+		if(segment.state != SEGMENT_FLIGHT)
+			continue;
+
+		if(segment.sentAt + reorder <= _deliveredSentAt)
+		{
+			segment.state = SEGMENT_LOST;
+			--_inFlight;
+			++_lost;
+			++_roundLost;
+			++_stats.fastRetransmits;
+		}
+		else if(segment.transmissions == 1)
+			break;
+	}
+}
+
+/*
+ * Shrink the congestion window by half the fraction of the round's segments
+ * which were lost (halving it instead in slow start, which then ends), and
+ * start the next round with the next segment sent
+ */
+void ReliableClient::endRound()
+{
+	if(_roundLost > 0)
+	{
+		double const lost(min(double(_roundLost)
+				/ double(max(_roundSent, 1u)), 1.));
+
+		if(_cwnd < _ssthresh)
+			_cwnd /= 2.;
+		else
+			_cwnd *= 1. - lost / 2.;
+
+		_cwnd = max(_cwnd, 2.);
+		_ssthresh = _cwnd;
+	}
+
+	_roundEnd = _next;
+	_roundSent = 0;
+	_roundLost = 0;
+}
+
+/*
+ * Nothing was acknowledged for an RTO: everything in flight is deemed lost,
+ * the congestion window falls back to one segment & the timeout doubles
+ */
+void ReliableClient::timeout(uint64_t const date)
+{
+	for(uint32_t s = _acked ; s != _next ; ++s)
+	{
+		Segment & segment(_segments[s & _mask]);
+
+		if(segment.state == SEGMENT_FLIGHT)
+		{
+			segment.state = SEGMENT_LOST;
+			--_inFlight;
+			++_lost;
+		}
+	}
+
+	++_stats.timeouts;
+	_timeoutAt = date;
+	_priorCwnd = _cwnd;
+	_priorSsthresh = _ssthresh;
+	_ssthresh = max(_cwnd / 2., 2.);
+	_cwnd = 1.;
+	_roundEnd = _next;
+	_roundSent = 0;
+	_roundLost = 0;
+	_rto = min(2 * _rto, uint64_t(RELIABLE_RTO_MAX));
+	_deadline = date + _rto;
+	_probed = true;
+}
+
+/*
+ * Resend the most recent segment not acknowledged yet, outside of the
+ * congestion window: its acknowledgement either closes the tail or exposes
+ * the losses before it
+ */
+void ReliableClient::probe(uint64_t const date)
+{
+	for(uint32_t s = _next ; s != _acked ; --s)
+	{
+		Segment & segment(_segments[(s - 1) & _mask]);
+
+		if(segment.state == SEGMENT_SACKED)
+			continue;
+
+		if(segment.state == SEGMENT_FLIGHT)
+			--_inFlight;
+		else
+			--_lost;
+
+		++_stats.probes;
+		++_stats.retransmits;
+		transmit(s - 1, date);
+		break;
+	}
+
+	_probed = true;
+	_deadline = date + _rto;
+}
+
+/*
+ * Lost segments go first, oldest first
+ */
+void ReliableClient::retransmit(uint64_t const date)
+{
+	for(uint32_t s = _acked ; _lost > 0 && s != _next
+			&& double(_inFlight) < max(_cwnd, 1.) ; ++s)
+		if(_segments[s & _mask].state == SEGMENT_LOST)
+		{
+			--_lost;
+			++_stats.retransmits;
+			transmit(s, date);
+		}
+}
+
+/*
+ * Stamp the segment with the current date & send it, unless the loss injector
+ * drops it (send errors count as losses as well)
+ */
+void ReliableClient::transmit(uint32_t const sequence, uint64_t const date)
+{
+	Segment & segment(_segments[sequence & _mask]);
+
+	putWord(segment.datagram.data() + 12, uint32_t(date));
+	_lastSent = date;
+	segment.sentAt = date;
+	segment.state = SEGMENT_FLIGHT;
+	++segment.transmissions;
+	++_inFlight;
+	++_roundSent;
+
+	if(_lossRate > 0.)
+	{
+		/* xorshift64* */
+		_random ^= _random >> 12;
+		_random ^= _random << 25;
+		_random ^= _random >> 27;
+
+		if(double((_random * 0x2545F4914F6CDD1Dull) >> 11)
+				* (1. / 9007199254740992.) < _lossRate)
+		{
+			++_stats.injectedLosses;
+			return;
+		}
+	}
+
+	::send(_socket, (char const *)(segment.datagram.data()),
+			segment.datagram.size(), 0);
+}
+
+/*
+ * Within the sending buffer, the receiver's window & the congestion window,
+ * with no retransmission pending
+ */
+bool ReliableClient::open() const
+{
+	uint32_t const outstanding(_next - _acked);
+
+	return outstanding < _segments.size() && outstanding < _peerWindow
+		&& _lost == 0 && double(_inFlight) < max(_cwnd, 1.);
+}
+
+/*
+ * New identifier & sequence numbers, the receiver taking the next segment for
+ * a new channel whether or not it still remembers the old one. The congestion
+ * window is brought back to its initial size, the path's state being unknown
+ * after idling.
+ */
+void ReliableClient::restart()
+{
+	random_device device;
+
+	_connection = uint32_t(device());
+	_acked = _next = 0;
+	_roundEnd = 0;
+	_roundSent = _roundLost = 0;
+	_cwnd = min(_cwnd, RELIABLE_INITIAL_WINDOW);
+	_deadline = _probeAt = 0;
+	_probed = false;
+	_timeoutAt = 0;
+	++_stats.restarts;
+}
+
+/*
+ * Copy the payload into the next segment once the window allows it (starting
+ * a new channel after idling), and send it right away
+ */
+void ReliableClient::send(uint8_t const * bytes, size_t const length)
+{
+	unique_lock<mutex> lock(_mutex);
+	uint64_t date(now());
+
+	if(length > RELIABLE_PAYLOAD_MAX)
+		throw Exception("Payload too large for ReliableClient::send()!");
+
+	while(_running)
+	{
+		uint64_t const wake(timers(date));
+
+		if(open())
+			break;
+
+		_room.wait_for(lock, chrono::microseconds(wake - date));
+		date = now();
+	}
+
+	if(!_running)
+		throw Exception("ReliableClient is not connected!");
+
+	if(_acked == _next && date - _lastSent
+			>= uint64_t(RELIABLE_RESTART_IDLE) * 1000000)
+		restart();
+
+	Segment & segment(_segments[_next & _mask]);
+	ReliableData header;
+
+	header.connection = _connection;
+	header.sequence = _next;
+	header.timestamp = 0;
+
+	segment.datagram.resize(RELIABLE_DATA_HEADER + length);
+	encodeData(segment.datagram.data(), header);
+	memcpy(segment.datagram.data() + RELIABLE_DATA_HEADER, bytes, length);
+	segment.transmissions = 0;
+
+	if(_acked == _next)
+		arm(date);
+
+	++_stats.segments;
+	transmit(_next++, date);
+}
+
+/*
+ * Wait for the acknowledgement thread to release every segment (running the
+ * timers meanwhile)
+ */
+bool ReliableClient::flush(chrono::milliseconds const timeout)
+{
+	unique_lock<mutex> lock(_mutex);
+	uint64_t date(now());
+	uint64_t const end(date + uint64_t(timeout.count()) * 1000);
+
+	while(_running && _acked != _next && date < end)
+	{
+		uint64_t const wake(min(timers(date), end));
+
+		_room.wait_for(lock, chrono::microseconds(wake - date));
+		date = now();
+	}
+
+	return _acked == _next;
+}
+
+/*
+ * Set the probability of dropping an outgoing segment
+ */
+void ReliableClient::setLossRate(double const rate)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	_lossRate = max(0., min(rate, 1.));
+}
+
+/*
+ * Snapshot of the counters & estimators
+ */
+ReliableStatistics ReliableClient::statistics() const
+{
+	lock_guard<mutex> lock(_mutex);
+	ReliableStatistics stats(_stats);
+
+	stats.srtt = (unsigned long)(_srtt);
+	stats.rttvar = (unsigned long)(_rttvar);
+	stats.rto = (unsigned long)(_rto);
+	stats.cwnd = _cwnd;
+	stats.ssthresh = _ssthresh;
+
+	return stats;
+}
+
+}
@@ -0,0 +1,410 @@
+#include "../include/Mach/ReliableServer.hpp"
+#include "../include/Mach/Exception.hpp"
+#include <algorithm>
+#include <random>
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Reorder window size: window rounded up to a power of 2 (at most 32768, so
+ * that it fits the acknowledgement's window field)
+ */
+static uint32_t windowSize(size_t const window)
+{
+	uint32_t size(1);
+
+	while(size < window && size < 32768)
+		size <<= 1;
+
+	return size;
+}
+
+/*
+ * Build the underlying UDPServer, preallocate the streams & start expiring
+ * idle ones (the table being sized twice the streams, so that probe chains
+ * stay short when it fills up)
+ */
+ReliableServer::ReliableServer(unsigned short const port,
+		string const logPath, Priority const prio, size_t const window,
+		size_t const maxStreams, unsigned const listeners,
+		ReceiveBackend const backend)
+	:
+	UDPServer(port, logPath, prio, listeners, backend),
+	_window(windowSize(window)),
+	_lossRate(0.),
+	_pool(new Stream[max(maxStreams, size_t(1))]),
+	_streams(2 * max(maxStreams, size_t(1))),
+	_delivered(0),
+	_reordered(0),
+	_duplicates(0),
+	_overflows(0),
+	_acks(0),
+	_injectedLosses(0),
+	_refused(0)
+{
+	size_t const count(max(maxStreams, size_t(1)));
+
+	if(count >= UINT32_MAX)
+		throw Exception("ReliableServer: too many streams");
+
+	_free.reserve(count);
+
+	for(size_t i = count ; i > 0 ; --i)
+	{
+		_pool[i - 1]._open = false;
+		_free.push_back(uint32_t(i));
+	}
+
+	_streams.startExpiry(chrono::seconds(RELIABLE_STREAM_IDLE),
+			chrono::seconds(RELIABLE_STREAM_IDLE / 4),
+			[this](SockAddr const &, uint32_t const & index)
+			{
+				close(index);
+			});
+}
+
+/*
+ * Streams go away with the pool, once the table stopped expiring them
+ */
+ReliableServer::~ReliableServer()
+{
+	_streams.stopExpiry();
+}
+
+/*
+ * Look the sender's stream up without locking (lookups marking it used),
+ * opening one if it is new, then lock it, looking it up again if it expired
+ * & changed hands meanwhile
+ */
+ReliableServer::Stream * ReliableServer::streamOf(SockAddr const & peer,
+		unique_lock<mutex> & lock)
+{
+	for(;;)
+	{
+		uint32_t index(0);
+
+		if(!_streams.find(peer, index))
+			index = open(peer);
+
+		if(index == 0)
+			return nullptr;
+
+		Stream & stream(_pool[index - 1]);
+
+		lock = unique_lock<mutex>(stream._mutex);
+
+		if(stream._open && stream._peer == peer)
+			return &stream;
+
+		lock.unlock();
+	}
+}
+
+/*
+ * Reset an unused stream for the sender and register it, unless another
+ * thread registered one for the same sender first (the latter being
+ * returned, and ours put back)
+ */
+uint32_t ReliableServer::open(SockAddr const & peer)
+{
+	uint32_t index(0);
+	uint32_t registered(0);
+
+	{
+		lock_guard<mutex> lock(_freeMutex);
+
+		if(_free.empty())
+			return 0;
+
+		index = _free.back();
+		_free.pop_back();
+	}
+
+	{
+		Stream & stream(_pool[index - 1]);
+		lock_guard<mutex> lock(stream._mutex);
+		random_device device;
+
+		stream._peer = peer;
+		stream._open = true;
+		stream._connection = 0;
+		stream._next = 0;
+		stream._highest = 0;
+		stream._received.assign(_window, false);
+		stream._echo = 0;
+		stream._ackDue = false;
+		stream._random = uint64_t(device()) << 32 | device() | 1;
+	}
+
+	if(!_streams.update(peer, [index, &registered](uint32_t & value)
+	{
+		if(value == 0)
+			value = index;
+
+		registered = value;
+	}))
+		registered = 0;
+
+	if(registered != index)
+		close(index);
+
+	return registered;
+}
+
+/*
+ * Mark the stream closed (so that a thread which had just found it looks
+ * again), free its reorder buffers & hand it back
+ */
+void ReliableServer::close(uint32_t const index)
+{
+	Stream & stream(_pool[index - 1]);
+
+	{
+		lock_guard<mutex> lock(stream._mutex);
+
+		stream._open = false;
+		vector< vector<uint8_t> >().swap(stream._buffers);
+	}
+
+	lock_guard<mutex> lock(_freeMutex);
+	_free.push_back(index);
+}
+
+/*
+ * Deliver the segment right away if it is the next one (followed by the
+ * buffered ones it makes contiguous), buffer it if it fits in the window,
+ * drop it otherwise. Any segment calls for an acknowledgement.
+ */
+void ReliableServer::accept(Stream & stream, ReliableData const & data,
+		uint8_t const * payload, size_t const length,
+		SockAddr const & peer)
+{
+	uint32_t const mask(_window - 1);
+
+	/* A new channel from the same endpoint starts over */
+	if(data.connection != stream._connection)
+	{
+		stream._connection = data.connection;
+		stream._next = 0;
+		stream._highest = 0;
+		stream._received.assign(_window, false);
+	}
+
+	stream._echo = data.timestamp;
+	stream._ackDue = true;
+
+	if(!sequenceBefore(data.sequence, stream._next)
+			&& data.sequence - stream._next >= _window)
+	{
+		_overflows.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	if(sequenceBefore(data.sequence, stream._next)
+			|| stream._received[data.sequence & mask])
+	{
+		_duplicates.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	if(sequenceBefore(stream._highest, data.sequence + 1))
+		stream._highest = data.sequence + 1;
+
+	if(data.sequence != stream._next)
+	{
+		if(stream._buffers.empty())
+			stream._buffers.resize(_window);
+
+		stream._buffers[data.sequence & mask].assign(payload,
+				payload + length);
+		stream._received[data.sequence & mask] = true;
+		_reordered.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	/* In order: no copy, then drain the reorder window */
+	receiveMessage(payload, length, peer);
+	++stream._next;
+	_delivered.fetch_add(1, memory_order_relaxed);
+
+	while(stream._received[stream._next & mask])
+	{
+		vector<uint8_t> const & buffer(
+				stream._buffers[stream._next & mask]);
+
+		stream._received[stream._next & mask] = false;
+		receiveMessage(buffer.data(), buffer.size(), peer);
+		++stream._next;
+		_delivered.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+/*
+ * Report the cumulative sequence & the most recent received ranges past it
+ * (scanning the window backwards from the highest segment received)
+ */
+void ReliableServer::acknowledge(Stream & stream, SockAddr const & peer,
+		int const socketFd)
+{
+	uint32_t const mask(_window - 1);
+	double const lossRate(_lossRate.load(memory_order_relaxed));
+	uint8_t bytes[RELIABLE_ACK_MAX];
+	ReliableAck ack;
+
+	ack.connection = stream._connection;
+	ack.cumulative = stream._next;
+	ack.echo = stream._echo;
+	ack.window = uint16_t(_window);
+	ack.blocks = 0;
+
+	for(uint32_t s = stream._highest ; ack.blocks < RELIABLE_SACK_BLOCKS
+			&& sequenceBefore(stream._next, s) ; )
+	{
+		uint32_t const end(s);
+
+		while(sequenceBefore(stream._next, s)
+				&& stream._received[(s - 1) & mask])
+			--s;
+
+		if(s != end)
+		{
+			ack.start[ack.blocks] = s;
+			ack.end[ack.blocks] = end;
+			++ack.blocks;
+		}
+
+		while(sequenceBefore(stream._next, s)
+				&& !stream._received[(s - 1) & mask])
+			--s;
+	}
+
+	stream._ackDue = false;
+
+	if(lossRate > 0.)
+	{
+		/* xorshift64* */
+		stream._random ^= stream._random >> 12;
+		stream._random ^= stream._random << 25;
+		stream._random ^= stream._random >> 27;
+
+		if(double((stream._random * 0x2545F4914F6CDD1Dull) >> 11)
+				* (1. / 9007199254740992.) < lossRate)
+		{
+			_injectedLosses.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+	}
+
+	/* A failed acknowledgement is as good as a lost one (and counted by
+	 * UDPServer as a send failure) */
+	try
+	{
+		sendBytes(bytes, encodeAck(bytes, ack), peer, socketFd);
+		_acks.fetch_add(1, memory_order_relaxed);
+	}
+	catch(Exception const &)
+	{
+	}
+}
+
+/*
+ * Single segment: handle & acknowledge it
+ */
+void ReliableServer::receiveBytes(uint8_t const * bytes, size_t const length,
+		sockaddr_storage const * sender, int const socketFd)
+{
+	SockAddr const peer(*sender);
+	ReliableData data;
+	unique_lock<mutex> lock;
+
+	if(!decodeData(bytes, length, data))
+		return;
+
+	Stream * const stream(streamOf(peer, lock));
+
+	if(stream == nullptr)
+	{
+		_refused.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	accept(*stream, data, bytes + RELIABLE_DATA_HEADER,
+			length - RELIABLE_DATA_HEADER, peer);
+	acknowledge(*stream, peer, socketFd);
+}
+
+/*
+ * Runs of segments from the same sender are handled under a single lookup &
+ * lock, and acknowledged once (when the run ends)
+ */
+void ReliableServer::receiveBatch(Datagram const * datagrams,
+		unsigned const count, int const socketFd)
+{
+	unsigned i(0);
+
+	while(i < count)
+	{
+		SockAddr const peer(*datagrams[i].sender);
+		unique_lock<mutex> lock;
+		Stream * const stream(streamOf(peer, lock));
+		unsigned const first(i);
+
+		while(i < count && SockAddr(*datagrams[i].sender) == peer)
+			++i;
+
+		if(stream == nullptr)
+		{
+			_refused.fetch_add(i - first, memory_order_relaxed);
+			continue;
+		}
+
+		for(unsigned j = first ; j < i ; ++j)
+		{
+			Datagram const & datagram(datagrams[j]);
+			ReliableData data;
+
+			if(decodeData(datagram.data, datagram.length, data))
+				accept(*stream, data,
+					datagram.data + RELIABLE_DATA_HEADER,
+					datagram.length - RELIABLE_DATA_HEADER,
+					peer);
+		}
+
+		if(stream->_ackDue)
+			acknowledge(*stream, peer, socketFd);
+	}
+}
+
+/*
+ * Set the probability of dropping an outgoing acknowledgement
+ */
+void ReliableServer::setLossRate(double const rate)
+{
+	_lossRate.store(max(0., min(rate, 1.)), memory_order_relaxed);
+}
+
+/*
+ * Snapshot of the counters
+ */
+ReliableServerStatistics ReliableServer::reliableStatistics() const
+{
+	ReliableServerStatistics stats;
+
+	stats.delivered = _delivered.load(memory_order_relaxed);
+	stats.reordered = _reordered.load(memory_order_relaxed);
+	stats.duplicates = _duplicates.load(memory_order_relaxed);
+	stats.overflows = _overflows.load(memory_order_relaxed);
+	stats.acks = _acks.load(memory_order_relaxed);
+	stats.injectedLosses = _injectedLosses.load(memory_order_relaxed);
+	stats.streams = _streams.size();
+	stats.refused = _refused.load(memory_order_relaxed);
+
+	return stats;
+}
+
+}
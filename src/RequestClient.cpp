@@ -0,0 +1,375 @@
+#include "../include/Mach/RequestClient.hpp"
+#include "../include/Mach/Exception.hpp"
+#include <algorithm>
+#include <memory>
+
+#if defined(__gnu_linux__)
+#include <errno.h>
+#endif
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Request table size: capacity rounded up to a power of 2 (at most 2^24, the
+ * other 8 bits of an identifier at least being left to the generation)
+ */
+static unsigned slotBits(size_t const capacity)
+{
+	unsigned bits(0);
+
+	while((size_t(1) << bits) < capacity && bits < 24)
+		++bits;
+
+	return bits;
+}
+
+/*
+ * Allocate the request table, the connection itself being set up by
+ * connectTo()
+ */
+RequestClient::RequestClient(size_t const capacity)
+	:
+	_slots(size_t(1) << slotBits(capacity)),
+	_mask(uint32_t((size_t(1) << slotBits(capacity)) - 1)),
+	_slotBits(slotBits(capacity)),
+	_deadlines(chrono::milliseconds(1)),
+	_stats(),
+	_running(false)
+{
+	_free.reserve(_slots.size());
+
+	for(size_t i = _slots.size() ; i > 0 ; --i)
+	{
+		_slots[i - 1].timer = 0;
+		_slots[i - 1].generation = 1;
+		_slots[i - 1].busy = false;
+		_free.push_back(uint32_t(i - 1));
+	}
+}
+
+/*
+ * Stop the completion thread before the socket goes away
+ */
+RequestClient::~RequestClient()
+{
+	disconnect();
+}
+
+/*
+ * Connect, reset the counters and start reading responses (a client still
+ * reading them, even through a socket closed by UDPClient::disconnect(), must
+ * disconnect first)
+ */
+void RequestClient::connectTo(string const host, unsigned short const port)
+{
+	if(_completer.joinable())
+		throw Exception("RequestClient is already connected!");
+
+	UDPClient::connectTo(host, port);
+
+	_stats = RequestStatistics();
+	_running = true;
+	_completer = thread(&RequestClient::completions, this);
+}
+
+/*
+ * Stop the completion thread, release blocked requesters, cancel what is still
+ * outstanding & close the socket
+ */
+void RequestClient::disconnect()
+{
+	vector<Completion> cancelled;
+
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		_running = false;
+		_room.notify_all();
+	}
+
+	if(_completer.joinable())
+		_completer.join();
+
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		for(uint32_t i = 0 ; i < uint32_t(_slots.size()) ; ++i)
+			if(_slots[i].busy)
+			{
+				_deadlines.cancel(_slots[i].timer);
+				cancelled.push_back(release(i));
+				++_stats.cancelled;
+			}
+	}
+
+	for(Completion const & completion : cancelled)
+		completion(REQUEST_CANCELLED, nullptr, 0);
+
+	UDPClient::disconnect();
+}
+
+/*
+ * The slot's generation moves on, which makes a late response to the request
+ * stale
+ */
+RequestClient::Completion RequestClient::release(uint32_t const index)
+{
+	Slot & slot(_slots[index]);
+	Completion completion(move(slot.completion));
+
+	slot.completion = nullptr;
+	slot.busy = false;
+	slot.generation = (slot.generation + 1) & (UINT32_MAX >> _slotBits);
+	_free.push_back(index);
+
+	return completion;
+}
+
+/*
+ * Header & payload go out as two vectors (one copy outside Linux)
+ */
+void RequestClient::transmit(uint32_t const id, uint8_t const * bytes,
+		size_t const length)
+{
+	uint8_t header[REQUEST_HEADER];
+	RequestHeader request;
+
+	request.type = REQUEST_CALL;
+	request.id = id;
+	encodeRequest(header, request);
+
+#if defined(__gnu_linux__)
+	iovec vectors[2];
+	msghdr message;
+
+	memset(&message, 0, sizeof(msghdr));
+	vectors[0].iov_base = header;
+	vectors[0].iov_len = REQUEST_HEADER;
+	vectors[1].iov_base = (void *)(bytes);
+	vectors[1].iov_len = length;
+	message.msg_iov = vectors;
+	message.msg_iovlen = 2;
+
+	while(sendmsg(_socket, &message, 0) == -1)
+		if(errno != EINTR)
+			throw Exception(lastError("sendmsg"));
+#else
+	uint8_t datagram[REQUEST_HEADER + REQUEST_PAYLOAD_MAX];
+
+	memcpy(datagram, header, REQUEST_HEADER);
+	memcpy(datagram + REQUEST_HEADER, bytes, length);
+	sendBytes(datagram, REQUEST_HEADER + length);
+#endif
+}
+
+/*
+ * Take a free slot (waiting for one if needed), start its deadline & send the
+ * request. If sending fails, the request is withdrawn (its completion is not
+ * run, unless its deadline passed meanwhile) and an exception is thrown.
+ */
+uint32_t RequestClient::request(uint8_t const * bytes, size_t const length,
+		chrono::microseconds const deadline, Completion completion)
+{
+	uint32_t index(0), id(0);
+
+	if(length > REQUEST_PAYLOAD_MAX)
+		throw Exception("Request too large for "
+				"RequestClient::request()!");
+
+	{
+		unique_lock<mutex> lock(_mutex);
+
+		while(_running && _free.empty())
+			_room.wait(lock);
+
+		if(!_running)
+			throw Exception("RequestClient is not connected!");
+
+		index = _free.back();
+		_free.pop_back();
+
+		Slot & slot(_slots[index]);
+
+		slot.completion = move(completion);
+		slot.busy = true;
+		slot.timer = _deadlines.schedule(deadline, index);
+		id = slot.generation << _slotBits | index;
+		++_stats.sent;
+	}
+
+	try
+	{
+		transmit(id, bytes, length);
+	}
+	catch(Exception const &)
+	{
+		lock_guard<mutex> lock(_mutex);
+		Slot & slot(_slots[index]);
+
+		if(slot.busy && (slot.generation << _slotBits | index) == id)
+		{
+			_deadlines.cancel(slot.timer);
+			release(index);
+			--_stats.sent;
+			_room.notify_all();
+		}
+
+		throw;
+	}
+
+	return id;
+}
+
+/*
+ * Wrap a promise into the completion
+ */
+future<RequestResult> RequestClient::request(uint8_t const * bytes,
+		size_t const length, chrono::microseconds const deadline)
+{
+	shared_ptr< promise<RequestResult> > const result(
+			new promise<RequestResult>);
+	future<RequestResult> outcome(result->get_future());
+
+	request(bytes, length, deadline, [result](RequestStatus const status,
+			uint8_t const * response, size_t const size)
+	{
+		RequestResult r;
+
+		r.status = status;
+		r.response.assign(response, response + size);
+		result->set_value(move(r));
+	});
+
+	return outcome;
+}
+
+/*
+ * Wait for responses (one tick at most, so that deadlines are checked), read
+ * a batch of them, match them & expire the deadlines under the lock, then run
+ * the completions
+ */
+void RequestClient::completions()
+{
+	size_t const stride(REQUEST_HEADER + REQUEST_PAYLOAD_MAX);
+	vector<uint8_t> buffers(REQUEST_RECEIVE_BATCH * stride);
+	size_t lengths[REQUEST_RECEIVE_BATCH];
+	vector<Done> done;
+	uint64_t wait(REQUEST_TICK);
+
+#if defined(__gnu_linux__)
+	mmsghdr headers[REQUEST_RECEIVE_BATCH];
+	iovec vectors[REQUEST_RECEIVE_BATCH];
+
+	for(unsigned i = 0 ; i < REQUEST_RECEIVE_BATCH ; ++i)
+	{
+		vectors[i].iov_base = &buffers[i * stride];
+		vectors[i].iov_len = stride;
+		memset(&headers[i], 0, sizeof(mmsghdr));
+		headers[i].msg_hdr.msg_iov = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+
+	done.reserve(REQUEST_RECEIVE_BATCH);
+
+	while(_running)
+	{
+		int count(0);
+
+		if(pending(chrono::microseconds(wait)))
+		{
+#if defined(__gnu_linux__)
+			count = recvmmsg(_socket, headers,
+					REQUEST_RECEIVE_BATCH, MSG_DONTWAIT,
+					nullptr);
+
+			for(int i = 0 ; i < count ; ++i)
+				lengths[i] = headers[i].msg_len;
+#else
+			long const length(long(recv(_socket,
+					(char *)(buffers.data()), stride, 0)));
+
+			count = length < 0 ? -1 : 1;
+			lengths[0] = size_t(max(length, long(0)));
+#endif
+		}
+
+		{
+			lock_guard<mutex> lock(_mutex);
+
+			if(count > 0)
+				++_stats.receiveCalls;
+
+			for(int i = 0 ; i < count ; ++i)
+			{
+				uint8_t const * const bytes(
+						&buffers[i * stride]);
+				size_t const length(lengths[i]);
+				RequestHeader header;
+
+				if(!decodeRequest(bytes, length, header)
+						|| header.type != REQUEST_REPLY)
+				{
+					++_stats.stale;
+					continue;
+				}
+
+				uint32_t const index(header.id & _mask);
+				Slot & slot(_slots[index]);
+
+				if(!slot.busy || slot.generation
+						!= header.id >> _slotBits)
+				{
+					++_stats.stale;
+					continue;
+				}
+
+				_deadlines.cancel(slot.timer);
+				done.push_back(Done { release(index),
+					REQUEST_COMPLETED,
+					bytes + REQUEST_HEADER,
+					length - REQUEST_HEADER });
+				++_stats.completed;
+			}
+
+			_deadlines.poll([this, &done](TimerWheel::TimerId const,
+					uint64_t const index)
+			{
+				done.push_back(Done { release(uint32_t(index)),
+					REQUEST_TIMEOUT, nullptr, 0 });
+				++_stats.timeouts;
+			});
+		}
+
+		if(!done.empty())
+			_room.notify_all();
+
+		for(Done const & d : done)
+			d.completion(d.status, d.response, d.length);
+
+		done.clear();
+
+		/* A full batch may leave more responses behind */
+		wait = count == REQUEST_RECEIVE_BATCH ? 0 : REQUEST_TICK;
+	}
+}
+
+/*
+ * Snapshot of the counters
+ */
+RequestStatistics RequestClient::statistics() const
+{
+	lock_guard<mutex> lock(_mutex);
+	RequestStatistics stats(_stats);
+
+	stats.outstanding = _slots.size() - _free.size();
+
+	return stats;
+}
+
+}
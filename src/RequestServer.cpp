@@ -0,0 +1,186 @@
+#include "../include/Mach/RequestServer.hpp"
+#include "../include/Mach/Exception.hpp"
+#include <algorithm>
+#include <vector>
+
+#if defined(__gnu_linux__)
+#include <errno.h>
+#endif
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/* Response datagrams of the calling receiving thread */
+static thread_local vector<uint8_t> responses;
+
+
+/*
+ * Build the underlying UDPServer
+ */
+RequestServer::RequestServer(unsigned short const port,
+		string const logPath, Priority const prio,
+		unsigned const listeners, ReceiveBackend const backend)
+	:
+	UDPServer(port, logPath, prio, listeners, backend),
+	_answered(0),
+	_malformed(0),
+	_calls(0)
+{
+}
+
+/*
+ * Nothing to release but the server itself
+ */
+RequestServer::~RequestServer()
+{
+}
+
+/*
+ * Let the handler write each response after its header, then send them all
+ * back (one at a time outside Linux)
+ */
+void RequestServer::answer(Datagram const * datagrams, unsigned const count,
+		int const socketFd)
+{
+	size_t const stride(REQUEST_HEADER + REQUEST_PAYLOAD_MAX);
+	unsigned answers(0);
+
+#if defined(__gnu_linux__)
+	mmsghdr headers[REQUEST_BATCH];
+	iovec vectors[REQUEST_BATCH];
+#endif
+
+	if(responses.size() < REQUEST_BATCH * stride)
+		responses.resize(REQUEST_BATCH * stride);
+
+	for(unsigned i = 0 ; i < count ; ++i)
+	{
+		Datagram const & datagram(datagrams[i]);
+		uint8_t * const response(&responses[answers * stride]);
+		RequestHeader header;
+
+		if(!decodeRequest(datagram.data, datagram.length, header)
+				|| header.type != REQUEST_CALL)
+		{
+			_malformed.fetch_add(1, memory_order_relaxed);
+			continue;
+		}
+
+		size_t const length(min(receiveRequest(
+				datagram.data + REQUEST_HEADER,
+				datagram.length - REQUEST_HEADER,
+				response + REQUEST_HEADER,
+				SockAddr(*datagram.sender)),
+				size_t(REQUEST_PAYLOAD_MAX)));
+
+		header.type = REQUEST_REPLY;
+		encodeRequest(response, header);
+
+#if defined(__gnu_linux__)
+		sockaddr const * const sender((sockaddr const *)(
+				datagram.sender));
+
+		vectors[answers].iov_base = response;
+		vectors[answers].iov_len = REQUEST_HEADER + length;
+
+		memset(&headers[answers], 0, sizeof(mmsghdr));
+		headers[answers].msg_hdr.msg_name = (void *)(sender);
+		headers[answers].msg_hdr.msg_namelen =
+			sender->sa_family == AF_INET6 ?
+			sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+		headers[answers].msg_hdr.msg_iov = &vectors[answers];
+		headers[answers].msg_hdr.msg_iovlen = 1;
+		++answers;
+#else
+		_calls.fetch_add(1, memory_order_relaxed);
+
+		/* sendBytes(...) counts its failures */
+		try
+		{
+			sendBytes(response, REQUEST_HEADER + length,
+					(sockaddr const *)(datagram.sender),
+					socketFd);
+			_answered.fetch_add(1, memory_order_relaxed);
+		}
+		catch(Exception const &)
+		{
+		}
+#endif
+	}
+
+#if defined(__gnu_linux__)
+	/* A response the socket refuses is counted against its listener
+	 * and lost, as with any UDP datagram (the client times the request
+	 * out), the next ones being sent all the same */
+	for(unsigned sent = 0 ; sent < answers ; )
+	{
+		int const result(sendmmsg(socketFd, &headers[sent],
+				answers - sent, 0));
+
+		_calls.fetch_add(1, memory_order_relaxed);
+
+		if(result == -1)
+		{
+			if(errno != EINTR)
+			{
+				sendFailed(socketFd);
+				++sent;
+			}
+
+			continue;
+		}
+
+		sent += unsigned(result);
+		_answered.fetch_add(unsigned(result), memory_order_relaxed);
+	}
+#else
+	(void)(answers);
+#endif
+}
+
+/*
+ * Answer a single request
+ */
+void RequestServer::receiveBytes(uint8_t const * bytes, size_t const length,
+		sockaddr_storage const * sender, int const socketFd)
+{
+	Datagram datagram;
+
+	datagram.data = bytes;
+	datagram.length = length;
+	datagram.sender = sender;
+	datagram.packet = nullptr;
+
+	answer(&datagram, 1, socketFd);
+}
+
+/*
+ * Answer the batch by chunks of REQUEST_BATCH
+ */
+void RequestServer::receiveBatch(Datagram const * datagrams,
+		unsigned const count, int const socketFd)
+{
+	for(unsigned first = 0 ; first < count ; first += REQUEST_BATCH)
+		answer(datagrams + first, min(count - first,
+				unsigned(REQUEST_BATCH)), socketFd);
+}
+
+/*
+ * Snapshot of the counters
+ */
+RequestServerStatistics RequestServer::requestStatistics() const
+{
+	RequestServerStatistics stats;
+
+	stats.answered = _answered.load(memory_order_relaxed);
+	stats.malformed = _malformed.load(memory_order_relaxed);
+	stats.calls = _calls.load(memory_order_relaxed);
+
+	return stats;
+}
+
+}
@@ -0,0 +1,136 @@
+#include "../include/Mach/SessionTable.hpp"
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Construct the :: (port 0) key
+ */
+PeerKey::PeerKey()
+{
+	for(unsigned i = 0 ; i < PEER_KEY_WORDS ; ++i)
+		words[i] = 0;
+}
+
+/*
+ * Fill the words from an IPv4 or IPv6 socket address (other families being
+ * left as the default key)
+ */
+static void load(uint32_t * words, sockaddr const * peer)
+{
+	if(peer->sa_family == AF_INET)
+	{
+		sockaddr_in const & in(*(sockaddr_in const *)(peer));
+
+		words[2] = 0xFFFF;
+		words[3] = ntohl(in.sin_addr.s_addr);
+		words[4] = ntohs(in.sin_port);
+	}
+	else if(peer->sa_family == AF_INET6)
+	{
+		sockaddr_in6 const & in6(*(sockaddr_in6 const *)(peer));
+		uint8_t const * bytes(in6.sin6_addr.s6_addr);
+
+		for(unsigned i = 0 ; i < 4 ; ++i)
+			words[i] = uint32_t(bytes[4 * i]) << 24
+				| uint32_t(bytes[4 * i + 1]) << 16
+				| uint32_t(bytes[4 * i + 2]) << 8
+				| uint32_t(bytes[4 * i + 3]);
+
+		words[4] = ntohs(in6.sin6_port);
+	}
+}
+
+/*
+ * Construct the key of an endpoint (the unspecified one yielding the default
+ * key)
+ */
+PeerKey::PeerKey(SockAddr const & endpoint)
+	:
+	PeerKey()
+{
+	load(words, endpoint.get());
+}
+
+/*
+ * Rebuild the endpoint
+ */
+SockAddr PeerKey::address() const
+{
+	sockaddr_storage peer;
+
+	memset(&peer, 0, sizeof(sockaddr_storage));
+
+	if(ipv4())
+	{
+		sockaddr_in & in((sockaddr_in &)(peer));
+
+		in.sin_family = AF_INET;
+		in.sin_addr.s_addr = htonl(words[3]);
+		in.sin_port = htons(uint16_t(words[4]));
+	}
+	else
+	{
+		sockaddr_in6 & in6((sockaddr_in6 &)(peer));
+		uint8_t * bytes(in6.sin6_addr.s6_addr);
+
+		in6.sin6_family = AF_INET6;
+
+		for(unsigned i = 0 ; i < 4 ; ++i)
+		{
+			bytes[4 * i] = uint8_t(words[i] >> 24);
+			bytes[4 * i + 1] = uint8_t(words[i] >> 16);
+			bytes[4 * i + 2] = uint8_t(words[i] >> 8);
+			bytes[4 * i + 3] = uint8_t(words[i]);
+		}
+
+		in6.sin6_port = htons(uint16_t(words[4]));
+	}
+
+	return SockAddr(peer);
+}
+
+/*
+ * IPv4-mapped addresses are ::ffff:a.b.c.d
+ */
+bool PeerKey::ipv4() const
+{
+	return words[0] == 0 && words[1] == 0 && words[2] == 0xFFFF;
+}
+
+/*
+ * Mix the words the way SockAddr::hash() & UDPServer's steering program do,
+ * which only see IPv4 addresses for IPv4 peers
+ */
+uint32_t PeerKey::hash() const
+{
+	uint32_t hash(PEER_HASH_SEED);
+
+	for(unsigned i = ipv4() ? 3 : 0 ; i < PEER_KEY_WORDS ; ++i)
+		hash = (hash ^ words[i]) * PEER_HASH_PRIME;
+
+	return hash ^ (hash >> 16);
+}
+
+/*
+ * Word by word comparison
+ */
+bool PeerKey::operator == (PeerKey const & other) const
+{
+	for(unsigned i = 0 ; i < PEER_KEY_WORDS ; ++i)
+		if(words[i] != other.words[i])
+			return false;
+
+	return true;
+}
+
+bool PeerKey::operator != (PeerKey const & other) const
+{
+	return !(*this == other);
+}
+
+}
@@ -0,0 +1,328 @@
+#include "../include/Mach/SockAddr.hpp"
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Write the decimal form of value at buffer, returns the number of digits
+ */
+static size_t writeDecimal(char * buffer, unsigned value)
+{
+	char digits[10];
+	size_t count(0);
+
+	do
+	{
+		digits[count++] = char('0' + value % 10);
+		value /= 10;
+	} while(value != 0);
+
+	for(size_t i = 0 ; i < count ; ++i)
+		buffer[i] = digits[count - 1 - i];
+
+	return count;
+}
+
+/*
+ * Parse a decimal port ending at end, returns false if it isn't one
+ */
+static bool parsePort(char const * text, char const * end,
+		unsigned short & port)
+{
+	unsigned value(0);
+
+	if(text == end || end - text > 5)
+		return false;
+
+	for( ; text != end ; ++text)
+	{
+		if(*text < '0' || *text > '9')
+			return false;
+
+		value = value * 10 + unsigned(*text - '0');
+	}
+
+	if(value > 65535)
+		return false;
+
+	port = (unsigned short)(value);
+
+	return true;
+}
+
+/*
+ * Copy an IPv4 or IPv6 socket address
+ */
+SockAddr::SockAddr(sockaddr const * address)
+	:
+	SockAddr()
+{
+	if(address == nullptr)
+		return;
+
+	if(address->sa_family == AF_INET)
+		memcpy(&_address, address, sizeof(sockaddr_in));
+	else if(address->sa_family == AF_INET6)
+		memcpy(&_address, address, sizeof(sockaddr_in6));
+}
+
+SockAddr::SockAddr(sockaddr_storage const & address)
+	:
+	SockAddr((sockaddr const *)(&address))
+{
+}
+
+/*
+ * Parse the IPv4, [IPv6]:port or IPv6 forms
+ */
+bool SockAddr::parse(char const * text, SockAddr & endpoint)
+{
+	char address[INET6_ADDRSTRLEN];
+	char const * end(text + strnlen(text, SOCKADDR_STRLEN));
+	char const * colon(nullptr);
+	char const * addressEnd(end);
+	unsigned short port(0);
+	SockAddr parsed;
+
+	if(*end != '\0')
+		return false;
+
+	if(*text == '[')
+	{
+		/* [IPv6] or [IPv6]:port */
+		char const * bracket((char const *)(memchr(text, ']',
+				size_t(end - text))));
+
+		if(bracket == nullptr || (bracket + 1 != end
+				&& (bracket[1] != ':'
+				|| !parsePort(bracket + 2, end, port))))
+			return false;
+
+		++text;
+		addressEnd = bracket;
+		parsed._address.sin6_family = AF_INET6;
+	}
+	else
+	{
+		/* a.b.c.d, a.b.c.d:port or a bare IPv6 address (several
+		 * colons) */
+		colon = (char const *)(memchr(text, ':', size_t(end - text)));
+
+		if(colon != nullptr && memchr(colon + 1, ':',
+				size_t(end - colon - 1)) != nullptr)
+			parsed._address.sin6_family = AF_INET6;
+		else
+		{
+			if(colon != nullptr)
+			{
+				if(!parsePort(colon + 1, end, port))
+					return false;
+
+				addressEnd = colon;
+			}
+
+			parsed._address.sin6_family = AF_INET;
+		}
+	}
+
+	if(size_t(addressEnd - text) >= sizeof(address))
+		return false;
+
+	memcpy(address, text, size_t(addressEnd - text));
+	address[addressEnd - text] = '\0';
+
+	if(parsed.ipv4())
+	{
+		sockaddr_in & in((sockaddr_in &)(parsed._address));
+
+		if(inet_pton(AF_INET, address, &in.sin_addr) != 1)
+			return false;
+	}
+	else if(inet_pton(AF_INET6, address, &parsed._address.sin6_addr) != 1)
+		return false;
+
+	parsed.setPort(port);
+	endpoint = parsed;
+
+	return true;
+}
+
+/*
+ * Port field of either family
+ */
+unsigned short SockAddr::port() const
+{
+	if(ipv4())
+		return ntohs(((sockaddr_in const &)(_address)).sin_port);
+
+	return ntohs(_address.sin6_port);
+}
+
+void SockAddr::setPort(unsigned short const port)
+{
+	if(ipv4())
+		((sockaddr_in &)(_address)).sin_port = htons(port);
+	else
+		_address.sin6_port = htons(port);
+}
+
+/*
+ * Copy into a sockaddr_storage (zero-padded)
+ */
+sockaddr_storage SockAddr::storage() const
+{
+	sockaddr_storage copy;
+
+	memset(&copy, 0, sizeof(sockaddr_storage));
+	memcpy(&copy, &_address, sizeof(sockaddr_in6));
+
+	return copy;
+}
+
+/*
+ * Mix the big-endian 32-bit words of the address (its last one only for IPv4
+ * and IPv4-mapped addresses, the unspecified endpoint hashing as ::), then the
+ * port
+ */
+uint32_t SockAddr::hash() const
+{
+	uint32_t hash(PEER_HASH_SEED);
+
+	if(ipv4())
+		hash = (hash ^ ntohl(((sockaddr_in const &)(_address))
+				.sin_addr.s_addr)) * PEER_HASH_PRIME;
+	else
+	{
+		uint8_t const * bytes(_address.sin6_addr.s6_addr);
+
+		for(unsigned i = IN6_IS_ADDR_V4MAPPED(&_address.sin6_addr) ?
+				3 : 0 ; i < 4 ; ++i)
+		{
+			uint32_t const word(uint32_t(bytes[4 * i]) << 24
+				| uint32_t(bytes[4 * i + 1]) << 16
+				| uint32_t(bytes[4 * i + 2]) << 8
+				| uint32_t(bytes[4 * i + 3]));
+
+			hash = (hash ^ word) * PEER_HASH_PRIME;
+		}
+	}
+
+	hash = (hash ^ port()) * PEER_HASH_PRIME;
+
+	return hash ^ (hash >> 16);
+}
+
+/*
+ * IPv4 addresses are formatted by hand, IPv6 ones by inet_ntop() straight into
+ * the buffer
+ */
+size_t SockAddr::format(char * buffer, size_t const size,
+		bool const withPort) const
+{
+	char text[SOCKADDR_STRLEN];
+	size_t length(0);
+
+	if(ipv4())
+	{
+		uint8_t const * bytes((uint8_t const *)(
+				&((sockaddr_in const &)(_address)).sin_addr));
+
+		for(unsigned i = 0 ; i < 4 ; ++i)
+		{
+			if(i > 0)
+				text[length++] = '.';
+
+			length += writeDecimal(text + length, bytes[i]);
+		}
+	}
+	else if(ipv6())
+	{
+		if(withPort)
+			text[length++] = '[';
+
+		if(inet_ntop(AF_INET6, (void *)(&_address.sin6_addr),
+				text + length, INET6_ADDRSTRLEN) == nullptr)
+			return 0;
+
+		length += strlen(text + length);
+
+		if(withPort)
+			text[length++] = ']';
+	}
+	else
+		return 0;
+
+	if(withPort)
+	{
+		text[length++] = ':';
+		length += writeDecimal(text + length, port());
+	}
+
+	if(length >= size)
+		return 0;
+
+	memcpy(buffer, text, length);
+	buffer[length] = '\0';
+
+	return length;
+}
+
+/*
+ * Same family, address & port (and scope for IPv6)
+ */
+bool SockAddr::operator == (SockAddr const & other) const
+{
+	if(family() != other.family() || port() != other.port())
+		return false;
+
+	if(ipv4())
+		return ((sockaddr_in const &)(_address)).sin_addr.s_addr
+			== ((sockaddr_in const &)(other._address))
+			.sin_addr.s_addr;
+
+	if(ipv6())
+		return _address.sin6_scope_id == other._address.sin6_scope_id
+			&& memcmp(&_address.sin6_addr,
+				&other._address.sin6_addr,
+				sizeof(in6_addr)) == 0;
+
+	return true;
+}
+
+bool SockAddr::operator != (SockAddr const & other) const
+{
+	return !(*this == other);
+}
+
+/*
+ * Addresses compare bytewise in network order, i.e. numerically
+ */
+bool SockAddr::operator < (SockAddr const & other) const
+{
+	int order(0);
+
+	if(family() != other.family())
+		return family() < other.family();
+
+	if(ipv4())
+		order = memcmp(&((sockaddr_in const &)(_address)).sin_addr,
+			&((sockaddr_in const &)(other._address)).sin_addr,
+			sizeof(in_addr));
+	else if(ipv6())
+		order = memcmp(&_address.sin6_addr, &other._address.sin6_addr,
+				sizeof(in6_addr));
+
+	if(order != 0)
+		return order < 0;
+
+	if(port() != other.port())
+		return port() < other.port();
+
+	return ipv6() && _address.sin6_scope_id < other._address.sin6_scope_id;
+}
+
+}
@@ -0,0 +1,345 @@
+#include "../include/Mach/TimerWheel.hpp"
+#include <algorithm>
+
+#if defined(__gnu_linux__)
+#include <time.h>
+#endif
+
+/* End of list / no timer */
+#define TIMER_NONE UINT32_MAX
+
+/* Longest delay (ticks) */
+#define TIMER_SPAN ((uint64_t(1) << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1)
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Empty wheel, starting at the current date
+ */
+TimerWheel::TimerWheel(chrono::nanoseconds const tick)
+	:
+	_free(TIMER_NONE),
+	_tick(max(uint64_t(tick.count()), uint64_t(1))),
+	_now(clock() / _tick),
+	_size(0)
+{
+	fill(_heads, _heads + TIMER_LEVELS * TIMER_SLOTS, TIMER_NONE);
+
+	for(unsigned level = 0 ; level < TIMER_LEVELS ; ++level)
+		fill(_occupied[level], _occupied[level] + TIMER_SLOTS / 64, 0);
+}
+
+/*
+ * CLOCK_MONOTONIC_COARSE on Linux, the steady clock elsewhere
+ */
+uint64_t TimerWheel::clock()
+{
+#if defined(__gnu_linux__)
+	timespec date;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &date);
+
+	return uint64_t(date.tv_sec) * 1000000000 + uint64_t(date.tv_nsec);
+#else
+	return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now().time_since_epoch())
+			.count());
+#endif
+}
+
+/*
+ * CLOCK_MONOTONIC on Linux (which CLOCK_MONOTONIC_COARSE follows, never
+ * running ahead of it), the steady clock elsewhere
+ */
+uint64_t TimerWheel::preciseClock()
+{
+#if defined(__gnu_linux__)
+	timespec date;
+
+	clock_gettime(CLOCK_MONOTONIC, &date);
+
+	return uint64_t(date.tv_sec) * 1000000000 + uint64_t(date.tv_nsec);
+#else
+	return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now().time_since_epoch())
+			.count());
+#endif
+}
+
+/*
+ * The level is the first whose span covers the delay, the slot is the
+ * matching digit of the expiry (timers due now or past land in the current
+ * level 0 slot)
+ */
+void TimerWheel::link(uint32_t const index)
+{
+	Timer & timer(_timers[index]);
+	uint64_t const delay(timer.expiry > _now ? timer.expiry - _now : 0);
+	unsigned level(0);
+
+	while(level + 1 < TIMER_LEVELS
+			&& delay >> (TIMER_SLOT_BITS * (level + 1)) != 0)
+		++level;
+
+	unsigned const slot(unsigned(max(timer.expiry, _now)
+			>> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1));
+	uint32_t & head(_heads[level * TIMER_SLOTS + slot]);
+
+	timer.slot = level * TIMER_SLOTS + slot;
+	timer.prev = TIMER_NONE;
+	timer.next = head;
+
+	if(head != TIMER_NONE)
+		_timers[head].prev = index;
+
+	head = index;
+	_occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+}
+
+/*
+ * Unlink the timer, clearing the slot's occupancy bit if it was the last one
+ */
+void TimerWheel::unlink(uint32_t const index)
+{
+	Timer & timer(_timers[index]);
+
+	if(timer.prev != TIMER_NONE)
+		_timers[timer.prev].next = timer.next;
+	else
+		_heads[timer.slot] = timer.next;
+
+	if(timer.next != TIMER_NONE)
+		_timers[timer.next].prev = timer.prev;
+
+	if(_heads[timer.slot] == TIMER_NONE)
+	{
+		unsigned const level(timer.slot / TIMER_SLOTS);
+		unsigned const slot(timer.slot % TIMER_SLOTS);
+
+		_occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+	}
+}
+
+/*
+ * Detach the whole list, then link its timers again (relative to the current
+ * tick, which puts them one level down at least)
+ */
+void TimerWheel::cascade(unsigned const level, unsigned const index)
+{
+	uint32_t & head(_heads[level * TIMER_SLOTS + index]);
+	uint32_t timer(head);
+
+	head = TIMER_NONE;
+	_occupied[level][index / 64] &= ~(uint64_t(1) << (index % 64));
+
+	while(timer != TIMER_NONE)
+	{
+		uint32_t const next(_timers[timer].next);
+
+		/* The list is scattered over the storage: fetch the next timer
+		 * while relinking this one */
+		if(next != TIMER_NONE)
+			__builtin_prefetch(&_timers[next]);
+
+		link(timer);
+		timer = next;
+	}
+}
+
+/*
+ * Scan the level 0 bitmap past the current slot, stopping at the end of the
+ * rotation (where the next cascade is due)
+ */
+uint64_t TimerWheel::nextStep(uint64_t const limit) const
+{
+	unsigned const current(unsigned(_now) & (TIMER_SLOTS - 1));
+	uint64_t const rotation((_now | (TIMER_SLOTS - 1)) + 1);
+
+	for(unsigned word = (current + 1) / 64 ; current + 1 < TIMER_SLOTS
+			&& word < TIMER_SLOTS / 64 ; ++word)
+	{
+		uint64_t bits(_occupied[0][word]);
+
+		if(word == (current + 1) / 64)
+			bits &= ~uint64_t(0) << ((current + 1) % 64);
+
+		if(bits != 0)
+			return min(limit, _now - current + word * 64
+					+ unsigned(__builtin_ctzll(bits)));
+	}
+
+	return min(limit, rotation);
+}
+
+/*
+ * Pop the head of the slot, the timer going back to the free list (with a
+ * new generation, which makes its handle stale)
+ */
+bool TimerWheel::pop(unsigned const index, TimerId & id, uint64_t & data)
+{
+	uint32_t const timer(_heads[index]);
+
+	if(timer == TIMER_NONE)
+		return false;
+
+	unlink(timer);
+
+	Timer & t(_timers[timer]);
+
+	id = uint64_t(t.generation) << 32 | timer;
+	data = t.data;
+
+	t.generation = t.generation == UINT32_MAX ? 1 : t.generation + 1;
+	t.slot = TIMER_NONE;
+	t.next = _free;
+	_free = timer;
+	--_size;
+
+	return true;
+}
+
+/*
+ * Check the handle's generation against the timer's
+ */
+uint32_t TimerWheel::find(TimerId const id) const
+{
+	uint32_t const index(id & UINT32_MAX);
+
+	if(index >= _timers.size() || _timers[index].slot == TIMER_NONE
+			|| _timers[index].generation != uint32_t(id >> 32))
+		return TIMER_NONE;
+
+	return index;
+}
+
+/*
+ * Expiry tick of a delay: the first tick starting no earlier than the delay
+ * from now, now being read from the precise clock (the coarse one lags by up
+ * to a kernel tick, and the last tick processed until the next advance(...),
+ * either of which would fire timers early), and at least the next tick
+ */
+uint64_t TimerWheel::expiryOf(chrono::nanoseconds const delay) const
+{
+	uint64_t const nanoseconds(uint64_t(max(delay.count(),
+			chrono::nanoseconds::rep(0))));
+	uint64_t expiry(_now + TIMER_SPAN);
+
+	if(nanoseconds / _tick < TIMER_SPAN)
+		expiry = min(expiry, (preciseClock() + nanoseconds + _tick - 1)
+				/ _tick);
+
+	return max(expiry, _now + 1);
+}
+
+/*
+ * Take a free timer (growing the storage if none) & link it
+ */
+TimerWheel::TimerId TimerWheel::schedule(chrono::nanoseconds const delay,
+		uint64_t const data)
+{
+	uint32_t index(_free);
+
+	if(index == TIMER_NONE)
+	{
+		Timer timer;
+
+		timer.expiry = 0;
+		timer.data = 0;
+		timer.prev = TIMER_NONE;
+		timer.next = TIMER_NONE;
+		timer.generation = 1;
+		timer.slot = TIMER_NONE;
+		index = uint32_t(_timers.size());
+		_timers.push_back(timer);
+	}
+	else
+		_free = _timers[index].next;
+
+	Timer & timer(_timers[index]);
+
+	timer.expiry = expiryOf(delay);
+	timer.data = data;
+	link(index);
+	++_size;
+
+	return uint64_t(timer.generation) << 32 | index;
+}
+
+/*
+ * Unlink the timer & free it
+ */
+bool TimerWheel::cancel(TimerId const id)
+{
+	uint32_t const index(find(id));
+
+	if(index == TIMER_NONE)
+		return false;
+
+	Timer & timer(_timers[index]);
+
+	unlink(index);
+
+	timer.generation = timer.generation == UINT32_MAX ? 1
+		: timer.generation + 1;
+	timer.slot = TIMER_NONE;
+	timer.next = _free;
+	_free = index;
+	--_size;
+
+	return true;
+}
+
+/*
+ * Move the timer to the slot of its new expiry
+ */
+bool TimerWheel::restart(TimerId const id, chrono::nanoseconds const delay)
+{
+	uint32_t const index(find(id));
+
+	if(index == TIMER_NONE)
+		return false;
+
+	unlink(index);
+	_timers[index].expiry = expiryOf(delay);
+	link(index);
+
+	return true;
+}
+
+/*
+ * Date of the next tick needing work (see nextStep())
+ */
+uint64_t TimerWheel::nextDeadline() const
+{
+	if(_size == 0)
+		return UINT64_MAX;
+
+	return nextStep(UINT64_MAX) * _tick;
+}
+
+/*
+ * Pending timers
+ */
+size_t TimerWheel::size() const
+{
+	return _size;
+}
+bool TimerWheel::empty() const
+{
+	return _size == 0;
+}
+
+/*
+ * Tick length
+ */
+chrono::nanoseconds TimerWheel::tick() const
+{
+	return chrono::nanoseconds(_tick);
+}
+
+}
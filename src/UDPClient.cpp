@@ -1,6 +1,17 @@
 #include "../include/Mach/UDPClient.hpp"
 #include "../include/Mach/Exception.hpp"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <climits>
+
+#if defined(__gnu_linux__)
+#include <time.h>
+#include <poll.h>
+#include <linux/net_tstamp.h>
+#endif
 
 
 namespace Mach
@@ -14,7 +25,17 @@ using namespace std;
  * host and port describe the remote server information (thus, port shall be
  * != 0 and host should be a VALID FQDN or IP address)
  */
-UDPClient::UDPClient() : _socket(-1)
+UDPClient::UDPClient()
+	:
+	_interval(0),
+	_nextDeparture(0),
+	_txtime(false),
+	_departures(0),
+	_firstDeparture(0),
+	_lastDeparture(0),
+	_deviation(0.),
+	_maxDeviation(0.),
+	_socket(-1)
 {}
 
 /*
@@ -94,13 +115,264 @@ void UDPClient::sendBytes(uint8_t const * bytes, size_t const length) const
 		throw Exception(lastError("send"));
 }
 
+/*
+ * ppoll() on Linux, select() elsewhere
+ */
+bool UDPClient::pending(chrono::microseconds const wait) const
+{
+	long long const delay(wait.count());
+
+#if defined(__gnu_linux__)
+	pollfd descriptor = { _socket, POLLIN, 0 };
+	timespec const timeout = { time_t(delay / 1000000),
+			long(delay % 1000000) * 1000 };
+
+	return ppoll(&descriptor, 1, delay < 0 ? nullptr : &timeout,
+			nullptr) > 0;
+#else
+	fd_set descriptors;
+	timeval timeout = { long(delay / 1000000), long(delay % 1000000) };
+
+	FD_ZERO(&descriptors);
+	FD_SET(_socket, &descriptors);
+
+	return select(0, &descriptors, nullptr, nullptr,
+			delay < 0 ? nullptr : &timeout) > 0;
+#endif
+}
+
 /*
  * Wait for a message from the remote server on the internal socket
  */
-void UDPClient::receiveBytes(uint8_t * bytes, size_t const max) const
+long UDPClient::receiveBytes(uint8_t * bytes, size_t const max,
+		chrono::milliseconds const timeout) const
 {
-	if(recv(_socket, (char *)bytes, max, 0) == -1)
+	if(_socket == -1)
+		throw Exception("UDPClient is not connected!");
+
+	if(timeout.count() >= 0 && !pending(timeout))
+		return -1;
+
+	long const length(long(recv(_socket, (char *)bytes, max, 0)));
+
+	if(length == -1)
 		throw Exception(lastError("recv"));
+
+	return length;
+}
+
+/*
+ * Try forcing the size past the rmem_max limit first (CAP_NET_ADMIN), then
+ * read back what the kernel settled on (Linux reports twice the requested
+ * size, bookkeeping overhead included)
+ */
+size_t UDPClient::setReceiveBuffer(size_t const bytes)
+{
+	int const size(int(min(bytes, size_t(INT_MAX / 2))));
+	int actual(0);
+	socklen_t length(sizeof(int));
+
+	if(_socket == -1)
+		throw Exception("UDPClient is not connected!");
+
+#if defined(__gnu_linux__)
+	if(setsockopt(_socket, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+			sizeof(int)) != 0)
+#endif
+		setsockopt(_socket, SOL_SOCKET, SO_RCVBUF, (char *)(&size),
+				sizeof(int));
+
+	if(getsockopt(_socket, SOL_SOCKET, SO_RCVBUF, (char *)(&actual),
+			&length) != 0)
+		throw Exception(lastError("getsockopt"));
+
+	return size_t(actual);
+}
+
+/*
+ * CLOCK_MONOTONIC on Linux, the steady clock elsewhere
+ */
+uint64_t UDPClient::now()
+{
+#if defined(__gnu_linux__)
+	timespec date;
+
+	clock_gettime(CLOCK_MONOTONIC, &date);
+
+	return uint64_t(date.tv_sec) * 1000000000 + uint64_t(date.tv_nsec);
+#else
+	return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now().time_since_epoch())
+			.count());
+#endif
+}
+
+/*
+ * Sleep until PACING_SPIN before the date (the scheduler waking threads up
+ * late), then spin, yielding to whatever else is runnable on the CPU
+ */
+uint64_t UDPClient::waitUntil(uint64_t const date)
+{
+	uint64_t current(now());
+
+	if(current + PACING_SPIN < date)
+	{
+		this_thread::sleep_for(chrono::nanoseconds(date - current
+				- PACING_SPIN));
+		current = now();
+	}
+
+	while(current < date)
+	{
+		this_thread::yield();
+		current = now();
+	}
+
+	return current;
+}
+
+/*
+ * Attach the departure date to the datagram (SCM_TXTIME)
+ */
+void UDPClient::sendAt(uint8_t const * bytes, size_t const length,
+		uint64_t const date)
+{
+#if defined(__gnu_linux__)
+	uint64_t control[(CMSG_SPACE(sizeof(uint64_t)) + sizeof(uint64_t) - 1)
+		/ sizeof(uint64_t)];
+	iovec vector;
+	msghdr header;
+
+	memset(&header, 0, sizeof(msghdr));
+	memset(control, 0, sizeof(control));
+
+	vector.iov_base = (void *)(bytes);
+	vector.iov_len = length;
+	header.msg_iov = &vector;
+	header.msg_iovlen = 1;
+	header.msg_control = control;
+	header.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+
+	cmsghdr * const message(CMSG_FIRSTHDR(&header));
+
+	message->cmsg_level = SOL_SOCKET;
+	message->cmsg_type = SCM_TXTIME;
+	message->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+	memcpy(CMSG_DATA(message), &date, sizeof(uint64_t));
+
+	if(sendmsg(_socket, &header, 0) == -1)
+		throw Exception(lastError("sendmsg"));
+#else
+	(void)(date);
+	sendBytes(bytes, length);
+#endif
+}
+
+/*
+ * Set the departure interval & reset the statistics, enabling SO_TXTIME on the
+ * socket if asked to
+ */
+bool UDPClient::setPacing(double const rate, bool const txtime)
+{
+	_interval = rate > 0. ? max(uint64_t(1e9 / rate), uint64_t(1)) : 0;
+	_nextDeparture = 0;
+	_txtime = false;
+	_departures = 0;
+	_firstDeparture = 0;
+	_lastDeparture = 0;
+	_deviation = 0.;
+	_maxDeviation = 0.;
+
+	if(_interval == 0 || !txtime)
+		return false;
+
+	if(_socket == -1)
+		throw Exception("UDPClient is not connected!");
+
+#if defined(__gnu_linux__)
+	sock_txtime config;
+
+	config.clockid = CLOCK_MONOTONIC;
+	config.flags = 0;
+
+	_txtime = setsockopt(_socket, SOL_SOCKET, SO_TXTIME, &config,
+			sizeof(sock_txtime)) == 0;
+#endif
+
+	return _txtime;
+}
+
+/*
+ * Send at the next departure date (a sender more than an interval late
+ * starting over from now), either waiting for it or handing it to the kernel
+ * along with the datagram. Only the departures the client waited for are
+ * measured: kernel-timed ones leave whenever the qdisc lets them.
+ */
+void UDPClient::sendPaced(uint8_t const * bytes, size_t const length)
+{
+	if(_socket == -1)
+		throw Exception("UDPClient is not connected!");
+
+	if(_interval == 0)
+	{
+		sendBytes(bytes, length);
+		return;
+	}
+
+	uint64_t date(now());
+
+	if(date > _nextDeparture + _interval)
+		_nextDeparture = date;
+
+	if(_txtime)
+	{
+		if(_nextDeparture > date + PACING_LEAD)
+			waitUntil(_nextDeparture - PACING_LEAD);
+
+		sendAt(bytes, length, _nextDeparture);
+		_nextDeparture += _interval;
+		++_departures;
+		return;
+	}
+
+	date = waitUntil(_nextDeparture);
+	sendBytes(bytes, length);
+
+	if(_departures == 0)
+		_firstDeparture = date;
+	else
+	{
+		double const deviation(fabs(double(date - _lastDeparture)
+				- double(_interval)));
+
+		_deviation += deviation;
+		_maxDeviation = max(_maxDeviation, deviation);
+	}
+
+	_lastDeparture = date;
+	_nextDeparture += _interval;
+	++_departures;
+}
+
+/*
+ * Rate & jitter from the departures recorded so far (none being recorded for
+ * kernel-timed ones)
+ */
+PacingStatistics UDPClient::pacingStatistics() const
+{
+	PacingStatistics stats;
+
+	stats.datagrams = _departures;
+	stats.targetRate = _interval > 0 ? 1e9 / double(_interval) : 0.;
+	stats.achievedRate = _departures > 1
+		&& _lastDeparture > _firstDeparture ? 1e9 * double(_departures
+		- 1) / double(_lastDeparture - _firstDeparture) : 0.;
+	stats.jitter = _departures > 1 ? _deviation / double(_departures - 1)
+		: 0.;
+	stats.maxJitter = _maxDeviation;
+	stats.txtime = _txtime;
+
+	return stats;
 }
 
 }
@@ -0,0 +1,283 @@
+#include "../include/Mach/UDPSendBatch.hpp"
+#include <algorithm>
+
+#if defined(__gnu_linux__)
+#include <netinet/udp.h>
+#include <errno.h>
+
+/* Control message space of a train (64-bit words) */
+#define SEGMENT_CONTROL_WORDS \
+	((CMSG_SPACE(sizeof(uint16_t)) + sizeof(uint64_t) - 1) \
+	/ sizeof(uint64_t))
+#endif
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Construct a batch sending through the given socket
+ * capacity and maxDelay are the automatic flush thresholds
+ */
+UDPSendBatch::UDPSendBatch(int const socket, size_t const capacity,
+		chrono::microseconds const maxDelay, size_t const maxResults)
+	:
+	_socket(socket),
+	_capacity(max(capacity, size_t(1))),
+	_maxDelay(maxDelay),
+	_nextId(0),
+	_maxResults(maxResults),
+	_droppedResults(0)
+{
+#if defined(__gnu_linux__)
+	_headers.reserve(_capacity);
+	_controls.reserve(_capacity * SEGMENT_CONTROL_WORDS);
+#endif
+	_vectors.reserve(_capacity);
+	_destinations.reserve(_capacity);
+	_segments.reserve(_capacity);
+}
+
+/*
+ * Flush whatever is left before leaving
+ */
+UDPSendBatch::~UDPSendBatch()
+{
+	flush();
+}
+
+/*
+ * Queue a datagram, flushing the batch if one of the thresholds is reached
+ */
+unsigned long UDPSendBatch::queue(uint8_t const * data, size_t const length,
+		sockaddr const * destination)
+{
+	return queueSegmented(data, length, 0, destination);
+}
+
+/*
+ * Queue a train of datagrams (a plain datagram if segment is 0 or covers the
+ * whole buffer), flushing the batch if one of the thresholds is reached
+ */
+unsigned long UDPSendBatch::queueSegmented(uint8_t const * data,
+		size_t const length, uint16_t const segment,
+		sockaddr const * destination)
+{
+	sockaddr_storage address;
+
+	memset(&address, 0, sizeof(address));
+
+	if(destination)
+		memcpy(&address, destination,
+			destination->sa_family == AF_INET6 ?
+			sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+
+	if(pending() == 0)
+		_oldest = chrono::steady_clock::now();
+
+#if defined(__gnu_linux__)
+	iovec vector;
+
+	vector.iov_base = (void *)(data);
+	vector.iov_len = length;
+	_vectors.push_back(vector);
+	_headers.push_back(mmsghdr());
+	_controls.resize(_controls.size() + SEGMENT_CONTROL_WORDS);
+#else
+	_vectors.push_back(make_pair(data, length));
+#endif
+
+	_destinations.push_back(address);
+	_addressed.push_back(destination != nullptr);
+	_segments.push_back(segment < length ? segment : 0);
+
+	unsigned long const id(_nextId++);
+
+	if(pending() >= _capacity)
+		flush();
+	else
+		poll();
+
+	return id;
+}
+
+/*
+ * Flush the batch if its oldest datagram has waited long enough
+ */
+void UDPSendBatch::poll()
+{
+	if(pending() > 0
+		&& chrono::steady_clock::now() - _oldest >= _maxDelay)
+		flush();
+}
+
+/*
+ * Send every queued datagram
+ */
+size_t UDPSendBatch::flush()
+{
+	size_t const count(pending());
+	size_t sent(0), first(0);
+
+	if(count == 0)
+		return 0;
+
+#if defined(__gnu_linux__)
+	/* Vectors are stable now, headers can point into them */
+	for(size_t i = 0 ; i < count ; ++i)
+	{
+		msghdr & header(_headers[i].msg_hdr);
+
+		memset(&_headers[i], 0, sizeof(mmsghdr));
+		header.msg_iov = &_vectors[i];
+		header.msg_iovlen = 1;
+
+		if(_addressed[i])
+		{
+			header.msg_name = &_destinations[i];
+			header.msg_namelen =
+				_destinations[i].ss_family == AF_INET6 ?
+				sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+		}
+
+		/* Trains carry their segment size */
+		if(_segments[i] > 0)
+		{
+			cmsghdr * control(nullptr);
+
+			header.msg_control =
+				&_controls[i * SEGMENT_CONTROL_WORDS];
+			header.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+			control = CMSG_FIRSTHDR(&header);
+			control->cmsg_level = SOL_UDP;
+			control->cmsg_type = UDP_SEGMENT;
+			control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			memcpy(CMSG_DATA(control), &_segments[i],
+					sizeof(uint16_t));
+		}
+	}
+
+	while(first < count)
+	{
+		int const done(sendmmsg(_socket, &_headers[first],
+				count - first, 0));
+
+		if(done == -1)
+		{
+			/* Interrupted before sending anything: try again */
+			if(errno == EINTR)
+				continue;
+
+			/* The first datagram failed: report and skip it */
+			record(first, errno, 0);
+			++first;
+		}
+		else
+		{
+			for(int i = 0 ; i < done ; ++i)
+				record(first + i, 0, _headers[first + i].msg_len);
+
+			sent += done;
+			first += done;
+		}
+	}
+
+	_headers.clear();
+	_controls.clear();
+#else
+	/* Trains are sent one datagram at a time */
+	for(first = 0 ; first < count ; ++first)
+	{
+		size_t const length(_vectors[first].second);
+		size_t const step(_segments[first] > 0 ?
+				_segments[first] : max(length, size_t(1)));
+		size_t offset(0), bytes(0);
+		int error(0);
+
+		do
+		{
+			int const done(sendto(_socket,
+				(char *)(_vectors[first].first + offset),
+				min(step, length - offset), 0,
+				_addressed[first] ?
+				(sockaddr *)(&_destinations[first]) : nullptr,
+				_addressed[first] ?
+				sizeof(sockaddr_storage) : 0));
+
+			if(done == -1)
+			{
+				error = WSAGetLastError();
+				break;
+			}
+
+			bytes += done;
+			offset += step;
+		} while(offset < length);
+
+		record(first, error, bytes);
+
+		if(error == 0)
+			++sent;
+	}
+#endif
+
+	_vectors.clear();
+	_destinations.clear();
+	_addressed.clear();
+	_segments.clear();
+
+	return sent;
+}
+
+/*
+ * Number of datagrams waiting for the next flush
+ */
+size_t UDPSendBatch::pending() const
+{
+	return _destinations.size();
+}
+
+/*
+ * Hand the collected results over to the caller
+ */
+void UDPSendBatch::results(vector<SendResult> & output)
+{
+	output.clear();
+	output.swap(_results);
+}
+
+/*
+ * Results lost for want of room
+ */
+unsigned long UDPSendBatch::droppedResults() const
+{
+	return _droppedResults;
+}
+
+/*
+ * Store the result of the i-th queued datagram, unless the results haven't
+ * been collected for too long
+ */
+void UDPSendBatch::record(size_t const index, int const error,
+		size_t const bytes)
+{
+	SendResult result;
+
+	if(_results.size() >= _maxResults)
+	{
+		++_droppedResults;
+		return;
+	}
+
+	result.id = _nextId - pending() + index;
+	result.error = error;
+	result.bytes = bytes;
+
+	_results.push_back(result);
+}
+
+}
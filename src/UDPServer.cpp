@@ -1,7 +1,43 @@
 #include "../include/Mach/UDPServer.hpp"
 #include "../include/Mach/Exception.hpp"
 #include <iostream>
+#include <algorithm>
+#include <climits>
 
+#if defined(__gnu_linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <sched.h>
+#include <linux/filter.h>
+#endif
+
+/* Maximum number of readiness events handled per epoll_wait() call */
+#define EPOLL_EVENTS_MAX 64
+
+/* Maximum number of receive calls per readiness event, so that a busy socket
+ * can't starve the others served by the same event loop */
+#define DRAIN_MAX 16
+
+/* io_uring submission queue size & provided buffers per event loop */
+#define URING_ENTRIES 256
+#define URING_BUFFERS 128
+
+/* Control message space per received datagram */
+#define CONTROL_SIZE 64
+
+#if defined(__gnu_linux__)
+static_assert(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage)
+		+ CONTROL_SIZE <= PACKET_HEADROOM,
+		"io_uring receive headers must fit in the packet headroom");
+#endif
+
+/* Empty rounds a worker spins through before going to sleep */
+#define WORKER_SPINS 64
+
+/* Senders whose buckets are fetched ahead of charging them */
+#define ADMIT_AHEAD 64
 
 namespace Mach
 {
@@ -9,6 +45,10 @@ namespace Mach
 using namespace std;
 
 
+/* Timer wheel of the calling receiving thread (see UDPServer::timerWheel()) */
+static thread_local TimerWheel * threadWheel(nullptr);
+
+
 /*
  * Construct a base UDPServer
  * The logPath and priority are used to setup the internal Logger
@@ -16,9 +56,31 @@ using namespace std;
  */
 UDPServer::UDPServer(unsigned short const port,
 			string const logPath,
-			Priority const prio)
+			Priority const prio,
+			unsigned const listeners,
+			ReceiveBackend const backend)
 	:
 	_listening(false),
+	_batchSize(1),
+	_plainReceive(false),
+#if defined(__gnu_linux__)
+	_listenersPerAddress(max(listeners, 1u)),
+	_backend(backend),
+#else
+	_listenersPerAddress(1),
+	_backend(BACKEND_BLOCKING),
+#endif
+	_eventLoops(1),
+	_wakeup(-1),
+	_workerCount(0),
+	_queueCapacity(1024),
+	_overflow(OVERFLOW_DROP),
+	_working(false),
+	_poolSize(1024),
+	_gro(false),
+	_timestamps(false),
+	_steering(false),
+	_timerTick(0),
 	_log(logPath, prio)
 {
 	int getaddrinfoError(0);
@@ -30,6 +92,12 @@ UDPServer::UDPServer(unsigned short const port,
 	hints.ai_flags = AI_PASSIVE;	/* Bind to every available address */
 	hints.ai_socktype = SOCK_DGRAM; /* Use datagram sockets (UDP) */
 
+	if(backend != _backend)
+		_log.warn
+		<< "Event loop backends are only available on Linux, "
+		<< "falling back to blocking listeners."
+		<< endl;
+
 	/* Get available adresses list */
 	getaddrinfoError = getaddrinfo(nullptr, to_string(port).c_str(),
 			&hints, &results);
@@ -50,25 +118,34 @@ UDPServer::UDPServer(unsigned short const port,
 		currentAddress != nullptr ;
 		currentAddress = currentAddress->ai_next)
 	{
-		try
-		{
-			bindTo(currentAddress);
-		}
-		catch(Exception * e)
+		/* One socket per listener, all sharing the same address */
+		for(unsigned rank = 0 ; rank < _listenersPerAddress ; ++rank)
 		{
-			_log.error
-			<< "Failed to bind to "
-			<< extractIP(currentAddress) << ":"
-			<< extractPort(currentAddress) << "!"
-			<< endl;
-			_log.error
-			<< "Error was: " << e->message() << "."
-			<< endl;
+			try
+			{
+				bindTo(currentAddress, rank);
+			}
+			catch(Exception * e)
+			{
+				_log.error
+				<< "Failed to bind to "
+				<< extractIP(currentAddress) << ":"
+				<< extractPort(currentAddress) << "!"
+				<< endl;
+				_log.error
+				<< "Error was: " << e->message() << "."
+				<< endl;
+			}
 		}
 	}
 
 	/* Clean da carpet */
 	freeaddrinfo(results);
+
+	/* One handler slot per potential receiving thread */
+	for(size_t i = 0 ; i < max(size_t(1), _sockets.size()) ; ++i)
+		_handlerSlots.push_back(unique_ptr<HandlerSlot>(
+					new HandlerSlot));
 }
 
 /*
@@ -83,7 +160,7 @@ UDPServer::~UDPServer()
 /*
  * Bind to an individual addrinfo
  */
-void UDPServer::bindTo(addrinfo const * addr)
+void UDPServer::bindTo(addrinfo const * addr, unsigned const rank)
 {
 #if defined(_WIN32) || defined(_WIN64)
 	char yes(1);
@@ -91,16 +168,14 @@ void UDPServer::bindTo(addrinfo const * addr)
 	int yes(1);
 #endif
 
-	/* Will host a copy of the successfully bound socket's addrinfo */
-	addrinfo aiCopy = *addr;
+	/* Will host the successfully bound socket */
+	unique_ptr<Listener> bound(new Listener);
 
 	/* Various temporary variables */
 	int sock(0), sockoptError(0), bindError(0);
 	unsigned short port;
 	string ipstr;
 
-	aiCopy.ai_next = nullptr;
-
 	/* Extract human-readable IP address and port */
 	ipstr = extractIP(addr);
 	port = extractPort(addr);
@@ -120,16 +195,70 @@ void UDPServer::bindTo(addrinfo const * addr)
 	if(sockoptError)
 		throw Exception(lastError("setsockopt"));
 
+#if defined(__gnu_linux__)
+	/* Let the kernel spread flows among the sockets of the group */
+	if(_listenersPerAddress > 1)
+	{
+		sockoptError = setsockopt(sock, SOL_SOCKET, SO_REUSEPORT,
+				&yes, sizeof(int));
+		if(sockoptError)
+		{
+			closeSocket(sock);
+			throw Exception(lastError("setsockopt"));
+		}
+	}
+
+	/* Report kernel drops along with received datagrams (not fatal) */
+	if(setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &yes, sizeof(int)))
+		_log.warn
+		<< "Failed to enable SO_RXQ_OVFL ("
+		<< lastError("setsockopt") << "), kernel drops won't be "
+		<< "counted."
+		<< endl;
+
+	/* Event loops never block on their sockets */
+	if(_backend != BACKEND_BLOCKING)
+	{
+		int const flags(fcntl(sock, F_GETFL, 0));
+
+		if(flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
+		{
+			closeSocket(sock);
+			throw Exception(lastError("fcntl"));
+		}
+	}
+#endif
+
 	/* Let's bind! */
 	bindError = ::bind(sock, addr->ai_addr, addr->ai_addrlen);
 	if(bindError)
+	{
+		closeSocket(sock);
 		throw Exception(lastError("bind"));
+	}
 
 	/* Register the socket */
-	_sockets.push_back(make_pair(sock, aiCopy));
+	bound->_socket = sock;
+	bound->_family = addr->ai_family;
+	bound->_rank = rank;
+	bound->_index = unsigned(_sockets.size());
+	bound->_fill.reset(new atomic<unsigned long>[BATCH_SIZE_MAX + 1]);
+
+	for(unsigned i = 0 ; i <= BATCH_SIZE_MAX ; ++i)
+		bound->_fill[i].store(0, memory_order_relaxed);
+
+	bound->_packets.store(0, memory_order_relaxed);
+	bound->_bytes.store(0, memory_order_relaxed);
+	bound->_exhausted.store(0, memory_order_relaxed);
+	bound->_segments.store(0, memory_order_relaxed);
+	bound->_kernelDrops.store(0, memory_order_relaxed);
+	bound->_sendFailures.store(0, memory_order_relaxed);
+
+	_sockets.push_back(move(bound));
 
 	_log.info
 	<< "Bound to " << ipstr << ":" << port
+	<< " (listener " << rank << ")"
 	<< endl;
 }
 
@@ -144,10 +273,58 @@ void UDPServer::startListening()
 {
 	if(!_listening)
 	{
+		/* Workers first, so that their queues are ready */
+		startWorkers();
+
+#if defined(__gnu_linux__)
+		if(_gro)
+			_gro = enableOption(SOL_UDP, UDP_GRO, "UDP GRO");
+
+		if(_timestamps)
+			_timestamps = enableOption(SOL_SOCKET, SO_TIMESTAMPNS,
+					"kernel timestamps");
+#endif
+
+#if defined(__gnu_linux__)
+		/* Fall back to epoll if io_uring isn't usable */
+		if(_backend == BACKEND_URING && !URing::supported())
+		{
+			_log.warn
+			<< "io_uring multishot receive isn't supported, "
+			<< "falling back to epoll."
+			<< endl;
+
+			_backend = BACKEND_EPOLL;
+		}
+
+		if(_backend == BACKEND_URING)
+		{
+			try
+			{
+				startRingLoops();
+			}
+			catch(Exception const & e)
+			{
+				_log.warn
+				<< "Failed to setup io_uring (" << e.message()
+				<< "), falling back to epoll."
+				<< endl;
+
+				_backend = BACKEND_EPOLL;
+			}
+		}
+
+		placeSockets();
+		steerSockets();
+
+		if(_backend == BACKEND_EPOLL)
+			startEventLoops();
+		else if(_backend == BACKEND_BLOCKING)
+#endif
 		/* Create & start the threads */
-		for(pair<int, addrinfo> socket : _sockets)
+		for(unique_ptr<Listener> & socket : _sockets)
 			_threads.push_back(thread(&UDPServer::listener,
-						this, socket));
+						this, socket.get()));
 
 		_listening = true;
 	}
@@ -160,22 +337,28 @@ void UDPServer::startListening()
 
 /*
  * Stop networking threads by closing their respective listening sockets
+ * (event loops are woken up and joined first)
  */
 void UDPServer::stopListening()
 {
 	if(_listening)
 	{
+#if defined(__gnu_linux__)
+		if(_backend != BACKEND_BLOCKING)
+			stopEventLoops();
+#endif
+
 		_log.info
 		<< _sockets.size() << " sockets to close..."
 		<< endl;
 
-		for (pair<int, addrinfo>& socket : _sockets)
+		for (unique_ptr<Listener> & socket : _sockets)
 		{
 			_log.info
-			<< "Closing socket " << socket.first
+			<< "Closing socket " << socket->_socket
 			<< endl;
 
-			closeSocket(socket.first);
+			closeSocket(socket->_socket);
 		}
 
 		for(thread& t : _threads)
@@ -183,6 +366,9 @@ void UDPServer::stopListening()
 
 		_threads.clear();
 
+		/* Nothing can be queued anymore */
+		stopWorkers();
+
 		_listening = false;
 	}
 	else
@@ -193,77 +379,2037 @@ void UDPServer::stopListening()
 }
 
 /*
- * Listen on the given socket until an error is encountered
+ * Receive buffers & their descriptors, kept by each receiving thread
+ */
+struct UDPServer::ReceiveBuffers
+{
+	/* Maximum number of datagrams per receive call */
+	unsigned const _size;
+
+	/* Receiving thread index & worker round-robin position */
+	unsigned const _producer;
+	unsigned _cursor;
+
+	/* The thread's packet pool & the packets armed for the next receive
+	 * call, along with their descriptors */
+	PacketPool * const _pool;
+	vector<PacketRef> _packets;
+#if defined(__gnu_linux__)
+	vector<mmsghdr> _headers;
+	vector<iovec> _vectors;
+	vector<uint64_t> _controls;
+	vector<size_t> _segmentSizes;
+#endif
+
+	/* Datagrams of the batch & the slices they refer to (GRO segments),
+	 * a packet holding several datagrams */
+	vector<Datagram> _datagrams;
+	vector<PacketRef> _slices;
+
+	/* Landing zone of the datagrams dropped while the pool is exhausted */
+	unique_ptr<uint8_t[]> _scratch;
+	sockaddr_storage _scratchSender;
+
+	/* Create the pool (from the receiving thread, so that its slabs are
+	 * allocated close to it, prefault buffers being allocated & touched
+	 * right away) & link the descriptors */
+	ReceiveBuffers(unsigned const size, unsigned const producer,
+			size_t const poolSize, size_t const prefault)
+		:
+		_size(size),
+		_producer(producer),
+		_cursor(0),
+		_pool(PacketPool::create(poolSize)),
+		_packets(size),
+#if defined(__gnu_linux__)
+		_headers(size),
+		_vectors(size),
+		_controls(size * CONTROL_SIZE / sizeof(uint64_t)),
+		_segmentSizes(size),
+#endif
+		_datagrams(size),
+		_slices(size),
+		_scratch(new uint8_t[PACKET_SIZE])
+	{
+#if defined(__gnu_linux__)
+		for(unsigned i = 0 ; i < size ; ++i)
+		{
+			memset(&_headers[i], 0, sizeof(mmsghdr));
+			_headers[i].msg_hdr.msg_iov = &_vectors[i];
+			_headers[i].msg_hdr.msg_iovlen = 1;
+			_headers[i].msg_hdr.msg_control = &_controls[i
+				* CONTROL_SIZE / sizeof(uint64_t)];
+		}
+#endif
+
+		_pool->reserve(prefault);
+	}
+
+	/* Release the packets & retire the pool (which lives on until the
+	 * packets kept by handlers are back) */
+	~ReceiveBuffers()
+	{
+		_packets.clear();
+		_pool->retire();
+	}
+
+	/* Give a pooled buffer to every slot lacking one, returns the number
+	 * of consecutive armed slots from the first one */
+	unsigned arm()
+	{
+		for(unsigned i = 0 ; i < _size ; ++i)
+		{
+			if(_packets[i])
+				continue;
+
+			_packets[i] = _pool->allocate();
+			if(!_packets[i])
+				return i;
+
+#if defined(__gnu_linux__)
+			_vectors[i].iov_base = _packets[i]->_bytes;
+			_vectors[i].iov_len = PACKET_SIZE - 1;
+			_headers[i].msg_hdr.msg_name = &_packets[i]->_sender;
+#endif
+		}
+
+		return _size;
+	}
+
+	/* Number of datagrams in a payload of the given length, coalesced
+	 * from segments of the given size (0 if not coalesced) */
+	static unsigned segments(size_t const length, size_t const segment)
+	{
+		if(segment == 0 || length <= segment)
+			return 1;
+
+		return unsigned((length + segment - 1) / segment);
+	}
+
+	/* Make room for a batch of count datagrams (only while no batch is
+	 * pending, as the descriptors may move) */
+	void reserve(unsigned const count)
+	{
+		if(_datagrams.size() < count)
+		{
+			_datagrams.resize(count);
+			_slices.resize(count);
+		}
+	}
+
+	/* Describe the given packet as the n-th datagram of the batch, or as
+	 * the n-th and following ones if it was coalesced from segments of
+	 * the given size, returns the number of datagrams */
+	unsigned describe(unsigned const n, PacketRef const & packet,
+			size_t const segment)
+	{
+		size_t const length(packet.length());
+		unsigned const count(segments(length, segment));
+
+		if(count == 1)
+		{
+			_datagrams[n].data = packet.data();
+			_datagrams[n].length = length;
+			_datagrams[n].sender = &packet->_sender;
+			_datagrams[n].packet = &packet;
+
+			return 1;
+		}
+
+		for(unsigned k = 0 ; k < count ; ++k)
+		{
+			PacketRef & slice(_slices[n + k]);
+
+			slice = packet.slice(k * segment,
+					min(segment, length - k * segment));
+
+			_datagrams[n + k].data = slice.data();
+			_datagrams[n + k].length = slice.length();
+			_datagrams[n + k].sender = &packet->_sender;
+			_datagrams[n + k].packet = &slice;
+		}
+
+		return count;
+	}
+
+	/* Drop the slices of the last batch of count datagrams, then keep
+	 * the first packets buffers for the next receive call, unless a
+	 * handler kept them */
+	void release(unsigned const packets, unsigned const count)
+	{
+		for(unsigned k = 0 ; k < count ; ++k)
+			_slices[k].reset();
+
+		for(unsigned i = 0 ; i < packets ; ++i)
+			if(_packets[i] && !_packets[i].unique())
+				_packets[i].reset();
+	}
+};
+
+/*
+ * CPUs are handed out round-robin
  */
-void UDPServer::listener(pair<int, addrinfo> const socket)
+int UDPServer::cpuOf(unsigned const thread) const
 {
-	uint8_t bytes[PACKET_SIZE];
+	if(_placement.cpus.empty())
+		return -1;
 
-	/* Remote end address and port (machine readable form) */
-	sockaddr_storage remoteSockaddr;
-	socklen_t addrLen(sizeof(remoteSockaddr));
+	return int(_placement.cpus[thread % _placement.cpus.size()]);
+}
+
+/*
+ * Restrict the calling thread to its CPU
+ */
+void UDPServer::place(unsigned const thread)
+{
+#if defined(__gnu_linux__)
+	int const cpu(cpuOf(thread));
+	cpu_set_t set;
+
+	if(cpu == -1)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) == -1)
+		_log.warn
+		<< "Failed to pin receiving thread " << thread << " to CPU "
+		<< cpu << " (" << lastError("sched_setaffinity") << ")."
+		<< endl;
+#else
+	(void)(thread);
+#endif
+}
+
+/*
+ * Set SO_INCOMING_CPU (to the CPU of the thread serving the socket) and
+ * SO_BUSY_POLL on every socket, failures only being logged
+ */
+void UDPServer::placeSockets()
+{
+#if defined(__gnu_linux__)
+	unsigned const loops(max(1u, min(_eventLoops,
+			unsigned(_sockets.size()))));
+	int const busyPoll(int(_placement.busyPoll));
+
+	for(unique_ptr<Listener> const & socket : _sockets)
+	{
+		/* Same spread as startEventLoops() & startRingLoops() */
+		int const cpu(cpuOf(_backend == BACKEND_BLOCKING ?
+				socket->_index : socket->_index % loops));
+
+		if(_placement.incomingCpu && cpu != -1 && setsockopt(
+				socket->_socket, SOL_SOCKET, SO_INCOMING_CPU,
+				&cpu, sizeof(int)))
+			_log.warn
+			<< "Failed to set SO_INCOMING_CPU on socket "
+			<< socket->_socket << " ("
+			<< lastError("setsockopt") << ")."
+			<< endl;
+
+		if(busyPoll > 0 && setsockopt(socket->_socket, SOL_SOCKET,
+				SO_BUSY_POLL, &busyPoll, sizeof(int)))
+			_log.warn
+			<< "Failed to set SO_BUSY_POLL on socket "
+			<< socket->_socket << " ("
+			<< lastError("setsockopt") << ")."
+			<< endl;
+	}
+#endif
+}
+
+#if defined(__gnu_linux__)
+/*
+ * Append the instructions mixing the 32-bit word loaded by the given
+ * instruction into the hash kept in M[0] (same steps as PeerKey::hash())
+ */
+static void hashWord(vector<sock_filter> & program, uint16_t const load,
+		uint32_t const offset)
+{
+	program.push_back(BPF_STMT(load, offset));
+	program.push_back(BPF_STMT(BPF_LDX | BPF_MEM, 0));
+	program.push_back(BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0));
+	program.push_back(BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, PEER_HASH_PRIME));
+	program.push_back(BPF_STMT(BPF_ST, 0));
+}
+
+/*
+ * Classic BPF program returning the index of the socket a datagram goes to
+ * among the given number of sockets of a SO_REUSEPORT group: the flow hash of
+ * its source address & port (read from the network header, as the program
+ * runs with the payload at offset 0), modulo the group size
+ * IPv6 extension headers aren't walked: datagrams carrying some still go to
+ * a single socket, just not the one flowHash(...) points at.
+ */
+static vector<sock_filter> steeringProgram(int const family,
+		unsigned const sockets)
+{
+	vector<sock_filter> program;
+
+	program.push_back(BPF_STMT(BPF_LD | BPF_IMM, PEER_HASH_SEED));
+	program.push_back(BPF_STMT(BPF_ST, 0));
+
+	/* IPv6 sockets also get IPv4 datagrams (mapped addresses): check
+	 * the IP version, then hash the source address & port, jumping over
+	 * the IPv4 part (11 instructions) */
+	if(family == AF_INET6)
+	{
+		program.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS,
+				uint32_t(SKF_NET_OFF)));
+		program.push_back(BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4));
+		program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, 26, 0));
+
+		for(uint32_t word = 0 ; word < 4 ; ++word)
+			hashWord(program, BPF_LD | BPF_W | BPF_ABS,
+					uint32_t(SKF_NET_OFF + 8 + 4 * word));
+
+		hashWord(program, BPF_LD | BPF_H | BPF_ABS,
+				uint32_t(SKF_NET_OFF + 40));
+		program.push_back(BPF_STMT(BPF_JMP | BPF_JA, 11));
+	}
+
+	/* IPv4: source address, then source port past the IP header */
+	hashWord(program, BPF_LD | BPF_W | BPF_ABS,
+			uint32_t(SKF_NET_OFF + 12));
+	program.push_back(BPF_STMT(BPF_LDX | BPF_B | BPF_MSH,
+			uint32_t(SKF_NET_OFF)));
+	hashWord(program, BPF_LD | BPF_H | BPF_IND, uint32_t(SKF_NET_OFF));
+
+	/* Finalize the hash & pick the socket */
+	program.push_back(BPF_STMT(BPF_LD | BPF_MEM, 0));
+	program.push_back(BPF_STMT(BPF_MISC | BPF_TAX, 0));
+	program.push_back(BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16));
+	program.push_back(BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0));
+	program.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, sockets));
+	program.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+
+	return program;
+}
+#endif
+
+/*
+ * Attach the steering program to the first socket of every SO_REUSEPORT group
+ * (the kernel numbers a group's sockets in binding order, which is their order
+ * in _sockets), failures only being logged
+ */
+void UDPServer::steerSockets()
+{
+#if defined(__gnu_linux__)
+	size_t first(0);
+
+	if(!_steering)
+		return;
+
+	/* A group ends where ranks stop increasing */
+	for(size_t i = 1 ; i <= _sockets.size() ; ++i)
+	{
+		if(i < _sockets.size()
+				&& _sockets[i]->_rank > _sockets[i - 1]->_rank)
+			continue;
+
+		if(i - first > 1)
+		{
+			vector<sock_filter> program(steeringProgram(
+					_sockets[first]->_family,
+					unsigned(i - first)));
+			sock_fprog fprog;
+
+			fprog.len = (unsigned short)(program.size());
+			fprog.filter = program.data();
+
+			if(setsockopt(_sockets[first]->_socket, SOL_SOCKET,
+					SO_ATTACH_REUSEPORT_CBPF, &fprog,
+					sizeof(sock_fprog)))
+				_log.warn
+				<< "Failed to attach the flow steering program "
+				<< "to socket " << _sockets[first]->_socket
+				<< " (" << lastError("setsockopt") << ")."
+				<< endl;
+		}
+
+		first = i;
+	}
+#endif
+}
+
+/*
+ * Hash the address & port of a peer (see SockAddr::hash())
+ */
+uint32_t UDPServer::flowHash(sockaddr_storage const & peer)
+{
+	return SockAddr(peer).hash();
+}
+
+/*
+ * Listen on the given socket until an error is encountered
+ */
+void UDPServer::listener(Listener * const socket)
+{
+	/* Remote end address length */
+	socklen_t addrLen(sizeof(sockaddr_storage));
 
 	int length(0);
 
 #if defined(__gnu_linux__)
 	/* Rename thread (Linux-only feature) */
-	switch(socket.second.ai_family)
+	switch(socket->_family)
 	{
 		/* IPv4 */
 		case AF_INET:
-			prctl(PR_SET_NAME, "IPv4listener\0",0,0,0);
+			prctl(PR_SET_NAME, ("IPv4listener"
+				+ to_string(socket->_rank)).c_str(),0,0,0);
 		break;
 
 		/* IPv6 */
 		case AF_INET6:
-			prctl(PR_SET_NAME, "IPv6listener\0",0,0,0);
+			prctl(PR_SET_NAME, ("IPv6listener"
+				+ to_string(socket->_rank)).c_str(),0,0,0);
 		break;
 
 		/* Unknown family */
 		default:
 		break;
 	}
+
+	place(socket->_index);
+
+	/* recvmmsg() also brings control messages (kernel drops, GRO
+	 * segments, timestamps) along, even for single datagrams: plain
+	 * recvfrom() calls are only made when asked for */
+	if(!_plainReceive || _gro || _timestamps)
+	{
+		batchListener(*socket);
+		return;
+	}
 #endif
 
+	/* One pooled packet at a time */
+	ReceiveBuffers buffers(1, socket->_index, _poolSize,
+			_placement.prefault);
+
 	/* Main listening loop */
 	do
 	{
+		if(buffers.arm() == 0)
+		{
+			length = dropFrom(*socket, buffers, 0);
+			continue;
+		}
+
 		/* Try receiving some bytes from the socket (UDP, blocking) */
-		length = recvfrom(socket.first,
-				(char *)(bytes), PACKET_SIZE-1,
-				0, (sockaddr *)(&remoteSockaddr),
+		addrLen = sizeof(sockaddr_storage);
+		length = recvfrom(socket->_socket,
+				(char *)(buffers._packets[0]->_bytes),
+				PACKET_SIZE-1, 0,
+				(sockaddr *)(&buffers._packets[0]->_sender),
 				&addrLen);
 
 		/* If something has been received, forward it to the internal
 		 * datagram processing method */
 		if(length > 0)
-			receiveBytes(bytes,
-				length,
-				&remoteSockaddr,
-				socket.first);
+		{
+			socket->received(1, 1, length);
+
+			buffers._packets[0]->_length = length;
+			buffers._packets[0]->_socket = socket->_socket;
+
+			buffers.describe(0, buffers._packets[0], 0);
+			dispatch(socket->_index, buffers._cursor,
+					buffers._datagrams.data(), 1,
+					socket->_socket);
+			buffers.release(1, 1);
+		}
 	} while(length != -1);
 
 	return;	/* End of thread */
 }
 
 /*
- * Send given data to remote sockaddr using given socket
+ * Receive a single datagram into the scratch buffer and drop it (the packet
+ * pool being exhausted), returns recvfrom()'s result
  */
-void UDPServer::sendBytes(uint8_t const * data, size_t length,
-		sockaddr const * remoteSockaddr,
-		int const socketFd)
+int UDPServer::dropFrom(Listener & socket, ReceiveBuffers & buffers,
+		int const flags)
 {
-	/* Trivial UDP send operation */
-	if(sendto(
-		socketFd,			/* Source socket */
-		(char *)(data),			/* Data to send */
-		length,				/* Data length */
-		0,				/* Additional flags */
-		remoteSockaddr,			/* Recipient info */
-		sizeof(sockaddr_storage))	/* Recipient info size */
-		== -1)
-		/* If an error occurs while sending... */
-		throw Exception(lastError("sendto"));
+	socklen_t addrLen(sizeof(sockaddr_storage));
+	int const length(recvfrom(socket._socket,
+			(char *)(buffers._scratch.get()), PACKET_SIZE-1, flags,
+			(sockaddr *)(&buffers._scratchSender), &addrLen));
+
+	if(length > 0)
+		socket._exhausted.fetch_add(1, memory_order_relaxed);
+
+	return length;
+}
+
+#if defined(__gnu_linux__)
+/*
+ * Listen on the given socket until an error is encountered, pulling up to
+ * _batchSize datagrams per system call into pooled buffers
+ */
+void UDPServer::batchListener(Listener & socket)
+{
+	ReceiveBuffers buffers(_batchSize, socket._index, _poolSize,
+			_placement.prefault);
+	unique_ptr<TimerWheel> const wheel(_timerTick.count() > 0
+			? new TimerWheel(_timerTick) : nullptr);
+	unsigned idle(0);
+	int count(0);
+	bool ticking(false);
+
+	threadWheel = wheel.get();
+
+	/* Main listening loop: block until at least one datagram is available
+	 * (trying a few non-blocking calls first if asked to spin), then grab
+	 * whatever else is already queued */
+	do
+	{
+		bool const spinning(idle < _placement.spins);
+
+		count = receiveFrom(socket, buffers, spinning ?
+				MSG_DONTWAIT : MSG_WAITFORONE);
+
+		if(spinning && count == -1 && (errno == EAGAIN
+				|| errno == EWOULDBLOCK))
+		{
+			++idle;
+			count = 0;
+		}
+		else
+			idle = 0;
+
+		if(!wheel)
+			continue;
+
+		/* Receive timeout (SO_RCVTIMEO, set to one tick while the
+		 * wheel holds timers) */
+		if(count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			count = 0;
+
+		runTimers(*wheel, *_handlerSlots[socket._index]);
+
+		if(wheel->empty() == ticking)
+		{
+			timeval timeout;
+			uint64_t const tick(ticking ? 0
+				: uint64_t(_timerTick.count()) / 1000 + 1);
+
+			timeout.tv_sec = time_t(tick / 1000000);
+			timeout.tv_usec = suseconds_t(tick % 1000000);
+
+			setsockopt(socket._socket, SOL_SOCKET, SO_RCVTIMEO,
+					&timeout, sizeof(timeval));
+			ticking = !ticking;
+		}
+	} while(count != -1);
+
+	threadWheel = nullptr;
+
+	return;	/* End of thread */
+}
+
+/*
+ * Store the kernel timestamp carried by a received message's control data into
+ * the packet and raise drops to the socket's kernel drop count if given,
+ * returns the GRO segment size (0 if the payload wasn't coalesced)
+ */
+static size_t readControl(msghdr & header, PacketBuffer & packet,
+		unsigned long & drops)
+{
+	size_t segment(0);
+
+	for(cmsghdr * c = CMSG_FIRSTHDR(&header) ; c != nullptr ;
+			c = CMSG_NXTHDR(&header, c))
+	{
+		if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO)
+		{
+			int size(0);
+
+			memcpy(&size, CMSG_DATA(c), sizeof(int));
+			segment = size > 0 ? size_t(size) : 0;
+		}
+		else if(c->cmsg_level == SOL_SOCKET
+			&& c->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			timespec date;
+
+			memcpy(&date, CMSG_DATA(c), sizeof(timespec));
+			packet._timestamp = uint64_t(date.tv_sec) * 1000000000
+				+ uint64_t(date.tv_nsec);
+		}
+		else if(c->cmsg_level == SOL_SOCKET
+			&& c->cmsg_type == SO_RXQ_OVFL)
+		{
+			uint32_t count(0);
+
+			memcpy(&count, CMSG_DATA(c), sizeof(uint32_t));
+			drops = max(drops, (unsigned long)(count));
+		}
+	}
+
+	return segment;
+}
+
+/*
+ * Pull up to buffers._size datagrams (or GRO super-packets) from the given
+ * socket with a single recvmmsg() call and dispatch them to the handlers
+ */
+int UDPServer::receiveFrom(Listener & socket, ReceiveBuffers & buffers,
+		int const flags)
+{
+	unsigned const armed(buffers.arm());
+	int count(0);
+	unsigned received(0), datagrams(0);
+	unsigned long drops(socket._kernelDrops.load(memory_order_relaxed));
+	size_t bytes(0);
+
+	if(armed == 0)
+		return dropFrom(socket, buffers, flags & MSG_DONTWAIT);
+
+	for(unsigned i = 0 ; i < armed ; ++i)
+	{
+		buffers._headers[i].msg_hdr.msg_namelen
+			= sizeof(sockaddr_storage);
+		buffers._headers[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+	}
+
+	count = recvmmsg(socket._socket, buffers._headers.data(),
+			armed, flags, nullptr);
+
+	/* Count the datagrams first: coalesced messages hold several */
+	for(int i = 0 ; i < count ; ++i)
+	{
+		mmsghdr & header(buffers._headers[i]);
+
+		buffers._segmentSizes[i] = readControl(header.msg_hdr,
+				*buffers._packets[i].get(), drops);
+		datagrams += ReceiveBuffers::segments(header.msg_len,
+				buffers._segmentSizes[i]);
+	}
+
+	buffers.reserve(datagrams);
+	datagrams = 0;
+
+	/* A socket being shut down yields sender-less empty messages, which
+	 * are skipped (as recvfrom()'s zero return is by listener(...)) */
+	for(int i = 0 ; i < count ; ++i)
+	{
+		PacketRef & packet(buffers._packets[i]);
+		unsigned n(0);
+
+		if(buffers._headers[i].msg_hdr.msg_namelen == 0)
+			continue;
+
+		packet->_length = buffers._headers[i].msg_len;
+		packet->_socket = socket._socket;
+
+		n = buffers.describe(datagrams, packet,
+				buffers._segmentSizes[i]);
+		if(n > 1)
+			socket._segments.fetch_add(n, memory_order_relaxed);
+
+		bytes += packet->_length;
+		datagrams += n;
+		++received;
+	}
+
+	socket._kernelDrops.store(drops, memory_order_relaxed);
+
+	if(received > 0)
+	{
+		socket.received(received, datagrams, bytes);
+
+		dispatch(buffers._producer, buffers._cursor,
+				buffers._datagrams.data(), datagrams,
+				socket._socket);
+	}
+
+	buffers.release(count > 0 ? unsigned(count) : 0, datagrams);
+
+	return count;
+}
+
+/*
+ * Set a boolean socket option on each socket, going without it if any socket
+ * refuses it (e.g. UDP_GRO on an older kernel)
+ */
+bool UDPServer::enableOption(int const level, int const name,
+		string const & label)
+{
+	int yes(1), no(0);
+
+	for(unique_ptr<Listener> const & socket : _sockets)
+	{
+		if(setsockopt(socket->_socket, level, name, &yes,
+				sizeof(int)) == 0)
+			continue;
+
+		_log.warn
+		<< "Failed to enable " << label << " ("
+		<< lastError("setsockopt") << "), going without."
+		<< endl;
+
+		for(unique_ptr<Listener> const & s : _sockets)
+			setsockopt(s->_socket, level, name, &no, sizeof(int));
+
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Create one epoll instance per event loop, spread the sockets between them
+ * (round-robin) and start the loops
+ */
+void UDPServer::startEventLoops()
+{
+	unsigned const loops(max(1u, min(_eventLoops,
+			unsigned(_sockets.size()))));
+	epoll_event event;
+
+	memset(&event, 0, sizeof(epoll_event));
+
+	/* A single eventfd, registered to every loop and never read, wakes
+	 * all of them up at once (level-triggered) */
+	_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(_wakeup == -1)
+		throw Exception(lastError("eventfd"));
+
+	for(unsigned i = 0 ; i < loops ; ++i)
+	{
+		int const epoll(epoll_create1(EPOLL_CLOEXEC));
+
+		if(epoll == -1)
+		{
+			string const error(lastError("epoll_create1"));
+			stopEventLoops();
+			throw Exception(error);
+		}
+
+		_epolls.push_back(epoll);
+
+		event.events = EPOLLIN;
+		event.data.ptr = nullptr;
+		if(epoll_ctl(epoll, EPOLL_CTL_ADD, _wakeup, &event) == -1)
+		{
+			string const error(lastError("epoll_ctl"));
+			stopEventLoops();
+			throw Exception(error);
+		}
+	}
+
+	for(size_t i = 0 ; i < _sockets.size() ; ++i)
+	{
+		event.events = EPOLLIN;
+		event.data.ptr = _sockets[i].get();
+
+		if(epoll_ctl(_epolls[i % loops], EPOLL_CTL_ADD,
+				_sockets[i]->_socket, &event) == -1)
+		{
+			string const error(lastError("epoll_ctl"));
+			stopEventLoops();
+			throw Exception(error);
+		}
+	}
+
+	_log.info
+	<< _sockets.size() << " sockets served by "
+	<< loops << " event loops"
+	<< endl;
+
+	for(unsigned i = 0 ; i < loops ; ++i)
+		_threads.push_back(thread(&UDPServer::eventLoop, this, i));
+}
+
+/*
+ * Create one io_uring instance per event loop, register its share of the
+ * sockets (same round-robin spread as epoll) and set its provided buffer ring
+ * up, then start the loops
+ */
+void UDPServer::startRingLoops()
+{
+	unsigned const loops(max(1u, min(_eventLoops,
+			unsigned(_sockets.size()))));
+
+	_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(_wakeup == -1)
+		throw Exception(lastError("eventfd"));
+
+	try
+	{
+		for(unsigned i = 0 ; i < loops ; ++i)
+		{
+			unique_ptr<URing> ring(new URing(URING_ENTRIES));
+			vector<int> files;
+
+			for(size_t s = i ; s < _sockets.size() ; s += loops)
+				files.push_back(_sockets[s]->_socket);
+
+			if(!files.empty())
+				ring->registerFiles(files.data(),
+						unsigned(files.size()));
+
+			ring->setupBuffers(URING_BUFFERS);
+
+			_rings.push_back(move(ring));
+		}
+	}
+	catch(Exception const &)
+	{
+		stopEventLoops();
+		throw;
+	}
+
+	_log.info
+	<< _sockets.size() << " sockets served by "
+	<< loops << " io_uring event loops"
+	<< endl;
+
+	for(unsigned i = 0 ; i < loops ; ++i)
+		_threads.push_back(thread(&UDPServer::ringLoop, this, i));
+}
+
+/*
+ * Signal the wakeup eventfd, join the event loops and release their epoll or
+ * io_uring instances
+ */
+void UDPServer::stopEventLoops()
+{
+	uint64_t const one(1);
+
+	if(_wakeup != -1)
+	{
+		if(write(_wakeup, &one, sizeof(uint64_t)) == -1)
+			_log.error
+			<< lastError("write")
+			<< endl;
+	}
+
+	for(thread & t : _threads)
+		t.join();
+
+	_threads.clear();
+
+	for(int epoll : _epolls)
+		close(epoll);
+
+	_epolls.clear();
+	_rings.clear();
+
+	if(_wakeup != -1)
+		close(_wakeup);
+
+	_wakeup = -1;
+}
+
+/*
+ * Wait for readiness events on the given epoll instance and drain the ready
+ * sockets, until the wakeup eventfd is signaled
+ */
+void UDPServer::eventLoop(unsigned const index)
+{
+	/* Pinned first, so that the buffers are allocated on its node */
+	place(index);
+
+	ReceiveBuffers buffers(_batchSize, index, _poolSize,
+			_placement.prefault);
+	unique_ptr<TimerWheel> const wheel(_timerTick.count() > 0
+			? new TimerWheel(_timerTick) : nullptr);
+	epoll_event events[EPOLL_EVENTS_MAX];
+	int ready(0);
+	unsigned idle(0);
+	bool running(true);
+
+	prctl(PR_SET_NAME, ("UDPloop" + to_string(index)).c_str(), 0, 0, 0);
+
+	threadWheel = wheel.get();
+
+	while(running)
+	{
+		/* Poll a few rounds before blocking if asked to spin, sleep
+		 * until the next timer at most */
+		int timeout(idle < _placement.spins ? 0 : -1);
+
+		if(wheel && timeout != 0 && !wheel->empty())
+		{
+			uint64_t const next(wheel->nextDeadline());
+			uint64_t const now(TimerWheel::clock());
+
+			timeout = next <= now ? 0 : int(min((next - now
+					+ 999999) / 1000000, uint64_t(INT_MAX)));
+		}
+
+		ready = epoll_wait(_epolls[index], events, EPOLL_EVENTS_MAX,
+				timeout);
+
+		if(ready == -1)
+		{
+			if(errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		idle = ready == 0 ? idle + 1 : 0;
+
+		for(int i = 0 ; i < ready ; ++i)
+		{
+			Listener * const socket(
+				static_cast<Listener *>(events[i].data.ptr));
+
+			/* Wakeup eventfd: finish this round then leave */
+			if(socket == nullptr)
+			{
+				running = false;
+				continue;
+			}
+
+			/* Drain the socket (bounded, remaining datagrams will
+			 * be reported again by the next epoll_wait() call) */
+			for(unsigned n = 0 ; n < DRAIN_MAX ; ++n)
+				if(receiveFrom(*socket, buffers, MSG_DONTWAIT)
+						<= 0)
+					break;
+		}
+
+		if(wheel)
+			runTimers(*wheel, *_handlerSlots[index]);
+	}
+
+	threadWheel = nullptr;
+
+	return;	/* End of thread */
+}
+
+/*
+ * Keep one multishot recvmsg armed per socket, receiving into pooled buffers,
+ * and dispatch the received datagrams by batches of up to _batchSize, until
+ * the wakeup eventfd is signaled
+ */
+void UDPServer::ringLoop(unsigned const index)
+{
+	/* Pinned first, so that the buffers are allocated on its node */
+	place(index);
+
+	URing & ring(*_rings[index]);
+	unsigned const loops(unsigned(_rings.size()));
+	unsigned const size(_batchSize);
+
+	/* The loop's packet pool & batch descriptors */
+	ReceiveBuffers buffers(size, index, _poolSize,
+			_placement.prefault);
+
+	/* Packets handed to the kernel, by buffer id, & ids waiting for a
+	 * buffer (pool exhausted) */
+	vector<PacketRef> provided(URING_BUFFERS);
+	vector<unsigned short> missing;
+
+	/* Registered sockets, by fixed file index */
+	vector<Listener *> sockets;
+	vector<bool> rearm;
+
+	/* Pending batch of count datagrams, all from batchSocket, & the
+	 * buffer ids it holds */
+	vector<unsigned short> held;
+	Listener * batchSocket(nullptr);
+	unsigned count(0);
+
+	/* Shared by the recvmsg requests (name & control lengths only) */
+	msghdr header;
+	size_t offset(0);
+
+	/* Delay between two attempts to replace missing buffers */
+	__kernel_timespec retry;
+	bool retrying(false);
+
+	/* Timer wheel, ticked by a timeout while it holds timers */
+	unique_ptr<TimerWheel> const wheel(_timerTick.count() > 0
+			? new TimerWheel(_timerTick) : nullptr);
+	__kernel_timespec tick;
+	bool ticking(false);
+
+	io_uring_cqe * cqe(nullptr);
+	bool running(true);
+
+	for(size_t s = index ; s < _sockets.size() ; s += loops)
+		sockets.push_back(_sockets[s].get());
+
+	rearm.assign(sockets.size(), false);
+
+	memset(&header, 0, sizeof(msghdr));
+	header.msg_namelen = sizeof(sockaddr_storage);
+	header.msg_controllen = CONTROL_SIZE;
+	offset = sizeof(io_uring_recvmsg_out) + header.msg_namelen
+		+ header.msg_controllen;
+
+	held.reserve(size);
+
+	retry.tv_sec = 0;
+	retry.tv_nsec = 1000000;
+
+	tick.tv_sec = _timerTick.count() / 1000000000;
+	tick.tv_nsec = _timerTick.count() % 1000000000;
+
+	threadWheel = wheel.get();
+
+	prctl(PR_SET_NAME, ("UDPring" + to_string(index)).c_str(), 0, 0, 0);
+
+	/* Hand the given packet (a new one if not unique) to the kernel */
+	auto provide = [&](unsigned short const id)
+	{
+		if(!provided[id].unique())
+			provided[id] = buffers._pool->allocate();
+
+		if(!provided[id])
+		{
+			missing.push_back(id);
+			return;
+		}
+
+		ring.provideBuffer(id, provided[id]->_bytes,
+				PACKET_HEADROOM + PACKET_SIZE);
+	};
+
+	/* Hand the pending batch over, then the buffers back to the kernel
+	 * (handlers keeping a packet get it replaced by a fresh one) */
+	auto flush = [&]()
+	{
+		if(held.empty())
+			return;
+
+		size_t bytes(0);
+
+		for(unsigned i = 0 ; i < count ; ++i)
+			bytes += buffers._datagrams[i].length;
+
+		batchSocket->received(unsigned(held.size()), count, bytes);
+
+		dispatch(index, buffers._cursor, buffers._datagrams.data(),
+				count, batchSocket->_socket);
+
+		buffers.release(0, count);
+
+		for(unsigned short const id : held)
+			provide(id);
+
+		held.clear();
+		count = 0;
+	};
+
+	for(unsigned short id = 0 ; id < URING_BUFFERS ; ++id)
+		provide(id);
+
+	/* User data: fixed file index + 1, 0 being the wakeup eventfd, ~0 the
+	 * buffer retry timeout and ~1 the timer tick */
+	for(unsigned i = 0 ; i < sockets.size() ; ++i)
+		ring.receiveMultishot(i, &header, i + 1);
+
+	ring.pollIn(_wakeup, 0);
+
+	while(running)
+	{
+		if(wheel && !ticking && !wheel->empty())
+		{
+			ring.timeout(&tick, ~uint64_t(1));
+			ticking = true;
+		}
+
+		if(ring.submit(1) == -1)
+		{
+			if(errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		while((cqe = ring.peek()) != nullptr)
+		{
+			uint64_t const data(cqe->user_data);
+			int const result(cqe->res);
+			unsigned const flags(cqe->flags);
+
+			ring.advance();
+
+			/* Wakeup eventfd: finish this round then leave */
+			if(data == 0)
+			{
+				running = false;
+				continue;
+			}
+
+			/* Retry timeout: missing buffers are tried below */
+			if(data == ~uint64_t(0))
+			{
+				retrying = false;
+				continue;
+			}
+
+			/* Timer tick: the wheel is run below */
+			if(data == ~uint64_t(1))
+			{
+				ticking = false;
+				continue;
+			}
+
+			if(flags & IORING_CQE_F_BUFFER)
+			{
+				unsigned short const id(
+					flags >> IORING_CQE_BUFFER_SHIFT);
+
+				if(result > 0)
+				{
+					Listener * const socket(
+						sockets[data - 1]);
+					PacketBuffer * const packet(
+						provided[id].get());
+					io_uring_recvmsg_out const * const out(
+						reinterpret_cast<
+						io_uring_recvmsg_out const *>(
+						packet->_bytes));
+					msghdr control;
+					size_t segment(0);
+					unsigned long drops(0);
+					unsigned n(0);
+
+					/* Truncated payloads report their
+					 * full length */
+					packet->_offset = offset;
+					packet->_length = min(
+						size_t(out->payloadlen),
+						PACKET_HEADROOM + PACKET_SIZE
+						- offset);
+					packet->_socket = socket->_socket;
+					memcpy(&packet->_sender, packet->_bytes
+						+ sizeof(io_uring_recvmsg_out),
+						min(size_t(out->namelen),
+						sizeof(sockaddr_storage)));
+
+					/* Control data follows the name */
+					memset(&control, 0, sizeof(msghdr));
+					control.msg_control = packet->_bytes
+						+ sizeof(io_uring_recvmsg_out)
+						+ header.msg_namelen;
+					control.msg_controllen =
+						out->controllen;
+					drops = socket->_kernelDrops.load(
+						memory_order_relaxed);
+					segment = readControl(control,
+							*packet, drops);
+					socket->_kernelDrops.store(drops,
+						memory_order_relaxed);
+					n = ReceiveBuffers::segments(
+						packet->_length, segment);
+
+					if(held.size() == size || (count > 0
+						&& (socket != batchSocket
+						|| count + n > buffers
+						._datagrams.size())))
+						flush();
+
+					buffers.reserve(n);
+					batchSocket = socket;
+					held.push_back(id);
+
+					count += buffers.describe(count,
+						provided[id], segment);
+					if(n > 1)
+						socket->_segments.fetch_add(n,
+							memory_order_relaxed);
+				}
+				else
+					provide(id);
+			}
+
+			/* Terminated request (e.g. buffers exhausted): re-arm
+			 * it once the batch is flushed, unless the socket
+			 * failed */
+			if(!(flags & IORING_CQE_F_MORE)
+				&& (result >= 0 || result == -ENOBUFS))
+				rearm[data - 1] = true;
+		}
+
+		flush();
+
+		if(wheel)
+			runTimers(*wheel, *_handlerSlots[index]);
+
+		/* Replace the buffers kept by handlers while the pool was
+		 * exhausted, retrying later if it still is */
+		for(size_t n = missing.size() ; n > 0 ; --n)
+		{
+			unsigned short const id(missing.front());
+
+			missing.erase(missing.begin());
+			provide(id);
+		}
+
+		if(!missing.empty() && !retrying)
+		{
+			ring.timeout(&retry, ~uint64_t(0));
+			retrying = true;
+		}
+
+		/* Re-arming without any buffer would fail right away */
+		if(missing.size() == URING_BUFFERS)
+			continue;
+
+		for(unsigned i = 0 ; i < sockets.size() ; ++i)
+		{
+			if(rearm[i])
+			{
+				ring.receiveMultishot(i, &header, i + 1);
+				rearm[i] = false;
+			}
+		}
+	}
+
+	return;	/* End of thread */
+}
+#endif
+
+/*
+ * Create one queue per receiving thread for every worker, then start them
+ */
+void UDPServer::startWorkers()
+{
+	size_t const producers(max(size_t(1), _sockets.size()));
+
+	if(_workerCount == 0)
+		return;
+
+	_working.store(true, memory_order_release);
+
+	for(unsigned i = 0 ; i < _workerCount ; ++i)
+	{
+		unique_ptr<Worker> w(new Worker);
+
+		for(size_t p = 0 ; p < producers ; ++p)
+			w->_queues.push_back(unique_ptr<WorkQueue>(
+					new WorkQueue(_queueCapacity)));
+
+		w->_handled.store(0, memory_order_relaxed);
+		w->_sleeping.store(false, memory_order_relaxed);
+
+		_workers.push_back(move(w));
+	}
+
+	for(unsigned i = 0 ; i < _workerCount ; ++i)
+		_workerThreads.push_back(thread(&UDPServer::worker, this, i));
+
+	_log.info
+	<< _workerCount << " workers started ("
+	<< producers << " queues of " << _queueCapacity << " datagrams each)"
+	<< endl;
+}
+
+/*
+ * Tell the workers to leave once their queues are empty, wake them up and
+ * join them (receiving threads must have been stopped already)
+ */
+void UDPServer::stopWorkers()
+{
+	_working.store(false, memory_order_release);
+
+	for(unique_ptr<Worker> & w : _workers)
+	{
+		lock_guard<mutex> lock(w->_mutex);
+		w->_wakeup.notify_one();
+	}
+
+	for(thread & t : _workerThreads)
+		t.join();
+
+	_workerThreads.clear();
+	_workers.clear();
+}
+
+/*
+ * Pop datagrams from every queue of the worker in turn (a bounded number per
+ * queue and round) and run their handler, sleeping when all of them stay empty
+ */
+void UDPServer::worker(unsigned const index)
+{
+	Worker & self(*_workers[index]);
+	Datagram datagram;
+	PacketRef packet;
+	unsigned idle(0);
+	bool found(false);
+
+	/* Take the packet out, freeing the slot before the handler runs */
+	auto take = [&packet](PacketRef & slot)
+	{
+		packet = move(slot);
+	};
+
+#if defined(__gnu_linux__)
+	prctl(PR_SET_NAME, ("UDPworker" + to_string(index)).c_str(), 0, 0, 0);
+#endif
+
+	while(true)
+	{
+		found = false;
+
+		for(unique_ptr<WorkQueue> & queue : self._queues)
+		{
+			for(unsigned n = 0 ; n < BATCH_SIZE_MAX ; ++n)
+			{
+				if(!queue->_ring.tryPop(take))
+					break;
+
+				datagram.data = packet.data();
+				datagram.length = packet.length();
+				datagram.sender = &packet->_sender;
+				datagram.packet = &packet;
+
+				handle(self._slot, &datagram, 1,
+						packet.socket());
+				packet.reset();
+
+				self._handled.fetch_add(1, memory_order_relaxed);
+				found = true;
+			}
+		}
+
+		if(found)
+		{
+			idle = 0;
+			continue;
+		}
+
+		/* Queues are drained & nothing can be queued anymore */
+		if(!_working.load(memory_order_acquire))
+			break;
+
+		if(++idle < WORKER_SPINS)
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		/* Announce the nap, then check the queues one last time (the
+		 * fences pair with the ones of dispatch(...)) */
+		unique_lock<mutex> lock(self._mutex);
+
+		self._sleeping.store(true, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		for(unique_ptr<WorkQueue> & queue : self._queues)
+			found = found || !queue->_ring.empty();
+
+		if(!found && _working.load(memory_order_acquire))
+			self._wakeup.wait_for(lock, chrono::milliseconds(10));
+
+		self._sleeping.store(false, memory_order_relaxed);
+		idle = 0;
+	}
+
+	return;	/* End of thread */
+}
+
+/*
+ * Run the batch handler & count the time it took, recording how long ago the
+ * kernel received each datagram & the per-datagram handler duration if
+ * timestamps are enabled
+ */
+void UDPServer::handle(HandlerSlot & slot, Datagram const * datagrams,
+		unsigned const count, int const socketFd)
+{
+	chrono::steady_clock::time_point const start(
+			chrono::steady_clock::now());
+	uint64_t elapsed(0);
+
+	if(_timestamps)
+	{
+		uint64_t const now(chrono::duration_cast<chrono::nanoseconds>(
+			chrono::system_clock::now().time_since_epoch())
+			.count());
+
+		for(unsigned i = 0 ; i < count ; ++i)
+		{
+			uint64_t const arrival(datagrams[i].packet != nullptr ?
+					datagrams[i].packet->timestamp() : 0);
+
+			if(arrival > 0)
+				slot._queueing.record(now > arrival ?
+						now - arrival : 0);
+		}
+	}
+
+	receiveBatch(datagrams, count, socketFd);
+
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now() - start).count();
+
+	slot._calls.fetch_add(1, memory_order_relaxed);
+	slot._nanoseconds.fetch_add(elapsed, memory_order_relaxed);
+
+	if(_timestamps)
+		slot._handling.record(elapsed / count, count);
+}
+
+/*
+ * Charge every datagram to its sender's buckets (reading the clock once for
+ * the whole batch, and fetching ADMIT_AHEAD senders' buckets before charging
+ * the first of them, so that their cache misses overlap) and keep the admitted
+ * ones, in order
+ */
+unsigned UDPServer::admit(HandlerSlot & slot, Datagram * datagrams,
+		unsigned const count)
+{
+	uint64_t const date(RateLimiter::now());
+	SockAddr senders[ADMIT_AHEAD];
+	unsigned admitted(0);
+
+	for(unsigned i = 0 ; i < count ; ++i)
+	{
+		if(i % ADMIT_AHEAD == 0)
+			for(unsigned j = i ; j < min(count, i + ADMIT_AHEAD) ; ++j)
+			{
+				senders[j - i] = SockAddr(*datagrams[j].sender);
+				_limiter->prefetch(senders[j - i]);
+			}
+
+		switch(_limiter->admit(senders[i % ADMIT_AHEAD],
+				datagrams[i].length, date))
+		{
+			case RATE_PACKETS:
+				slot._packetRateDrops.fetch_add(1,
+						memory_order_relaxed);
+			continue;
+
+			case RATE_BYTES:
+				slot._byteRateDrops.fetch_add(1,
+						memory_order_relaxed);
+			continue;
+
+			case RATE_UNTRACKED:
+				slot._untracked.fetch_add(1,
+						memory_order_relaxed);
+			break;
+
+			case RATE_ADMITTED:
+			break;
+		}
+
+		if(admitted != i)
+			datagrams[admitted] = datagrams[i];
+
+		++admitted;
+	}
+
+	return admitted;
+}
+
+/*
+ * Run the handler inline, or queue each packet between the calling receiving
+ * thread and the next worker (round-robin) or the peer's one (flow steering),
+ * applying the overflow policy if the queue is full
+ */
+void UDPServer::dispatch(unsigned const producer, unsigned & cursor,
+		Datagram * datagrams, unsigned count, int const socketFd)
+{
+	if(_limiter)
+		count = admit(*_handlerSlots[producer], datagrams, count);
+
+	if(count == 0)
+		return;
+
+	if(_workers.empty())
+	{
+		handle(*_handlerSlots[producer], datagrams, count, socketFd);
+		return;
+	}
+
+	for(unsigned i = 0 ; i < count ; ++i)
+	{
+		Datagram const & datagram(datagrams[i]);
+		Worker & w(*_workers[_steering ? flowHash(*datagram.sender)
+				% unsigned(_workers.size()) : cursor]);
+		WorkQueue & queue(*w._queues[producer]);
+		size_t depth(0);
+
+		/* Share the packet with the worker (no copy) */
+		auto fill = [&datagram](PacketRef & slot)
+		{
+			slot = *datagram.packet;
+		};
+
+		cursor = (cursor + 1) % unsigned(_workers.size());
+
+		bool pushed(queue._ring.tryPush(fill));
+
+		/* Backpressure: wait for the worker to make room */
+		while(!pushed && _overflow == OVERFLOW_BLOCK)
+		{
+			w._wakeup.notify_one();
+			this_thread::yield();
+			pushed = queue._ring.tryPush(fill);
+		}
+
+		if(!pushed)
+		{
+			queue._dropped.fetch_add(1, memory_order_relaxed);
+			continue;
+		}
+
+		queue._queued.fetch_add(1, memory_order_relaxed);
+
+		depth = queue._ring.size();
+		if(depth > queue._maxDepth.load(memory_order_relaxed))
+			queue._maxDepth.store(depth, memory_order_relaxed);
+
+		/* Wake the worker up if it went to sleep */
+		atomic_thread_fence(memory_order_seq_cst);
+		if(w._sleeping.load(memory_order_relaxed))
+		{
+			lock_guard<mutex> lock(w._mutex);
+			w._wakeup.notify_one();
+		}
+	}
+}
+
+/*
+ * Advance the wheel to the current date, calling timerExpired(...) for each
+ * timer due
+ */
+void UDPServer::runTimers(TimerWheel & wheel, HandlerSlot & slot)
+{
+	size_t const fired(wheel.poll([this](TimerWheel::TimerId const id,
+			uint64_t const data)
+	{
+		timerExpired(id, data);
+	}));
+
+	if(fired > 0)
+		slot._timersFired.fetch_add(fired, memory_order_relaxed);
+}
+
+/*
+ * Wheel of the calling thread, if it is a receiving thread
+ */
+TimerWheel * UDPServer::timerWheel()
+{
+	return threadWheel;
+}
+
+/*
+ * Default timer handler: nothing to do
+ */
+void UDPServer::timerExpired(TimerWheel::TimerId const, uint64_t const)
+{
+}
+
+/*
+ * Default batch handler: forward every datagram to receivePacket(...)
+ */
+void UDPServer::receiveBatch(Datagram const * datagrams, unsigned const count,
+		int const socketFd)
+{
+	for(unsigned i = 0 ; i < count ; ++i)
+	{
+		if(datagrams[i].packet != nullptr)
+			receivePacket(*datagrams[i].packet);
+		else
+			receiveBytes(datagrams[i].data,
+				datagrams[i].length,
+				datagrams[i].sender,
+				socketFd);
+	}
+}
+
+/*
+ * Default packet handler: forward the packet's content to receiveBytes(...)
+ */
+void UDPServer::receivePacket(PacketRef const & packet)
+{
+	receiveBytes(packet.data(), packet.length(), &packet.sender(),
+			packet.socket());
+}
+
+/*
+ * Set the receive batch size (clamped to [1, BATCH_SIZE_MAX])
+ */
+void UDPServer::setBatchSize(unsigned const size)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setBatchSize()."
+		<< endl;
+		return;
+	}
+
+#if defined(__gnu_linux__)
+	_batchSize = max(1u, min(size, unsigned(BATCH_SIZE_MAX)));
+	_plainReceive = size == 0;
+#else
+	(void)(size);
+	_log.warn
+	<< "Batched receive is only available on Linux."
+	<< endl;
+#endif
+}
+
+/*
+ * Set the number of event loops used by BACKEND_EPOLL (at least 1)
+ */
+void UDPServer::setEventLoops(unsigned const loops)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setEventLoops()."
+		<< endl;
+		return;
+	}
+
+	_eventLoops = max(1u, loops);
+}
+
+/*
+ * Enable or disable flow steering
+ */
+void UDPServer::setFlowSteering(bool const steering)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setFlowSteering()."
+		<< endl;
+		return;
+	}
+
+	_steering = steering;
+}
+
+/*
+ * Set the placement of the receiving threads
+ */
+void UDPServer::setPlacement(Placement const & placement)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setPlacement()."
+		<< endl;
+		return;
+	}
+
+#if defined(__gnu_linux__)
+	_placement = placement;
+#else
+	(void)(placement);
+	_log.warn
+	<< "Thread placement is only available on Linux."
+	<< endl;
+#endif
+}
+
+/*
+ * Set the per-peer rate limits, replacing the limiter (and forgetting every
+ * peer)
+ */
+void UDPServer::setRateLimit(RateLimit const & limit)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setRateLimit()."
+		<< endl;
+		return;
+	}
+
+	if(limit.packetsPerSecond > 0. || limit.bytesPerSecond > 0.)
+		_limiter.reset(new RateLimiter(limit));
+	else
+		_limiter.reset();
+}
+
+/*
+ * Set the maximum number of pooled packet buffers per receiving thread
+ */
+void UDPServer::setPacketPool(size_t const buffers)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setPacketPool()."
+		<< endl;
+		return;
+	}
+
+	_poolSize = max(buffers, size_t(PACKET_SLAB_SIZE));
+}
+
+/*
+ * Set SO_RCVBUF on every socket (forcing it past net.core.rmem_max where
+ * allowed), then read the size back from the first one
+ */
+size_t UDPServer::setReceiveBuffer(size_t const bytes)
+{
+	int const size(int(min(bytes, size_t(INT_MAX / 2))));
+	int obtained(0);
+	socklen_t length(sizeof(int));
+
+	for(unique_ptr<Listener> const & socket : _sockets)
+	{
+#if defined(__gnu_linux__)
+		if(setsockopt(socket->_socket, SOL_SOCKET, SO_RCVBUFFORCE,
+				&size, sizeof(int)) == 0)
+			continue;
+#endif
+
+		if(setsockopt(socket->_socket, SOL_SOCKET, SO_RCVBUF,
+				(char const *)(&size), sizeof(int)))
+			_log.warn
+			<< "Failed to resize the receive buffer ("
+			<< lastError("setsockopt") << ")."
+			<< endl;
+	}
+
+	if(_sockets.empty() || getsockopt(_sockets.front()->_socket,
+			SOL_SOCKET, SO_RCVBUF, (char *)(&obtained), &length))
+		return 0;
+
+	return size_t(obtained);
+}
+
+/*
+ * Set the tick of the receiving threads' timer wheels
+ */
+void UDPServer::setTimerWheel(chrono::nanoseconds const tick)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setTimerWheel()."
+		<< endl;
+		return;
+	}
+
+#if defined(__gnu_linux__)
+	_timerTick = max(tick, chrono::nanoseconds(0));
+#else
+	(void)(tick);
+	_log.warn
+	<< "Timer wheels are only available on Linux."
+	<< endl;
+#endif
+}
+
+/*
+ * Enable or disable UDP GRO on the listening sockets
+ */
+void UDPServer::setGRO(bool const enabled)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setGRO()."
+		<< endl;
+		return;
+	}
+
+#if defined(__gnu_linux__)
+	_gro = enabled;
+#else
+	(void)(enabled);
+	_log.warn
+	<< "UDP GRO is only available on Linux."
+	<< endl;
+#endif
+}
+
+/*
+ * Enable or disable kernel receive timestamps & latency measurements
+ */
+void UDPServer::setTimestamps(bool const enabled)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setTimestamps()."
+		<< endl;
+		return;
+	}
+
+#if defined(__gnu_linux__)
+	_timestamps = enabled;
+#else
+	(void)(enabled);
+	_log.warn
+	<< "Kernel timestamps are only available on Linux."
+	<< endl;
+#endif
+}
+
+/*
+ * Set the worker pool size, queue capacity & overflow policy
+ */
+void UDPServer::setWorkers(unsigned const workers, size_t const capacity,
+		OverflowPolicy const policy)
+{
+	if(_listening)
+	{
+		_log.warn
+		<< "The server is already listening! "
+		<< "Ignoring call to UDPServer::setWorkers()."
+		<< endl;
+		return;
+	}
+
+	_workerCount = workers;
+	_queueCapacity = max(capacity, size_t(2));
+	_overflow = policy;
+}
+
+/*
+ * Sum the counters of each worker's queues
+ */
+vector<WorkerStatistics> UDPServer::workerStatistics() const
+{
+	vector<WorkerStatistics> stats;
+
+	for(unique_ptr<Worker> const & w : _workers)
+	{
+		WorkerStatistics s;
+
+		s.queued = 0;
+		s.dropped = 0;
+		s.handled = w->_handled.load(memory_order_relaxed);
+		s.depth = 0;
+		s.maxDepth = 0;
+
+		for(unique_ptr<WorkQueue> const & queue : w->_queues)
+		{
+			s.queued += queue->_queued.load(memory_order_relaxed);
+			s.dropped += queue->_dropped.load(memory_order_relaxed);
+			s.depth += queue->_ring.size();
+			s.maxDepth = max(s.maxDepth, size_t(
+				queue->_maxDepth.load(memory_order_relaxed)));
+		}
+
+		stats.push_back(s);
+	}
+
+	return stats;
+}
+
+/*
+ * Receive backend in use
+ */
+ReceiveBackend UDPServer::backend() const
+{
+	return _backend;
+}
+
+/*
+ * Sum the per-socket, per-receiving thread & per-worker counters
+ */
+ServerStatistics UDPServer::statistics() const
+{
+	ServerStatistics stats;
+
+	memset(&stats, 0, sizeof(ServerStatistics));
+
+	for(unique_ptr<Listener> const & socket : _sockets)
+	{
+		stats.packets += socket->_packets.load(memory_order_relaxed);
+		stats.bytes += socket->_bytes.load(memory_order_relaxed);
+		stats.kernelDrops +=
+			socket->_kernelDrops.load(memory_order_relaxed);
+		stats.poolDrops += socket->_exhausted.load(memory_order_relaxed);
+		stats.sendFailures +=
+			socket->_sendFailures.load(memory_order_relaxed);
+
+		for(unsigned n = 1 ; n <= BATCH_SIZE_MAX ; ++n)
+			stats.batches +=
+				socket->_fill[n].load(memory_order_relaxed);
+	}
+
+	for(unique_ptr<HandlerSlot> const & slot : _handlerSlots)
+	{
+		stats.handlerCalls += slot->_calls.load(memory_order_relaxed);
+		stats.handlerNanoseconds +=
+			slot->_nanoseconds.load(memory_order_relaxed);
+		stats.packetRateDrops +=
+			slot->_packetRateDrops.load(memory_order_relaxed);
+		stats.byteRateDrops +=
+			slot->_byteRateDrops.load(memory_order_relaxed);
+		stats.untrackedPeers +=
+			slot->_untracked.load(memory_order_relaxed);
+		stats.timersFired +=
+			slot->_timersFired.load(memory_order_relaxed);
+	}
+
+	for(unique_ptr<Worker> const & w : _workers)
+	{
+		stats.handlerCalls += w->_slot._calls.load(memory_order_relaxed);
+		stats.handlerNanoseconds +=
+			w->_slot._nanoseconds.load(memory_order_relaxed);
+
+		for(unique_ptr<WorkQueue> const & queue : w->_queues)
+			stats.queueDrops +=
+				queue->_dropped.load(memory_order_relaxed);
+	}
+
+	return stats;
+}
+
+/*
+ * Sum the batch fill histograms of all sockets (batches larger than the
+ * current batch size, received before it was changed or by an io_uring loop,
+ * extending the histogram) and their datagram counters
+ */
+BatchStatistics UDPServer::batchStatistics() const
+{
+	BatchStatistics stats;
+
+	stats.batches = 0;
+	stats.datagrams = 0;
+	stats.exhausted = 0;
+	stats.segments = 0;
+	stats.fill.assign(_batchSize + 1, 0);
+
+	for(unique_ptr<Listener> const & socket : _sockets)
+	{
+		stats.datagrams += socket->_packets.load(memory_order_relaxed);
+		stats.exhausted += socket->_exhausted.load(memory_order_relaxed);
+		stats.segments += socket->_segments.load(memory_order_relaxed);
+
+		for(unsigned n = 1 ; n <= BATCH_SIZE_MAX ; ++n)
+		{
+			unsigned long const batches(
+				socket->_fill[n].load(memory_order_relaxed));
+
+			if(batches == 0)
+				continue;
+
+			if(n >= stats.fill.size())
+				stats.fill.resize(n + 1, 0);
+
+			stats.fill[n] += batches;
+			stats.batches += batches;
+		}
+	}
+
+	return stats;
+}
+
+/*
+ * Merge the latency histograms of the receiving threads & workers
+ */
+LatencyStatistics UDPServer::latencyStatistics() const
+{
+	LatencyStatistics stats;
+
+	for(unique_ptr<HandlerSlot> const & slot : _handlerSlots)
+	{
+		stats.queueing.merge(slot->_queueing);
+		stats.handling.merge(slot->_handling);
+	}
+
+	for(unique_ptr<Worker> const & w : _workers)
+	{
+		stats.queueing.merge(w->_slot._queueing);
+		stats.handling.merge(w->_slot._handling);
+	}
+
+	return stats;
+}
+
+/*
+ * Send given data to remote sockaddr using given socket
+ */
+void UDPServer::sendBytes(uint8_t const * data, size_t length,
+		sockaddr const * remoteSockaddr,
+		int const socketFd)
+{
+	/* Trivial UDP send operation */
+	if(sendto(
+		socketFd,			/* Source socket */
+		(char *)(data),			/* Data to send */
+		length,				/* Data length */
+		0,				/* Additional flags */
+		remoteSockaddr,			/* Recipient info */
+		sizeof(sockaddr_storage))	/* Recipient info size */
+		== -1)
+	{
+		/* If an error occurs while sending, count it against the
+		 * socket... */
+		sendFailed(socketFd);
+
+		throw Exception(lastError("sendto"));
+	}
+}
+
+/*
+ * Count a send failure against the listener owning the socket
+ */
+void UDPServer::sendFailed(int const socketFd)
+{
+	for(unique_ptr<Listener> const & socket : _sockets)
+		if(socket->_socket == socketFd)
+			socket->_sendFailures.fetch_add(1, memory_order_relaxed);
+}
+
+/*
+ * Same, to an endpoint value (sendto() being given a whole sockaddr_storage)
+ */
+void UDPServer::sendBytes(uint8_t const * data, size_t length,
+		SockAddr const & destination, int const socketFd)
+{
+	sockaddr_storage const remote(destination.storage());
+
+	sendBytes(data, length, (sockaddr const *)(&remote), socketFd);
+}
+
+/*
+ * Compute how the received datagrams are spread between listening sockets
+ * (shares are relative to the sockets of the same address family)
+ */
+vector<ListenerLoad> UDPServer::listenerLoad() const
+{
+	vector<ListenerLoad> loads;
+	unsigned long ipv4(0), ipv6(0);
+
+	for(unique_ptr<Listener> const & socket : _sockets)
+	{
+		ListenerLoad load;
+
+		load.socket = socket->_socket;
+		load.family = socket->_family;
+		load.datagrams = socket->_packets.load(memory_order_relaxed);
+		load.share = 0.;
+
+		if(load.family == AF_INET6)
+			ipv6 += load.datagrams;
+		else
+			ipv4 += load.datagrams;
+
+		loads.push_back(load);
+	}
+
+	for(ListenerLoad & load : loads)
+	{
+		unsigned long const total(load.family == AF_INET6 ? ipv6 : ipv4);
+
+		if(total > 0)
+			load.share = double(load.datagrams) / double(total);
+	}
+
+	return loads;
 }
 
 }
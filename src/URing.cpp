@@ -0,0 +1,422 @@
+#include "../include/Mach/URing.hpp"
+#include "../include/Mach/Exception.hpp"
+
+#if defined(__gnu_linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <algorithm>
+#include <vector>
+
+
+namespace Mach
+{
+
+using namespace std;
+
+
+/*
+ * Setup a ring with the given submission queue size and map its queues
+ */
+URing::URing(unsigned const entries)
+	:
+	_fd(-1),
+	_sqRing(nullptr),
+	_sqRingSize(0),
+	_sqHead(nullptr),
+	_sqTail(nullptr),
+	_sqMask(nullptr),
+	_sqEntries(nullptr),
+	_sqArray(nullptr),
+	_sqLocalTail(0),
+	_sqes(nullptr),
+	_sqesSize(0),
+	_cqRing(nullptr),
+	_cqRingSize(0),
+	_cqHead(nullptr),
+	_cqTail(nullptr),
+	_cqMask(nullptr),
+	_cqes(nullptr),
+	_bufferRing(nullptr),
+	_bufferRingSize(0),
+	_bufferMask(0),
+	_bufferTail(0)
+{
+	io_uring_params params;
+	uint8_t * sq(nullptr);
+	uint8_t * cq(nullptr);
+
+	/* Completions are only reaped by the submitting thread, which lets the
+	 * kernel skip interrupting it (Linux 5.19+, retried without) */
+	memset(&params, 0, sizeof(io_uring_params));
+	params.flags = IORING_SETUP_COOP_TASKRUN;
+	_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+
+	if(_fd == -1 && errno == EINVAL)
+	{
+		memset(&params, 0, sizeof(io_uring_params));
+		_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+	}
+
+	if(_fd == -1)
+		throw Exception(lastError("io_uring_setup"));
+
+	_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cqRingSize = params.cq_off.cqes
+		+ params.cq_entries * sizeof(io_uring_cqe);
+
+	/* Both rings may live in a single mapping (Linux 5.4+) */
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+		_sqRingSize = _cqRingSize = max(_sqRingSize, _cqRingSize);
+
+	_sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+	if(_sqRing == MAP_FAILED)
+	{
+		string const error(lastError("mmap"));
+		_sqRing = nullptr;
+		release();
+		throw Exception(error);
+	}
+
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+		_cqRing = _sqRing;
+	else
+	{
+		_cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, _fd,
+				IORING_OFF_CQ_RING);
+		if(_cqRing == MAP_FAILED)
+		{
+			string const error(lastError("mmap"));
+			_cqRing = nullptr;
+			release();
+			throw Exception(error);
+		}
+	}
+
+	_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	_sqes = static_cast<io_uring_sqe *>(mmap(nullptr, _sqesSize,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			_fd, IORING_OFF_SQES));
+	if(_sqes == MAP_FAILED)
+	{
+		string const error(lastError("mmap"));
+		_sqes = nullptr;
+		release();
+		throw Exception(error);
+	}
+
+	sq = static_cast<uint8_t *>(_sqRing);
+	_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	_sqEntries = reinterpret_cast<unsigned *>(
+			sq + params.sq_off.ring_entries);
+	_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	_sqLocalTail = *_sqTail;
+
+	cq = static_cast<uint8_t *>(_cqRing);
+	_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+/*
+ * Tear the ring down (pending requests are cancelled by the kernel)
+ */
+URing::~URing()
+{
+	release();
+}
+
+/*
+ * Unmap whatever has been mapped & close the ring
+ */
+void URing::release()
+{
+	if(_bufferRing != nullptr)
+		munmap(_bufferRing, _bufferRingSize);
+
+	if(_sqes != nullptr)
+		munmap(_sqes, _sqesSize);
+
+	if(_cqRing != nullptr && _cqRing != _sqRing)
+		munmap(_cqRing, _cqRingSize);
+
+	if(_sqRing != nullptr)
+		munmap(_sqRing, _sqRingSize);
+
+	if(_fd != -1)
+		close(_fd);
+
+	_bufferRing = nullptr;
+	_sqes = nullptr;
+	_cqRing = nullptr;
+	_sqRing = nullptr;
+	_fd = -1;
+}
+
+/*
+ * Probe the kernel: opcodes first, then provided buffer rings, then an actual
+ * multishot recvmsg on a loopback socket which received a datagram from
+ * itself
+ */
+bool URing::supported()
+{
+	size_t const probeSize(sizeof(io_uring_probe)
+			+ 256 * sizeof(io_uring_probe_op));
+	vector<uint8_t> probeBytes(probeSize, 0);
+	io_uring_probe * probe(
+			reinterpret_cast<io_uring_probe *>(probeBytes.data()));
+	sockaddr_in address;
+	socklen_t addressLength(sizeof(sockaddr_in));
+	msghdr header;
+	io_uring_cqe * cqe(nullptr);
+	uint8_t buffer[256];
+	bool multishot(false);
+	int sock(-1);
+
+	try
+	{
+		URing ring(4);
+
+		if(syscall(__NR_io_uring_register, ring._fd,
+				IORING_REGISTER_PROBE, probe, 256) == -1)
+			return false;
+
+		if(probe->last_op < IORING_OP_RECVMSG
+			|| !(probe->ops[IORING_OP_RECVMSG].flags
+				& IO_URING_OP_SUPPORTED)
+			|| !(probe->ops[IORING_OP_POLL_ADD].flags
+				& IO_URING_OP_SUPPORTED))
+			return false;
+
+		ring.setupBuffers(1);
+		ring.provideBuffer(0, buffer, sizeof(buffer));
+
+		sock = socket(AF_INET, SOCK_DGRAM, 0);
+		if(sock == -1)
+			return false;
+
+		memset(&address, 0, sizeof(sockaddr_in));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if(::bind(sock, (sockaddr *)(&address), sizeof(sockaddr_in))
+			|| getsockname(sock, (sockaddr *)(&address),
+				&addressLength)
+			|| sendto(sock, "probe", 5, 0, (sockaddr *)(&address),
+				sizeof(sockaddr_in)) != 5)
+		{
+			close(sock);
+			return false;
+		}
+
+		ring.registerFiles(&sock, 1);
+
+		memset(&header, 0, sizeof(msghdr));
+		header.msg_namelen = sizeof(sockaddr_storage);
+
+		ring.receiveMultishot(0, &header, 1);
+
+		if(ring.submit(1) != -1)
+		{
+			cqe = ring.peek();
+
+			/* Older kernels fail with -EINVAL or complete the
+			 * request without IORING_CQE_F_MORE */
+			multishot = (cqe != nullptr && cqe->res > 0
+				&& (cqe->flags & IORING_CQE_F_MORE));
+		}
+	}
+	catch(Exception const &)
+	{
+		multishot = false;
+	}
+
+	if(sock != -1)
+		close(sock);
+
+	return multishot;
+}
+
+/*
+ * Register the given file descriptors to the ring
+ */
+void URing::registerFiles(int const * fds, unsigned const count)
+{
+	if(syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES,
+			fds, count) == -1)
+		throw Exception(lastError("io_uring_register"));
+}
+
+/*
+ * Register an empty ring of count provided buffers as buffer group 0
+ */
+void URing::setupBuffers(unsigned const count)
+{
+	io_uring_buf_reg registration;
+	void * ring(nullptr);
+
+	if(count == 0 || count > 32768 || (count & (count - 1)))
+		throw Exception("URing::setupBuffers: "
+				"count must be a power of 2 (up to 32768)");
+
+	if(_bufferRing != nullptr)
+		throw Exception("URing::setupBuffers: "
+				"buffers have already been set up");
+
+	/* The buffer ring must be page-aligned */
+	_bufferRingSize = count * sizeof(io_uring_buf);
+	ring = mmap(nullptr, _bufferRingSize, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ring == MAP_FAILED)
+		throw Exception(lastError("mmap"));
+
+	_bufferRing = static_cast<io_uring_buf *>(ring);
+	_bufferMask = (unsigned short)(count - 1);
+	_bufferTail = 0;
+
+	memset(&registration, 0, sizeof(io_uring_buf_reg));
+	registration.ring_addr = uint64_t(uintptr_t(ring));
+	registration.ring_entries = count;
+	registration.bgid = 0;
+
+	if(syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING,
+			&registration, 1) == -1)
+	{
+		string const error(lastError("io_uring_register"));
+		munmap(_bufferRing, _bufferRingSize);
+		_bufferRing = nullptr;
+		throw Exception(error);
+	}
+}
+
+/*
+ * Append the buffer to the ring and publish the new tail (which overlays the
+ * reserved field of the first ring entry)
+ */
+void URing::provideBuffer(unsigned short const id, uint8_t * address,
+		unsigned const length)
+{
+	io_uring_buf & entry(_bufferRing[_bufferTail & _bufferMask]);
+
+	entry.addr = uint64_t(uintptr_t(address));
+	entry.len = length;
+	entry.bid = id;
+
+	++_bufferTail;
+	__atomic_store_n(&_bufferRing[0].resv, _bufferTail, __ATOMIC_RELEASE);
+}
+
+/*
+ * Get the next free submission queue entry
+ */
+io_uring_sqe * URing::prepare()
+{
+	io_uring_sqe * sqe(nullptr);
+	unsigned index(0);
+
+	/* Queue full: let the kernel consume it first */
+	if(_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE)
+			>= *_sqEntries)
+		if(submit(0) == -1)
+			throw Exception(lastError("io_uring_enter"));
+
+	index = _sqLocalTail & *_sqMask;
+	sqe = &_sqes[index];
+
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	_sqArray[index] = index;
+	++_sqLocalTail;
+
+	return sqe;
+}
+
+/*
+ * Queue a multishot recvmsg picking its buffers from group 0
+ */
+void URing::receiveMultishot(unsigned const file, msghdr const * header,
+		uint64_t const userData)
+{
+	io_uring_sqe * sqe(prepare());
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = int(file);
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->addr = uint64_t(uintptr_t(header));
+	sqe->len = 1;
+	sqe->buf_group = 0;
+	sqe->user_data = userData;
+}
+
+/*
+ * Queue a one-shot POLLIN poll
+ */
+void URing::pollIn(int const fd, uint64_t const userData)
+{
+	io_uring_sqe * sqe(prepare());
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = userData;
+}
+
+/*
+ * Queue a relative timeout
+ */
+void URing::timeout(__kernel_timespec const * delay, uint64_t const userData)
+{
+	io_uring_sqe * sqe(prepare());
+
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = uint64_t(uintptr_t(delay));
+	sqe->len = 1;
+	sqe->user_data = userData;
+}
+
+/*
+ * Publish the pending entries & enter the kernel
+ */
+int URing::submit(unsigned const wait)
+{
+	unsigned const pending(_sqLocalTail - *_sqTail);
+
+	if(pending == 0 && wait == 0)
+		return 0;
+
+	__atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+	return int(syscall(__NR_io_uring_enter, _fd, pending, wait,
+			wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+}
+
+/*
+ * Oldest unread completion queue entry
+ */
+io_uring_cqe * URing::peek()
+{
+	unsigned const head(*_cqHead);
+
+	if(head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+		return nullptr;
+
+	return &_cqes[head & *_cqMask];
+}
+
+/*
+ * Release the oldest completion queue entry to the kernel
+ */
+void URing::advance()
+{
+	__atomic_store_n(_cqHead, *_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+}
+
+#endif